@@ -314,6 +314,7 @@ static struct ion_platform_data apq8064_ion_pdata = {
 			.id	= ION_SYSTEM_HEAP_ID,
 			.type	= ION_HEAP_TYPE_SYSTEM,
 			.name	= ION_VMALLOC_HEAP_NAME,
+			.flags	= ION_HEAP_FLAG_DEFER_FREE,
 		},
 #ifdef CONFIG_MSM_MULTIMEDIA_USE_ION
 		{
@@ -354,6 +355,7 @@ static struct ion_platform_data apq8064_ion_pdata = {
 			.id	= ION_IOMMU_HEAP_ID,
 			.type	= ION_HEAP_TYPE_IOMMU,
 			.name	= ION_IOMMU_HEAP_NAME,
+			.flags	= ION_HEAP_FLAG_DEFER_FREE,
 		},
 		{
 			.id	= ION_QSECOM_HEAP_ID,
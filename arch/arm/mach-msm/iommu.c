@@ -712,13 +712,23 @@ static unsigned int get_phys_addr(struct scatterlist *sg)
 	return pa;
 }
 
+/*
+ * Return true if a @align sized mapping fits at @va -> @pa, given @len
+ * bytes left in both the range and the current sg chunk
+ */
+static inline int is_fully_aligned(unsigned int va, unsigned int pa,
+				   unsigned int len, unsigned int align)
+{
+	return IS_ALIGNED(va, align) && IS_ALIGNED(pa, align) && len >= align;
+}
+
 static int msm_iommu_map_range(struct iommu_domain *domain, unsigned int va,
 			       struct scatterlist *sg, unsigned int len,
 			       int prot)
 {
 	unsigned int pa;
 	unsigned int offset = 0;
-	unsigned int pgprot;
+	unsigned int pgprot, pgprot_sect;
 	unsigned long *fl_table;
 	unsigned long *fl_pte;
 	unsigned long fl_offset;
@@ -726,7 +736,8 @@ static int msm_iommu_map_range(struct iommu_domain *domain, unsigned int va,
 	unsigned long sl_offset, sl_start;
 	unsigned int chunk_offset = 0;
 	unsigned int chunk_pa;
-	int ret = 0;
+	unsigned int size;
+	int i, ret = 0;
 	struct msm_priv *priv;
 
 	mutex_lock(&msm_iommu_lock);
@@ -737,8 +748,9 @@ static int msm_iommu_map_range(struct iommu_domain *domain, unsigned int va,
 	fl_table = priv->pgtable;
 
 	pgprot = __get_pgprot(prot, SZ_4K);
+	pgprot_sect = __get_pgprot(prot, SZ_1M);
 
-	if (!pgprot) {
+	if (!pgprot || !pgprot_sect) {
 		ret = -EINVAL;
 		goto fail;
 	}
@@ -757,42 +769,22 @@ static int msm_iommu_map_range(struct iommu_domain *domain, unsigned int va,
 	}
 
 	while (offset < len) {
-		/* Set up a 2nd level page table if one doesn't exist */
-		if (*fl_pte == 0) {
-			sl_table = (unsigned long *)
-				 __get_free_pages(GFP_KERNEL, get_order(SZ_4K));
-
-			if (!sl_table) {
-				pr_debug("Could not allocate second level table\n");
-				ret = -ENOMEM;
-				goto fail;
-			}
-
-			memset(sl_table, 0, SZ_4K);
-			clean_pte(sl_table, sl_table + NUM_SL_PTE,
-				  priv->redirect);
-
-			*fl_pte = ((((int)__pa(sl_table)) & FL_BASE_MASK) |
-							    FL_TYPE_TABLE);
-			clean_pte(fl_pte, fl_pte + 1, priv->redirect);
-		} else
-			sl_table = (unsigned long *)
-					       __va(((*fl_pte) & FL_BASE_MASK));
-
-		/* Keep track of initial position so we
-		 * don't clean more than we have to
+		/*
+		 * Use a section if a whole 1M of the current chunk lines up
+		 * with an unused first level entry
 		 */
-		sl_start = sl_offset;
+		pa = chunk_pa + chunk_offset;
+		size = min(len - offset, sg->length - chunk_offset);
 
-		/* Build the 2nd level page table */
-		while (offset < len && sl_offset < NUM_SL_PTE) {
-			pa = chunk_pa + chunk_offset;
-			sl_table[sl_offset] = (pa & SL_BASE_MASK_SMALL) |
-				     pgprot | SL_NG | SL_SHARED | SL_TYPE_SMALL;
-			sl_offset++;
-			offset += SZ_4K;
+		if (sl_offset == 0 && *fl_pte == 0 &&
+		    is_fully_aligned(va + offset, pa, size, SZ_1M)) {
+			*fl_pte = (pa & 0xFFF00000) | FL_NG | FL_TYPE_SECT
+				  | FL_SHARED | pgprot_sect;
+			clean_pte(fl_pte, fl_pte + 1, priv->redirect);
 
-			chunk_offset += SZ_4K;
+			offset += SZ_1M;
+			chunk_offset += SZ_1M;
+			fl_pte++;
 
 			if (chunk_offset >= sg->length && offset < len) {
 				chunk_offset = 0;
@@ -805,13 +797,82 @@ static int msm_iommu_map_range(struct iommu_domain *domain, unsigned int va,
 					goto fail;
 				}
 			}
-		}
+		} else {
+			/* Set up a 2nd level page table if one doesn't exist */
+			if (*fl_pte == 0) {
+				sl_table = (unsigned long *)
+					__get_free_pages(GFP_KERNEL,
+							 get_order(SZ_4K));
+
+				if (!sl_table) {
+					pr_debug("Could not allocate second level table\n");
+					ret = -ENOMEM;
+					goto fail;
+				}
 
-		clean_pte(sl_table + sl_start, sl_table + sl_offset,
-			  priv->redirect);
+				memset(sl_table, 0, SZ_4K);
+				clean_pte(sl_table, sl_table + NUM_SL_PTE,
+					  priv->redirect);
+
+				*fl_pte = ((((int)__pa(sl_table)) &
+					    FL_BASE_MASK) | FL_TYPE_TABLE);
+				clean_pte(fl_pte, fl_pte + 1, priv->redirect);
+			} else
+				sl_table = (unsigned long *)
+					__va(((*fl_pte) & FL_BASE_MASK));
+
+			/* Keep track of initial position so we
+			 * don't clean more than we have to
+			 */
+			sl_start = sl_offset;
+
+			/* Build the 2nd level page table */
+			while (offset < len && sl_offset < NUM_SL_PTE) {
+				pa = chunk_pa + chunk_offset;
+				size = min(len - offset,
+					   sg->length - chunk_offset);
+
+				/* 64K large pages take 16 identical entries */
+				if (is_fully_aligned(va + offset, pa, size,
+						     SZ_64K)) {
+					for (i = 0; i < 16; i++)
+						sl_table[sl_offset + i] =
+						    (pa & SL_BASE_MASK_LARGE) |
+						    pgprot | SL_NG | SL_SHARED |
+						    SL_TYPE_LARGE;
+					sl_offset += 16;
+					size = SZ_64K;
+				} else {
+					sl_table[sl_offset] =
+						(pa & SL_BASE_MASK_SMALL) |
+						pgprot | SL_NG | SL_SHARED |
+						SL_TYPE_SMALL;
+					sl_offset++;
+					size = SZ_4K;
+				}
 
-		fl_pte++;
-		sl_offset = 0;
+				offset += size;
+				chunk_offset += size;
+
+				if (chunk_offset >= sg->length && offset < len) {
+					chunk_offset = 0;
+					sg = sg_next(sg);
+					chunk_pa = get_phys_addr(sg);
+					if (chunk_pa == 0) {
+						pr_debug("No dma address for sg %p\n",
+							 sg);
+						ret = -EINVAL;
+						goto fail;
+					}
+				}
+			}
+
+			clean_pte(sl_table + sl_start, sl_table + sl_offset,
+				  priv->redirect);
+
+			fl_pte++;
+			sl_offset = 0;
+		}
 	}
 	__flush_iotlb(domain);
 fail:
@@ -845,6 +906,16 @@ static int msm_iommu_unmap_range(struct iommu_domain *domain, unsigned int va,
 	sl_start = SL_OFFSET(va);
 
 	while (offset < len) {
+		/* Sections set up by msm_iommu_map_range */
+		if (*fl_pte & FL_TYPE_SECT) {
+			*fl_pte = 0;
+			clean_pte(fl_pte, fl_pte + 1, priv->redirect);
+
+			offset += SZ_1M;
+			fl_pte++;
+			continue;
+		}
+
 		sl_table = (unsigned long *) __va(((*fl_pte) & FL_BASE_MASK));
 		sl_end = ((len - offset) / SZ_4K) + sl_start;
 
@@ -369,6 +369,15 @@ int msm_register_domain(struct msm_iova_layout *layout)
 			pools[i].gpool = NULL;
 			continue;
 		}
+
+		/*
+		 * Naturally aligned IOVAs let buffers be mapped with 64K and
+		 * 1M entries. A partition at 0 is offset by 4k in the pool,
+		 * so aligning there would not align the IOVA.
+		 */
+		if (pools[i].paddr != 0)
+			gen_pool_set_algo(pools[i].gpool, gen_pool_buddy_fit,
+					  NULL);
 	}
 
 	data->pools = pools;
@@ -19,12 +19,15 @@
 #include <linux/file.h>
 #include <linux/fs.h>
 #include <linux/anon_inodes.h>
+#include <linux/hash.h>
 #include <linux/ion.h>
 #include <linux/list.h>
 #include <linux/miscdevice.h>
 #include <linux/mm.h>
 #include <linux/mm_types.h>
 #include <linux/rbtree.h>
+#include <linux/rculist.h>
+#include <linux/rwsem.h>
 #include <linux/sched.h>
 #include <linux/slab.h>
 #include <linux/seq_file.h>
@@ -35,23 +38,36 @@
 #include "ion_priv.h"
 #define DEBUG
 
+#define ION_CLIENT_HASH_BITS	6
+
 /**
  * struct ion_device - the metadata of the ion device node
  * @dev:		the actual misc device
  * @buffers:	an rb tree of all the existing buffers
- * @lock:		lock protecting the buffers & heaps trees
+ * @buffer_lock:	lock protecting the buffers tree
  * @heaps:		list of all the heaps in the system
+ * @heap_lock:		lock protecting the heaps tree, taken for writing
+ *			only when heaps are added
  * @user_clients:	list of all the clients created from userspace
+ * @kernel_clients:	list of all the clients created from the kernel
+ * @client_lock:	lock protecting both client trees and updates to
+ *			@user_client_hash
+ * @user_client_hash:	the user clients hashed by task, walked under RCU
+ *
+ * Locks nest as client_lock, then a client's lock, then buffer_lock.
  */
 struct ion_device {
 	struct miscdevice dev;
 	struct rb_root buffers;
-	struct mutex lock;
+	struct mutex buffer_lock;
 	struct rb_root heaps;
+	struct rw_semaphore heap_lock;
 	long (*custom_ioctl) (struct ion_client *client, unsigned int cmd,
 			      unsigned long arg);
 	struct rb_root user_clients;
 	struct rb_root kernel_clients;
+	struct mutex client_lock;
+	struct hlist_head user_client_hash[1 << ION_CLIENT_HASH_BITS];
 	struct dentry *debug_root;
 };
 
@@ -59,6 +75,8 @@ struct ion_device {
  * struct ion_client - a process/hw block local address space
  * @ref:		for reference counting the client
  * @node:		node in the tree of all clients
+ * @hash_node:		node in the device's hash of user clients
+ * @rcu:		for freeing the client after an RCU grace period
  * @dev:		backpointer to ion device
  * @handles:		an rb tree of all the handles in this client
  * @lock:		lock protecting the tree of handles
@@ -73,6 +91,8 @@ struct ion_device {
 struct ion_client {
 	struct kref ref;
 	struct rb_node node;
+	struct hlist_node hash_node;
+	struct rcu_head rcu;
 	struct ion_device *dev;
 	struct rb_root handles;
 	struct mutex lock;
@@ -127,7 +147,7 @@ static int ion_validate_buffer_flags(struct ion_buffer *buffer,
 	return 0;
 }
 
-/* this function should only be called while dev->lock is held */
+/* this function should only be called while dev->buffer_lock is held */
 static void ion_buffer_add(struct ion_device *dev,
 			   struct ion_buffer *buffer)
 {
@@ -208,7 +228,7 @@ static struct ion_iommu_map *ion_iommu_lookup(struct ion_buffer *buffer,
 	return NULL;
 }
 
-/* this function should only be called while dev->lock is held */
+/* this function should only be called while dev->heap_lock is held */
 static struct ion_buffer *ion_buffer_create(struct ion_heap *heap,
 				     struct ion_device *dev,
 				     unsigned long len,
@@ -226,6 +246,12 @@ static struct ion_buffer *ion_buffer_create(struct ion_heap *heap,
 	kref_init(&buffer->ref);
 
 	ret = heap->ops->allocate(heap, buffer, len, align, flags);
+
+	/* the memory may still be held by buffers waiting to be freed */
+	if (ret && heap->flags & ION_HEAP_FLAG_DEFER_FREE &&
+	    ion_heap_freelist_drain(heap, 0))
+		ret = heap->ops->allocate(heap, buffer, len, align, flags);
+
 	if (ret) {
 		kfree(buffer);
 		return ERR_PTR(ret);
@@ -233,7 +259,9 @@ static struct ion_buffer *ion_buffer_create(struct ion_heap *heap,
 	buffer->dev = dev;
 	buffer->size = len;
 	mutex_init(&buffer->lock);
+	mutex_lock(&dev->buffer_lock);
 	ion_buffer_add(dev, buffer);
+	mutex_unlock(&dev->buffer_lock);
 	return buffer;
 }
 
@@ -269,17 +297,27 @@ static void ion_iommu_delayed_unmap(struct ion_buffer *buffer)
 	mutex_unlock(&buffer->lock);
 }
 
-static void ion_buffer_destroy(struct kref *kref)
+void ion_buffer_destroy(struct ion_buffer *buffer)
+{
+	ion_iommu_delayed_unmap(buffer);
+	buffer->heap->ops->free(buffer);
+	kfree(buffer);
+}
+
+static void _ion_buffer_destroy(struct kref *kref)
 {
 	struct ion_buffer *buffer = container_of(kref, struct ion_buffer, ref);
+	struct ion_heap *heap = buffer->heap;
 	struct ion_device *dev = buffer->dev;
 
-	ion_iommu_delayed_unmap(buffer);
-	buffer->heap->ops->free(buffer);
-	mutex_lock(&dev->lock);
+	mutex_lock(&dev->buffer_lock);
 	rb_erase(&buffer->node, &dev->buffers);
-	mutex_unlock(&dev->lock);
-	kfree(buffer);
+	mutex_unlock(&dev->buffer_lock);
+
+	if (heap->flags & ION_HEAP_FLAG_DEFER_FREE)
+		ion_heap_freelist_add(heap, buffer);
+	else
+		ion_buffer_destroy(buffer);
 }
 
 static void ion_buffer_get(struct ion_buffer *buffer)
@@ -289,7 +327,7 @@ static void ion_buffer_get(struct ion_buffer *buffer)
 
 static int ion_buffer_put(struct ion_buffer *buffer)
 {
-	return kref_put(&buffer->ref, ion_buffer_destroy);
+	return kref_put(&buffer->ref, _ion_buffer_destroy);
 }
 
 static struct ion_handle *ion_handle_create(struct ion_client *client,
@@ -411,7 +449,7 @@ struct ion_handle *ion_alloc(struct ion_client *client, size_t len,
 	 * request of the caller allocate from it.  Repeat until allocate has
 	 * succeeded or all heaps have been tried
 	 */
-	mutex_lock(&dev->lock);
+	down_read(&dev->heap_lock);
 	for (n = rb_first(&dev->heaps); n != NULL; n = rb_next(n)) {
 		struct ion_heap *heap = rb_entry(n, struct ion_heap, node);
 		/* if the client doesn't support this heap type */
@@ -442,7 +480,7 @@ struct ion_handle *ion_alloc(struct ion_client *client, size_t len,
 			}
 		}
 	}
-	mutex_unlock(&dev->lock);
+	up_read(&dev->heap_lock);
 
 	if (IS_ERR_OR_NULL(buffer)) {
 		pr_debug("ION is unable to allocate 0x%x bytes (alignment: "
@@ -492,7 +530,6 @@ void ion_free(struct ion_client *client, struct ion_handle *handle)
 }
 EXPORT_SYMBOL(ion_free);
 
-static void ion_client_get(struct ion_client *client);
 static int ion_client_put(struct ion_client *client);
 
 static bool _ion_map(int *buffer_cnt, int *handle_cnt)
@@ -1052,26 +1089,29 @@ static const struct file_operations debug_client_fops = {
 	.release = single_release,
 };
 
+static struct hlist_head *ion_client_hash(struct ion_device *dev,
+					  struct task_struct *task)
+{
+	return &dev->user_client_hash[hash_ptr(task, ION_CLIENT_HASH_BITS)];
+}
+
 static struct ion_client *ion_client_lookup(struct ion_device *dev,
 					    struct task_struct *task)
 {
-	struct rb_node *n = dev->user_clients.rb_node;
 	struct ion_client *client;
-
-	mutex_lock(&dev->lock);
-	while (n) {
-		client = rb_entry(n, struct ion_client, node);
-		if (task == client->task) {
-			ion_client_get(client);
-			mutex_unlock(&dev->lock);
+	struct hlist_node *pos;
+
+	rcu_read_lock();
+	hlist_for_each_entry_rcu(client, pos, ion_client_hash(dev, task),
+				 hash_node) {
+		/* skip a client whose last reference is being dropped */
+		if (client->task == task &&
+		    atomic_inc_not_zero(&client->ref.refcount)) {
+			rcu_read_unlock();
 			return client;
-		} else if (task < client->task) {
-			n = n->rb_left;
-		} else if (task > client->task) {
-			n = n->rb_right;
 		}
 	}
-	mutex_unlock(&dev->lock);
+	rcu_read_unlock();
 	return NULL;
 }
 
@@ -1140,20 +1180,26 @@ struct ion_client *ion_client_create(struct ion_device *dev,
 	client->pid = pid;
 	kref_init(&client->ref);
 
-	mutex_lock(&dev->lock);
+	mutex_lock(&dev->client_lock);
 	if (task) {
 		p = &dev->user_clients.rb_node;
 		while (*p) {
 			parent = *p;
 			entry = rb_entry(parent, struct ion_client, node);
 
+			/*
+			 * A client of the same task whose last reference
+			 * was just dropped may not be unlinked yet
+			 */
 			if (task < entry->task)
 				p = &(*p)->rb_left;
-			else if (task > entry->task)
+			else
 				p = &(*p)->rb_right;
 		}
 		rb_link_node(&client->node, parent, p);
 		rb_insert_color(&client->node, &dev->user_clients);
+		hlist_add_head_rcu(&client->hash_node,
+				   ion_client_hash(dev, task));
 	} else {
 		p = &dev->kernel_clients.rb_node;
 		while (*p) {
@@ -1173,7 +1219,7 @@ struct ion_client *ion_client_create(struct ion_device *dev,
 	client->debug_root = debugfs_create_file(name, 0664,
 						 dev->debug_root, client,
 						 &debug_client_fops);
-	mutex_unlock(&dev->lock);
+	mutex_unlock(&dev->client_lock);
 
 	return client;
 }
@@ -1185,28 +1231,28 @@ static void _ion_client_destroy(struct kref *kref)
 	struct rb_node *n;
 
 	pr_debug("%s: %d\n", __func__, __LINE__);
-	while ((n = rb_first(&client->handles))) {
-		struct ion_handle *handle = rb_entry(n, struct ion_handle,
-						     node);
-		ion_handle_destroy(&handle->ref);
-	}
-	mutex_lock(&dev->lock);
+	/* unlink first so lookups and the debug code stop finding it */
+	mutex_lock(&dev->client_lock);
 	if (client->task) {
 		rb_erase(&client->node, &dev->user_clients);
-		put_task_struct(client->task);
+		hlist_del_rcu(&client->hash_node);
 	} else {
 		rb_erase(&client->node, &dev->kernel_clients);
 	}
 	debugfs_remove_recursive(client->debug_root);
-	mutex_unlock(&dev->lock);
+	mutex_unlock(&dev->client_lock);
 
-	kfree(client->name);
-	kfree(client);
-}
+	while ((n = rb_first(&client->handles))) {
+		struct ion_handle *handle = rb_entry(n, struct ion_handle,
+						     node);
+		ion_handle_destroy(&handle->ref);
+	}
+	if (client->task)
+		put_task_struct(client->task);
 
-static void ion_client_get(struct ion_client *client)
-{
-	kref_get(&client->ref);
+	kfree(client->name);
+	/* ion_client_lookup may still be looking at it */
+	kfree_rcu(client, rcu);
 }
 
 static int ion_client_put(struct ion_client *client)
@@ -1265,6 +1311,27 @@ int ion_handle_get_size(struct ion_client *client, struct ion_handle *handle,
 }
 EXPORT_SYMBOL(ion_handle_get_size);
 
+int ion_handle_get_heap_type(struct ion_client *client,
+			     struct ion_handle *handle,
+			     enum ion_heap_type *type)
+{
+	struct ion_buffer *buffer;
+
+	mutex_lock(&client->lock);
+	if (!ion_handle_validate(client, handle)) {
+		pr_err("%s: invalid handle passed to %s.\n",
+		       __func__, __func__);
+		mutex_unlock(&client->lock);
+		return -EINVAL;
+	}
+	buffer = handle->buffer;
+	*type = buffer->heap->type;
+	mutex_unlock(&client->lock);
+
+	return 0;
+}
+EXPORT_SYMBOL(ion_handle_get_heap_type);
+
 static int ion_share_release(struct inode *inode, struct file* file)
 {
 	struct ion_buffer *buffer = file->private_data;
@@ -1767,6 +1834,7 @@ void ion_debug_mem_map_create(struct seq_file *s, struct ion_heap *heap,
 	struct ion_device *dev = heap->dev;
 	struct rb_node *n;
 
+	mutex_lock(&dev->buffer_lock);
 	for (n = rb_first(&dev->buffers); n; n = rb_next(n)) {
 		struct ion_buffer *buffer =
 				rb_entry(n, struct ion_buffer, node);
@@ -1785,6 +1853,7 @@ void ion_debug_mem_map_create(struct seq_file *s, struct ion_heap *heap,
 			ion_debug_mem_map_add(mem_map, data);
 		}
 	}
+	mutex_unlock(&dev->buffer_lock);
 }
 
 /**
@@ -1825,7 +1894,7 @@ static int ion_debug_heap_show(struct seq_file *s, void *unused)
 	struct ion_device *dev = heap->dev;
 	struct rb_node *n;
 
-	mutex_lock(&dev->lock);
+	mutex_lock(&dev->client_lock);
 	seq_printf(s, "%16.s %16.s %16.s\n", "client", "pid", "size");
 	for (n = rb_first(&dev->user_clients); n; n = rb_next(n)) {
 		struct ion_client *client = rb_entry(n, struct ion_client,
@@ -1850,7 +1919,14 @@ static int ion_debug_heap_show(struct seq_file *s, void *unused)
 			   size);
 	}
 	ion_heap_print_debug(s, heap);
-	mutex_unlock(&dev->lock);
+	mutex_unlock(&dev->client_lock);
+
+	if (heap->flags & ION_HEAP_FLAG_DEFER_FREE) {
+		spin_lock(&heap->free_lock);
+		seq_printf(s, "deferred free: %u buffers, %x bytes queued\n",
+			   heap->free_list_count, heap->free_list_size);
+		spin_unlock(&heap->free_lock);
+	}
 	return 0;
 }
 
@@ -1873,7 +1949,7 @@ void ion_device_add_heap(struct ion_device *dev, struct ion_heap *heap)
 	struct ion_heap *entry;
 
 	heap->dev = dev;
-	mutex_lock(&dev->lock);
+	down_write(&dev->heap_lock);
 	while (*p) {
 		parent = *p;
 		entry = rb_entry(parent, struct ion_heap, node);
@@ -1894,7 +1970,7 @@ void ion_device_add_heap(struct ion_device *dev, struct ion_heap *heap)
 	debugfs_create_file(heap->name, 0664, dev->debug_root, heap,
 			    &debug_heap_fops);
 end:
-	mutex_unlock(&dev->lock);
+	up_write(&dev->heap_lock);
 }
 
 int ion_secure_heap(struct ion_device *dev, int heap_id)
@@ -1906,7 +1982,7 @@ int ion_secure_heap(struct ion_device *dev, int heap_id)
 	 * traverse the list of heaps available in this system
 	 * and find the heap that is specified.
 	 */
-	mutex_lock(&dev->lock);
+	down_read(&dev->heap_lock);
 	for (n = rb_first(&dev->heaps); n != NULL; n = rb_next(n)) {
 		struct ion_heap *heap = rb_entry(n, struct ion_heap, node);
 		if (heap->type != ION_HEAP_TYPE_CP)
@@ -1919,7 +1995,7 @@ int ion_secure_heap(struct ion_device *dev, int heap_id)
 			ret_val = -EINVAL;
 		break;
 	}
-	mutex_unlock(&dev->lock);
+	up_read(&dev->heap_lock);
 	return ret_val;
 }
 
@@ -1932,7 +2008,7 @@ int ion_unsecure_heap(struct ion_device *dev, int heap_id)
 	 * traverse the list of heaps available in this system
 	 * and find the heap that is specified.
 	 */
-	mutex_lock(&dev->lock);
+	down_read(&dev->heap_lock);
 	for (n = rb_first(&dev->heaps); n != NULL; n = rb_next(n)) {
 		struct ion_heap *heap = rb_entry(n, struct ion_heap, node);
 		if (heap->type != ION_HEAP_TYPE_CP)
@@ -1945,7 +2021,7 @@ int ion_unsecure_heap(struct ion_device *dev, int heap_id)
 			ret_val = -EINVAL;
 		break;
 	}
-	mutex_unlock(&dev->lock);
+	up_read(&dev->heap_lock);
 	return ret_val;
 }
 
@@ -1958,13 +2034,19 @@ static int ion_debug_leak_show(struct seq_file *s, void *unused)
 	/* mark all buffers as 1 */
 	seq_printf(s, "%16.s %16.s %16.s %16.s\n", "buffer", "heap", "size",
 		"ref cnt");
-	mutex_lock(&dev->lock);
+	mutex_lock(&dev->client_lock);
+	mutex_lock(&dev->buffer_lock);
 	for (n = rb_first(&dev->buffers); n; n = rb_next(n)) {
 		struct ion_buffer *buf = rb_entry(n, struct ion_buffer,
 						     node);
 
 		buf->marked = 1;
 	}
+	/*
+	 * buffer_lock nests inside the client locks taken below; buffers
+	 * created meanwhile start unmarked and those with handles can't go
+	 */
+	mutex_unlock(&dev->buffer_lock);
 
 	/* now see which buffers we can access */
 	for (n = rb_first(&dev->kernel_clients); n; n = rb_next(n)) {
@@ -1999,6 +2081,7 @@ static int ion_debug_leak_show(struct seq_file *s, void *unused)
 
 	}
 	/* And anyone still marked as a 1 means a leaked handle somewhere */
+	mutex_lock(&dev->buffer_lock);
 	for (n = rb_first(&dev->buffers); n; n = rb_next(n)) {
 		struct ion_buffer *buf = rb_entry(n, struct ion_buffer,
 						     node);
@@ -2008,7 +2091,8 @@ static int ion_debug_leak_show(struct seq_file *s, void *unused)
 				(int)buf, buf->heap->name, buf->size,
 				atomic_read(&buf->ref.refcount));
 	}
-	mutex_unlock(&dev->lock);
+	mutex_unlock(&dev->buffer_lock);
+	mutex_unlock(&dev->client_lock);
 	return 0;
 }
 
@@ -2054,10 +2138,12 @@ struct ion_device *ion_device_create(long (*custom_ioctl)
 
 	idev->custom_ioctl = custom_ioctl;
 	idev->buffers = RB_ROOT;
-	mutex_init(&idev->lock);
+	mutex_init(&idev->buffer_lock);
 	idev->heaps = RB_ROOT;
+	init_rwsem(&idev->heap_lock);
 	idev->user_clients = RB_ROOT;
 	idev->kernel_clients = RB_ROOT;
+	mutex_init(&idev->client_lock);
 	debugfs_create_file("check_leaked_fds", 0664, idev->debug_root, idev,
 			    &debug_leak_fops);
 	return idev;
@@ -907,11 +907,13 @@ struct ion_heap *ion_cp_heap_create(struct ion_platform_heap *heap_data)
 	cp_heap->pool = gen_pool_create(12, -1);
 	if (!cp_heap->pool)
 		goto free_heap;
+	gen_pool_set_algo(cp_heap->pool, gen_pool_best_fit, NULL);
 
 	cp_heap->base = heap_data->base;
 	ret = gen_pool_add(cp_heap->pool, cp_heap->base, heap_data->size, -1);
 	if (ret < 0)
 		goto destroy_pool;
+	gen_pool_debugfs_create(cp_heap->pool, heap_data->name);
 
 	cp_heap->allocated_bytes = 0;
 	cp_heap->umap_count = 0;
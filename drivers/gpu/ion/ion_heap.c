@@ -16,9 +16,136 @@
  */
 
 #include <linux/err.h>
+#include <linux/freezer.h>
 #include <linux/ion.h>
+#include <linux/kthread.h>
+#include <linux/list.h>
+#include <linux/mm.h>
+#include <linux/sched.h>
+#include <linux/spinlock.h>
+#include <linux/swap.h>
 #include "ion_priv.h"
 
+void ion_heap_freelist_add(struct ion_heap *heap, struct ion_buffer *buffer)
+{
+	spin_lock(&heap->free_lock);
+	list_add_tail(&buffer->list, &heap->free_list);
+	heap->free_list_size += buffer->size;
+	heap->free_list_count++;
+	spin_unlock(&heap->free_lock);
+	wake_up(&heap->waitqueue);
+}
+
+size_t ion_heap_freelist_size(struct ion_heap *heap)
+{
+	size_t size;
+
+	spin_lock(&heap->free_lock);
+	size = heap->free_list_size;
+	spin_unlock(&heap->free_lock);
+
+	return size;
+}
+
+/* Take the oldest buffer off the free list, NULL if it is empty */
+static struct ion_buffer *ion_heap_freelist_remove(struct ion_heap *heap)
+{
+	struct ion_buffer *buffer = NULL;
+
+	spin_lock(&heap->free_lock);
+	if (!list_empty(&heap->free_list)) {
+		buffer = list_first_entry(&heap->free_list, struct ion_buffer,
+					  list);
+		list_del(&buffer->list);
+		heap->free_list_size -= buffer->size;
+		heap->free_list_count--;
+	}
+	spin_unlock(&heap->free_lock);
+
+	return buffer;
+}
+
+size_t ion_heap_freelist_drain(struct ion_heap *heap, size_t size)
+{
+	struct ion_buffer *buffer;
+	size_t freed = 0;
+
+	while (!size || freed < size) {
+		buffer = ion_heap_freelist_remove(heap);
+		if (!buffer)
+			break;
+		freed += buffer->size;
+		ion_buffer_destroy(buffer);
+	}
+
+	return freed;
+}
+
+static int ion_heap_deferred_free(void *data)
+{
+	struct ion_heap *heap = data;
+	struct ion_buffer *buffer;
+
+	set_freezable();
+
+	while (!kthread_should_stop()) {
+		wait_event_freezable(heap->waitqueue,
+				     ion_heap_freelist_size(heap) > 0 ||
+				     kthread_should_stop());
+
+		while ((buffer = ion_heap_freelist_remove(heap))) {
+			ion_buffer_destroy(buffer);
+			cond_resched();
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Counts are in pages. Only kswapd frees buffers from here: direct
+ * reclaim may be entered from a heap's own allocate op with the heap's
+ * locks held, which freeing a buffer of that heap would take again, so
+ * in that case the free thread is kicked instead.
+ */
+static int ion_heap_shrink(struct shrinker *shrinker,
+			   struct shrink_control *sc)
+{
+	struct ion_heap *heap = container_of(shrinker, struct ion_heap,
+					     shrinker);
+
+	if (sc->nr_to_scan) {
+		if (current_is_kswapd())
+			ion_heap_freelist_drain(heap,
+						sc->nr_to_scan * PAGE_SIZE);
+		else
+			wake_up(&heap->waitqueue);
+	}
+
+	return ion_heap_freelist_size(heap) / PAGE_SIZE;
+}
+
+int ion_heap_init_deferred_free(struct ion_heap *heap)
+{
+	INIT_LIST_HEAD(&heap->free_list);
+	spin_lock_init(&heap->free_lock);
+	init_waitqueue_head(&heap->waitqueue);
+
+	heap->task = kthread_run(ion_heap_deferred_free, heap,
+				 "ion_%s_free", heap->name);
+	if (IS_ERR(heap->task)) {
+		pr_err("%s: creating thread for deferred free failed\n",
+		       __func__);
+		return PTR_ERR(heap->task);
+	}
+
+	heap->shrinker.shrink = ion_heap_shrink;
+	heap->shrinker.seeks = DEFAULT_SEEKS;
+	register_shrinker(&heap->shrinker);
+
+	return 0;
+}
+
 struct ion_heap *ion_heap_create(struct ion_platform_heap *heap_data)
 {
 	struct ion_heap *heap = NULL;
@@ -54,6 +181,15 @@ struct ion_heap *ion_heap_create(struct ion_platform_heap *heap_data)
 
 	heap->name = heap_data->name;
 	heap->id = heap_data->id;
+	heap->flags = heap_data->flags;
+
+	if (heap->flags & ION_HEAP_FLAG_DEFER_FREE &&
+	    ion_heap_init_deferred_free(heap)) {
+		pr_err("%s: heap %s will free buffers synchronously\n",
+		       __func__, heap->name);
+		heap->flags &= ~ION_HEAP_FLAG_DEFER_FREE;
+	}
+
 	return heap;
 }
 
@@ -62,6 +198,12 @@ void ion_heap_destroy(struct ion_heap *heap)
 	if (!heap)
 		return;
 
+	if (heap->flags & ION_HEAP_FLAG_DEFER_FREE) {
+		unregister_shrinker(&heap->shrinker);
+		kthread_stop(heap->task);
+		ion_heap_freelist_drain(heap, 0);
+	}
+
 	switch (heap->type) {
 	case ION_HEAP_TYPE_SYSTEM_CONTIG:
 		ion_system_contig_heap_destroy(heap);
@@ -0,0 +1,192 @@
+/*
+ * drivers/gpu/ion/ion_page_pool.c
+ *
+ * Copyright (c) 2012, Code Aurora Forum. All rights reserved.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#include <linux/highmem.h>
+#include <linux/list.h>
+#include <linux/mm.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <asm/cacheflush.h>
+#include "ion_priv.h"
+
+/*
+ * Zero a block of the pool's order. Blocks for uncached buffers are also
+ * flushed, so no dirty line can later be written back over data a device
+ * put there through an uncached mapping.
+ */
+static void ion_page_pool_zero_page(struct ion_page_pool *pool,
+				    struct page *page)
+{
+	int i;
+
+	for (i = 0; i < (1 << pool->order); i++) {
+		void *addr = kmap_atomic(page + i, KM_USER0);
+
+		clear_page(addr);
+		if (!pool->cached)
+			dmac_flush_range(addr, addr + PAGE_SIZE);
+		kunmap_atomic(addr, KM_USER0);
+	}
+
+	if (!pool->cached)
+		outer_flush_range(page_to_phys(page), page_to_phys(page) +
+				  (PAGE_SIZE << pool->order));
+}
+
+/* Take a block off @list, which must not be empty. Caller holds mutex. */
+static struct page *ion_page_pool_remove(struct ion_page_pool *pool,
+					 struct list_head *list, int *count)
+{
+	struct page *page;
+
+	page = list_first_entry(list, struct page, lru);
+	list_del(&page->lru);
+	(*count)--;
+
+	return page;
+}
+
+struct page *ion_page_pool_alloc(struct ion_page_pool *pool)
+{
+	struct page *page = NULL;
+	bool dirty = false;
+
+	mutex_lock(&pool->mutex);
+	if (pool->clean_count) {
+		page = ion_page_pool_remove(pool, &pool->clean_items,
+					    &pool->clean_count);
+	} else if (pool->dirty_count) {
+		page = ion_page_pool_remove(pool, &pool->dirty_items,
+					    &pool->dirty_count);
+		dirty = true;
+	}
+	if (page)
+		pool->hits++;
+	else
+		pool->misses++;
+	mutex_unlock(&pool->mutex);
+
+	if (!page) {
+		page = alloc_pages(pool->gfp_mask, pool->order);
+		if (!page)
+			return NULL;
+		dirty = true;
+	}
+
+	if (dirty)
+		ion_page_pool_zero_page(pool, page);
+
+	return page;
+}
+
+void ion_page_pool_free(struct ion_page_pool *pool, struct page *page)
+{
+	mutex_lock(&pool->mutex);
+	list_add_tail(&page->lru, &pool->dirty_items);
+	pool->dirty_count++;
+	mutex_unlock(&pool->mutex);
+}
+
+int ion_page_pool_zero(struct ion_page_pool *pool, int nr_to_zero)
+{
+	struct page *page;
+	int zeroed = 0;
+
+	while (zeroed < nr_to_zero) {
+		mutex_lock(&pool->mutex);
+		if (!pool->dirty_count) {
+			mutex_unlock(&pool->mutex);
+			break;
+		}
+		page = ion_page_pool_remove(pool, &pool->dirty_items,
+					    &pool->dirty_count);
+		mutex_unlock(&pool->mutex);
+
+		ion_page_pool_zero_page(pool, page);
+
+		mutex_lock(&pool->mutex);
+		list_add_tail(&page->lru, &pool->clean_items);
+		pool->clean_count++;
+		mutex_unlock(&pool->mutex);
+
+		zeroed++;
+	}
+
+	return zeroed;
+}
+
+bool ion_page_pool_has_dirty(struct ion_page_pool *pool)
+{
+	return pool->dirty_count != 0;
+}
+
+int ion_page_pool_total(struct ion_page_pool *pool)
+{
+	return (pool->clean_count + pool->dirty_count) << pool->order;
+}
+
+int ion_page_pool_shrink(struct ion_page_pool *pool, int nr_to_scan)
+{
+	struct page *page;
+	int freed = 0;
+
+	/* Dirty blocks go first, they would still cost a zeroing */
+	while (freed < nr_to_scan) {
+		mutex_lock(&pool->mutex);
+		if (pool->dirty_count)
+			page = ion_page_pool_remove(pool, &pool->dirty_items,
+						    &pool->dirty_count);
+		else if (pool->clean_count)
+			page = ion_page_pool_remove(pool, &pool->clean_items,
+						    &pool->clean_count);
+		else
+			page = NULL;
+		mutex_unlock(&pool->mutex);
+
+		if (!page)
+			break;
+
+		__free_pages(page, pool->order);
+		freed += 1 << pool->order;
+	}
+
+	return freed;
+}
+
+struct ion_page_pool *ion_page_pool_create(gfp_t gfp_mask, unsigned int order,
+					   bool cached)
+{
+	struct ion_page_pool *pool;
+
+	pool = kzalloc(sizeof(*pool), GFP_KERNEL);
+	if (!pool)
+		return NULL;
+
+	INIT_LIST_HEAD(&pool->clean_items);
+	INIT_LIST_HEAD(&pool->dirty_items);
+	mutex_init(&pool->mutex);
+	pool->gfp_mask = gfp_mask;
+	pool->order = order;
+	pool->cached = cached;
+
+	return pool;
+}
+
+void ion_page_pool_destroy(struct ion_page_pool *pool)
+{
+	ion_page_pool_shrink(pool, INT_MAX);
+	kfree(pool);
+}
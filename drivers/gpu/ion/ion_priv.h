@@ -19,9 +19,12 @@
 #define _ION_PRIV_H
 
 #include <linux/kref.h>
+#include <linux/mm.h>
 #include <linux/mm_types.h>
 #include <linux/mutex.h>
 #include <linux/rbtree.h>
+#include <linux/spinlock.h>
+#include <linux/wait.h>
 #include <linux/ion.h>
 #include <linux/iommu.h>
 
@@ -92,6 +95,8 @@ struct ion_buffer *ion_handle_buffer(struct ion_handle *handle);
  * @vaddr:		the kenrel mapping if kmap_cnt is not zero
  * @dmap_cnt:		number of times the buffer is mapped for dma
  * @sglist:		the scatterlist for the buffer is dmap_cnt is not zero
+ * @list:		element in the heap's free list once the buffer is
+ *			released, for heaps deferring frees
 */
 struct ion_buffer {
 	struct kref ref;
@@ -113,6 +118,7 @@ struct ion_buffer {
 	unsigned int iommu_map_cnt;
 	struct rb_root iommu_maps;
 	int marked;
+	struct list_head list;
 };
 
 /**
@@ -171,6 +177,15 @@ struct ion_heap_ops {
  *			allocating.  These are specified by platform data and
  *			MUST be unique
  * @name:		used for debugging
+ * @flags:		ION_HEAP_FLAG_* options
+ * @free_list:		buffers released but not freed yet, if the heap
+ *			defers frees
+ * @free_list_size:	bytes in the free list
+ * @free_list_count:	buffers in the free list
+ * @free_lock:		protects the free list and its size and count
+ * @waitqueue:		where the free thread waits for buffers
+ * @task:		thread freeing the buffers on the free list
+ * @shrinker:		drains the free list under memory pressure
  *
  * Represents a pool of memory from which buffers can be made.  In some
  * systems the only heap is regular system memory allocated via vmalloc.
@@ -184,6 +199,14 @@ struct ion_heap {
 	struct ion_heap_ops *ops;
 	int id;
 	const char *name;
+	unsigned long flags;
+	struct list_head free_list;
+	size_t free_list_size;
+	unsigned int free_list_count;
+	spinlock_t free_lock;
+	wait_queue_head_t waitqueue;
+	struct task_struct *task;
+	struct shrinker shrinker;
 };
 
 /**
@@ -239,6 +262,47 @@ void ion_device_add_heap(struct ion_device *dev, struct ion_heap *heap);
 struct ion_heap *ion_heap_create(struct ion_platform_heap *);
 void ion_heap_destroy(struct ion_heap *);
 
+/**
+ * ion_buffer_destroy - release a buffer's mappings and memory
+ * @buffer:		buffer no longer referenced by anyone
+ */
+void ion_buffer_destroy(struct ion_buffer *buffer);
+
+/**
+ * functions for deferring the freeing of a heap's buffers to a thread,
+ * used by heaps created with ION_HEAP_FLAG_DEFER_FREE
+ */
+
+/**
+ * ion_heap_init_deferred_free - start the heap's free thread and shrinker
+ * @heap:		the heap
+ *
+ * returns 0 on success or a negative errno
+ */
+int ion_heap_init_deferred_free(struct ion_heap *heap);
+
+/**
+ * ion_heap_freelist_add - queue a released buffer for freeing
+ * @heap:		the heap the buffer came from
+ * @buffer:		the buffer
+ */
+void ion_heap_freelist_add(struct ion_heap *heap, struct ion_buffer *buffer);
+
+/**
+ * ion_heap_freelist_drain - free queued buffers now
+ * @heap:		the heap
+ * @size:		bytes to free at least, 0 to empty the free list
+ *
+ * returns the number of bytes freed
+ */
+size_t ion_heap_freelist_drain(struct ion_heap *heap, size_t size);
+
+/**
+ * ion_heap_freelist_size - bytes waiting to be freed
+ * @heap:		the heap
+ */
+size_t ion_heap_freelist_size(struct ion_heap *heap);
+
 struct ion_heap *ion_system_heap_create(struct ion_platform_heap *);
 void ion_system_heap_destroy(struct ion_heap *);
 
@@ -314,6 +378,52 @@ int ion_do_cache_op(struct ion_client *client, struct ion_handle *handle,
 			void *uaddr, unsigned long offset, unsigned long len,
 			unsigned int cmd);
 
+/**
+ * struct ion_page_pool - pagepool struct
+ * @clean_count:	number of zeroed blocks in the pool
+ * @dirty_count:	number of blocks in the pool still to be zeroed
+ * @clean_items:	list of zeroed blocks, linked through page->lru
+ * @dirty_items:	list of freed blocks not zeroed yet
+ * @mutex:		protects the lists and counts
+ * @gfp_mask:		gfp mask to allocate new blocks with
+ * @order:		order of the blocks in this pool
+ * @cached:		whether blocks are for cached buffers; blocks for
+ *			uncached buffers are flushed from the caches once
+ *			zeroed
+ * @hits:		allocations served from the pool
+ * @misses:		allocations that went to the page allocator
+ *
+ * Keeps blocks of one order freed by a heap around so they can be handed
+ * out again without going through the page allocator. Freed blocks are
+ * zeroed later, off the allocation and free paths, by the heap calling
+ * ion_page_pool_zero() from a background thread.
+ */
+struct ion_page_pool {
+	int clean_count;
+	int dirty_count;
+	struct list_head clean_items;
+	struct list_head dirty_items;
+	struct mutex mutex;
+	gfp_t gfp_mask;
+	unsigned int order;
+	bool cached;
+	unsigned long hits;
+	unsigned long misses;
+};
+
+struct ion_page_pool *ion_page_pool_create(gfp_t gfp_mask, unsigned int order,
+					   bool cached);
+void ion_page_pool_destroy(struct ion_page_pool *);
+/* returns a zeroed block, or NULL */
+struct page *ion_page_pool_alloc(struct ion_page_pool *);
+void ion_page_pool_free(struct ion_page_pool *, struct page *);
+/* zeroes up to nr_to_zero freed blocks, returns how many it did */
+int ion_page_pool_zero(struct ion_page_pool *pool, int nr_to_zero);
+bool ion_page_pool_has_dirty(struct ion_page_pool *pool);
+/* pool size and shrink amounts below are counted in pages */
+int ion_page_pool_total(struct ion_page_pool *pool);
+int ion_page_pool_shrink(struct ion_page_pool *pool, int nr_to_scan);
+
 void ion_cp_heap_get_base(struct ion_heap *heap, unsigned long *base,
 			unsigned long *size);
 
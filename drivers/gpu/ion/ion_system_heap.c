@@ -16,10 +16,16 @@
  */
 
 #include <linux/err.h>
+#include <linux/freezer.h>
+#include <linux/highmem.h>
 #include <linux/ion.h>
+#include <linux/kthread.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
 #include <linux/mm.h>
 #include <linux/scatterlist.h>
 #include <linux/slab.h>
+#include <linux/spinlock.h>
 #include <linux/vmalloc.h>
 #include <linux/iommu.h>
 #include <linux/seq_file.h>
@@ -30,79 +36,266 @@
 
 static atomic_t system_heap_allocated;
 static atomic_t system_contig_heap_allocated;
-static unsigned int system_heap_has_outer_cache;
 static unsigned int system_heap_contig_has_outer_cache;
 
+/*
+ * Buffers are built from the largest blocks available, so they need fewer
+ * scatterlist entries, IOMMU mappings and frees. Order-8 blocks (1MB) are
+ * only taken if the page allocator has them without reclaim or compaction.
+ */
+static const unsigned int orders[] = {8, 4, 0};
+#define NUM_ORDERS ARRAY_SIZE(orders)
+
+static gfp_t high_order_gfp_flags = (GFP_HIGHUSER | __GFP_NOWARN |
+				     __GFP_NORETRY | __GFP_NO_KSWAPD) &
+				    ~__GFP_WAIT;
+static gfp_t low_order_gfp_flags = GFP_HIGHUSER | __GFP_NOWARN;
+
+/* Freed blocks the zeroing thread handles before checking for more work */
+#define ION_SYSTEM_HEAP_ZERO_BATCH	32
+
+/* Upper bounds, in us, of the allocation latency histogram buckets */
+static const unsigned int alloc_latency_us[] = {100, 1000, 10000};
+#define NUM_LATENCY_BUCKETS (ARRAY_SIZE(alloc_latency_us) + 1)
+
+struct ion_system_heap {
+	struct ion_heap heap;
+	unsigned int has_outer_cache;
+	struct ion_page_pool *cached_pools[NUM_ORDERS];
+	struct ion_page_pool *uncached_pools[NUM_ORDERS];
+	struct shrinker shrinker;
+	struct task_struct *zero_thread;
+	wait_queue_head_t zero_wait;
+	/* allocation latency, protected by stats_lock */
+	spinlock_t stats_lock;
+	unsigned long nr_allocs;
+	u64 alloc_ns;
+	u64 max_alloc_ns;
+	unsigned long latency_hist[NUM_LATENCY_BUCKETS];
+};
+
+/* What a system heap buffer's priv_virt points to */
+struct ion_system_buffer_info {
+	struct scatterlist *sglist;
+	int nents;
+	bool cached;
+};
+
+static int order_to_index(unsigned int order)
+{
+	int i;
+
+	for (i = 0; i < NUM_ORDERS; i++)
+		if (order == orders[i])
+			return i;
+	BUG();
+	return -1;
+}
+
+static struct ion_page_pool *system_heap_pool(struct ion_system_heap *heap,
+					      bool cached, unsigned int order)
+{
+	int idx = order_to_index(order);
+
+	return cached ? heap->cached_pools[idx] : heap->uncached_pools[idx];
+}
+
+/*
+ * Allocate the largest block of at most @max_order that still fits in
+ * @size, from the pool of that order or, failing that, smaller ones.
+ */
+static struct page *alloc_largest_available(struct ion_system_heap *heap,
+					    bool cached, unsigned long size,
+					    unsigned int max_order,
+					    unsigned int *order)
+{
+	struct page *page;
+	int i;
+
+	for (i = 0; i < NUM_ORDERS; i++) {
+		if (size < (PAGE_SIZE << orders[i]))
+			continue;
+		if (max_order < orders[i])
+			continue;
+
+		page = ion_page_pool_alloc(system_heap_pool(heap, cached,
+							    orders[i]));
+		if (!page)
+			continue;
+
+		*order = orders[i];
+		return page;
+	}
+
+	return NULL;
+}
+
+static void system_heap_free_pages(struct ion_system_heap *heap, bool cached,
+				   struct list_head *pages)
+{
+	struct page *page, *tmp;
+
+	list_for_each_entry_safe(page, tmp, pages, lru) {
+		unsigned int order = page_private(page);
+
+		list_del(&page->lru);
+		set_page_private(page, 0);
+		ion_page_pool_free(system_heap_pool(heap, cached, order), page);
+	}
+	wake_up(&heap->zero_wait);
+}
+
+static void system_heap_account_alloc(struct ion_system_heap *heap,
+				      ktime_t start)
+{
+	u64 ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(alloc_latency_us); i++)
+		if (ns < (u64)alloc_latency_us[i] * NSEC_PER_USEC)
+			break;
+
+	spin_lock(&heap->stats_lock);
+	heap->nr_allocs++;
+	heap->alloc_ns += ns;
+	heap->max_alloc_ns = max(heap->max_alloc_ns, ns);
+	heap->latency_hist[i]++;
+	spin_unlock(&heap->stats_lock);
+}
+
 static int ion_system_heap_allocate(struct ion_heap *heap,
 				     struct ion_buffer *buffer,
 				     unsigned long size, unsigned long align,
 				     unsigned long flags)
 {
-	buffer->priv_virt = vmalloc_user(size);
-	if (!buffer->priv_virt)
+	struct ion_system_heap *sys_heap =
+		container_of(heap, struct ion_system_heap, heap);
+	struct ion_system_buffer_info *info;
+	unsigned long size_remaining = PAGE_ALIGN(size);
+	unsigned int max_order = orders[0];
+	unsigned int order;
+	struct page *page;
+	struct scatterlist *sg;
+	LIST_HEAD(pages);
+	ktime_t start;
+	int nents = 0;
+
+	start = ktime_get();
+
+	info = kzalloc(sizeof(*info), GFP_KERNEL);
+	if (!info)
 		return -ENOMEM;
+	info->cached = ION_IS_CACHED(flags);
 
+	while (size_remaining > 0) {
+		page = alloc_largest_available(sys_heap, info->cached,
+					       size_remaining, max_order,
+					       &order);
+		if (!page)
+			goto err;
+		/* the block's order, until it goes back to its pool */
+		set_page_private(page, order);
+		list_add_tail(&page->lru, &pages);
+		size_remaining -= PAGE_SIZE << order;
+		max_order = order;
+		nents++;
+	}
+
+	info->sglist = vmalloc(nents * sizeof(struct scatterlist));
+	if (!info->sglist)
+		goto err;
+	sg_init_table(info->sglist, nents);
+	info->nents = nents;
+
+	sg = info->sglist;
+	list_for_each_entry(page, &pages, lru) {
+		sg_set_page(sg, page, PAGE_SIZE << page_private(page), 0);
+		sg = sg_next(sg);
+	}
+
+	/* the pages are owned by the scatterlist from here on */
+	buffer->priv_virt = info;
 	atomic_add(size, &system_heap_allocated);
+	system_heap_account_alloc(sys_heap, start);
+
 	return 0;
+
+err:
+	system_heap_free_pages(sys_heap, info->cached, &pages);
+	kfree(info);
+	return -ENOMEM;
 }
 
 void ion_system_heap_free(struct ion_buffer *buffer)
 {
-	vfree(buffer->priv_virt);
+	struct ion_system_heap *sys_heap =
+		container_of(buffer->heap, struct ion_system_heap, heap);
+	struct ion_system_buffer_info *info = buffer->priv_virt;
+	struct scatterlist *sg;
+	LIST_HEAD(pages);
+	int i;
+
+	for_each_sg(info->sglist, sg, info->nents, i) {
+		struct page *page = sg_page(sg);
+
+		set_page_private(page, get_order(sg->length));
+		list_add_tail(&page->lru, &pages);
+	}
+	system_heap_free_pages(sys_heap, info->cached, &pages);
+
+	vfree(info->sglist);
+	kfree(info);
 	atomic_sub(buffer->size, &system_heap_allocated);
 }
 
 struct scatterlist *ion_system_heap_map_dma(struct ion_heap *heap,
 					    struct ion_buffer *buffer)
 {
-	struct scatterlist *sglist;
-	struct page *page;
-	int i;
-	int npages = PAGE_ALIGN(buffer->size) / PAGE_SIZE;
-	void *vaddr = buffer->priv_virt;
+	struct ion_system_buffer_info *info = buffer->priv_virt;
 
-	sglist = vmalloc(npages * sizeof(struct scatterlist));
-	if (!sglist)
-		return ERR_PTR(-ENOMEM);
-	memset(sglist, 0, npages * sizeof(struct scatterlist));
-	sg_init_table(sglist, npages);
-	for (i = 0; i < npages; i++) {
-		page = vmalloc_to_page(vaddr);
-		if (!page)
-			goto end;
-		sg_set_page(&sglist[i], page, PAGE_SIZE, 0);
-		vaddr += PAGE_SIZE;
-	}
-	/* XXX do cache maintenance for dma? */
-	return sglist;
-end:
-	vfree(sglist);
-	return NULL;
+	return info->sglist;
 }
 
 void ion_system_heap_unmap_dma(struct ion_heap *heap,
 			       struct ion_buffer *buffer)
 {
-	/* XXX undo cache maintenance for dma? */
-	if (buffer->sglist)
-		vfree(buffer->sglist);
 }
 
 void *ion_system_heap_map_kernel(struct ion_heap *heap,
 				 struct ion_buffer *buffer,
 				 unsigned long flags)
 {
-	if (ION_IS_CACHED(flags))
-		return buffer->priv_virt;
-	else {
-		pr_err("%s: cannot map system heap uncached\n", __func__);
-		return ERR_PTR(-EINVAL);
+	struct ion_system_buffer_info *info = buffer->priv_virt;
+	int npages = PAGE_ALIGN(buffer->size) / PAGE_SIZE;
+	pgprot_t pgprot = PAGE_KERNEL;
+	struct page **pages, **tmp;
+	struct scatterlist *sg;
+	void *vaddr;
+	int i, j;
+
+	if (!ION_IS_CACHED(flags))
+		pgprot = pgprot_noncached(pgprot);
+
+	pages = vmalloc(npages * sizeof(struct page *));
+	if (!pages)
+		return ERR_PTR(-ENOMEM);
+
+	tmp = pages;
+	for_each_sg(info->sglist, sg, info->nents, i) {
+		for (j = 0; j < sg->length / PAGE_SIZE; j++)
+			*(tmp++) = sg_page(sg) + j;
 	}
+
+	vaddr = vmap(pages, npages, VM_MAP, pgprot);
+	vfree(pages);
+
+	return vaddr ? vaddr : ERR_PTR(-ENOMEM);
 }
 
 void ion_system_heap_unmap_kernel(struct ion_heap *heap,
 				  struct ion_buffer *buffer)
 {
+	vunmap(buffer->vaddr);
 }
 
 void ion_system_heap_unmap_iommu(struct ion_iommu_map *data)
@@ -134,19 +327,50 @@ void ion_system_heap_unmap_iommu(struct ion_iommu_map *data)
 int ion_system_heap_map_user(struct ion_heap *heap, struct ion_buffer *buffer,
 			     struct vm_area_struct *vma, unsigned long flags)
 {
-	if (ION_IS_CACHED(flags))
-		return remap_vmalloc_range(vma, buffer->priv_virt,
-						vma->vm_pgoff);
-	else {
-		pr_err("%s: cannot map system heap uncached\n", __func__);
-		return -EINVAL;
+	struct ion_system_buffer_info *info = buffer->priv_virt;
+	unsigned long addr = vma->vm_start;
+	unsigned long offset = vma->vm_pgoff * PAGE_SIZE;
+	struct scatterlist *sg;
+	int i, ret;
+
+	if (!ION_IS_CACHED(flags))
+		vma->vm_page_prot = pgprot_writecombine(vma->vm_page_prot);
+
+	for_each_sg(info->sglist, sg, info->nents, i) {
+		unsigned long remainder = vma->vm_end - addr;
+		unsigned long len = sg->length;
+		struct page *page = sg_page(sg);
+
+		if (offset >= len) {
+			offset -= len;
+			continue;
+		}
+		if (offset) {
+			page += offset / PAGE_SIZE;
+			len -= offset;
+			offset = 0;
+		}
+		len = min(len, remainder);
+
+		ret = remap_pfn_range(vma, addr, page_to_pfn(page), len,
+				      vma->vm_page_prot);
+		if (ret)
+			return ret;
+
+		addr += len;
+		if (addr >= vma->vm_end)
+			break;
 	}
+
+	return 0;
 }
 
 int ion_system_heap_cache_ops(struct ion_heap *heap, struct ion_buffer *buffer,
 			void *vaddr, unsigned int offset, unsigned int length,
 			unsigned int cmd)
 {
+	struct ion_system_heap *sys_heap =
+		container_of(heap, struct ion_system_heap, heap);
 	void (*outer_cache_op)(phys_addr_t, phys_addr_t);
 
 	switch (cmd) {
@@ -166,18 +390,12 @@ int ion_system_heap_cache_ops(struct ion_heap *heap, struct ion_buffer *buffer,
 		return -EINVAL;
 	}
 
-	if (system_heap_has_outer_cache) {
-		unsigned long pstart;
-		void *vend;
-		void *vtemp;
-		unsigned long ln = 0;
-		vend = buffer->priv_virt + buffer->size;
-		vtemp = buffer->priv_virt + offset;
-
-		if ((vtemp+length) > vend) {
-			pr_err("Trying to flush outside of mapped range.\n");
-			pr_err("End of mapped range: %p, trying to flush to "
-				"address %p\n", vend, vtemp+length);
+	if (sys_heap->has_outer_cache) {
+		struct ion_system_buffer_info *info = buffer->priv_virt;
+		struct scatterlist *sg;
+		int i;
+
+		if (offset + length > buffer->size) {
 			WARN(1, "%s: called with heap name %s, buffer size 0x%x, "
 				"vaddr 0x%p, offset 0x%x, length: 0x%x\n",
 				__func__, heap->name, buffer->size, vaddr,
@@ -185,26 +403,24 @@ int ion_system_heap_cache_ops(struct ion_heap *heap, struct ion_buffer *buffer,
 			return -EINVAL;
 		}
 
-		for (; ln < length && vtemp < vend;
-		      vtemp += PAGE_SIZE, ln += PAGE_SIZE) {
-			struct page *page = vmalloc_to_page(vtemp);
-			if (!page) {
-				WARN(1, "Could not find page for virt. address %p\n",
-					vtemp);
-				return -EINVAL;
-			}
-			pstart = page_to_phys(page);
-			/*
-			 * If page -> phys is returning NULL, something
-			 * has really gone wrong...
-			 */
-			if (!pstart) {
-				WARN(1, "Could not translate %p to physical address\n",
-					vtemp);
-				return -EINVAL;
+		/* outer cache ops work on physical ranges, one block at a time */
+		for_each_sg(info->sglist, sg, info->nents, i) {
+			unsigned long len = sg->length;
+			phys_addr_t pstart;
+			unsigned int op_len;
+
+			if (!length)
+				break;
+			if (offset >= len) {
+				offset -= len;
+				continue;
 			}
 
-			outer_cache_op(pstart, pstart + PAGE_SIZE);
+			pstart = page_to_phys(sg_page(sg)) + offset;
+			op_len = min_t(unsigned int, len - offset, length);
+			outer_cache_op(pstart, pstart + op_len);
+			length -= op_len;
+			offset = 0;
 		}
 	}
 	return 0;
@@ -213,9 +429,45 @@ int ion_system_heap_cache_ops(struct ion_heap *heap, struct ion_buffer *buffer,
 static int ion_system_print_debug(struct ion_heap *heap, struct seq_file *s,
 				  const struct rb_root *unused)
 {
+	struct ion_system_heap *sys_heap =
+		container_of(heap, struct ion_system_heap, heap);
+	unsigned long nr_allocs;
+	u64 alloc_ns, max_alloc_ns;
+	unsigned long hist[NUM_LATENCY_BUCKETS];
+	int i;
+
 	seq_printf(s, "total bytes currently allocated: %lx\n",
 			(unsigned long) atomic_read(&system_heap_allocated));
 
+	spin_lock(&sys_heap->stats_lock);
+	nr_allocs = sys_heap->nr_allocs;
+	alloc_ns = sys_heap->alloc_ns;
+	max_alloc_ns = sys_heap->max_alloc_ns;
+	memcpy(hist, sys_heap->latency_hist, sizeof(hist));
+	spin_unlock(&sys_heap->stats_lock);
+
+	seq_printf(s, "allocations: %lu, avg latency: %llu us, "
+		   "max latency: %llu us\n", nr_allocs,
+		   div64_u64(alloc_ns, max(nr_allocs, 1UL) * NSEC_PER_USEC),
+		   div64_u64(max_alloc_ns, NSEC_PER_USEC));
+	for (i = 0; i < ARRAY_SIZE(alloc_latency_us); i++)
+		seq_printf(s, "  < %u us: %lu\n", alloc_latency_us[i],
+			   hist[i]);
+	seq_printf(s, "  >= %u us: %lu\n", alloc_latency_us[i - 1], hist[i]);
+
+	for (i = 0; i < NUM_ORDERS; i++) {
+		struct ion_page_pool *cached = sys_heap->cached_pools[i];
+		struct ion_page_pool *uncached = sys_heap->uncached_pools[i];
+
+		seq_printf(s, "order %u pool: cached %d clean %d dirty "
+			   "(hits %lu misses %lu), uncached %d clean %d dirty "
+			   "(hits %lu misses %lu)\n", orders[i],
+			   cached->clean_count, cached->dirty_count,
+			   cached->hits, cached->misses,
+			   uncached->clean_count, uncached->dirty_count,
+			   uncached->hits, uncached->misses);
+	}
+
 	return 0;
 }
 
@@ -227,20 +479,14 @@ int ion_system_heap_map_iommu(struct ion_buffer *buffer,
 				unsigned long iova_length,
 				unsigned long flags)
 {
-	int ret = 0, i;
+	int ret = 0;
 	struct iommu_domain *domain;
 	unsigned long extra;
 	unsigned long extra_iova_addr;
-	struct page *page;
-	int npages = buffer->size >> PAGE_SHIFT;
-	void *vaddr = buffer->priv_virt;
-	struct scatterlist *sglist = 0;
+	struct ion_system_buffer_info *info = buffer->priv_virt;
 	int prot = IOMMU_WRITE | IOMMU_READ;
 	prot |= ION_IS_CACHED(flags) ? IOMMU_CACHE : 0;
 
-	if (!ION_IS_CACHED(flags))
-		return -EINVAL;
-
 	if (!msm_use_iommu())
 		return -EINVAL;
 
@@ -261,23 +507,7 @@ int ion_system_heap_map_iommu(struct ion_buffer *buffer,
 		goto out1;
 	}
 
-
-	sglist = vmalloc(sizeof(*sglist) * npages);
-	if (!sglist) {
-		ret = -ENOMEM;
-		goto out1;
-	}
-
-	sg_init_table(sglist, npages);
-	for (i = 0; i < npages; i++) {
-		page = vmalloc_to_page(vaddr);
-		if (!page)
-			goto out1;
-		sg_set_page(&sglist[i], page, PAGE_SIZE, 0);
-		vaddr += PAGE_SIZE;
-	}
-
-	ret = iommu_map_range(domain, data->iova_addr, sglist,
+	ret = iommu_map_range(domain, data->iova_addr, info->sglist,
 			      buffer->size, prot);
 
 	if (ret) {
@@ -293,20 +523,18 @@ int ion_system_heap_map_iommu(struct ion_buffer *buffer,
 		if (ret)
 			goto out2;
 	}
-	vfree(sglist);
 	return ret;
 
 out2:
 	iommu_unmap_range(domain, data->iova_addr, buffer->size);
 out1:
-	vfree(sglist);
 	msm_free_iova_address(data->iova_addr, domain_num, partition_num,
 				data->mapped_size);
 out:
 	return ret;
 }
 
-static struct ion_heap_ops vmalloc_ops = {
+static struct ion_heap_ops system_heap_ops = {
 	.allocate = ion_system_heap_allocate,
 	.free = ion_system_heap_free,
 	.map_dma = ion_system_heap_map_dma,
@@ -320,22 +548,137 @@ static struct ion_heap_ops vmalloc_ops = {
 	.unmap_iommu = ion_system_heap_unmap_iommu,
 };
 
+/*
+ * Give pooled pages back under memory pressure. Counts are in pages, as
+ * the pools hold blocks of different orders.
+ */
+static int ion_system_heap_shrink(struct shrinker *shrinker,
+				  struct shrink_control *sc)
+{
+	struct ion_system_heap *sys_heap =
+		container_of(shrinker, struct ion_system_heap, shrinker);
+	int nr_to_scan = sc->nr_to_scan;
+	int total = 0;
+	int i;
+
+	for (i = 0; i < NUM_ORDERS && nr_to_scan > 0; i++) {
+		nr_to_scan -= ion_page_pool_shrink(sys_heap->uncached_pools[i],
+						   nr_to_scan);
+		if (nr_to_scan > 0)
+			nr_to_scan -= ion_page_pool_shrink(
+					sys_heap->cached_pools[i], nr_to_scan);
+	}
+
+	for (i = 0; i < NUM_ORDERS; i++) {
+		total += ion_page_pool_total(sys_heap->cached_pools[i]);
+		total += ion_page_pool_total(sys_heap->uncached_pools[i]);
+	}
+
+	return total;
+}
+
+static bool system_heap_has_dirty(struct ion_system_heap *sys_heap)
+{
+	int i;
+
+	for (i = 0; i < NUM_ORDERS; i++)
+		if (ion_page_pool_has_dirty(sys_heap->cached_pools[i]) ||
+		    ion_page_pool_has_dirty(sys_heap->uncached_pools[i]))
+			return true;
+
+	return false;
+}
+
+/* Zeroes freed blocks so that allocations find clean ones in the pools */
+static int ion_system_heap_zero_thread(void *data)
+{
+	struct ion_system_heap *sys_heap = data;
+	int i;
+
+	set_freezable();
+
+	while (!kthread_should_stop()) {
+		wait_event_freezable(sys_heap->zero_wait,
+				     system_heap_has_dirty(sys_heap) ||
+				     kthread_should_stop());
+
+		for (i = 0; i < NUM_ORDERS; i++) {
+			ion_page_pool_zero(sys_heap->uncached_pools[i],
+					   ION_SYSTEM_HEAP_ZERO_BATCH);
+			ion_page_pool_zero(sys_heap->cached_pools[i],
+					   ION_SYSTEM_HEAP_ZERO_BATCH);
+			cond_resched();
+		}
+	}
+
+	return 0;
+}
+
+static void ion_system_heap_destroy_pools(struct ion_system_heap *sys_heap)
+{
+	int i;
+
+	for (i = 0; i < NUM_ORDERS; i++) {
+		if (sys_heap->cached_pools[i])
+			ion_page_pool_destroy(sys_heap->cached_pools[i]);
+		if (sys_heap->uncached_pools[i])
+			ion_page_pool_destroy(sys_heap->uncached_pools[i]);
+	}
+}
+
 struct ion_heap *ion_system_heap_create(struct ion_platform_heap *pheap)
 {
-	struct ion_heap *heap;
+	struct ion_system_heap *sys_heap;
+	int i;
 
-	heap = kzalloc(sizeof(struct ion_heap), GFP_KERNEL);
-	if (!heap)
+	sys_heap = kzalloc(sizeof(struct ion_system_heap), GFP_KERNEL);
+	if (!sys_heap)
 		return ERR_PTR(-ENOMEM);
-	heap->ops = &vmalloc_ops;
-	heap->type = ION_HEAP_TYPE_SYSTEM;
-	system_heap_has_outer_cache = pheap->has_outer_cache;
-	return heap;
+	sys_heap->heap.ops = &system_heap_ops;
+	sys_heap->heap.type = ION_HEAP_TYPE_SYSTEM;
+	sys_heap->has_outer_cache = pheap->has_outer_cache;
+	spin_lock_init(&sys_heap->stats_lock);
+	init_waitqueue_head(&sys_heap->zero_wait);
+
+	for (i = 0; i < NUM_ORDERS; i++) {
+		gfp_t gfp_flags = low_order_gfp_flags;
+
+		if (orders[i] > 4)
+			gfp_flags = high_order_gfp_flags;
+		sys_heap->cached_pools[i] =
+			ion_page_pool_create(gfp_flags, orders[i], true);
+		sys_heap->uncached_pools[i] =
+			ion_page_pool_create(gfp_flags, orders[i], false);
+		if (!sys_heap->cached_pools[i] || !sys_heap->uncached_pools[i])
+			goto err;
+	}
+
+	sys_heap->zero_thread = kthread_run(ion_system_heap_zero_thread,
+					    sys_heap, "ion_system_zero");
+	if (IS_ERR(sys_heap->zero_thread))
+		goto err;
+
+	sys_heap->shrinker.shrink = ion_system_heap_shrink;
+	sys_heap->shrinker.seeks = DEFAULT_SEEKS;
+	register_shrinker(&sys_heap->shrinker);
+
+	return &sys_heap->heap;
+
+err:
+	ion_system_heap_destroy_pools(sys_heap);
+	kfree(sys_heap);
+	return ERR_PTR(-ENOMEM);
 }
 
 void ion_system_heap_destroy(struct ion_heap *heap)
 {
-	kfree(heap);
+	struct ion_system_heap *sys_heap =
+		container_of(heap, struct ion_system_heap, heap);
+
+	unregister_shrinker(&sys_heap->shrinker);
+	kthread_stop(sys_heap->zero_thread);
+	ion_system_heap_destroy_pools(sys_heap);
+	kfree(sys_heap);
 }
 
 static int ion_system_contig_heap_allocate(struct ion_heap *heap,
@@ -357,6 +700,23 @@ void ion_system_contig_heap_free(struct ion_buffer *buffer)
 	atomic_sub(buffer->size, &system_contig_heap_allocated);
 }
 
+void *ion_system_contig_heap_map_kernel(struct ion_heap *heap,
+					struct ion_buffer *buffer,
+					unsigned long flags)
+{
+	if (ION_IS_CACHED(flags))
+		return buffer->priv_virt;
+	else {
+		pr_err("%s: cannot map system heap uncached\n", __func__);
+		return ERR_PTR(-EINVAL);
+	}
+}
+
+void ion_system_contig_heap_unmap_kernel(struct ion_heap *heap,
+					 struct ion_buffer *buffer)
+{
+}
+
 static int ion_system_contig_heap_phys(struct ion_heap *heap,
 				       struct ion_buffer *buffer,
 				       ion_phys_addr_t *addr, size_t *len)
@@ -379,6 +739,13 @@ struct scatterlist *ion_system_contig_heap_map_dma(struct ion_heap *heap,
 	return sglist;
 }
 
+void ion_system_contig_heap_unmap_dma(struct ion_heap *heap,
+				      struct ion_buffer *buffer)
+{
+	if (buffer->sglist)
+		vfree(buffer->sglist);
+}
+
 int ion_system_contig_heap_map_user(struct ion_heap *heap,
 				    struct ion_buffer *buffer,
 				    struct vm_area_struct *vma,
@@ -528,9 +895,9 @@ static struct ion_heap_ops kmalloc_ops = {
 	.free = ion_system_contig_heap_free,
 	.phys = ion_system_contig_heap_phys,
 	.map_dma = ion_system_contig_heap_map_dma,
-	.unmap_dma = ion_system_heap_unmap_dma,
-	.map_kernel = ion_system_heap_map_kernel,
-	.unmap_kernel = ion_system_heap_unmap_kernel,
+	.unmap_dma = ion_system_contig_heap_unmap_dma,
+	.map_kernel = ion_system_contig_heap_map_kernel,
+	.unmap_kernel = ion_system_contig_heap_unmap_kernel,
 	.map_user = ion_system_contig_heap_map_user,
 	.cache_op = ion_system_contig_heap_cache_ops,
 	.print_debug = ion_system_contig_print_debug,
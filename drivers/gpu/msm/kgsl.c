@@ -33,6 +33,7 @@
 #include "kgsl_cffdump.h"
 #include "kgsl_log.h"
 #include "kgsl_sharedmem.h"
+#include "kgsl_pool.h"
 #include "kgsl_device.h"
 #include "kgsl_trace.h"
 
@@ -66,7 +67,7 @@ int kgsl_add_event(struct kgsl_device *device, u32 id, u32 ts,
 	void *owner)
 {
 	struct kgsl_event *event;
-	struct list_head *n;
+	struct list_head *head, *n;
 	unsigned int cur_ts;
 	struct kgsl_context *context = NULL;
 
@@ -98,62 +99,78 @@ int kgsl_add_event(struct kgsl_device *device, u32 id, u32 ts,
 	event->owner = owner;
 
 	/*
-	 * Add the event in order to the list.  Order is by context id
-	 * first and then by timestamp for that context.
+	 * Keep the timeline sorted by timestamp. New events are nearly
+	 * always for the latest timestamp, so search from the tail.
 	 */
+	head = context ? &context->events : &device->events;
 
-	for (n = device->events.next ; n != &device->events; n = n->next) {
+	list_for_each_prev(n, head) {
 		struct kgsl_event *e =
 			list_entry(n, struct kgsl_event, list);
 
-		if (e->context != context)
-			continue;
-
-		if (timestamp_cmp(e->timestamp, ts) > 0) {
-			list_add(&event->list, n->prev);
+		if (timestamp_cmp(e->timestamp, ts) <= 0)
 			break;
-		}
 	}
+	list_add(&event->list, n);
+
+	if (context && list_empty(&context->events_list))
+		list_add_tail(&context->events_list,
+			      &device->events_pending_list);
 
-	if (n == &device->events)
-		list_add_tail(&event->list, &device->events);
+	device->event_stats.queued++;
+	if (device->event_stats.queued > device->event_stats.max_queued)
+		device->event_stats.max_queued = device->event_stats.queued;
 
 	queue_work(device->work_queue, &device->ts_expired_ws);
 	return 0;
 }
 EXPORT_SYMBOL(kgsl_add_event);
 
-/**
- * kgsl_cancel_events_ctxt - Cancel all events for a context
- * @device - KGSL device for the events to cancel
- * @ctxt - context whose events we want to cancel
- *
+/*
+ * Call and free the events on a timeline. With @owner set only the
+ * events of that owner go, otherwise all of them. The callbacks see
+ * the current retired timestamp, events are used for lock and memory
+ * management so if the owner is going away the right thing to do is
+ * release or free.
  */
-static void kgsl_cancel_events_ctxt(struct kgsl_device *device,
-	struct kgsl_context *context)
+static void _cancel_timeline(struct kgsl_device *device,
+	struct kgsl_context *context, struct list_head *head, void *owner)
 {
 	struct kgsl_event *event, *event_tmp;
 	unsigned int id, cur;
 
+	if (list_empty(head))
+		return;
+
 	cur = kgsl_readtimestamp(device, context, KGSL_TIMESTAMP_RETIRED);
-	id = context->id;
+	id = context ? context->id : KGSL_MEMSTORE_GLOBAL;
 
-	list_for_each_entry_safe(event, event_tmp, &device->events, list) {
-		if (event->context != context)
+	list_for_each_entry_safe(event, event_tmp, head, list) {
+		if (owner != NULL && event->owner != owner)
 			continue;
 
-		/*
-		 * "cancel" the events by calling their callback.
-		 * Currently, events are used for lock and memory
-		 * management, so if the process is dying the right
-		 * thing to do is release or free.
-		 */
 		if (event->func)
 			event->func(device, event->priv, id, cur);
 
 		list_del(&event->list);
 		kfree(event);
+		device->event_stats.queued--;
 	}
+
+	if (context && list_empty(&context->events))
+		list_del_init(&context->events_list);
+}
+
+/**
+ * kgsl_cancel_events_ctxt - Cancel all events for a context
+ * @device - KGSL device for the events to cancel
+ * @ctxt - context whose events we want to cancel
+ *
+ */
+static void kgsl_cancel_events_ctxt(struct kgsl_device *device,
+	struct kgsl_context *context)
+{
+	_cancel_timeline(device, context, &context->events, NULL);
 }
 
 /**
@@ -165,29 +182,13 @@ static void kgsl_cancel_events_ctxt(struct kgsl_device *device,
 void kgsl_cancel_events(struct kgsl_device *device,
 	void *owner)
 {
-	struct kgsl_event *event, *event_tmp;
-	unsigned int id, cur;
+	struct kgsl_context *context, *tmp;
 
-	list_for_each_entry_safe(event, event_tmp, &device->events, list) {
-		if (event->owner != owner)
-			continue;
-
-		cur = kgsl_readtimestamp(device, event->context,
-					 KGSL_TIMESTAMP_RETIRED);
-
-		id = event->context ? event->context->id : KGSL_MEMSTORE_GLOBAL;
-		/*
-		 * "cancel" the events by calling their callback.
-		 * Currently, events are used for lock and memory
-		 * management, so if the process is dying the right
-		 * thing to do is release or free.
-		 */
-		if (event->func)
-			event->func(device, event->priv, id, cur);
+	_cancel_timeline(device, NULL, &device->events, owner);
 
-		list_del(&event->list);
-		kfree(event);
-	}
+	list_for_each_entry_safe(context, tmp, &device->events_pending_list,
+				 events_list)
+		_cancel_timeline(device, context, &context->events, owner);
 }
 EXPORT_SYMBOL(kgsl_cancel_events);
 
@@ -237,6 +238,29 @@ kgsl_mem_entry_create(void)
 	return entry;
 }
 
+/* Drop an ion mapping evicted from the pagetable mapping cache */
+static void kgsl_ion_release(void *handle, struct kgsl_memdesc *memdesc)
+{
+	kgsl_driver.stats.mapped -= memdesc->size;
+	ion_unmap_dma(kgsl_ion_client, handle);
+	ion_free(kgsl_ion_client, handle);
+}
+
+/*
+ * Only system memory is worth keeping mapped: carveout and content
+ * protection heaps are shared with other users and the mapping would keep
+ * the memory out of their reach.
+ */
+static bool kgsl_ion_cacheable(struct ion_handle *handle)
+{
+	enum ion_heap_type type;
+
+	if (ion_handle_get_heap_type(kgsl_ion_client, handle, &type))
+		return false;
+
+	return type == ION_HEAP_TYPE_SYSTEM || type == ION_HEAP_TYPE_IOMMU;
+}
+
 void
 kgsl_mem_entry_destroy(struct kref *kref)
 {
@@ -244,6 +268,20 @@ kgsl_mem_entry_destroy(struct kref *kref)
 						    struct kgsl_mem_entry,
 						    refcount);
 
+	/*
+	 * Keep ion mappings around in case the same buffer gets imported
+	 * again; the cache takes over the handle and the dma mapping, and
+	 * the memory stays accounted as mapped until it is evicted
+	 */
+
+	if (entry->memtype == KGSL_MEM_ENTRY_ION &&
+		kgsl_ion_cacheable(entry->priv_data) &&
+		!kgsl_mmu_cache_add(entry->memdesc.pagetable, &entry->memdesc,
+			entry->priv_data, kgsl_ion_release)) {
+		kfree(entry);
+		return;
+	}
+
 	if (entry->memtype != KGSL_MEM_ENTRY_KERNEL)
 		kgsl_driver.stats.mapped -= entry->memdesc.size;
 
@@ -341,8 +379,10 @@ kgsl_create_context(struct kgsl_device_private *dev_priv)
 			return NULL;
 		}
 
+		down_write(&dev_priv->device->context_sem);
 		ret = idr_get_new_above(&dev_priv->device->context_idr,
 				  context, 1, &id);
+		up_write(&dev_priv->device->context_sem);
 
 		if (ret != -EAGAIN)
 			break;
@@ -358,7 +398,9 @@ kgsl_create_context(struct kgsl_device_private *dev_priv)
 		KGSL_DRV_ERR(dev_priv->device, "cannot have more than %d "
 				"ctxts due to memstore limitation\n",
 				KGSL_MEMSTORE_MAX);
+		down_write(&dev_priv->device->context_sem);
 		idr_remove(&dev_priv->device->context_idr, id);
+		up_write(&dev_priv->device->context_sem);
 		kfree(context);
 		return NULL;
 	}
@@ -366,6 +408,8 @@ kgsl_create_context(struct kgsl_device_private *dev_priv)
 	kref_init(&context->refcount);
 	context->id = id;
 	context->dev_priv = dev_priv;
+	INIT_LIST_HEAD(&context->events);
+	INIT_LIST_HEAD(&context->events_list);
 
 	return context;
 }
@@ -391,6 +435,9 @@ kgsl_context_detach(struct kgsl_context *context)
 	trace_kgsl_context_detach(device, context);
 	id = context->id;
 
+	/* Keep lockless lookups away until the context is gone */
+	down_write(&device->context_sem);
+
 	if (device->ftbl->drawctxt_destroy)
 		device->ftbl->drawctxt_destroy(device, context);
 	/*device specific drawctxt_destroy MUST clean up devctxt */
@@ -403,6 +450,9 @@ kgsl_context_detach(struct kgsl_context *context)
 	kgsl_cancel_events_ctxt(device, context);
 	idr_remove(&device->context_idr, id);
 	context->id = KGSL_CONTEXT_INVALID;
+
+	up_write(&device->context_sem);
+
 	kgsl_context_put(context);
 }
 
@@ -414,32 +464,64 @@ kgsl_context_destroy(struct kref *kref)
 	kfree(context);
 }
 
-void kgsl_timestamp_expired(struct work_struct *work)
+/*
+ * Fire the expired events at the head of a timeline. The timeline is
+ * sorted, so this stops at the first event still in the future.
+ */
+static unsigned int _retire_timeline(struct kgsl_device *device,
+	struct kgsl_context *context, struct list_head *head)
 {
-	struct kgsl_device *device = container_of(work, struct kgsl_device,
-		ts_expired_ws);
 	struct kgsl_event *event, *event_tmp;
 	uint32_t ts_processed;
-	unsigned int id;
+	unsigned int id, fired = 0;
 
-	mutex_lock(&device->mutex);
+	if (list_empty(head))
+		return 0;
 
-	/* Process expired events */
-	list_for_each_entry_safe(event, event_tmp, &device->events, list) {
-		ts_processed = kgsl_readtimestamp(device, event->context,
-						  KGSL_TIMESTAMP_RETIRED);
-		if (timestamp_cmp(ts_processed, event->timestamp) < 0)
-			continue;
+	ts_processed = kgsl_readtimestamp(device, context,
+					  KGSL_TIMESTAMP_RETIRED);
+	id = context ? context->id : KGSL_MEMSTORE_GLOBAL;
 
-		id = event->context ? event->context->id : KGSL_MEMSTORE_GLOBAL;
+	list_for_each_entry_safe(event, event_tmp, head, list) {
+		if (timestamp_cmp(ts_processed, event->timestamp) < 0)
+			break;
 
 		if (event->func)
 			event->func(device, event->priv, id, ts_processed);
 
 		list_del(&event->list);
 		kfree(event);
+		fired++;
+	}
+
+	return fired;
+}
+
+void kgsl_timestamp_expired(struct work_struct *work)
+{
+	struct kgsl_device *device = container_of(work, struct kgsl_device,
+		ts_expired_ws);
+	struct kgsl_context *context, *tmp;
+	unsigned int fired;
+
+	mutex_lock(&device->mutex);
+
+	/* Process expired events, only contexts with events are visited */
+	fired = _retire_timeline(device, NULL, &device->events);
+
+	list_for_each_entry_safe(context, tmp, &device->events_pending_list,
+				 events_list) {
+		fired += _retire_timeline(device, context, &context->events);
+		if (list_empty(&context->events))
+			list_del_init(&context->events_list);
 	}
 
+	device->event_stats.retires++;
+	device->event_stats.fired += fired;
+	device->event_stats.queued -= fired;
+	if (fired > device->event_stats.max_fired)
+		device->event_stats.max_fired = fired;
+
 	device->last_expired_ctxt_id = KGSL_CONTEXT_INVALID;
 
 	mutex_unlock(&device->mutex);
@@ -1167,17 +1249,50 @@ done:
 	return result;
 }
 
+/*
+ * Retired and queued timestamps come from the memstore and from driver
+ * state, so they are read without the device mutex and do not wait
+ * behind a submission. context_sem keeps the context from being detached
+ * meanwhile. The consumed timestamp is a register read and still needs
+ * the device awake, under the mutex.
+ */
 static long _cmdstream_readtimestamp(struct kgsl_device_private *dev_priv,
-		struct kgsl_context *context, unsigned int type,
+		unsigned int context_id, unsigned int type,
 		unsigned int *timestamp)
 {
-	*timestamp = kgsl_readtimestamp(dev_priv->device, context, type);
+	struct kgsl_device *device = dev_priv->device;
+	struct kgsl_context *context = NULL;
+	bool locked = (type == KGSL_TIMESTAMP_CONSUMED);
+	long result = 0;
 
-	trace_kgsl_readtimestamp(dev_priv->device,
-			context ? context->id : KGSL_MEMSTORE_GLOBAL,
-			type, *timestamp);
+	if (locked) {
+		mutex_lock(&device->mutex);
+		kgsl_check_suspended(device);
+	} else
+		down_read(&device->context_sem);
 
-	return 0;
+	if (context_id != KGSL_MEMSTORE_GLOBAL) {
+		context = kgsl_find_context(dev_priv, context_id);
+		if (context == NULL) {
+			KGSL_DRV_ERR(device, "invalid context_id %d\n",
+				context_id);
+			result = -EINVAL;
+			goto done;
+		}
+	}
+
+	*timestamp = kgsl_readtimestamp(device, context, type);
+
+	trace_kgsl_readtimestamp(device, context_id, type, *timestamp);
+
+done:
+	if (locked) {
+		kgsl_check_idle_locked(device);
+		mutex_unlock(&device->mutex);
+	} else
+		up_read(&device->context_sem);
+
+	return result;
 }
 
 static long kgsl_ioctl_cmdstream_readtimestamp(struct kgsl_device_private
@@ -1186,7 +1301,7 @@ static long kgsl_ioctl_cmdstream_readtimestamp(struct kgsl_device_private
 {
 	struct kgsl_cmdstream_readtimestamp *param = data;
 
-	return _cmdstream_readtimestamp(dev_priv, NULL,
+	return _cmdstream_readtimestamp(dev_priv, KGSL_MEMSTORE_GLOBAL,
 			param->type, &param->timestamp);
 }
 
@@ -1195,16 +1310,15 @@ static long kgsl_ioctl_cmdstream_readtimestamp_ctxtid(struct kgsl_device_private
 						void *data)
 {
 	struct kgsl_cmdstream_readtimestamp_ctxtid *param = data;
-	struct kgsl_context *context;
 
-	context = kgsl_find_context(dev_priv, param->context_id);
-	if (context == NULL) {
+	/* Context ids start at 1, 0 would be taken for the global one */
+	if (param->context_id == KGSL_MEMSTORE_GLOBAL) {
 		KGSL_DRV_ERR(dev_priv->device, "invalid context_id %d\n",
 			param->context_id);
 		return -EINVAL;
 	}
 
-	return _cmdstream_readtimestamp(dev_priv, context,
+	return _cmdstream_readtimestamp(dev_priv, param->context_id,
 			param->type, &param->timestamp);
 }
 
@@ -1760,6 +1874,20 @@ static int kgsl_setup_ion(struct kgsl_mem_entry *entry,
 
 	entry->memtype = KGSL_MEM_ENTRY_ION;
 	entry->priv_data = handle;
+
+	/*
+	 * The kgsl client gets the same handle every time the buffer is
+	 * imported, so it doubles as the key for the mapping cache. A cached
+	 * mapping comes with its own reference to the handle.
+	 */
+
+	if (!kgsl_mmu_cache_get(pagetable, handle, &entry->memdesc)) {
+		/* The import accounts for it again */
+		kgsl_driver.stats.mapped -= entry->memdesc.size;
+		ion_free(kgsl_ion_client, handle);
+		return 0;
+	}
+
 	entry->memdesc.pagetable = pagetable;
 	entry->memdesc.size = 0;
 
@@ -1864,9 +1992,11 @@ static long kgsl_ioctl_map_user_mem(struct kgsl_device_private *dev_priv,
 	if (result)
 		goto error;
 
-	result = kgsl_mmu_map(private->pagetable,
-			      &entry->memdesc,
-			      GSL_PT_PAGE_RV | GSL_PT_PAGE_WV);
+	/* Ion buffers might come back from the mapping cache already mapped */
+	if (entry->memdesc.gpuaddr == 0)
+		result = kgsl_mmu_map(private->pagetable,
+				      &entry->memdesc,
+				      GSL_PT_PAGE_RV | GSL_PT_PAGE_WV);
 
 	if (result)
 		goto error_put_file_ptr;
@@ -2129,9 +2259,9 @@ static const struct {
 	KGSL_IOCTL_FUNC(IOCTL_KGSL_RINGBUFFER_ISSUEIBCMDS,
 			kgsl_ioctl_rb_issueibcmds, 1),
 	KGSL_IOCTL_FUNC(IOCTL_KGSL_CMDSTREAM_READTIMESTAMP,
-			kgsl_ioctl_cmdstream_readtimestamp, 1),
+			kgsl_ioctl_cmdstream_readtimestamp, 0),
 	KGSL_IOCTL_FUNC(IOCTL_KGSL_CMDSTREAM_READTIMESTAMP_CTXTID,
-			kgsl_ioctl_cmdstream_readtimestamp_ctxtid, 1),
+			kgsl_ioctl_cmdstream_readtimestamp_ctxtid, 0),
 	KGSL_IOCTL_FUNC(IOCTL_KGSL_CMDSTREAM_FREEMEMONTIMESTAMP,
 			kgsl_ioctl_cmdstream_freememontimestamp, 1),
 	KGSL_IOCTL_FUNC(IOCTL_KGSL_CMDSTREAM_FREEMEMONTIMESTAMP_CTXTID,
@@ -2168,6 +2298,7 @@ static long kgsl_ioctl(struct file *filep, unsigned int cmd, unsigned long arg)
 	unsigned int nr = _IOC_NR(cmd);
 	kgsl_ioctl_func_t func;
 	int lock, ret;
+	ktime_t start = ktime_set(0, 0), locked = ktime_set(0, 0);
 	char ustack[64];
 	void *uptr = NULL;
 
@@ -2220,7 +2351,9 @@ static long kgsl_ioctl(struct file *filep, unsigned int cmd, unsigned long arg)
 	}
 
 	if (lock) {
+		start = ktime_get();
 		mutex_lock(&dev_priv->device->mutex);
+		locked = ktime_get();
 		kgsl_check_suspended(dev_priv->device);
 	}
 
@@ -2229,6 +2362,9 @@ static long kgsl_ioctl(struct file *filep, unsigned int cmd, unsigned long arg)
 	if (lock) {
 		kgsl_check_idle_locked(dev_priv->device);
 		mutex_unlock(&dev_priv->device->mutex);
+		trace_kgsl_ioctl_lock(dev_priv->device, nr,
+			ktime_to_us(ktime_sub(locked, start)),
+			ktime_to_us(ktime_sub(ktime_get(), locked)));
 	}
 
 	if (ret == 0 && (cmd & IOC_OUT)) {
@@ -2429,39 +2565,21 @@ static int _register_device(struct kgsl_device *device)
 	return 0;
 }
 
-int kgsl_device_platform_probe(struct kgsl_device *device)
+static int _map_registers(struct kgsl_device *device,
+			  struct platform_device *pdev)
 {
-	int result;
-	int status = -EINVAL;
 	struct resource *res;
-	struct platform_device *pdev =
-		container_of(device->parentdev, struct platform_device, dev);
-
-	status = _register_device(device);
-	if (status)
-		return status;
-
-	/* Initialize logging first, so that failures below actually print. */
-	kgsl_device_debugfs_init(device);
-
-	status = kgsl_pwrctrl_init(device);
-	if (status)
-		goto error;
-
-	kgsl_ion_client = msm_ion_client_create(UINT_MAX, KGSL_NAME);
 
 	res = platform_get_resource_byname(pdev, IORESOURCE_MEM,
 					   device->iomemname);
 	if (res == NULL) {
 		KGSL_DRV_ERR(device, "platform_get_resource_byname failed\n");
-		status = -EINVAL;
-		goto error_pwrctrl_close;
+		return -EINVAL;
 	}
 	if (res->start == 0 || resource_size(res) == 0) {
 		KGSL_DRV_ERR(device, "dev %d invalid register region\n",
 			device->id);
-		status = -EINVAL;
-		goto error_pwrctrl_close;
+		return -EINVAL;
 	}
 
 	device->reg_phys = res->start;
@@ -2470,8 +2588,7 @@ int kgsl_device_platform_probe(struct kgsl_device *device)
 	if (!devm_request_mem_region(device->dev, device->reg_phys,
 				device->reg_len, device->name)) {
 		KGSL_DRV_ERR(device, "request_mem_region failed\n");
-		status = -ENODEV;
-		goto error_pwrctrl_close;
+		return -ENODEV;
 	}
 
 	device->reg_virt = devm_ioremap(device->dev, device->reg_phys,
@@ -2479,18 +2596,29 @@ int kgsl_device_platform_probe(struct kgsl_device *device)
 
 	if (device->reg_virt == NULL) {
 		KGSL_DRV_ERR(device, "ioremap failed\n");
-		status = -ENODEV;
-		goto error_pwrctrl_close;
+		return -ENODEV;
 	}
-	/*acquire interrupt */
+
+	KGSL_DRV_INFO(device,
+		"dev_id %d regs phys 0x%08lx size 0x%08x virt %p\n",
+		device->id, device->reg_phys, device->reg_len,
+		device->reg_virt);
+
+	return 0;
+}
+
+static int _request_irq(struct kgsl_device *device,
+			struct platform_device *pdev)
+{
+	int status;
+
 	device->pwrctrl.interrupt_num =
 		platform_get_irq_byname(pdev, device->pwrctrl.irq_name);
 
 	if (device->pwrctrl.interrupt_num <= 0) {
 		KGSL_DRV_ERR(device, "platform_get_irq_byname failed: %d\n",
 					 device->pwrctrl.interrupt_num);
-		status = -EINVAL;
-		goto error_pwrctrl_close;
+		return -EINVAL;
 	}
 
 	status = devm_request_irq(device->dev, device->pwrctrl.interrupt_num,
@@ -2499,14 +2627,45 @@ int kgsl_device_platform_probe(struct kgsl_device *device)
 	if (status) {
 		KGSL_DRV_ERR(device, "request_irq(%d) failed: %d\n",
 			      device->pwrctrl.interrupt_num, status);
-		goto error_pwrctrl_close;
+		return status;
 	}
 	disable_irq(device->pwrctrl.interrupt_num);
 
-	KGSL_DRV_INFO(device,
-		"dev_id %d regs phys 0x%08lx size 0x%08x virt %p\n",
-		device->id, device->reg_phys, device->reg_len,
-		device->reg_virt);
+	return 0;
+}
+
+int kgsl_device_platform_probe(struct kgsl_device *device)
+{
+	int result;
+	int status = -EINVAL;
+	struct platform_device *pdev =
+		container_of(device->parentdev, struct platform_device, dev);
+
+	status = _register_device(device);
+	if (status)
+		return status;
+
+	/* Initialize logging first, so that failures below actually print. */
+	kgsl_device_debugfs_init(device);
+
+	status = kgsl_pwrctrl_init(device);
+	if (status)
+		goto error;
+
+	kgsl_ion_client = msm_ion_client_create(UINT_MAX, KGSL_NAME);
+
+	/* Software-only devices have no register space and no interrupt */
+	if (device->iomemname != NULL) {
+		status = _map_registers(device, pdev);
+		if (status)
+			goto error_pwrctrl_close;
+	}
+
+	if (device->pwrctrl.irq_name != NULL) {
+		status = _request_irq(device, pdev);
+		if (status)
+			goto error_pwrctrl_close;
+	}
 
 	result = kgsl_drm_init(pdev);
 	if (result)
@@ -2613,11 +2772,19 @@ static void kgsl_core_exit(void)
 	kgsl_cffdump_destroy();
 	kgsl_core_debugfs_close();
 	kgsl_sharedmem_uninit_sysfs();
+	kgsl_mmu_cache_exit();
+	kgsl_exit_page_pools();
 }
 
 static int __init kgsl_core_init(void)
 {
 	int result = 0;
+
+	kgsl_init_page_pools();
+
+	INIT_LIST_HEAD(&kgsl_driver.pagetable_list);
+	kgsl_mmu_cache_init();
+
 	/* alloc major and minor device numbers */
 	result = alloc_chrdev_region(&kgsl_driver.major, 0, KGSL_DEVICE_MAX,
 				  KGSL_NAME);
@@ -2673,8 +2840,6 @@ static int __init kgsl_core_init(void)
 
 	INIT_LIST_HEAD(&kgsl_driver.process_list);
 
-	INIT_LIST_HEAD(&kgsl_driver.pagetable_list);
-
 	kgsl_mmu_set_mmutype(ksgl_mmu_type);
 
 	if (KGSL_MMU_TYPE_GPU == kgsl_mmu_get_mmutype()) {
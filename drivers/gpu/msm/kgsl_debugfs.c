@@ -12,6 +12,7 @@
  */
 
 #include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #include "kgsl.h"
 #include "kgsl_device.h"
@@ -49,6 +50,35 @@ KGSL_DEBUGFS_LOG(ctxt_log);
 KGSL_DEBUGFS_LOG(mem_log);
 KGSL_DEBUGFS_LOG(pwr_log);
 
+/* Events fired per retire pass is fired / retires */
+static int events_print(struct seq_file *s, void *unused)
+{
+	struct kgsl_device *device = s->private;
+
+	mutex_lock(&device->mutex);
+	seq_printf(s, "queued: %u\n", device->event_stats.queued);
+	seq_printf(s, "max_queued: %u\n", device->event_stats.max_queued);
+	seq_printf(s, "retires: %u\n", device->event_stats.retires);
+	seq_printf(s, "fired: %u\n", device->event_stats.fired);
+	seq_printf(s, "max_fired_per_retire: %u\n",
+		   device->event_stats.max_fired);
+	mutex_unlock(&device->mutex);
+
+	return 0;
+}
+
+static int events_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, events_print, inode->i_private);
+}
+
+static const struct file_operations events_fops = {
+	.open = events_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
 void kgsl_device_debugfs_init(struct kgsl_device *device)
 {
 	if (kgsl_debugfs_dir && !IS_ERR(kgsl_debugfs_dir))
@@ -74,6 +104,8 @@ void kgsl_device_debugfs_init(struct kgsl_device *device)
 				&mem_log_fops);
 	debugfs_create_file("log_level_pwr", 0644, device->d_debugfs, device,
 				&pwr_log_fops);
+	debugfs_create_file("events", 0444, device->d_debugfs, device,
+				&events_fops);
 }
 
 void kgsl_core_debugfs_init(void)
@@ -14,6 +14,7 @@
 #define __KGSL_DEVICE_H
 
 #include <linux/idr.h>
+#include <linux/rwsem.h>
 #include <linux/wakelock.h>
 #include <linux/pm_qos_params.h>
 #include <linux/earlysuspend.h>
@@ -168,6 +169,12 @@ struct kgsl_device {
 	struct completion recovery_gate;
 	struct dentry *d_debugfs;
 	struct idr context_idr;
+	/*
+	 * Held for write while a context is added to or detached from
+	 * context_idr, for read by paths that look up contexts without
+	 * holding the device mutex.
+	 */
+	struct rw_semaphore context_sem;
 	struct early_suspend display_off;
 
 	void *snapshot;		/* Pointer to the snapshot memory region */
@@ -196,7 +203,18 @@ struct kgsl_device {
 	struct kobject pwrscale_kobj;
 	struct pm_qos_request_list pm_qos_req_dma;
 	struct work_struct ts_expired_ws;
+	/* Events on KGSL_MEMSTORE_GLOBAL, sorted by timestamp */
 	struct list_head events;
+	/* Contexts with events pending on their own timeline */
+	struct list_head events_pending_list;
+	/* Event statistics for debugfs, protected by mutex */
+	struct {
+		unsigned int queued;
+		unsigned int max_queued;
+		unsigned int retires;
+		unsigned int fired;
+		unsigned int max_fired;
+	} event_stats;
 	s64 on_time;
 };
 
@@ -212,7 +230,9 @@ void kgsl_timestamp_expired(struct work_struct *work);
 	.ts_expired_ws  = __WORK_INITIALIZER((_dev).ts_expired_ws,\
 			kgsl_timestamp_expired),\
 	.context_idr = IDR_INIT((_dev).context_idr),\
+	.context_sem = __RWSEM_INITIALIZER((_dev).context_sem),\
 	.events = LIST_HEAD_INIT((_dev).events),\
+	.events_pending_list = LIST_HEAD_INIT((_dev).events_pending_list),\
 	.wait_queue = __WAIT_QUEUE_HEAD_INITIALIZER((_dev).wait_queue),\
 	.mutex = __MUTEX_INITIALIZER((_dev).mutex),\
 	.state = KGSL_STATE_INIT,\
@@ -234,6 +254,11 @@ struct kgsl_context {
 	 * context was responsible for causing it
 	 */
 	unsigned int reset_status;
+
+	/* Pending events for this context, sorted by timestamp */
+	struct list_head events;
+	/* Link in device->events_pending_list while events is not empty */
+	struct list_head events_list;
 };
 
 struct kgsl_process_private {
@@ -905,15 +905,13 @@ int kgsl_gem_kmem_fault(struct vm_area_struct *vma, struct vm_fault *vmf)
 	struct drm_kgsl_gem_object *priv;
 	unsigned long offset;
 	struct page *page;
-	int i;
 
 	mutex_lock(&dev->struct_mutex);
 
 	priv = obj->driver_private;
 
 	offset = (unsigned long) vmf->virtual_address - vma->vm_start;
-	i = offset >> PAGE_SHIFT;
-	page = sg_page(&(priv->memdesc.sg[i]));
+	page = kgsl_sg_page(priv->memdesc.sg, priv->memdesc.sglen, offset);
 
 	if (!page) {
 		mutex_unlock(&dev->struct_mutex);
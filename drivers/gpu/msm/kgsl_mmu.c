@@ -12,11 +12,14 @@
  */
 #include <linux/types.h>
 #include <linux/device.h>
+#include <linux/moduleparam.h>
 #include <linux/spinlock.h>
 #include <linux/genalloc.h>
 #include <linux/slab.h>
 #include <linux/sched.h>
 #include <linux/iommu.h>
+#include <linux/log2.h>
+#include <asm/sizes.h>
 #include <mach/socinfo.h>
 
 #include "kgsl.h"
@@ -30,6 +33,43 @@
 
 static enum kgsl_mmutype kgsl_mmu_type;
 
+#undef MODULE_PARAM_PREFIX
+#define MODULE_PARAM_PREFIX "kgsl."
+
+/*
+ * Upper bound on the size of the idle mappings kept in the cache of each
+ * pagetable; 0 turns the cache off
+ */
+static unsigned int kgsl_mmu_cache_size = SZ_32M;
+module_param_named(mmu_cache_size, kgsl_mmu_cache_size, uint, 0644);
+MODULE_PARM_DESC(kgsl_mmu_cache_size,
+"Bytes of idle imported buffer mappings to keep per pagetable, 0 to disable");
+
+/* An idle mapping parked by kgsl_mmu_cache_add */
+struct kgsl_mmu_cache_entry {
+	struct list_head node;
+	void *key;
+	struct kgsl_pagetable *pagetable;
+	struct kgsl_memdesc memdesc;
+	void (*release)(void *key, struct kgsl_memdesc *memdesc);
+};
+
+static void _cache_trim(struct kgsl_pagetable *pagetable, unsigned int size,
+			struct list_head *evict);
+static void _cache_release(struct kgsl_pagetable *pagetable,
+			   struct list_head *evict);
+
+/*
+ * Entries taken out of the pagetable caches by the shrinker. Releasing them
+ * frees ion handles, and reclaim may be running with the kgsl ion client
+ * locked, so a worker unmaps and releases them instead.
+ */
+static LIST_HEAD(kgsl_mmu_cache_evicted);
+static DEFINE_SPINLOCK(kgsl_mmu_cache_evict_lock);
+
+static void kgsl_mmu_cache_evict_work(struct work_struct *work);
+static DECLARE_WORK(kgsl_mmu_cache_work, kgsl_mmu_cache_evict_work);
+
 static void pagetable_remove_sysfs_objects(struct kgsl_pagetable *pagetable);
 
 static int kgsl_cleanup_pt(struct kgsl_pagetable *pt)
@@ -83,11 +123,24 @@ static void kgsl_destroy_pagetable(struct kref *kref)
 	struct kgsl_pagetable *pagetable = container_of(kref,
 		struct kgsl_pagetable, refcount);
 	unsigned long flags;
+	LIST_HEAD(evict);
 
 	spin_lock_irqsave(&kgsl_driver.ptlock, flags);
 	list_del(&pagetable->list);
 	spin_unlock_irqrestore(&kgsl_driver.ptlock, flags);
 
+	spin_lock(&pagetable->lock);
+	_cache_trim(pagetable, 0, &evict);
+	spin_unlock(&pagetable->lock);
+
+	_cache_release(pagetable, &evict);
+
+	/*
+	 * The shrinker can't find the pagetable any more, but may have handed
+	 * some of its entries to the worker before it was unlisted
+	 */
+	flush_work(&kgsl_mmu_cache_work);
+
 	pagetable_remove_sysfs_objects(pagetable);
 
 	kgsl_cleanup_pt(pagetable);
@@ -228,6 +281,58 @@ sysfs_show_max_entries(struct kobject *kobj,
 	return ret;
 }
 
+static ssize_t
+sysfs_show_cached(struct kobject *kobj,
+		  struct kobj_attribute *attr,
+		  char *buf)
+{
+	struct kgsl_pagetable *pt;
+	int ret = 0;
+
+	pt = _get_pt_from_kobj(kobj);
+
+	if (pt)
+		ret += snprintf(buf, PAGE_SIZE, "%d\n", pt->stats.cached);
+
+	kgsl_put_pagetable(pt);
+	return ret;
+}
+
+static ssize_t
+sysfs_show_cache_hits(struct kobject *kobj,
+		      struct kobj_attribute *attr,
+		      char *buf)
+{
+	struct kgsl_pagetable *pt;
+	int ret = 0;
+
+	pt = _get_pt_from_kobj(kobj);
+
+	if (pt)
+		ret += snprintf(buf, PAGE_SIZE, "%d\n", pt->stats.cache_hits);
+
+	kgsl_put_pagetable(pt);
+	return ret;
+}
+
+static ssize_t
+sysfs_show_cache_misses(struct kobject *kobj,
+			struct kobj_attribute *attr,
+			char *buf)
+{
+	struct kgsl_pagetable *pt;
+	int ret = 0;
+
+	pt = _get_pt_from_kobj(kobj);
+
+	if (pt)
+		ret += snprintf(buf, PAGE_SIZE, "%d\n",
+			pt->stats.cache_misses);
+
+	kgsl_put_pagetable(pt);
+	return ret;
+}
+
 static struct kobj_attribute attr_entries = {
 	.attr = { .name = "entries", .mode = 0444 },
 	.show = sysfs_show_entries,
@@ -258,12 +363,33 @@ static struct kobj_attribute attr_max_entries = {
 	.store = NULL,
 };
 
+static struct kobj_attribute attr_cached = {
+	.attr = { .name = "cached", .mode = 0444 },
+	.show = sysfs_show_cached,
+	.store = NULL,
+};
+
+static struct kobj_attribute attr_cache_hits = {
+	.attr = { .name = "cache_hits", .mode = 0444 },
+	.show = sysfs_show_cache_hits,
+	.store = NULL,
+};
+
+static struct kobj_attribute attr_cache_misses = {
+	.attr = { .name = "cache_misses", .mode = 0444 },
+	.show = sysfs_show_cache_misses,
+	.store = NULL,
+};
+
 static struct attribute *pagetable_attrs[] = {
 	&attr_entries.attr,
 	&attr_mapped.attr,
 	&attr_va_range.attr,
 	&attr_max_mapped.attr,
 	&attr_max_entries.attr,
+	&attr_cached.attr,
+	&attr_cache_hits.attr,
+	&attr_cache_misses.attr,
 	NULL,
 };
 
@@ -441,6 +567,7 @@ static struct kgsl_pagetable *kgsl_mmu_createpagetableobject(
 	kref_init(&pagetable->refcount);
 
 	spin_lock_init(&pagetable->lock);
+	INIT_LIST_HEAD(&pagetable->cache_list);
 
 	ptsize = kgsl_mmu_get_ptsize();
 
@@ -579,6 +706,7 @@ void kgsl_mh_start(struct kgsl_device *device)
 	 * kgsl_pwrctrl_irq() is called
 	 */
 }
+EXPORT_SYMBOL(kgsl_mh_start);
 
 static inline struct gen_pool *
 _get_pool(struct kgsl_pagetable *pagetable, unsigned int flags)
@@ -589,6 +717,30 @@ _get_pool(struct kgsl_pagetable *pagetable, unsigned int flags)
 	return pagetable->pool;
 }
 
+/*
+ * Buffers built from 1M or 64K chunks can be mapped with IOMMU sections and
+ * large pages, but only if the GPU address is aligned the same way as the
+ * chunks; page allocations put the largest chunk first in the sglist.
+ * Global mappings are left alone, they need the same address in every
+ * pagetable.
+ */
+static unsigned int
+_get_align_order(struct kgsl_memdesc *memdesc)
+{
+	unsigned int len = memdesc->sg[0].length;
+
+	if (KGSL_MMU_TYPE_IOMMU != kgsl_mmu_get_mmutype() ||
+		(memdesc->priv & KGSL_MEMFLAGS_GLOBAL))
+		return 0;
+
+	if (len >= SZ_1M)
+		return ilog2(SZ_1M);
+	else if (len >= SZ_64K)
+		return ilog2(SZ_64K);
+
+	return 0;
+}
+
 int
 kgsl_mmu_map(struct kgsl_pagetable *pagetable,
 				struct kgsl_memdesc *memdesc,
@@ -621,7 +773,23 @@ kgsl_mmu_map(struct kgsl_pagetable *pagetable,
 	/* Allocate from kgsl pool if it exists for global mappings */
 	pool = _get_pool(pagetable, memdesc->priv);
 
-	memdesc->gpuaddr = gen_pool_alloc(pool, size);
+	memdesc->gpuaddr = gen_pool_alloc_aligned(pool, size,
+		_get_align_order(memdesc));
+
+	/* Idle cached mappings are the first thing to go if we run out */
+	if (memdesc->gpuaddr == 0 && !list_empty(&pagetable->cache_list)) {
+		LIST_HEAD(evict);
+
+		spin_lock(&pagetable->lock);
+		_cache_trim(pagetable, 0, &evict);
+		spin_unlock(&pagetable->lock);
+
+		_cache_release(pagetable, &evict);
+
+		memdesc->gpuaddr = gen_pool_alloc_aligned(pool, size,
+			_get_align_order(memdesc));
+	}
+
 	if (memdesc->gpuaddr == 0) {
 		KGSL_CORE_ERR("gen_pool_alloc(%d) failed from pool: %s\n",
 			size,
@@ -704,6 +872,220 @@ kgsl_mmu_unmap(struct kgsl_pagetable *pagetable,
 }
 EXPORT_SYMBOL(kgsl_mmu_unmap);
 
+/*
+ * Move the least recently used cache entries to @evict until no more than
+ * @size bytes are cached. Call with the pagetable lock held.
+ */
+static void _cache_trim(struct kgsl_pagetable *pagetable, unsigned int size,
+			struct list_head *evict)
+{
+	struct kgsl_mmu_cache_entry *entry;
+
+	while (pagetable->stats.cached > size &&
+		!list_empty(&pagetable->cache_list)) {
+		entry = list_entry(pagetable->cache_list.prev,
+			struct kgsl_mmu_cache_entry, node);
+
+		list_move(&entry->node, evict);
+		pagetable->stats.cached -= entry->memdesc.size;
+	}
+}
+
+/*
+ * Unmap and release the entries on @evict. The whole batch is collected
+ * under the pagetable lock first so the lock isn't bounced per entry.
+ */
+static void _cache_release(struct kgsl_pagetable *pagetable,
+			   struct list_head *evict)
+{
+	struct kgsl_mmu_cache_entry *entry, *tmp;
+
+	list_for_each_entry_safe(entry, tmp, evict, node) {
+		list_del(&entry->node);
+
+		kgsl_mmu_unmap(pagetable, &entry->memdesc);
+		entry->release(entry->key, &entry->memdesc);
+		kfree(entry);
+	}
+}
+
+static void kgsl_mmu_cache_evict_work(struct work_struct *work)
+{
+	struct kgsl_mmu_cache_entry *entry;
+
+	while (1) {
+		spin_lock(&kgsl_mmu_cache_evict_lock);
+		if (list_empty(&kgsl_mmu_cache_evicted)) {
+			spin_unlock(&kgsl_mmu_cache_evict_lock);
+			break;
+		}
+		entry = list_first_entry(&kgsl_mmu_cache_evicted,
+			struct kgsl_mmu_cache_entry, node);
+		list_del(&entry->node);
+		spin_unlock(&kgsl_mmu_cache_evict_lock);
+
+		kgsl_mmu_unmap(entry->pagetable, &entry->memdesc);
+		entry->release(entry->key, &entry->memdesc);
+		kfree(entry);
+
+		cond_resched();
+	}
+}
+
+/*
+ * Give back cached mappings, least recently used first in each pagetable,
+ * when the system runs low on memory
+ */
+static int kgsl_mmu_cache_shrink(struct shrinker *shrinker,
+				 struct shrink_control *sc)
+{
+	struct kgsl_pagetable *pt;
+	unsigned int want = sc->nr_to_scan << PAGE_SHIFT;
+	unsigned int cached = 0, before;
+	unsigned long flags;
+	bool evicted = false;
+
+	spin_lock_irqsave(&kgsl_driver.ptlock, flags);
+	list_for_each_entry(pt, &kgsl_driver.pagetable_list, list) {
+		spin_lock(&pt->lock);
+		if (want && pt->stats.cached) {
+			before = pt->stats.cached;
+			spin_lock(&kgsl_mmu_cache_evict_lock);
+			_cache_trim(pt, before > want ? before - want : 0,
+				&kgsl_mmu_cache_evicted);
+			spin_unlock(&kgsl_mmu_cache_evict_lock);
+			want -= min(want, before - pt->stats.cached);
+			evicted = true;
+		}
+		cached += pt->stats.cached;
+		spin_unlock(&pt->lock);
+	}
+	/* Queued before the pagetables can be unlisted, see above */
+	if (evicted)
+		schedule_work(&kgsl_mmu_cache_work);
+	spin_unlock_irqrestore(&kgsl_driver.ptlock, flags);
+
+	return cached >> PAGE_SHIFT;
+}
+
+static struct shrinker kgsl_mmu_cache_shrinker = {
+	.shrink = kgsl_mmu_cache_shrink,
+	.seeks = DEFAULT_SEEKS,
+};
+
+/**
+ * kgsl_mmu_cache_add - Park the mapping of an imported buffer in the cache
+ * @pagetable: The pagetable the buffer is mapped in
+ * @memdesc: The mapping, copied into the cache on success
+ * @key: Identifies the underlying buffer on the next import
+ * @release: Called with @key once the cached mapping has been unmapped
+ *
+ * Buffers shared between processes are typically imported and freed over
+ * and over (once a frame for a buffer passed to the compositor). Rather than
+ * tear the mapping down, the caller can hand it to the cache along with its
+ * reference to the buffer; kgsl_mmu_cache_get() returns the same GPU address
+ * if the buffer is imported again, saving the page table update and TLB
+ * flush on both ends. Least recently used entries are evicted to stay under
+ * the mmu_cache_size limit, and by a shrinker when the system runs low on
+ * memory. The global pagetable is shared between
+ * processes and never caches anything.
+ *
+ * Return: 0 if the cache took ownership of the mapping, else the caller
+ * has to unmap and release it as usual.
+ */
+int kgsl_mmu_cache_add(struct kgsl_pagetable *pagetable,
+		       struct kgsl_memdesc *memdesc, void *key,
+		       void (*release)(void *key, struct kgsl_memdesc *memdesc))
+{
+	struct kgsl_mmu_cache_entry *entry;
+	LIST_HEAD(evict);
+
+	if (KGSL_MMU_TYPE_NONE == kgsl_mmu_type || pagetable == NULL ||
+		KGSL_MMU_GLOBAL_PT == pagetable->name ||
+		memdesc->gpuaddr == 0 || memdesc->size > kgsl_mmu_cache_size)
+		return -EINVAL;
+
+	entry = kzalloc(sizeof(*entry), GFP_KERNEL);
+	if (entry == NULL)
+		return -ENOMEM;
+
+	entry->key = key;
+	entry->pagetable = pagetable;
+	entry->memdesc = *memdesc;
+	entry->release = release;
+
+	spin_lock(&pagetable->lock);
+	list_add(&entry->node, &pagetable->cache_list);
+	pagetable->stats.cached += memdesc->size;
+	_cache_trim(pagetable, kgsl_mmu_cache_size, &evict);
+	spin_unlock(&pagetable->lock);
+
+	_cache_release(pagetable, &evict);
+
+	return 0;
+}
+EXPORT_SYMBOL(kgsl_mmu_cache_add);
+
+/**
+ * kgsl_mmu_cache_get - Take a cached mapping back out of the cache
+ * @pagetable: The pagetable the buffer is being imported into
+ * @key: The buffer that is being imported
+ * @memdesc: Filled in with the cached mapping on success
+ *
+ * On success the caller owns the mapping and the buffer reference that
+ * went into kgsl_mmu_cache_add(), exactly as if it had just mapped the
+ * buffer itself.
+ *
+ * Return: 0 on a hit, -ENOENT otherwise
+ */
+int kgsl_mmu_cache_get(struct kgsl_pagetable *pagetable, void *key,
+		       struct kgsl_memdesc *memdesc)
+{
+	struct kgsl_mmu_cache_entry *entry, *found = NULL;
+
+	if (KGSL_MMU_TYPE_NONE == kgsl_mmu_type || pagetable == NULL ||
+		KGSL_MMU_GLOBAL_PT == pagetable->name)
+		return -ENOENT;
+
+	spin_lock(&pagetable->lock);
+
+	list_for_each_entry(entry, &pagetable->cache_list, node) {
+		if (entry->key == key) {
+			found = entry;
+			break;
+		}
+	}
+
+	if (found) {
+		list_del(&found->node);
+		pagetable->stats.cached -= found->memdesc.size;
+		pagetable->stats.cache_hits++;
+	} else
+		pagetable->stats.cache_misses++;
+
+	spin_unlock(&pagetable->lock);
+
+	if (found == NULL)
+		return -ENOENT;
+
+	*memdesc = found->memdesc;
+	kfree(found);
+
+	return 0;
+}
+EXPORT_SYMBOL(kgsl_mmu_cache_get);
+
+void kgsl_mmu_cache_init(void)
+{
+	register_shrinker(&kgsl_mmu_cache_shrinker);
+}
+
+void kgsl_mmu_cache_exit(void)
+{
+	unregister_shrinker(&kgsl_mmu_cache_shrinker);
+	flush_work(&kgsl_mmu_cache_work);
+}
+
 int kgsl_mmu_map_global(struct kgsl_pagetable *pagetable,
 			struct kgsl_memdesc *memdesc, unsigned int protflags)
 {
@@ -110,10 +110,15 @@ struct kgsl_pagetable {
 		unsigned int mapped;
 		unsigned int max_mapped;
 		unsigned int max_entries;
+		unsigned int cached;
+		unsigned int cache_hits;
+		unsigned int cache_misses;
 	} stats;
 	const struct kgsl_mmu_pt_ops *pt_ops;
 	unsigned int tlb_flags;
 	void *priv;
+	/* Idle mappings of imported buffers, most recently used first */
+	struct list_head cache_list;
 };
 
 struct kgsl_mmu;
@@ -190,6 +195,14 @@ int kgsl_mmu_map_global(struct kgsl_pagetable *pagetable,
 			struct kgsl_memdesc *memdesc, unsigned int protflags);
 int kgsl_mmu_unmap(struct kgsl_pagetable *pagetable,
 		    struct kgsl_memdesc *memdesc);
+int kgsl_mmu_cache_add(struct kgsl_pagetable *pagetable,
+		       struct kgsl_memdesc *memdesc, void *key,
+		       void (*release)(void *key,
+				       struct kgsl_memdesc *memdesc));
+int kgsl_mmu_cache_get(struct kgsl_pagetable *pagetable, void *key,
+		       struct kgsl_memdesc *memdesc);
+void kgsl_mmu_cache_init(void);
+void kgsl_mmu_cache_exit(void);
 unsigned int kgsl_virtaddr_to_physaddr(void *virtaddr);
 void kgsl_setstate(struct kgsl_mmu *mmu, unsigned int context_id,
 			uint32_t flags);
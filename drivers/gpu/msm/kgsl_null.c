@@ -0,0 +1,743 @@
+/* Copyright (c) 2012, Code Aurora Forum. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 and
+ * only version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+/*
+ * A KGSL device without a GPU behind it. Submissions go through the same
+ * ioctl, context, memory lookup and MMU state paths as on z180, but are
+ * queued to a small software ring that a kernel thread retires by writing
+ * the memstore timestamps and raising the events an interrupt would. With
+ * the GPU out of the picture the cost of the driver itself can be measured.
+ */
+
+#include <linux/delay.h>
+#include <linux/kthread.h>
+#include <linux/module.h>
+#include <linux/uaccess.h>
+
+#include "kgsl.h"
+#include "kgsl_device.h"
+#include "kgsl_sharedmem.h"
+
+#define DRIVER_VERSION_MAJOR   3
+#define DRIVER_VERSION_MINOR   1
+
+#define DEVICE_NULL_NAME "kgsl-null"
+
+#define KGSL_NULL_DEVICE(device) \
+		KGSL_CONTAINER_OF(device, struct kgsl_null_device, dev)
+
+/* Covers the MH and MMU registers the core and GPUMMU code program */
+#define KGSL_NULL_REG_COUNT	0x0C00
+
+/* Submissions that can be outstanding before issueibcmds blocks */
+#define KGSL_NULL_RB_COUNT	64
+
+#define KGSL_NULL_INVALID_CONTEXT UINT_MAX
+
+struct kgsl_null_cmd {
+	unsigned int context_id;
+	unsigned int timestamp;
+	unsigned int global_timestamp;
+};
+
+struct kgsl_null_device {
+	struct kgsl_device dev;    /* Must be first field in this struct */
+	unsigned int regs[KGSL_NULL_REG_COUNT];
+	/* Last timestamp queued, per context and in KGSL_MEMSTORE_GLOBAL */
+	unsigned int timestamp[KGSL_MEMSTORE_MAX];
+	unsigned int prevctx;
+	spinlock_t lock;	/* protects ring, rptr and wptr */
+	struct kgsl_null_cmd ring[KGSL_NULL_RB_COUNT];
+	unsigned int rptr;
+	unsigned int wptr;
+	wait_queue_head_t retire_wq;	/* retire thread waits for work */
+	wait_queue_head_t idle_wq;	/* kgsl_null_idle() waits for it */
+	struct task_struct *retire_thread;
+};
+
+/* Time, in microseconds, each submission takes to "execute" */
+static unsigned int kgsl_null_retire_delay_us;
+module_param_named(retire_delay_us, kgsl_null_retire_delay_us, uint, 0644);
+
+static const struct kgsl_functable kgsl_null_functable;
+
+static struct kgsl_null_device device_null = {
+	.dev = {
+		KGSL_DEVICE_COMMON_INIT(device_null.dev),
+		.name = DEVICE_NULL_NAME,
+		.id = KGSL_DEVICE_NULL,
+		.mh = {
+			.mpu_base = 0x00000000,
+			.mpu_range =  0xFFFFF000,
+		},
+		/* no iomemname or irq_name, there is no hardware */
+		.ftbl = &kgsl_null_functable,
+	},
+	.prevctx = KGSL_NULL_INVALID_CONTEXT,
+	.lock = __SPIN_LOCK_UNLOCKED(device_null.lock),
+	.retire_wq = __WAIT_QUEUE_HEAD_INITIALIZER(device_null.retire_wq),
+	.idle_wq = __WAIT_QUEUE_HEAD_INITIALIZER(device_null.idle_wq),
+};
+
+static struct kgsl_device_platform_data kgsl_null_pdata = {
+	.pwrlevel = {
+		{
+			.gpu_freq = 0,
+			.bus_freq = 0,
+			.io_fraction = 100,
+		},
+	},
+	.init_level = 0,
+	.num_levels = 1,
+	.set_grp_async = NULL,
+	.idle_timeout = HZ/5,
+	.nap_allowed = true,
+	.clk_map = 0,
+};
+
+static struct platform_device *kgsl_null_pdev;
+
+static int kgsl_null_ring_empty(struct kgsl_null_device *null_dev)
+{
+	int empty;
+
+	spin_lock(&null_dev->lock);
+	empty = (null_dev->rptr == null_dev->wptr);
+	spin_unlock(&null_dev->lock);
+
+	return empty;
+}
+
+static int kgsl_null_room_in_ring(struct kgsl_null_device *null_dev)
+{
+	int room;
+
+	spin_lock(&null_dev->lock);
+	room = (null_dev->wptr - null_dev->rptr) < KGSL_NULL_RB_COUNT;
+	spin_unlock(&null_dev->lock);
+
+	return room;
+}
+
+/* Do what the interrupt handler of a real core does on a retired command */
+static void kgsl_null_retire_notify(struct kgsl_device *device)
+{
+	queue_work(device->work_queue, &device->ts_expired_ws);
+	wake_up_interruptible(&device->wait_queue);
+
+	atomic_notifier_call_chain(&(device->ts_notifier_list),
+				   device->id, NULL);
+
+	if ((device->pwrctrl.nap_allowed == true) &&
+		(device->requested_state == KGSL_STATE_NONE)) {
+		kgsl_pwrctrl_request_state(device, KGSL_STATE_NAP);
+		queue_work(device->work_queue, &device->idle_check_ws);
+	}
+	mod_timer_pending(&device->idle_timer,
+			jiffies + device->pwrctrl.interval_timeout);
+}
+
+static int kgsl_null_retire_thread(void *data)
+{
+	struct kgsl_device *device = data;
+	struct kgsl_null_device *null_dev = KGSL_NULL_DEVICE(device);
+	struct kgsl_null_cmd cmd;
+	unsigned int delay;
+
+	while (!kthread_should_stop()) {
+		wait_event_interruptible(null_dev->retire_wq,
+			!kgsl_null_ring_empty(null_dev) ||
+			kthread_should_stop());
+
+		spin_lock(&null_dev->lock);
+		if (null_dev->rptr == null_dev->wptr) {
+			spin_unlock(&null_dev->lock);
+			continue;
+		}
+		cmd = null_dev->ring[null_dev->rptr % KGSL_NULL_RB_COUNT];
+		spin_unlock(&null_dev->lock);
+
+		kgsl_sharedmem_writel(&device->memstore,
+			KGSL_MEMSTORE_OFFSET(cmd.context_id, soptimestamp),
+			cmd.timestamp);
+		kgsl_sharedmem_writel(&device->memstore,
+			KGSL_MEMSTORE_OFFSET(KGSL_MEMSTORE_GLOBAL,
+				soptimestamp),
+			cmd.global_timestamp);
+
+		delay = kgsl_null_retire_delay_us;
+		if (delay)
+			usleep_range(delay, delay);
+
+		kgsl_sharedmem_writel(&device->memstore,
+			KGSL_MEMSTORE_OFFSET(cmd.context_id, eoptimestamp),
+			cmd.timestamp);
+		kgsl_sharedmem_writel(&device->memstore,
+			KGSL_MEMSTORE_OFFSET(KGSL_MEMSTORE_GLOBAL,
+				eoptimestamp),
+			cmd.global_timestamp);
+
+		/* Timestamps must be visible before anyone is woken */
+		wmb();
+
+		spin_lock(&null_dev->lock);
+		null_dev->rptr++;
+		spin_unlock(&null_dev->lock);
+
+		wake_up(&null_dev->idle_wq);
+		kgsl_null_retire_notify(device);
+	}
+
+	return 0;
+}
+
+static irqreturn_t kgsl_null_irq_handler(struct kgsl_device *device)
+{
+	/* There is no interrupt line; see kgsl_null_retire_notify() */
+	return IRQ_NONE;
+}
+
+static void kgsl_null_cleanup_pt(struct kgsl_device *device,
+			       struct kgsl_pagetable *pagetable)
+{
+	kgsl_mmu_unmap(pagetable, &device->mmu.setstate_memory);
+
+	kgsl_mmu_unmap(pagetable, &device->memstore);
+}
+
+static int kgsl_null_setup_pt(struct kgsl_device *device,
+			     struct kgsl_pagetable *pagetable)
+{
+	int result = 0;
+
+	result = kgsl_mmu_map_global(pagetable, &device->mmu.setstate_memory,
+				     GSL_PT_PAGE_RV | GSL_PT_PAGE_WV);
+
+	if (result)
+		goto error;
+
+	result = kgsl_mmu_map_global(pagetable, &device->memstore,
+				     GSL_PT_PAGE_RV | GSL_PT_PAGE_WV);
+	if (result)
+		goto error_unmap_dummy;
+
+	return result;
+
+error_unmap_dummy:
+	kgsl_mmu_unmap(pagetable, &device->mmu.setstate_memory);
+
+error:
+	return result;
+}
+
+static unsigned int kgsl_null_isidle(struct kgsl_device *device)
+{
+	return kgsl_null_ring_empty(KGSL_NULL_DEVICE(device)) ? true : false;
+}
+
+static int kgsl_null_idle(struct kgsl_device *device, unsigned int timeout)
+{
+	struct kgsl_null_device *null_dev = KGSL_NULL_DEVICE(device);
+	long ret;
+
+	/* Not interruptible, callers rely on the ring being drained */
+	ret = wait_event_timeout(null_dev->idle_wq,
+				 kgsl_null_isidle(device),
+				 msecs_to_jiffies(timeout));
+	if (ret == 0) {
+		KGSL_DRV_ERR(device, "kgsl_null_idle() timed out\n");
+		return -ETIMEDOUT;
+	}
+
+	return 0;
+}
+
+static int
+kgsl_null_issueibcmds(struct kgsl_device_private *dev_priv,
+			struct kgsl_context *context,
+			struct kgsl_ibdesc *ibdesc,
+			unsigned int numibs,
+			uint32_t *timestamp,
+			unsigned int ctrl)
+{
+	long result = 0;
+	unsigned int i;
+	struct kgsl_device *device = dev_priv->device;
+	struct kgsl_pagetable *pagetable = dev_priv->process_priv->pagetable;
+	struct kgsl_null_device *null_dev = KGSL_NULL_DEVICE(device);
+	struct kgsl_mem_entry *entry;
+	struct kgsl_null_cmd *cmd;
+
+	if (device->state & KGSL_STATE_HUNG)
+		return -EINVAL;
+
+	/* Nothing reads the IBs, but they must still be valid allocations */
+	spin_lock(&dev_priv->process_priv->mem_lock);
+	for (i = 0; i < numibs; i++) {
+		entry = kgsl_sharedmem_find_region(dev_priv->process_priv,
+			ibdesc[i].gpuaddr,
+			ibdesc[i].sizedwords * sizeof(unsigned int));
+		if (entry == NULL) {
+			spin_unlock(&dev_priv->process_priv->mem_lock);
+			KGSL_DRV_ERR(device, "Bad ibdesc: gpuaddr 0x%x size %d\n",
+				     ibdesc[i].gpuaddr, ibdesc[i].sizedwords);
+			return -EINVAL;
+		}
+	}
+	spin_unlock(&dev_priv->process_priv->mem_lock);
+
+	KGSL_CMD_INFO(device, "ctxt %d numibs %d\n", context->id, numibs);
+
+	/* context switch */
+	if ((context->id != null_dev->prevctx) ||
+	    (ctrl & KGSL_CONTEXT_CTX_SWITCH)) {
+		kgsl_mmu_setstate(&device->mmu, pagetable,
+				KGSL_MEMSTORE_GLOBAL);
+		null_dev->prevctx = context->id;
+	}
+	kgsl_setstate(&device->mmu,
+			KGSL_MEMSTORE_GLOBAL,
+			kgsl_mmu_pt_get_flags(device->mmu.hwpagetable,
+			device->id));
+
+	result = wait_event_interruptible_timeout(device->wait_queue,
+				  kgsl_null_room_in_ring(null_dev),
+				  msecs_to_jiffies(KGSL_TIMEOUT_DEFAULT));
+	if (result <= 0) {
+		KGSL_CMD_ERR(device, "wait_event_interruptible_timeout "
+			"failed: %ld\n", result);
+		return result ? (int)result : -ETIMEDOUT;
+	}
+
+	/* Only issueibcmds, under device->mutex, writes the timestamps */
+	null_dev->timestamp[context->id]++;
+	null_dev->timestamp[KGSL_MEMSTORE_GLOBAL]++;
+	*timestamp = null_dev->timestamp[context->id];
+
+	spin_lock(&null_dev->lock);
+	cmd = &null_dev->ring[null_dev->wptr % KGSL_NULL_RB_COUNT];
+	cmd->context_id = context->id;
+	cmd->timestamp = null_dev->timestamp[context->id];
+	cmd->global_timestamp = null_dev->timestamp[KGSL_MEMSTORE_GLOBAL];
+	null_dev->wptr++;
+	spin_unlock(&null_dev->lock);
+
+	kgsl_pwrscale_busy(device);
+	wake_up(&null_dev->retire_wq);
+
+	return 0;
+}
+
+static int __devinit kgsl_null_probe(struct platform_device *pdev)
+{
+	int status;
+	struct kgsl_device *device = &device_null.dev;
+	struct task_struct *thread;
+
+	/* The IOMMU needs per-device context banks from the board file */
+	if (kgsl_mmu_get_mmutype() == KGSL_MMU_TYPE_IOMMU) {
+		dev_err(&pdev->dev, "not supported with the IOMMU\n");
+		return -ENODEV;
+	}
+
+	device->parentdev = &pdev->dev;
+
+	status = kgsl_device_platform_probe(device);
+	if (status)
+		goto error;
+
+	thread = kthread_run(kgsl_null_retire_thread, device,
+			     "kgsl-null-retire");
+	if (IS_ERR(thread)) {
+		status = PTR_ERR(thread);
+		goto error_remove;
+	}
+	device_null.retire_thread = thread;
+
+	kgsl_pwrscale_init(device);
+
+	return 0;
+
+error_remove:
+	kgsl_device_platform_remove(device);
+error:
+	device->parentdev = NULL;
+	return status;
+}
+
+static int __devexit kgsl_null_remove(struct platform_device *pdev)
+{
+	struct kgsl_device *device = &device_null.dev;
+
+	kgsl_pwrscale_close(device);
+
+	kthread_stop(device_null.retire_thread);
+	device_null.retire_thread = NULL;
+
+	kgsl_device_platform_remove(device);
+
+	return 0;
+}
+
+static int kgsl_null_start(struct kgsl_device *device, unsigned int init_ram)
+{
+	int status = 0;
+
+	kgsl_pwrctrl_set_state(device, KGSL_STATE_INIT);
+
+	kgsl_pwrctrl_enable(device);
+
+	kgsl_mh_start(device);
+
+	status = kgsl_mmu_start(device);
+	if (status)
+		goto error_clk_off;
+
+	mod_timer(&device->idle_timer, jiffies + FIRST_TIMEOUT);
+	kgsl_pwrctrl_irq(device, KGSL_PWRFLAGS_ON);
+	device->ftbl->irqctrl(device, 1);
+	return 0;
+
+error_clk_off:
+	kgsl_pwrctrl_disable(device);
+	return status;
+}
+
+static int kgsl_null_stop(struct kgsl_device *device)
+{
+	device->ftbl->irqctrl(device, 0);
+	kgsl_null_idle(device, KGSL_TIMEOUT_DEFAULT);
+
+	del_timer_sync(&device->idle_timer);
+
+	kgsl_mmu_stop(&device->mmu);
+
+	kgsl_pwrctrl_irq(device, KGSL_PWRFLAGS_OFF);
+
+	kgsl_pwrctrl_disable(device);
+
+	return 0;
+}
+
+static int kgsl_null_getproperty(struct kgsl_device *device,
+				enum kgsl_property_type type,
+				void *value,
+				unsigned int sizebytes)
+{
+	int status = -EINVAL;
+
+	switch (type) {
+	case KGSL_PROP_DEVICE_INFO:
+	{
+		struct kgsl_devinfo devinfo;
+
+		if (sizebytes != sizeof(devinfo)) {
+			status = -EINVAL;
+			break;
+		}
+
+		memset(&devinfo, 0, sizeof(devinfo));
+		devinfo.device_id = device->id+1;
+		devinfo.chip_id = 0;
+		devinfo.mmu_enabled = kgsl_mmu_enabled();
+
+		if (copy_to_user(value, &devinfo, sizeof(devinfo)) !=
+				0) {
+			status = -EFAULT;
+			break;
+		}
+		status = 0;
+	}
+	break;
+	case KGSL_PROP_DEVICE_SHADOW:
+	{
+		struct kgsl_shadowprop shadowprop;
+
+		if (sizebytes != sizeof(shadowprop)) {
+			status = -EINVAL;
+			break;
+		}
+		memset(&shadowprop, 0, sizeof(shadowprop));
+		if (device->memstore.hostptr) {
+			shadowprop.gpuaddr = device->memstore.physaddr;
+			shadowprop.size = device->memstore.size;
+			shadowprop.flags = KGSL_FLAGS_INITIALIZED |
+				KGSL_FLAGS_PER_CONTEXT_TIMESTAMPS;
+		}
+		if (copy_to_user(value, &shadowprop, sizeof(shadowprop))) {
+			status = -EFAULT;
+			break;
+		}
+		status = 0;
+	}
+	break;
+	case KGSL_PROP_MMU_ENABLE:
+	{
+		int mmu_prop = kgsl_mmu_enabled();
+		if (sizebytes != sizeof(int)) {
+			status = -EINVAL;
+			break;
+		}
+		if (copy_to_user(value, &mmu_prop, sizeof(mmu_prop))) {
+			status = -EFAULT;
+			break;
+		}
+		status = 0;
+	}
+	break;
+
+	default:
+		KGSL_DRV_ERR(device, "invalid property: %d\n", type);
+		status = -EINVAL;
+	}
+	return status;
+}
+
+static int kgsl_null_suspend_context(struct kgsl_device *device)
+{
+	struct kgsl_null_device *null_dev = KGSL_NULL_DEVICE(device);
+
+	null_dev->prevctx = KGSL_NULL_INVALID_CONTEXT;
+
+	return 0;
+}
+
+static void kgsl_null_regread(struct kgsl_device *device,
+				unsigned int offsetwords,
+				unsigned int *value)
+{
+	struct kgsl_null_device *null_dev = KGSL_NULL_DEVICE(device);
+
+	if (offsetwords >= KGSL_NULL_REG_COUNT) {
+		KGSL_DRV_ERR(device, "invalid offset %d\n", offsetwords);
+		*value = 0;
+		return;
+	}
+
+	*value = null_dev->regs[offsetwords];
+}
+
+static void kgsl_null_regwrite(struct kgsl_device *device,
+				unsigned int offsetwords,
+				unsigned int value)
+{
+	struct kgsl_null_device *null_dev = KGSL_NULL_DEVICE(device);
+
+	if (offsetwords >= KGSL_NULL_REG_COUNT) {
+		KGSL_DRV_ERR(device, "invalid offset %d\n", offsetwords);
+		return;
+	}
+
+	null_dev->regs[offsetwords] = value;
+}
+
+static unsigned int kgsl_null_readtimestamp(struct kgsl_device *device,
+		struct kgsl_context *context, enum kgsl_timestamp_type type)
+{
+	struct kgsl_null_device *null_dev = KGSL_NULL_DEVICE(device);
+	unsigned int context_id = KGSL_MEMSTORE_GLOBAL;
+	unsigned int timestamp = 0;
+
+	if (context != NULL) {
+		if (context->id == KGSL_CONTEXT_INVALID) {
+			KGSL_DRV_WARN(device, "context was detached");
+			return timestamp;
+		}
+		context_id = context->id;
+	}
+
+	switch (type) {
+	case KGSL_TIMESTAMP_QUEUED:
+		timestamp = null_dev->timestamp[context_id];
+		break;
+	case KGSL_TIMESTAMP_CONSUMED:
+		kgsl_sharedmem_readl(&device->memstore, &timestamp,
+			KGSL_MEMSTORE_OFFSET(context_id, soptimestamp));
+		break;
+	case KGSL_TIMESTAMP_RETIRED:
+		kgsl_sharedmem_readl(&device->memstore, &timestamp,
+			KGSL_MEMSTORE_OFFSET(context_id, eoptimestamp));
+		break;
+	}
+
+	rmb();
+
+	return timestamp;
+}
+
+static int kgsl_null_waittimestamp(struct kgsl_device *device,
+				struct kgsl_context *context,
+				unsigned int timestamp,
+				unsigned int msecs)
+{
+	int status;
+	long timeout;
+
+	/* Don't wait forever, set a max (10 sec) value for now */
+	if (msecs == -1)
+		msecs = 10 * MSEC_PER_SEC;
+
+	mutex_unlock(&device->mutex);
+	timeout = wait_io_event_interruptible_timeout(
+			device->wait_queue,
+			kgsl_check_timestamp(device, context, timestamp),
+			msecs_to_jiffies(msecs));
+	mutex_lock(&device->mutex);
+
+	/* A slow retire_delay_us is not a hang, so don't mark one */
+	if (timeout > 0)
+		status = 0;
+	else if (timeout == 0)
+		status = -ETIMEDOUT;
+	else
+		status = timeout;
+
+	return status;
+}
+
+static int
+kgsl_null_drawctxt_create(struct kgsl_device *device,
+			struct kgsl_pagetable *pagetable,
+			struct kgsl_context *context, uint32_t flags)
+{
+	struct kgsl_null_device *null_dev = KGSL_NULL_DEVICE(device);
+
+	/* The id may be reused, start its timestamps from scratch */
+	null_dev->timestamp[context->id] = 0;
+	kgsl_sharedmem_writel(&device->memstore,
+		KGSL_MEMSTORE_OFFSET(context->id, soptimestamp), 0);
+	kgsl_sharedmem_writel(&device->memstore,
+		KGSL_MEMSTORE_OFFSET(context->id, eoptimestamp), 0);
+	wmb();
+
+	return 0;
+}
+
+static void
+kgsl_null_drawctxt_destroy(struct kgsl_device *device,
+			  struct kgsl_context *context)
+{
+	struct kgsl_null_device *null_dev = KGSL_NULL_DEVICE(device);
+
+	kgsl_null_idle(device, KGSL_TIMEOUT_DEFAULT);
+
+	if (null_dev->prevctx == context->id) {
+		null_dev->prevctx = KGSL_NULL_INVALID_CONTEXT;
+		device->mmu.hwpagetable = device->mmu.defaultpagetable;
+		kgsl_setstate(&device->mmu, KGSL_MEMSTORE_GLOBAL,
+				KGSL_MMUFLAGS_PTUPDATE);
+	}
+}
+
+static void kgsl_null_power_stats(struct kgsl_device *device,
+			    struct kgsl_power_stats *stats)
+{
+	struct kgsl_pwrctrl *pwr = &device->pwrctrl;
+	s64 tmp = ktime_to_us(ktime_get());
+
+	if (pwr->time == 0) {
+		pwr->time = tmp;
+		stats->total_time = 0;
+		stats->busy_time = 0;
+	} else {
+		stats->total_time = tmp - pwr->time;
+		pwr->time = tmp;
+		stats->busy_time = tmp - device->on_time;
+		device->on_time = tmp;
+	}
+}
+
+static void kgsl_null_irqctrl(struct kgsl_device *device, int state)
+{
+	/* Nothing to mask, retirement is always reported */
+}
+
+static unsigned int kgsl_null_gpuid(struct kgsl_device *device,
+				    unsigned int *chipid)
+{
+	if (chipid != NULL)
+		*chipid = 0;
+
+	/* Neither 2D nor 3D, userspace must not load a real backend */
+	return 0;
+}
+
+static const struct kgsl_functable kgsl_null_functable = {
+	/* Mandatory functions */
+	.regread = kgsl_null_regread,
+	.regwrite = kgsl_null_regwrite,
+	.idle = kgsl_null_idle,
+	.isidle = kgsl_null_isidle,
+	.suspend_context = kgsl_null_suspend_context,
+	.start = kgsl_null_start,
+	.stop = kgsl_null_stop,
+	.getproperty = kgsl_null_getproperty,
+	.waittimestamp = kgsl_null_waittimestamp,
+	.readtimestamp = kgsl_null_readtimestamp,
+	.issueibcmds = kgsl_null_issueibcmds,
+	.setup_pt = kgsl_null_setup_pt,
+	.cleanup_pt = kgsl_null_cleanup_pt,
+	.power_stats = kgsl_null_power_stats,
+	.irqctrl = kgsl_null_irqctrl,
+	.gpuid = kgsl_null_gpuid,
+	.irq_handler = kgsl_null_irq_handler,
+	/* Optional functions */
+	.drawctxt_create = kgsl_null_drawctxt_create,
+	.drawctxt_destroy = kgsl_null_drawctxt_destroy,
+	.ioctl = NULL,
+};
+
+static struct platform_driver kgsl_null_platform_driver = {
+	.probe = kgsl_null_probe,
+	.remove = __devexit_p(kgsl_null_remove),
+	.suspend = kgsl_suspend_driver,
+	.resume = kgsl_resume_driver,
+	.driver = {
+		.owner = THIS_MODULE,
+		.name = DEVICE_NULL_NAME,
+		.pm = &kgsl_pm_ops,
+	}
+};
+
+static int __init kgsl_null_init(void)
+{
+	int ret;
+
+	ret = platform_driver_register(&kgsl_null_platform_driver);
+	if (ret)
+		return ret;
+
+	/* No board file describes this device, so provide it here */
+	kgsl_null_pdev = platform_device_register_data(NULL, DEVICE_NULL_NAME,
+				-1, &kgsl_null_pdata, sizeof(kgsl_null_pdata));
+	if (IS_ERR(kgsl_null_pdev)) {
+		platform_driver_unregister(&kgsl_null_platform_driver);
+		return PTR_ERR(kgsl_null_pdev);
+	}
+
+	return 0;
+}
+
+static void __exit kgsl_null_exit(void)
+{
+	platform_device_unregister(kgsl_null_pdev);
+	platform_driver_unregister(&kgsl_null_platform_driver);
+}
+
+module_init(kgsl_null_init);
+module_exit(kgsl_null_exit);
+
+MODULE_DESCRIPTION("Null graphics device for KGSL benchmarking");
+MODULE_VERSION("1.0");
+MODULE_LICENSE("GPL v2");
+MODULE_ALIAS("platform:kgsl-null");
@@ -0,0 +1,344 @@
+/* Copyright (c) 2012, Code Aurora Forum. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 and
+ * only version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+#include <linux/highmem.h>
+#include <linux/list.h>
+#include <linux/mm.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
+#include <asm/cacheflush.h>
+#include <asm/sizes.h>
+
+#include "kgsl_pool.h"
+
+/*
+ * GPU buffers are built out of the largest physically contiguous chunks the
+ * page allocator hands out without a fight. 1M and 64K chunks let the IOMMU
+ * use sections and large pages, single pages fill in whatever is left.
+ *
+ * Freed chunks are kept in a pool per order instead of going back to the
+ * page allocator. A worker zeroes and flushes them in the background, so
+ * most allocations get memory that can go to the GPU as is.
+ */
+
+/* Upper bound on the memory held by each pool */
+#define KGSL_POOL_MAX_SIZE	SZ_8M
+
+struct kgsl_page_pool {
+	unsigned int order;
+	spinlock_t lock;
+	/* Zeroed and flushed chunks, ready to be handed out */
+	struct list_head clean_list;
+	unsigned int clean_count;
+	/* Chunks waiting for the worker */
+	struct list_head dirty_list;
+	unsigned int dirty_count;
+};
+
+/* Largest order first, this is the order allocations try them in */
+static struct kgsl_page_pool kgsl_pools[] = {
+	{ .order = KGSL_POOL_ORDER_1M },
+	{ .order = KGSL_POOL_ORDER_64K },
+	{ .order = 0 },
+};
+
+static void kgsl_pool_zero_work(struct work_struct *work);
+static DECLARE_WORK(kgsl_pool_work, kgsl_pool_zero_work);
+
+static inline unsigned int _pool_max_chunks(struct kgsl_page_pool *pool)
+{
+	return KGSL_POOL_MAX_SIZE >> (PAGE_SHIFT + pool->order);
+}
+
+static struct kgsl_page_pool *_kgsl_get_pool(unsigned int order)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(kgsl_pools); i++) {
+		if (kgsl_pools[i].order == order)
+			return &kgsl_pools[i];
+	}
+
+	return NULL;
+}
+
+/* Take a chunk off the head of @list, which must not be empty */
+static struct page *_pool_remove(struct list_head *list, unsigned int *count)
+{
+	struct page *page = list_first_entry(list, struct page, lru);
+
+	list_del(&page->lru);
+	(*count)--;
+
+	return page;
+}
+
+static void _pool_zero_chunk(struct page *page, unsigned int order)
+{
+	int i;
+
+	for (i = 0; i < (1 << order); i++) {
+		void *ptr = kmap_atomic(nth_page(page, i), KM_USER0);
+
+		clear_page(ptr);
+		dmac_flush_range(ptr, ptr + PAGE_SIZE);
+		kunmap_atomic(ptr, KM_USER0);
+	}
+
+	outer_flush_range(page_to_phys(page),
+		page_to_phys(page) + (PAGE_SIZE << order));
+}
+
+static void _pool_release_chunk(struct page *page, unsigned int order)
+{
+	int i;
+
+	for (i = 0; i < (1 << order); i++)
+		__free_page(nth_page(page, i));
+}
+
+static struct page *_pool_get(struct kgsl_page_pool *pool, bool *zeroed)
+{
+	struct page *page = NULL;
+
+	spin_lock(&pool->lock);
+
+	if (pool->clean_count) {
+		page = _pool_remove(&pool->clean_list, &pool->clean_count);
+		*zeroed = true;
+	} else if (pool->dirty_count) {
+		page = _pool_remove(&pool->dirty_list, &pool->dirty_count);
+		*zeroed = false;
+	}
+
+	spin_unlock(&pool->lock);
+
+	return page;
+}
+
+static struct page *_pool_alloc_pages(unsigned int order)
+{
+	gfp_t gfp_mask = GFP_KERNEL | __GFP_HIGHMEM;
+	struct page *page;
+
+	/*
+	 * Large chunks are an optimization; don't thrash the system trying to
+	 * find one when a smaller order will do
+	 */
+	if (order)
+		gfp_mask |= __GFP_NOWARN | __GFP_NORETRY | __GFP_NO_KSWAPD;
+
+	page = alloc_pages(gfp_mask, order);
+	if (page == NULL)
+		return NULL;
+
+	/*
+	 * Split the chunk so every page carries its own reference count -
+	 * the pages are faulted into userspace one at a time
+	 */
+	if (order)
+		split_page(page, order);
+
+	return page;
+}
+
+/**
+ * kgsl_pool_alloc_chunk - Allocate a physically contiguous chunk of pages
+ * @size: The number of bytes still to be allocated
+ * @order: On entry the largest order to try, on success the order returned
+ *
+ * Return the largest chunk of at most *order that fits in @size, from the
+ * pools if possible, zeroed and flushed out of the caches. The pages of the
+ * chunk are split. Callers that build one buffer out of several chunks pass
+ * the order back in unchanged, so an order that failed once is not tried
+ * again and chunk offsets stay aligned to the chunk size.
+ */
+struct page *kgsl_pool_alloc_chunk(size_t size, unsigned int *order)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(kgsl_pools); i++) {
+		struct kgsl_page_pool *pool = &kgsl_pools[i];
+		struct page *page;
+		bool zeroed = false;
+
+		if (pool->order > *order || (PAGE_SIZE << pool->order) > size)
+			continue;
+
+		page = _pool_get(pool, &zeroed);
+
+		if (page == NULL)
+			page = _pool_alloc_pages(pool->order);
+
+		if (page != NULL) {
+			if (!zeroed)
+				_pool_zero_chunk(page, pool->order);
+
+			*order = pool->order;
+			return page;
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * kgsl_pool_free_chunk - Return a chunk allocated by kgsl_pool_alloc_chunk
+ * @page: The first page in the chunk
+ * @order: The order of the chunk
+ */
+void kgsl_pool_free_chunk(struct page *page, unsigned int order)
+{
+	struct kgsl_page_pool *pool = _kgsl_get_pool(order);
+	int i;
+
+	/* Pages somebody else still holds a reference to can't be recycled */
+	for (i = 0; pool != NULL && i < (1 << order); i++) {
+		if (page_count(nth_page(page, i)) != 1)
+			pool = NULL;
+	}
+
+	if (pool != NULL) {
+		spin_lock(&pool->lock);
+
+		if (pool->clean_count + pool->dirty_count <
+			_pool_max_chunks(pool)) {
+			list_add_tail(&page->lru, &pool->dirty_list);
+			pool->dirty_count++;
+			page = NULL;
+		}
+
+		spin_unlock(&pool->lock);
+	}
+
+	if (page == NULL)
+		schedule_work(&kgsl_pool_work);
+	else
+		_pool_release_chunk(page, order);
+}
+
+static void kgsl_pool_zero_work(struct work_struct *work)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(kgsl_pools); i++) {
+		struct kgsl_page_pool *pool = &kgsl_pools[i];
+		struct page *page;
+
+		while (1) {
+			spin_lock(&pool->lock);
+			if (pool->dirty_count == 0) {
+				spin_unlock(&pool->lock);
+				break;
+			}
+			page = _pool_remove(&pool->dirty_list,
+				&pool->dirty_count);
+			spin_unlock(&pool->lock);
+
+			_pool_zero_chunk(page, pool->order);
+
+			spin_lock(&pool->lock);
+			list_add_tail(&page->lru, &pool->clean_list);
+			pool->clean_count++;
+			spin_unlock(&pool->lock);
+
+			cond_resched();
+		}
+	}
+}
+
+/* Release up to @nr_pages pages from the pools, returns the number freed */
+static int _pool_shrink(int nr_pages)
+{
+	int i, freed = 0;
+
+	/* Give back the small chunks first, the big ones are harder to find */
+	for (i = ARRAY_SIZE(kgsl_pools) - 1; i >= 0; i--) {
+		struct kgsl_page_pool *pool = &kgsl_pools[i];
+		struct page *page;
+
+		while (freed < nr_pages) {
+			spin_lock(&pool->lock);
+			if (pool->dirty_count)
+				page = _pool_remove(&pool->dirty_list,
+					&pool->dirty_count);
+			else if (pool->clean_count)
+				page = _pool_remove(&pool->clean_list,
+					&pool->clean_count);
+			else
+				page = NULL;
+			spin_unlock(&pool->lock);
+
+			if (page == NULL)
+				break;
+
+			_pool_release_chunk(page, pool->order);
+			freed += 1 << pool->order;
+		}
+	}
+
+	return freed;
+}
+
+static unsigned int _pool_pages(void)
+{
+	unsigned int i, pages = 0;
+
+	for (i = 0; i < ARRAY_SIZE(kgsl_pools); i++)
+		pages += (kgsl_pools[i].clean_count +
+			kgsl_pools[i].dirty_count) << kgsl_pools[i].order;
+
+	return pages;
+}
+
+static int kgsl_pool_shrink(struct shrinker *shrinker,
+			    struct shrink_control *sc)
+{
+	if (sc->nr_to_scan)
+		_pool_shrink(sc->nr_to_scan);
+
+	return _pool_pages();
+}
+
+static struct shrinker kgsl_pool_shrinker = {
+	.shrink = kgsl_pool_shrink,
+	.seeks = DEFAULT_SEEKS,
+};
+
+/**
+ * kgsl_pool_size - Return the number of bytes held by the page pools
+ */
+unsigned int kgsl_pool_size(void)
+{
+	return _pool_pages() << PAGE_SHIFT;
+}
+
+void kgsl_init_page_pools(void)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(kgsl_pools); i++) {
+		spin_lock_init(&kgsl_pools[i].lock);
+		INIT_LIST_HEAD(&kgsl_pools[i].clean_list);
+		INIT_LIST_HEAD(&kgsl_pools[i].dirty_list);
+	}
+
+	register_shrinker(&kgsl_pool_shrinker);
+}
+
+void kgsl_exit_page_pools(void)
+{
+	unregister_shrinker(&kgsl_pool_shrinker);
+	cancel_work_sync(&kgsl_pool_work);
+
+	_pool_shrink(INT_MAX);
+}
@@ -0,0 +1,31 @@
+/* Copyright (c) 2012, Code Aurora Forum. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 and
+ * only version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+#ifndef __KGSL_POOL_H
+#define __KGSL_POOL_H
+
+#include <linux/mm_types.h>
+#include <linux/types.h>
+
+/* Chunk orders that map to IOMMU sections and large pages */
+#define KGSL_POOL_ORDER_1M	(20 - PAGE_SHIFT)
+#define KGSL_POOL_ORDER_64K	(16 - PAGE_SHIFT)
+
+struct page *kgsl_pool_alloc_chunk(size_t size, unsigned int *order);
+void kgsl_pool_free_chunk(struct page *page, unsigned int order);
+
+unsigned int kgsl_pool_size(void);
+
+void kgsl_init_page_pools(void);
+void kgsl_exit_page_pools(void);
+
+#endif /* __KGSL_POOL_H */
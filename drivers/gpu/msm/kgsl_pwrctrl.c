@@ -457,6 +457,10 @@ void kgsl_pwrctrl_irq(struct kgsl_device *device, int state)
 {
 	struct kgsl_pwrctrl *pwr = &device->pwrctrl;
 
+	/* Devices without an interrupt line retire commands in software */
+	if (pwr->interrupt_num <= 0)
+		return;
+
 	if (state == KGSL_PWRFLAGS_ON) {
 		if (!test_and_set_bit(KGSL_PWRFLAGS_IRQ_ON,
 			&pwr->power_flags)) {
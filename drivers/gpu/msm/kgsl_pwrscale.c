@@ -240,6 +240,7 @@ void kgsl_pwrscale_busy(struct kgsl_device *device)
 					&device->pwrscale);
 	device->pwrscale.gpu_busy = 1;
 }
+EXPORT_SYMBOL(kgsl_pwrscale_busy);
 
 void kgsl_pwrscale_idle(struct kgsl_device *device)
 {
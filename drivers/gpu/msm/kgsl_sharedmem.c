@@ -21,6 +21,7 @@
 #include "kgsl_sharedmem.h"
 #include "kgsl_cffdump.h"
 #include "kgsl_device.h"
+#include "kgsl_pool.h"
 
 /* An attribute for showing per-process memory statistics */
 struct kgsl_mem_entry_attribute {
@@ -223,6 +224,8 @@ static int kgsl_drv_memstat_show(struct device *dev,
 		val = kgsl_driver.stats.mapped;
 	else if (!strncmp(attr->attr.name, "mapped_max", 10))
 		val = kgsl_driver.stats.mapped_max;
+	else if (!strncmp(attr->attr.name, "page_pool", 9))
+		val = kgsl_pool_size();
 
 	return snprintf(buf, PAGE_SIZE, "%u\n", val);
 }
@@ -250,6 +253,7 @@ DEVICE_ATTR(coherent, 0444, kgsl_drv_memstat_show, NULL);
 DEVICE_ATTR(coherent_max, 0444, kgsl_drv_memstat_show, NULL);
 DEVICE_ATTR(mapped, 0444, kgsl_drv_memstat_show, NULL);
 DEVICE_ATTR(mapped_max, 0444, kgsl_drv_memstat_show, NULL);
+DEVICE_ATTR(page_pool, 0444, kgsl_drv_memstat_show, NULL);
 DEVICE_ATTR(histogram, 0444, kgsl_drv_histogram_show, NULL);
 
 static const struct device_attribute *drv_attr_list[] = {
@@ -261,6 +265,7 @@ static const struct device_attribute *drv_attr_list[] = {
 	&dev_attr_coherent_max,
 	&dev_attr_mapped,
 	&dev_attr_mapped_max,
+	&dev_attr_page_pool,
 	&dev_attr_histogram,
 	NULL
 };
@@ -317,12 +322,10 @@ static int kgsl_page_alloc_vmfault(struct kgsl_memdesc *memdesc,
 {
 	unsigned long offset;
 	struct page *page;
-	int i;
 
 	offset = (unsigned long) vmf->virtual_address - vma->vm_start;
 
-	i = offset >> PAGE_SHIFT;
-	page = sg_page(&memdesc->sg[i]);
+	page = kgsl_sg_page(memdesc->sg, memdesc->sglen, offset);
 	if (page == NULL)
 		return VM_FAULT_SIGBUS;
 
@@ -355,7 +358,8 @@ static void kgsl_page_alloc_free(struct kgsl_memdesc *memdesc)
 	}
 	if (memdesc->sg)
 		for_each_sg(memdesc->sg, sg, sglen, i)
-			__free_page(sg_page(sg));
+			kgsl_pool_free_chunk(sg_page(sg),
+				get_order(sg->length));
 }
 
 static int kgsl_contiguous_vmflags(struct kgsl_memdesc *memdesc)
@@ -378,22 +382,28 @@ static int kgsl_page_alloc_map_kernel(struct kgsl_memdesc *memdesc)
 		struct page **pages = NULL;
 		struct scatterlist *sg;
 		int sglen = memdesc->sglen;
-		int i;
+		int i, j, npages = 0;
 
 		/* Don't map the guard page if it exists */
 		if (memdesc->flags & KGSL_MEMDESC_GUARD_PAGE)
 			sglen--;
 
+		/* Each sg entry might be multiple pages long */
+		for_each_sg(memdesc->sg, sg, sglen, i)
+			npages += sg->length >> PAGE_SHIFT;
+
 		/* create a list of pages to call vmap */
-		pages = vmalloc(sglen * sizeof(struct page *));
+		pages = vmalloc(npages * sizeof(struct page *));
 		if (!pages) {
 			KGSL_CORE_ERR("vmalloc(%d) failed\n",
-				sglen * sizeof(struct page *));
+				npages * sizeof(struct page *));
 			return -ENOMEM;
 		}
+		npages = 0;
 		for_each_sg(memdesc->sg, sg, sglen, i)
-			pages[i] = sg_page(sg);
-		memdesc->hostptr = vmap(pages, sglen,
+			for (j = 0; j < sg->length >> PAGE_SHIFT; j++)
+				pages[npages++] = nth_page(sg_page(sg), j);
+		memdesc->hostptr = vmap(pages, npages,
 					VM_IOREMAP, page_prot);
 		KGSL_STATS_ADD(memdesc->size, kgsl_driver.stats.vmalloc,
 				kgsl_driver.stats.vmalloc_max);
@@ -489,10 +499,43 @@ _kgsl_sharedmem_page_alloc(struct kgsl_memdesc *memdesc,
 			size_t size, unsigned int protflags)
 {
 	int i, order, ret = 0;
-	int sglen = PAGE_ALIGN(size) / PAGE_SIZE;
-	struct page **pages = NULL;
-	pgprot_t page_prot = pgprot_writecombine(PAGE_KERNEL);
-	void *ptr;
+	int len = PAGE_ALIGN(size);
+	int sglen = 0;
+	unsigned int chunk_order = KGSL_POOL_ORDER_1M;
+	struct page *page, *tmp;
+	LIST_HEAD(chunks);
+
+	memdesc->size = size;
+	memdesc->pagetable = pagetable;
+	memdesc->priv = KGSL_MEMFLAGS_CACHED;
+	memdesc->ops = &kgsl_page_alloc_ops;
+
+	/*
+	 * Build the buffer out of the largest chunks available. The chunks
+	 * are chained through page->lru until we know how many there are,
+	 * with the order of each one stashed in page->private.
+	 */
+
+	while (len > 0) {
+		/*
+		 * All memory that goes to the user has to be zeroed out before
+		 * it gets exposed to userspace and the caches flushed for the
+		 * GPU. The pool hands out chunks in that state, most of them
+		 * zeroed in the background after an earlier free.
+		 */
+
+		page = kgsl_pool_alloc_chunk(len, &chunk_order);
+		if (page == NULL) {
+			ret = -ENOMEM;
+			goto err;
+		}
+
+		set_page_private(page, chunk_order);
+		list_add_tail(&page->lru, &chunks);
+		sglen++;
+
+		len -= PAGE_SIZE << chunk_order;
+	}
 
 	/*
 	 * Add guard page to the end of the allocation when the
@@ -502,34 +545,13 @@ _kgsl_sharedmem_page_alloc(struct kgsl_memdesc *memdesc,
 	if (kgsl_mmu_get_mmutype() == KGSL_MMU_TYPE_IOMMU)
 		sglen++;
 
-	memdesc->size = size;
-	memdesc->pagetable = pagetable;
-	memdesc->priv = KGSL_MEMFLAGS_CACHED;
-	memdesc->ops = &kgsl_page_alloc_ops;
-
 	memdesc->sg = kgsl_sg_alloc(sglen);
 
 	if (memdesc->sg == NULL) {
 		KGSL_CORE_ERR("vmalloc(%d) failed\n",
 			sglen * sizeof(struct scatterlist));
 		ret = -ENOMEM;
-		goto done;
-	}
-
-	/*
-	 * Allocate space to store the list of pages to send to vmap.
-	 * This is an array of pointers so we can track 1024 pages per page of
-	 * allocation which means we can handle up to a 8MB buffer request with
-	 * two pages; well within the acceptable limits for using kmalloc.
-	 */
-
-	pages = kmalloc(sglen * sizeof(struct page *), GFP_KERNEL);
-
-	if (pages == NULL) {
-		KGSL_CORE_ERR("kmalloc (%d) failed\n",
-			sglen * sizeof(struct page *));
-		ret = -ENOMEM;
-		goto done;
+		goto err;
 	}
 
 	kmemleak_not_leak(memdesc->sg);
@@ -537,21 +559,12 @@ _kgsl_sharedmem_page_alloc(struct kgsl_memdesc *memdesc,
 	memdesc->sglen = sglen;
 	sg_init_table(memdesc->sg, sglen);
 
-	for (i = 0; i < PAGE_ALIGN(size) / PAGE_SIZE; i++) {
-
-		/*
-		 * Don't use GFP_ZERO here because it is faster to memset the
-		 * range ourselves (see below)
-		 */
-
-		pages[i] = alloc_page(GFP_KERNEL | __GFP_HIGHMEM);
-		if (pages[i] == NULL) {
-			ret = -ENOMEM;
-			memdesc->sglen = i;
-			goto done;
-		}
-
-		sg_set_page(&memdesc->sg[i], pages[i], PAGE_SIZE, 0);
+	i = 0;
+	list_for_each_entry_safe(page, tmp, &chunks, lru) {
+		list_del(&page->lru);
+		sg_set_page(&memdesc->sg[i++], page,
+			PAGE_SIZE << page_private(page), 0);
+		set_page_private(page, 0);
 	}
 
 	/* ADd the guard page to the end of the sglist */
@@ -575,47 +588,6 @@ _kgsl_sharedmem_page_alloc(struct kgsl_memdesc *memdesc,
 			memdesc->sglen--;
 	}
 
-	/*
-	 * All memory that goes to the user has to be zeroed out before it gets
-	 * exposed to userspace. This means that the memory has to be mapped in
-	 * the kernel, zeroed (memset) and then unmapped.  This also means that
-	 * the dcache has to be flushed to ensure coherency between the kernel
-	 * and user pages. We used to pass __GFP_ZERO to alloc_page which mapped
-	 * zeroed and unmaped each individual page, and then we had to turn
-	 * around and call flush_dcache_page() on that page to clear the caches.
-	 * This was killing us for performance. Instead, we found it is much
-	 * faster to allocate the pages without GFP_ZERO, map the entire range,
-	 * memset it, flush the range and then unmap - this results in a factor
-	 * of 4 improvement for speed for large buffers.  There is a small
-	 * increase in speed for small buffers, but only on the order of a few
-	 * microseconds at best.  The only downside is that there needs to be
-	 * enough temporary space in vmalloc to accomodate the map. This
-	 * shouldn't be a problem, but if it happens, fall back to a much slower
-	 * path
-	 */
-
-	ptr = vmap(pages, i, VM_IOREMAP, page_prot);
-
-	if (ptr != NULL) {
-		memset(ptr, 0, memdesc->size);
-		dmac_flush_range(ptr, ptr + memdesc->size);
-		vunmap(ptr);
-	} else {
-		int j;
-
-		/* Very, very, very slow path */
-
-		for (j = 0; j < i; j++) {
-			ptr = kmap_atomic(pages[j]);
-			memset(ptr, 0, PAGE_SIZE);
-			dmac_flush_range(ptr, ptr + PAGE_SIZE);
-			kunmap_atomic(ptr);
-		}
-	}
-
-	outer_cache_range_op_sg(memdesc->sg, memdesc->sglen,
-				KGSL_CACHE_OP_FLUSH);
-
 	ret = kgsl_mmu_map(pagetable, memdesc, protflags);
 
 	if (ret)
@@ -630,12 +602,21 @@ _kgsl_sharedmem_page_alloc(struct kgsl_memdesc *memdesc,
 		kgsl_driver.stats.histogram[order]++;
 
 done:
-	kfree(pages);
-
 	if (ret)
 		kgsl_sharedmem_free(memdesc);
 
 	return ret;
+
+err:
+	list_for_each_entry_safe(page, tmp, &chunks, lru) {
+		list_del(&page->lru);
+		order = page_private(page);
+		set_page_private(page, 0);
+		kgsl_pool_free_chunk(page, order);
+	}
+
+	memset(memdesc, 0, sizeof(*memdesc));
+	return ret;
 }
 
 int
@@ -869,16 +850,25 @@ kgsl_sharedmem_map_vma(struct vm_area_struct *vma,
 {
 	unsigned long addr = vma->vm_start;
 	unsigned long size = vma->vm_end - vma->vm_start;
-	int ret, i = 0;
+	struct scatterlist *sg;
+	int sglen = memdesc->sglen;
+	int ret, i, j;
+
+	/* Don't map the guard page if it exists */
+	if (memdesc->flags & KGSL_MEMDESC_GUARD_PAGE)
+		sglen--;
 
 	if (!memdesc->sg || (size != memdesc->size) ||
-		(memdesc->sglen != (size / PAGE_SIZE)))
+		(kgsl_sg_size(memdesc->sg, sglen) != size))
 		return -EINVAL;
 
-	for (; addr < vma->vm_end; addr += PAGE_SIZE, i++) {
-		ret = vm_insert_page(vma, addr, sg_page(&memdesc->sg[i]));
-		if (ret)
-			return ret;
+	for_each_sg(memdesc->sg, sg, sglen, i) {
+		for (j = 0; j < sg->length >> PAGE_SHIFT; j++) {
+			ret = vm_insert_page(vma, addr, nth_page(sg_page(sg), j));
+			if (ret)
+				return ret;
+			addr += PAGE_SIZE;
+		}
 	}
 	return 0;
 }
@@ -168,4 +168,23 @@ static inline int kgsl_sg_size(struct scatterlist *sg, int sglen)
 
 	return size;
 }
+
+/*
+ * Return the page at @offset bytes into a page backed sglist. Entries
+ * might be multiple pages long so the list has to be walked.
+ */
+static inline struct page *
+kgsl_sg_page(struct scatterlist *sg, int sglen, unsigned int offset)
+{
+	int i;
+	struct scatterlist *s;
+
+	for_each_sg(sg, s, sglen, i) {
+		if (offset < s->length)
+			return nth_page(sg_page(s), offset >> PAGE_SHIFT);
+		offset -= s->length;
+	}
+
+	return NULL;
+}
 #endif /* __KGSL_SHAREDMEM_H */
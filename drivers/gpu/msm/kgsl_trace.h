@@ -462,6 +462,38 @@ TRACE_EVENT(kgsl_context_detach,
 	)
 );
 
+/*
+ * Tracepoint for an ioctl run under the device mutex, with the time
+ * spent waiting for the mutex and the time it was held
+ */
+TRACE_EVENT(kgsl_ioctl_lock,
+
+	TP_PROTO(struct kgsl_device *device, unsigned int nr,
+		 s64 wait_us, s64 hold_us),
+
+	TP_ARGS(device, nr, wait_us, hold_us),
+
+	TP_STRUCT__entry(
+		__string(device_name, device->name)
+		__field(unsigned int, nr)
+		__field(s64, wait_us)
+		__field(s64, hold_us)
+	),
+
+	TP_fast_assign(
+		__assign_str(device_name, device->name);
+		__entry->nr = nr;
+		__entry->wait_us = wait_us;
+		__entry->hold_us = hold_us;
+	),
+
+	TP_printk(
+		"d_name=%s ioctl=0x%x wait=%lldus hold=%lldus",
+		__get_str(device_name), __entry->nr,
+		__entry->wait_us, __entry->hold_us
+	)
+);
+
 TRACE_EVENT(kgsl_mmu_pagefault,
 
 	TP_PROTO(struct kgsl_device *device, unsigned int page,
@@ -37,7 +37,7 @@
 
 #include "binder.h"
 
-static DEFINE_MUTEX(binder_lock);
+static DEFINE_MUTEX(binder_main_lock);
 static DEFINE_MUTEX(binder_deferred_lock);
 
 static HLIST_HEAD(binder_procs);
@@ -106,6 +106,11 @@ module_param_named(debug_mask, binder_debug_mask, uint, S_IWUSR | S_IRUGO);
 static int binder_debug_no_lock;
 module_param_named(proc_no_lock, binder_debug_no_lock, bool, S_IWUSR | S_IRUGO);
 
+/* Number of freed buffer pages each process keeps mapped for reuse */
+static int binder_page_cache_max = 32;
+module_param_named(page_cache_max, binder_page_cache_max, int,
+		   S_IWUSR | S_IRUGO);
+
 static DECLARE_WAIT_QUEUE_HEAD(binder_user_error_wait);
 static int binder_stop_on_user_error;
 
@@ -148,13 +153,59 @@ enum binder_stat_types {
 
 struct binder_stats {
 	int br[_IOC_NR(BR_FAILED_REPLY) + 1];
-	int bc[_IOC_NR(BC_DEAD_BINDER_DONE) + 1];
+	int bc[_IOC_NR(BC_REPLY_SG) + 1];
 	int obj_created[BINDER_STAT_COUNT];
 	int obj_deleted[BINDER_STAT_COUNT];
 };
 
 static struct binder_stats binder_stats;
 
+/*
+ * Contention counters for binder_main_lock. They are only updated with the
+ * lock held, so no additional synchronization is needed.
+ */
+struct binder_lock_stats {
+	unsigned long acquired;
+	unsigned long contended;
+	u64 wait_ns;
+	u64 max_wait_ns;
+};
+
+static struct binder_lock_stats binder_lock_stats;
+
+struct binder_page_cache_stats {
+	atomic_t cached;
+	atomic_t hits;
+	atomic_t misses;
+	atomic_t reclaimed;
+};
+
+static struct binder_page_cache_stats binder_page_cache_stats;
+
+static inline void binder_lock(void)
+{
+	ktime_t start;
+	u64 wait_ns;
+
+	if (mutex_trylock(&binder_main_lock)) {
+		binder_lock_stats.acquired++;
+		return;
+	}
+	start = ktime_get();
+	mutex_lock(&binder_main_lock);
+	wait_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	binder_lock_stats.acquired++;
+	binder_lock_stats.contended++;
+	binder_lock_stats.wait_ns += wait_ns;
+	if (wait_ns > binder_lock_stats.max_wait_ns)
+		binder_lock_stats.max_wait_ns = wait_ns;
+}
+
+static inline void binder_unlock(void)
+{
+	mutex_unlock(&binder_main_lock);
+}
+
 static inline void binder_stats_deleted(enum binder_stat_types type)
 {
 	binder_stats.obj_deleted[type]++;
@@ -231,10 +282,22 @@ struct binder_node {
 	unsigned pending_weak_ref:1;
 	unsigned has_async_transaction:1;
 	unsigned accept_fds:1;
+	unsigned sched_policy:2;
+	unsigned inherit_rt:1;
 	unsigned min_priority:8;
 	struct list_head async_todo;
 };
 
+/*
+ * A page of a process' buffer area. Pages that are no longer used by any
+ * buffer stay mapped and are kept on the owning proc's lru list so that
+ * the next buffer covering them can skip alloc_page() and the PTE setup.
+ */
+struct binder_lru_page {
+	struct list_head lru;
+	struct page *page_ptr;
+};
+
 struct binder_ref_death {
 	struct binder_work work;
 	void __user *cookie;
@@ -280,6 +343,19 @@ enum binder_deferred_state {
 	BINDER_DEFERRED_RELEASE      = 0x04,
 };
 
+/*
+ * log2 histograms of transaction latency in microseconds; bucket n counts
+ * latencies below 2^n us, the last bucket collects everything larger.
+ * queue is the time an incoming transaction waited before a thread picked
+ * it up, handle the time from then until the reply was sent.
+ */
+#define BINDER_LATENCY_BUCKETS 24
+
+struct binder_latency_hist {
+	u32 queue[BINDER_LATENCY_BUCKETS];
+	u32 handle[BINDER_LATENCY_BUCKETS];
+};
+
 struct binder_proc {
 	struct hlist_node proc_node;
 	struct rb_root threads;
@@ -292,20 +368,38 @@ struct binder_proc {
 	struct files_struct *files;
 	struct hlist_node deferred_work_node;
 	int deferred_work;
+	/*
+	 * Transactions that dropped binder_main_lock while filling a buffer
+	 * in this proc. The release is held back until they are done.
+	 */
+	int tmp_ref;
+	int release_pending;
 	void *buffer;
 	ptrdiff_t user_buffer_offset;
 
+	/*
+	 * alloc_lock protects the buffer allocator state below (buffers,
+	 * free_buffers, allocated_buffers, free_async_space, pages and the
+	 * cached page lru).
+	 * It nests inside binder_main_lock and outside mm->mmap_sem, and is
+	 * also taken without binder_main_lock by binder_transaction while it
+	 * allocates and fills the target buffer.
+	 */
+	struct mutex alloc_lock;
 	struct list_head buffers;
 	struct rb_root free_buffers;
 	struct rb_root allocated_buffers;
 	size_t free_async_space;
 
-	struct page **pages;
+	struct binder_lru_page *pages;
+	struct list_head lru;
+	int lru_count;
 	size_t buffer_size;
 	uint32_t buffer_free;
 	struct list_head todo;
 	wait_queue_head_t wait;
 	struct binder_stats stats;
+	struct binder_latency_hist latency;
 	struct list_head delivered_death;
 	int max_threads;
 	int requested_threads;
@@ -339,6 +433,16 @@ struct binder_thread {
 	struct binder_stats stats;
 };
 
+/*
+ * Scheduling state inherited from a caller. rt_prio is used with
+ * SCHED_FIFO and SCHED_RR, nice with the other policies.
+ */
+struct binder_priority {
+	int sched_policy;
+	int rt_prio;
+	long nice;
+};
+
 struct binder_transaction {
 	int debug_id;
 	struct binder_work work;
@@ -353,11 +457,25 @@ struct binder_transaction {
 	struct binder_buffer *buffer;
 	unsigned int	code;
 	unsigned int	flags;
-	long	priority;
-	long	saved_priority;
+	struct binder_priority	priority;
+	struct binder_priority	saved_priority;
 	uid_t	sender_euid;
+	ktime_t	queued;
+	ktime_t	received;
 };
 
+#define CREATE_TRACE_POINTS
+#include "binder_trace.h"
+
+static void binder_latency_add(u32 *hist, s64 us)
+{
+	int bucket = 0;
+
+	if (us > 0)
+		bucket = min(ilog2(us) + 1, BINDER_LATENCY_BUCKETS - 1);
+	hist[bucket]++;
+}
+
 static void
 binder_defer_work(struct binder_proc *proc, enum binder_deferred_state defer);
 
@@ -516,6 +634,143 @@ static void binder_set_nice(long nice)
 	binder_user_error("binder: %d RLIMIT_NICE not set\n", current->pid);
 }
 
+static inline int binder_is_rt_policy(int policy)
+{
+	return policy == SCHED_FIFO || policy == SCHED_RR;
+}
+
+static struct binder_priority binder_get_priority(struct task_struct *task)
+{
+	struct binder_priority p;
+
+	p.sched_policy = task->policy;
+	p.rt_prio = task->rt_priority;
+	p.nice = task_nice(task);
+	return p;
+}
+
+static void binder_set_priority(struct binder_priority desired)
+{
+	struct sched_param param;
+	int policy = current->policy;
+
+	if (binder_is_rt_policy(desired.sched_policy)) {
+		if (policy == desired.sched_policy &&
+		    current->rt_priority == desired.rt_prio)
+			return;
+		trace_binder_set_priority(current->tgid, current->pid,
+					  policy, binder_is_rt_policy(policy) ?
+					  current->rt_priority :
+					  task_nice(current),
+					  desired.sched_policy,
+					  desired.rt_prio);
+		param.sched_priority = desired.rt_prio;
+		if (sched_setscheduler_nocheck(current, desired.sched_policy,
+					       &param))
+			binder_debug(BINDER_DEBUG_PRIORITY_CAP,
+				     "binder: %d: failed to set policy %d "
+				     "priority %d\n", current->pid,
+				     desired.sched_policy, desired.rt_prio);
+		return;
+	}
+
+	if (policy == desired.sched_policy &&
+	    task_nice(current) == desired.nice)
+		return;
+	trace_binder_set_priority(current->tgid, current->pid, policy,
+				  binder_is_rt_policy(policy) ?
+				  current->rt_priority : task_nice(current),
+				  desired.sched_policy, desired.nice);
+	if (policy != desired.sched_policy) {
+		param.sched_priority = 0;
+		if (sched_setscheduler_nocheck(current, desired.sched_policy,
+					       &param)) {
+			binder_debug(BINDER_DEBUG_PRIORITY_CAP,
+				     "binder: %d: failed to set policy %d\n",
+				     current->pid, desired.sched_policy);
+			return;
+		}
+	}
+	binder_set_nice(desired.nice);
+}
+
+/*
+ * Only let a node ask for an RT minimum priority, or for RT callers to keep
+ * their policy on it, if its owner could have made itself RT. The flags are
+ * checked once, when the owner first sends the node.
+ */
+static int binder_check_node_sched(struct binder_proc *proc,
+				   struct binder_thread *thread,
+				   unsigned long flags)
+{
+	int policy = (flags & FLAT_BINDER_FLAG_SCHED_POLICY_MASK) >>
+		FLAT_BINDER_FLAG_SCHED_POLICY_SHIFT;
+	int prio = flags & FLAT_BINDER_FLAG_PRIORITY_MASK;
+
+	if (!binder_is_rt_policy(policy) &&
+	    !(flags & FLAT_BINDER_FLAG_INHERIT_RT))
+		return 0;
+
+	if (binder_is_rt_policy(policy) &&
+	    (prio < 1 || prio > MAX_USER_RT_PRIO - 1)) {
+		binder_user_error("binder: %d:%d node with policy %d has "
+			"invalid RT priority %d\n", proc->pid, thread->pid,
+			policy, prio);
+		return -EINVAL;
+	}
+	if (!capable(CAP_SYS_NICE)) {
+		binder_user_error("binder: %d:%d node asks for RT scheduling "
+			"without CAP_SYS_NICE\n", proc->pid, thread->pid);
+		return -EPERM;
+	}
+	return 0;
+}
+
+/*
+ * Pick the priority a handler thread runs a transaction at: the caller's
+ * priority, raised to the node's minimum. RT callers only pass on their
+ * policy to nodes that asked for it with FLAT_BINDER_FLAG_INHERIT_RT,
+ * otherwise they are mapped to the highest nice value.
+ */
+static void binder_transaction_priority(struct binder_transaction *t,
+					struct binder_node *node)
+{
+	struct binder_priority desired = t->priority;
+
+	if (t->flags & TF_ONE_WAY) {
+		if (t->saved_priority.nice > node->min_priority &&
+		    !binder_is_rt_policy(node->sched_policy))
+			binder_set_nice(node->min_priority);
+		return;
+	}
+
+	if (binder_is_rt_policy(desired.sched_policy) && !node->inherit_rt) {
+		desired.sched_policy = SCHED_NORMAL;
+		desired.nice = -20;
+	}
+
+	if (binder_is_rt_policy(node->sched_policy)) {
+		if (!binder_is_rt_policy(desired.sched_policy) ||
+		    desired.rt_prio < node->min_priority) {
+			desired.sched_policy = node->sched_policy;
+			desired.rt_prio = node->min_priority;
+		}
+	} else if (!binder_is_rt_policy(desired.sched_policy) &&
+		   desired.nice > node->min_priority) {
+		desired.nice = node->min_priority;
+	}
+
+	/* Never lower a thread the service itself made RT */
+	if (binder_is_rt_policy(current->policy) &&
+	    (!binder_is_rt_policy(desired.sched_policy) ||
+	     desired.rt_prio <= current->rt_priority)) {
+		binder_set_nice(desired.nice);
+		return;
+	}
+
+	binder_set_priority(desired);
+}
+
 static size_t binder_buffer_size(struct binder_proc *proc,
 				 struct binder_buffer *buffer)
 {
@@ -587,13 +842,15 @@ static void binder_insert_allocated_buffer(struct binder_proc *proc,
 static struct binder_buffer *binder_buffer_lookup(struct binder_proc *proc,
 						  void __user *user_ptr)
 {
-	struct rb_node *n = proc->allocated_buffers.rb_node;
+	struct rb_node *n;
 	struct binder_buffer *buffer;
 	struct binder_buffer *kern_ptr;
 
 	kern_ptr = user_ptr - proc->user_buffer_offset
 		- offsetof(struct binder_buffer, data);
 
+	mutex_lock(&proc->alloc_lock);
+	n = proc->allocated_buffers.rb_node;
 	while (n) {
 		buffer = rb_entry(n, struct binder_buffer, rb_node);
 		BUG_ON(buffer->free);
@@ -602,12 +859,98 @@ static struct binder_buffer *binder_buffer_lookup(struct binder_proc *proc,
 			n = n->rb_left;
 		else if (kern_ptr > buffer)
 			n = n->rb_right;
-		else
+		else {
+			mutex_unlock(&proc->alloc_lock);
 			return buffer;
+		}
 	}
+	mutex_unlock(&proc->alloc_lock);
 	return NULL;
 }
 
+static void binder_free_lru_page(struct binder_proc *proc,
+				 struct binder_lru_page *page,
+				 struct vm_area_struct *vma)
+{
+	void *page_addr = proc->buffer + (page - proc->pages) * PAGE_SIZE;
+
+	list_del_init(&page->lru);
+	proc->lru_count--;
+	atomic_dec(&binder_page_cache_stats.cached);
+	if (vma)
+		zap_page_range(vma, (uintptr_t)page_addr +
+			proc->user_buffer_offset, PAGE_SIZE, NULL);
+	unmap_kernel_range((unsigned long)page_addr, PAGE_SIZE);
+	__free_page(page->page_ptr);
+	page->page_ptr = NULL;
+}
+
+/*
+ * Release up to nr of the least recently cached pages of proc. When
+ * nonblock is set the caller may be in reclaim, so give up instead of
+ * sleeping on mmap_sem.
+ */
+static int binder_trim_page_cache(struct binder_proc *proc, int nr,
+				  int nonblock)
+{
+	struct mm_struct *mm;
+	struct vm_area_struct *vma = NULL;
+	struct binder_lru_page *page;
+	int freed = 0;
+
+	if (list_empty(&proc->lru))
+		return 0;
+
+	mm = get_task_mm(proc->tsk);
+	if (mm) {
+		if (nonblock) {
+			if (!down_write_trylock(&mm->mmap_sem)) {
+				mmput(mm);
+				return 0;
+			}
+		} else
+			down_write(&mm->mmap_sem);
+		vma = proc->vma;
+	}
+
+	while (freed < nr && !list_empty(&proc->lru)) {
+		page = list_first_entry(&proc->lru, struct binder_lru_page,
+					lru);
+		binder_free_lru_page(proc, page, vma);
+		freed++;
+	}
+
+	if (mm) {
+		up_write(&mm->mmap_sem);
+		mmput(mm);
+	}
+
+	binder_debug(BINDER_DEBUG_BUFFER_ALLOC,
+		     "binder: %d: released %d cached pages\n",
+		     proc->pid, freed);
+	return freed;
+}
+
+static void binder_cache_page_range(struct binder_proc *proc,
+				    void *start, void *end)
+{
+	void *page_addr;
+	struct binder_lru_page *page;
+
+	for (page_addr = start; page_addr < end; page_addr += PAGE_SIZE) {
+		page = &proc->pages[(page_addr - proc->buffer) / PAGE_SIZE];
+		BUG_ON(!page->page_ptr);
+		BUG_ON(!list_empty(&page->lru));
+		list_add_tail(&page->lru, &proc->lru);
+		proc->lru_count++;
+		atomic_inc(&binder_page_cache_stats.cached);
+	}
+
+	if (proc->lru_count > binder_page_cache_max)
+		binder_trim_page_cache(proc,
+			proc->lru_count - max(binder_page_cache_max, 0), 0);
+}
+
 static int binder_update_page_range(struct binder_proc *proc, int allocate,
 				    void *start, void *end,
 				    struct vm_area_struct *vma)
@@ -615,7 +958,7 @@ static int binder_update_page_range(struct binder_proc *proc, int allocate,
 	void *page_addr;
 	unsigned long user_page_addr;
 	struct vm_struct tmp_area;
-	struct page **page;
+	struct binder_lru_page *page;
 	struct mm_struct *mm;
 
 	binder_debug(BINDER_DEBUG_BUFFER_ALLOC,
@@ -625,6 +968,31 @@ static int binder_update_page_range(struct binder_proc *proc, int allocate,
 	if (end <= start)
 		return 0;
 
+	if (allocate == 0) {
+		binder_cache_page_range(proc, start, end);
+		return 0;
+	}
+
+	/* Fast path: every page is still mapped from an earlier buffer */
+	for (page_addr = start; page_addr < end; page_addr += PAGE_SIZE) {
+		page = &proc->pages[(page_addr - proc->buffer) / PAGE_SIZE];
+		if (!page->page_ptr)
+			break;
+	}
+	if (page_addr >= end) {
+		for (page_addr = start; page_addr < end;
+		     page_addr += PAGE_SIZE) {
+			page = &proc->pages[(page_addr - proc->buffer) /
+					    PAGE_SIZE];
+			BUG_ON(list_empty(&page->lru));
+			list_del_init(&page->lru);
+			proc->lru_count--;
+			atomic_dec(&binder_page_cache_stats.cached);
+			atomic_inc(&binder_page_cache_stats.hits);
+		}
+		return 0;
+	}
+
 	if (vma)
 		mm = NULL;
 	else
@@ -635,9 +1003,6 @@ static int binder_update_page_range(struct binder_proc *proc, int allocate,
 		vma = proc->vma;
 	}
 
-	if (allocate == 0)
-		goto free_range;
-
 	if (vma == NULL) {
 		binder_debug(BINDER_DEBUG_TOP_ERRORS,
 		       "binder: %d: binder_alloc_buf failed to "
@@ -650,9 +1015,17 @@ static int binder_update_page_range(struct binder_proc *proc, int allocate,
 		struct page **page_array_ptr;
 		page = &proc->pages[(page_addr - proc->buffer) / PAGE_SIZE];
 
-		BUG_ON(*page);
-		*page = alloc_page(GFP_KERNEL | __GFP_ZERO);
-		if (*page == NULL) {
+		if (page->page_ptr) {
+			BUG_ON(list_empty(&page->lru));
+			list_del_init(&page->lru);
+			proc->lru_count--;
+			atomic_dec(&binder_page_cache_stats.cached);
+			atomic_inc(&binder_page_cache_stats.hits);
+			continue;
+		}
+		atomic_inc(&binder_page_cache_stats.misses);
+		page->page_ptr = alloc_page(GFP_KERNEL | __GFP_ZERO);
+		if (page->page_ptr == NULL) {
 			binder_debug(BINDER_DEBUG_TOP_ERRORS,
 			       "binder: %d: binder_alloc_buf failed "
 			       "for page at %p\n", proc->pid, page_addr);
@@ -660,7 +1033,7 @@ static int binder_update_page_range(struct binder_proc *proc, int allocate,
 		}
 		tmp_area.addr = page_addr;
 		tmp_area.size = PAGE_SIZE + PAGE_SIZE /* guard page? */;
-		page_array_ptr = page;
+		page_array_ptr = &page->page_ptr;
 		ret = map_vm_area(&tmp_area, PAGE_KERNEL, &page_array_ptr);
 		if (ret) {
 			binder_debug(BINDER_DEBUG_TOP_ERRORS,
@@ -671,7 +1044,7 @@ static int binder_update_page_range(struct binder_proc *proc, int allocate,
 		}
 		user_page_addr =
 			(uintptr_t)page_addr + proc->user_buffer_offset;
-		ret = vm_insert_page(vma, user_page_addr, page[0]);
+		ret = vm_insert_page(vma, user_page_addr, page->page_ptr);
 		if (ret) {
 			binder_debug(BINDER_DEBUG_TOP_ERRORS,
 			       "binder: %d: binder_alloc_buf failed "
@@ -687,7 +1060,6 @@ static int binder_update_page_range(struct binder_proc *proc, int allocate,
 	}
 	return 0;
 
-free_range:
 	for (page_addr = end - PAGE_SIZE; page_addr >= start;
 	     page_addr -= PAGE_SIZE) {
 		page = &proc->pages[(page_addr - proc->buffer) / PAGE_SIZE];
@@ -697,8 +1069,8 @@ free_range:
 err_vm_insert_page_failed:
 		unmap_kernel_range((unsigned long)page_addr, PAGE_SIZE);
 err_map_kernel_failed:
-		__free_page(*page);
-		*page = NULL;
+		__free_page(page->page_ptr);
+		page->page_ptr = NULL;
 err_alloc_page_failed:
 		;
 	}
@@ -710,9 +1082,10 @@ err_no_vma:
 	return -ENOMEM;
 }
 
-static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
-					      size_t data_size,
-					      size_t offsets_size, int is_async)
+static struct binder_buffer *__binder_alloc_buf(struct binder_proc *proc,
+						size_t data_size,
+						size_t offsets_size,
+						int is_async)
 {
 	struct rb_node *n = proc->free_buffers.rb_node;
 	struct binder_buffer *buffer;
@@ -807,6 +1180,13 @@ static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
 	buffer->data_size = data_size;
 	buffer->offsets_size = offsets_size;
 	buffer->async_transaction = is_async;
+	/*
+	 * The buffer is filled without binder_main_lock, keep BC_FREE_BUFFER
+	 * away from it until the transaction is delivered
+	 */
+	buffer->allow_user_free = 0;
+	buffer->transaction = NULL;
+	buffer->target_node = NULL;
 	if (is_async) {
 		proc->free_async_space -= size + sizeof(struct binder_buffer);
 		binder_debug(BINDER_DEBUG_BUFFER_ALLOC_ASYNC,
@@ -818,6 +1198,18 @@ static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
 	return buffer;
 }
 
+static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
+					      size_t data_size,
+					      size_t offsets_size, int is_async)
+{
+	struct binder_buffer *buffer;
+
+	mutex_lock(&proc->alloc_lock);
+	buffer = __binder_alloc_buf(proc, data_size, offsets_size, is_async);
+	mutex_unlock(&proc->alloc_lock);
+	return buffer;
+}
+
 static void *buffer_start_page(struct binder_buffer *buffer)
 {
 	return (void *)((uintptr_t)buffer & PAGE_MASK);
@@ -875,8 +1267,8 @@ static void binder_delete_free_buffer(struct binder_proc *proc,
 	}
 }
 
-static void binder_free_buf(struct binder_proc *proc,
-			    struct binder_buffer *buffer)
+static void __binder_free_buf(struct binder_proc *proc,
+			      struct binder_buffer *buffer)
 {
 	size_t size, buffer_size;
 
@@ -930,6 +1322,14 @@ static void binder_free_buf(struct binder_proc *proc,
 	binder_insert_free_buffer(proc, buffer);
 }
 
+static void binder_free_buf(struct binder_proc *proc,
+			    struct binder_buffer *buffer)
+{
+	mutex_lock(&proc->alloc_lock);
+	__binder_free_buf(proc, buffer);
+	mutex_unlock(&proc->alloc_lock);
+}
+
 static struct binder_node *binder_get_node(struct binder_proc *proc,
 					   void __user *ptr)
 {
@@ -1318,6 +1718,7 @@ static void binder_transaction_buffer_release(struct binder_proc *proc,
 	size_t *offp, *off_end;
 	int debug_id = buffer->debug_id;
 
+	trace_binder_transaction_buffer_release(buffer);
 	binder_debug(BINDER_DEBUG_TRANSACTION,
 		     "binder: %d buffer release %d, size %zd-%zd, failed at"
 		     " %p\n", proc->pid, buffer->debug_id,
@@ -1395,9 +1796,112 @@ static void binder_transaction_buffer_release(struct binder_proc *proc,
 	}
 }
 
+/*
+ * Gather the user segments of a scatter-gather transaction into the
+ * transaction buffer. The segment sizes must add up to exactly size.
+ */
+static int binder_copy_sg_data(struct binder_proc *proc,
+			       struct binder_thread *thread, void *dst,
+			       size_t size,
+			       const struct binder_sg_entry __user *segments,
+			       size_t segment_count)
+{
+	struct binder_sg_entry sg;
+	size_t i;
+
+	for (i = 0; i < segment_count; i++) {
+		if (copy_from_user(&sg, &segments[i], sizeof(sg))) {
+			binder_user_error("binder: %d:%d got sg transaction "
+				"with invalid segment list\n",
+				proc->pid, thread->pid);
+			return -EFAULT;
+		}
+		if (sg.size == 0)
+			continue;
+		if (sg.size > size) {
+			binder_user_error("binder: %d:%d got sg transaction "
+				"with segments larger than data size\n",
+				proc->pid, thread->pid);
+			return -EINVAL;
+		}
+		if (copy_from_user(dst, sg.buffer, sg.size)) {
+			binder_user_error("binder: %d:%d got sg transaction "
+				"with invalid segment %zd ptr\n",
+				proc->pid, thread->pid, i);
+			return -EFAULT;
+		}
+		dst += sg.size;
+		size -= sg.size;
+	}
+	if (size) {
+		binder_user_error("binder: %d:%d got sg transaction with "
+			"%zd bytes of data not covered by segments\n",
+			proc->pid, thread->pid, size);
+		return -EINVAL;
+	}
+	return 0;
+}
+
+static int binder_copy_transaction_data(struct binder_proc *proc,
+					struct binder_thread *thread,
+					struct binder_buffer *buffer,
+					struct binder_transaction_data *tr,
+					const struct binder_sg_entry __user *segments,
+					size_t segment_count)
+{
+	void *offp = buffer->data + ALIGN(tr->data_size, sizeof(void *));
+	int ret;
+
+	if (segments) {
+		ret = binder_copy_sg_data(proc, thread, buffer->data,
+					  tr->data_size, segments,
+					  segment_count);
+		if (ret)
+			return ret;
+	} else if (copy_from_user(buffer->data, tr->data.ptr.buffer,
+				  tr->data_size)) {
+		binder_user_error("binder: %d:%d got transaction with invalid "
+			"data ptr\n", proc->pid, thread->pid);
+		return -EFAULT;
+	}
+	if (copy_from_user(offp, tr->data.ptr.offsets, tr->offsets_size)) {
+		binder_user_error("binder: %d:%d got transaction with invalid "
+			"offsets ptr\n", proc->pid, thread->pid);
+		return -EFAULT;
+	}
+	return 0;
+}
+
+/*
+ * Find the thread in target_proc that is waiting on a transaction further
+ * down the caller's stack, if any; the call is then delivered to it.
+ */
+static struct binder_thread *binder_find_target_thread(
+	struct binder_thread *thread, struct binder_proc *target_proc)
+{
+	struct binder_transaction *tmp = thread->transaction_stack;
+	struct binder_thread *target_thread = NULL;
+
+	while (tmp) {
+		if (tmp->from && tmp->from->proc == target_proc)
+			target_thread = tmp->from;
+		tmp = tmp->from_parent;
+	}
+	return target_thread;
+}
+
+static void binder_proc_dec_tmpref(struct binder_proc *proc)
+{
+	proc->tmp_ref--;
+	if (proc->tmp_ref == 0 && proc->release_pending)
+		binder_defer_work(proc, BINDER_DEFERRED_RELEASE);
+}
+
 static void binder_transaction(struct binder_proc *proc,
 			       struct binder_thread *thread,
-			       struct binder_transaction_data *tr, int reply)
+			       struct binder_transaction_data *tr, int reply,
+			       const struct binder_sg_entry __user *segments,
+			       size_t segment_count)
 {
 	struct binder_transaction *t;
 	struct binder_work *tcomplete;
@@ -1408,10 +1912,15 @@ static void binder_transaction(struct binder_proc *proc,
 	struct list_head *target_list;
 	wait_queue_head_t *target_wait;
 	struct binder_transaction *in_reply_to = NULL;
-	struct binder_transaction_log_entry *e;
+	struct binder_transaction_log_entry log_entry, *e = &log_entry;
 	uint32_t return_error;
 
-	e = binder_transaction_log_add(&binder_transaction_log);
+	/*
+	 * The entry is built on the stack and only added to the log under
+	 * binder_main_lock: the lock is dropped around the copy below, and a
+	 * slot reserved before that could be handed out again meanwhile.
+	 */
+	memset(&log_entry, 0, sizeof(log_entry));
 	e->call_type = reply ? 2 : !!(tr->flags & TF_ONE_WAY);
 	e->from_proc = proc->pid;
 	e->from_thread = thread->pid;
@@ -1428,7 +1937,11 @@ static void binder_transaction(struct binder_proc *proc,
 			return_error = BR_FAILED_REPLY;
 			goto err_empty_call_stack;
 		}
-		binder_set_nice(in_reply_to->saved_priority);
+		binder_set_priority(in_reply_to->saved_priority);
+		if (in_reply_to->to_thread == thread)
+			binder_latency_add(proc->latency.handle,
+				ktime_us_delta(ktime_get(),
+					       in_reply_to->received));
 		if (in_reply_to->to_thread != thread) {
 			binder_user_error("binder: %d:%d got reply transaction "
 				"with bad transaction stack,"
@@ -1501,21 +2014,12 @@ static void binder_transaction(struct binder_proc *proc,
 				return_error = BR_FAILED_REPLY;
 				goto err_bad_call_stack;
 			}
-			while (tmp) {
-				if (tmp->from && tmp->from->proc == target_proc)
-					target_thread = tmp->from;
-				tmp = tmp->from_parent;
-			}
+			target_thread = binder_find_target_thread(thread,
+								  target_proc);
 		}
 	}
-	if (target_thread) {
+	if (target_thread)
 		e->to_thread = target_thread->pid;
-		target_list = &target_thread->todo;
-		target_wait = &target_thread->wait;
-	} else {
-		target_list = &target_proc->todo;
-		target_wait = &target_proc->wait;
-	}
 	e->to_proc = target_proc->pid;
 
 	/* TODO: reuse incoming transaction for reply */
@@ -1559,37 +2063,77 @@ static void binder_transaction(struct binder_proc *proc,
 		t->from = NULL;
 	t->sender_euid = proc->tsk->cred->euid;
 	t->to_proc = target_proc;
-	t->to_thread = target_thread;
 	t->code = tr->code;
 	t->flags = tr->flags;
-	t->priority = task_nice(current);
+	t->priority = binder_get_priority(current);
+
+	/*
+	 * Allocating the target buffer and copying the payload in only need
+	 * the target's allocator, so do them without binder_main_lock and let
+	 * transactions between other procs run meanwhile. The target node and
+	 * proc are pinned across the window, the target thread is checked
+	 * again once the lock is back.
+	 */
+	if (target_node)
+		binder_inc_node(target_node, 1, 0, NULL);
+	target_proc->tmp_ref++;
+	binder_unlock();
+
 	t->buffer = binder_alloc_buf(target_proc, tr->data_size,
 		tr->offsets_size, !reply && (t->flags & TF_ONE_WAY));
-	if (t->buffer == NULL) {
+	if (t->buffer == NULL)
+		return_error = BR_FAILED_REPLY;
+	else if (binder_copy_transaction_data(proc, thread, t->buffer, tr,
+					      segments, segment_count))
 		return_error = BR_FAILED_REPLY;
+	else
+		return_error = BR_OK;
+
+	binder_lock();
+	binder_proc_dec_tmpref(target_proc);
+	e = binder_transaction_log_add(&binder_transaction_log);
+	*e = log_entry;
+
+	if (t->buffer == NULL) {
+		if (target_node)
+			binder_dec_node(target_node, 1, 0);
 		goto err_binder_alloc_buf_failed;
 	}
-	t->buffer->allow_user_free = 0;
 	t->buffer->debug_id = t->debug_id;
 	t->buffer->transaction = t;
 	t->buffer->target_node = target_node;
-	if (target_node)
-		binder_inc_node(target_node, 1, 0, NULL);
 
 	offp = (size_t *)(t->buffer->data + ALIGN(tr->data_size, sizeof(void *)));
 
-	if (copy_from_user(t->buffer->data, tr->data.ptr.buffer, tr->data_size)) {
-		binder_user_error("binder: %d:%d got transaction with invalid "
-			"data ptr\n", proc->pid, thread->pid);
-		return_error = BR_FAILED_REPLY;
-		goto err_copy_data_failed;
-	}
-	if (copy_from_user(offp, tr->data.ptr.offsets, tr->offsets_size)) {
-		binder_user_error("binder: %d:%d got transaction with invalid "
-			"offsets ptr\n", proc->pid, thread->pid);
-		return_error = BR_FAILED_REPLY;
+	if (return_error != BR_OK)
 		goto err_copy_data_failed;
+
+	if (reply) {
+		if (in_reply_to->from == NULL) {
+			return_error = BR_DEAD_REPLY;
+			goto err_dead_target;
+		}
+		if (target_thread->transaction_stack != in_reply_to) {
+			binder_user_error("binder: %d:%d reply target %d "
+				"no longer waits for transaction %d\n",
+				proc->pid, thread->pid, target_thread->pid,
+				in_reply_to->debug_id);
+			return_error = BR_FAILED_REPLY;
+			in_reply_to = NULL;
+			goto err_dead_target;
+		}
+	} else if (!(tr->flags & TF_ONE_WAY) && thread->transaction_stack)
+		target_thread = binder_find_target_thread(thread, target_proc);
+
+	t->to_thread = target_thread;
+	if (target_thread) {
+		target_list = &target_thread->todo;
+		target_wait = &target_thread->wait;
+	} else {
+		target_list = &target_proc->todo;
+		target_wait = &target_proc->wait;
 	}
+
 	if (!IS_ALIGNED(tr->offsets_size, sizeof(size_t))) {
 		binder_user_error("binder: %d:%d got transaction with "
 			"invalid offsets size, %zd\n",
@@ -1617,6 +2161,11 @@ static void binder_transaction(struct binder_proc *proc,
 			struct binder_node *node = binder_get_node(proc,
 								fp->binder);
 			if (node == NULL) {
+				if (binder_check_node_sched(proc, thread,
+							    fp->flags)) {
+					return_error = BR_FAILED_REPLY;
+					goto err_binder_new_node_failed;
+				}
 				node = binder_new_node(proc, fp->binder,
 								fp->cookie);
 				if (node == NULL) {
@@ -1627,6 +2176,11 @@ static void binder_transaction(struct binder_proc *proc,
 						FLAT_BINDER_FLAG_PRIORITY_MASK;
 				node->accept_fds = !!(fp->flags &
 						FLAT_BINDER_FLAG_ACCEPTS_FDS);
+				node->sched_policy = (fp->flags &
+					FLAT_BINDER_FLAG_SCHED_POLICY_MASK) >>
+					FLAT_BINDER_FLAG_SCHED_POLICY_SHIFT;
+				node->inherit_rt = !!(fp->flags &
+						FLAT_BINDER_FLAG_INHERIT_RT);
 			}
 			if (fp->cookie != node->cookie) {
 				binder_user_error("binder: %d:%d sending u%p "
@@ -1774,6 +2328,8 @@ static void binder_transaction(struct binder_proc *proc,
 		} else
 			target_node->has_async_transaction = 1;
 	}
+	t->queued = ktime_get();
+	trace_binder_transaction(reply, t, target_node);
 	t->work.type = BINDER_WORK_TRANSACTION;
 	list_add_tail(&t->work.entry, target_list);
 	tcomplete->type = BINDER_WORK_TRANSACTION_COMPLETE;
@@ -1790,6 +2346,7 @@ err_binder_get_ref_failed:
 err_binder_new_node_failed:
 err_bad_object_type:
 err_bad_offset:
+err_dead_target:
 err_copy_data_failed:
 	binder_transaction_buffer_release(target_proc, t->buffer, offp);
 	t->buffer->transaction = NULL;
@@ -1811,6 +2368,10 @@ err_no_context_mgr_node:
 		     proc->pid, thread->pid, return_error,
 		     tr->data_size, tr->offsets_size);
 
+	if (e == &log_entry) {
+		e = binder_transaction_log_add(&binder_transaction_log);
+		*e = log_entry;
+	}
 	{
 		struct binder_transaction_log_entry *fe;
 		fe = binder_transaction_log_add(&binder_transaction_log_failed);
@@ -2025,7 +2586,31 @@ int binder_thread_write(struct binder_proc *proc, struct binder_thread *thread,
 			if (copy_from_user(&tr, ptr, sizeof(tr)))
 				return -EFAULT;
 			ptr += sizeof(tr);
-			binder_transaction(proc, thread, &tr, cmd == BC_REPLY);
+			binder_transaction(proc, thread, &tr, cmd == BC_REPLY,
+					   NULL, 0);
+			break;
+		}
+
+		case BC_TRANSACTION_SG:
+		case BC_REPLY_SG: {
+			struct binder_transaction_data_sg tr;
+
+			if (copy_from_user(&tr, ptr, sizeof(tr)))
+				return -EFAULT;
+			if (tr.segments == NULL || tr.segment_count == 0 ||
+			    tr.segment_count > BINDER_SG_MAX_SEGMENTS) {
+				binder_user_error("binder: %d:%d %s with "
+					"invalid segment list %p, count %zd\n",
+					proc->pid, thread->pid,
+					cmd == BC_REPLY_SG ? "BC_REPLY_SG" :
+					"BC_TRANSACTION_SG", tr.segments,
+					tr.segment_count);
+				return -EINVAL;
+			}
+			ptr += sizeof(tr);
+			binder_transaction(proc, thread, &tr.transaction_data,
+					   cmd == BC_REPLY_SG,
+					   tr.segments, tr.segment_count);
 			break;
 		}
 
@@ -2256,6 +2841,7 @@ static int binder_thread_read(struct binder_proc *proc,
 
 	int ret = 0;
 	int wait_for_proc_work;
+	s64 queue_us;
 
 	if (*consumed == 0) {
 		if (put_user(BR_NOOP, (uint32_t __user *)ptr))
@@ -2287,7 +2873,7 @@ retry:
 	thread->looper |= BINDER_LOOPER_STATE_WAITING;
 	if (wait_for_proc_work)
 		proc->ready_threads++;
-	mutex_unlock(&binder_lock);
+	binder_unlock();
 	if (wait_for_proc_work) {
 		if (!(thread->looper & (BINDER_LOOPER_STATE_REGISTERED |
 					BINDER_LOOPER_STATE_ENTERED))) {
@@ -2311,7 +2897,7 @@ retry:
 		} else
 			ret = wait_event_interruptible(thread->wait, binder_has_thread_work(thread));
 	}
-	mutex_lock(&binder_lock);
+	binder_lock();
 	if (wait_for_proc_work)
 		proc->ready_threads--;
 	thread->looper &= ~BINDER_LOOPER_STATE_WAITING;
@@ -2461,13 +3047,8 @@ retry:
 			struct binder_node *target_node = t->buffer->target_node;
 			tr.target.ptr = target_node->ptr;
 			tr.cookie =  target_node->cookie;
-			t->saved_priority = task_nice(current);
-			if (t->priority < target_node->min_priority &&
-			    !(t->flags & TF_ONE_WAY))
-				binder_set_nice(t->priority);
-			else if (!(t->flags & TF_ONE_WAY) ||
-				 t->saved_priority > target_node->min_priority)
-				binder_set_nice(target_node->min_priority);
+			t->saved_priority = binder_get_priority(current);
+			binder_transaction_priority(t, target_node);
 			cmd = BR_TRANSACTION;
 		} else {
 			tr.target.ptr = NULL;
@@ -2502,6 +3083,11 @@ retry:
 		ptr += sizeof(tr);
 
 		binder_stat_br(proc, thread, cmd);
+		t->received = ktime_get();
+		queue_us = ktime_us_delta(t->received, t->queued);
+		if (cmd == BR_TRANSACTION)
+			binder_latency_add(proc->latency.queue, queue_us);
+		trace_binder_transaction_received(t, thread, queue_us);
 		binder_debug(BINDER_DEBUG_TRANSACTION,
 			     "binder: %d:%d %s %d %d:%d, cmd %d"
 			     "size %zd-%zd ptr %p-%p\n",
@@ -2653,12 +3239,12 @@ static unsigned int binder_poll(struct file *filp,
 	struct binder_thread *thread = NULL;
 	int wait_for_proc_work;
 
-	mutex_lock(&binder_lock);
+	binder_lock();
 	thread = binder_get_thread(proc);
 
 	wait_for_proc_work = thread->transaction_stack == NULL &&
 		list_empty(&thread->todo) && thread->return_error == BR_OK;
-	mutex_unlock(&binder_lock);
+	binder_unlock();
 
 	if (wait_for_proc_work) {
 		if (binder_has_proc_work(proc, thread))
@@ -2692,7 +3278,7 @@ static long binder_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 	if (ret)
 		return ret;
 
-	mutex_lock(&binder_lock);
+	binder_lock();
 	thread = binder_get_thread(proc);
 	if (thread == NULL) {
 		ret = -ENOMEM;
@@ -2804,7 +3390,7 @@ static long binder_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 err:
 	if (thread)
 		thread->looper &= ~BINDER_LOOPER_STATE_NEED_RETURN;
-	mutex_unlock(&binder_lock);
+	binder_unlock();
 	wait_event_interruptible(binder_user_error_wait, binder_stop_on_user_error < 2);
 	if (ret && ret != -ERESTARTSYS)
 		binder_debug(BINDER_DEBUG_TOP_ERRORS,
@@ -2843,7 +3429,7 @@ static struct vm_operations_struct binder_vm_ops = {
 
 static int binder_mmap(struct file *filp, struct vm_area_struct *vma)
 {
-	int ret;
+	int ret, i;
 	struct vm_struct *area;
 	struct binder_proc *proc = filp->private_data;
 	const char *failure_string;
@@ -2896,6 +3482,8 @@ static int binder_mmap(struct file *filp, struct vm_area_struct *vma)
 		failure_string = "alloc page array";
 		goto err_alloc_pages_failed;
 	}
+	for (i = 0; i < (vma->vm_end - vma->vm_start) / PAGE_SIZE; i++)
+		INIT_LIST_HEAD(&proc->pages[i].lru);
 	proc->buffer_size = vma->vm_end - vma->vm_start;
 
 	vma->vm_ops = &binder_vm_ops;
@@ -2950,14 +3538,16 @@ static int binder_open(struct inode *nodp, struct file *filp)
 	proc->tsk = current;
 	INIT_LIST_HEAD(&proc->todo);
 	init_waitqueue_head(&proc->wait);
+	mutex_init(&proc->alloc_lock);
+	INIT_LIST_HEAD(&proc->lru);
 	proc->default_priority = task_nice(current);
-	mutex_lock(&binder_lock);
+	binder_lock();
 	binder_stats_created(BINDER_STAT_PROC);
 	hlist_add_head(&proc->proc_node, &binder_procs);
 	proc->pid = current->group_leader->pid;
 	INIT_LIST_HEAD(&proc->delivered_death);
 	filp->private_data = proc;
-	mutex_unlock(&binder_lock);
+	binder_unlock();
 
 	if (binder_debugfs_dir_entry_proc) {
 		char strbuf[11];
@@ -3102,7 +3692,7 @@ static void binder_deferred_release(struct binder_proc *proc)
 	if (proc->pages) {
 		int i;
 		for (i = 0; i < proc->buffer_size / PAGE_SIZE; i++) {
-			if (proc->pages[i]) {
+			if (proc->pages[i].page_ptr) {
 				void *page_addr = proc->buffer + i * PAGE_SIZE;
 				binder_debug(BINDER_DEBUG_BUFFER_ALLOC,
 					     "binder_release: %d: "
@@ -3111,7 +3701,9 @@ static void binder_deferred_release(struct binder_proc *proc)
 					     page_addr);
 				unmap_kernel_range((unsigned long)page_addr,
 					PAGE_SIZE);
-				__free_page(proc->pages[i]);
+				__free_page(proc->pages[i].page_ptr);
+				if (!list_empty(&proc->pages[i].lru))
+					atomic_dec(&binder_page_cache_stats.cached);
 				page_count++;
 			}
 		}
@@ -3138,7 +3730,7 @@ static void binder_deferred_func(struct work_struct *work)
 
 	int defer;
 	do {
-		mutex_lock(&binder_lock);
+		binder_lock();
 		mutex_lock(&binder_deferred_lock);
 		if (!hlist_empty(&binder_deferred_list)) {
 			proc = hlist_entry(binder_deferred_list.first,
@@ -3162,10 +3754,15 @@ static void binder_deferred_func(struct work_struct *work)
 		if (defer & BINDER_DEFERRED_FLUSH)
 			binder_deferred_flush(proc);
 
-		if (defer & BINDER_DEFERRED_RELEASE)
-			binder_deferred_release(proc); /* frees proc */
+		if (defer & BINDER_DEFERRED_RELEASE) {
+			/* binder_proc_dec_tmpref queues the release again */
+			if (proc->tmp_ref)
+				proc->release_pending = 1;
+			else
+				binder_deferred_release(proc); /* frees proc */
+		}
 
-		mutex_unlock(&binder_lock);
+		binder_unlock();
 		if (files)
 			put_files_struct(files);
 	} while (proc);
@@ -3189,13 +3786,17 @@ static void print_binder_transaction(struct seq_file *m, const char *prefix,
 				     struct binder_transaction *t)
 {
 	seq_printf(m,
-		   "%s %d: %p from %d:%d to %d:%d code %x flags %x pri %ld r%d",
+		   "%s %d: %p from %d:%d to %d:%d code %x flags %x "
+		   "pri %d:%ld r%d",
 		   prefix, t->debug_id, t,
 		   t->from ? t->from->proc->pid : 0,
 		   t->from ? t->from->pid : 0,
 		   t->to_proc ? t->to_proc->pid : 0,
 		   t->to_thread ? t->to_thread->pid : 0,
-		   t->code, t->flags, t->priority, t->need_reply);
+		   t->code, t->flags, t->priority.sched_policy,
+		   binder_is_rt_policy(t->priority.sched_policy) ?
+		   (long)t->priority.rt_prio : t->priority.nice,
+		   t->need_reply);
 	if (t->buffer == NULL) {
 		seq_puts(m, " buffer free\n");
 		return;
@@ -3346,9 +3947,11 @@ static void print_binder_proc(struct seq_file *m,
 			print_binder_ref(m, rb_entry(n, struct binder_ref,
 						     rb_node_desc));
 	}
+	mutex_lock(&proc->alloc_lock);
 	for (n = rb_first(&proc->allocated_buffers); n != NULL; n = rb_next(n))
 		print_binder_buffer(m, "  buffer",
 				    rb_entry(n, struct binder_buffer, rb_node));
+	mutex_unlock(&proc->alloc_lock);
 	list_for_each_entry(w, &proc->todo, entry)
 		print_binder_work(m, "  ", "  pending transaction", w);
 	list_for_each_entry(w, &proc->delivered_death, entry) {
@@ -3397,7 +4000,9 @@ static const char *binder_command_strings[] = {
 	"BC_EXIT_LOOPER",
 	"BC_REQUEST_DEATH_NOTIFICATION",
 	"BC_CLEAR_DEATH_NOTIFICATION",
-	"BC_DEAD_BINDER_DONE"
+	"BC_DEAD_BINDER_DONE",
+	"BC_TRANSACTION_SG",
+	"BC_REPLY_SG"
 };
 
 static const char *binder_objstat_strings[] = {
@@ -3461,6 +4066,7 @@ static void print_binder_proc_stats(struct seq_file *m,
 			"  free async space %zd\n", proc->requested_threads,
 			proc->requested_threads_started, proc->max_threads,
 			proc->ready_threads, proc->free_async_space);
+	seq_printf(m, "  cached pages: %d\n", proc->lru_count);
 	count = 0;
 	for (n = rb_first(&proc->nodes); n != NULL; n = rb_next(n))
 		count++;
@@ -3478,8 +4084,10 @@ static void print_binder_proc_stats(struct seq_file *m,
 	seq_printf(m, "  refs: %d s %d w %d\n", count, strong, weak);
 
 	count = 0;
+	mutex_lock(&proc->alloc_lock);
 	for (n = rb_first(&proc->allocated_buffers); n != NULL; n = rb_next(n))
 		count++;
+	mutex_unlock(&proc->alloc_lock);
 	seq_printf(m, "  buffers: %d\n", count);
 
 	count = 0;
@@ -3506,7 +4114,7 @@ static int binder_state_show(struct seq_file *m, void *unused)
 	int do_lock = !binder_debug_no_lock;
 
 	if (do_lock)
-		mutex_lock(&binder_lock);
+		binder_lock();
 
 	seq_puts(m, "binder state:\n");
 
@@ -3518,7 +4126,7 @@ static int binder_state_show(struct seq_file *m, void *unused)
 	hlist_for_each_entry(proc, pos, &binder_procs, proc_node)
 		print_binder_proc(m, proc, 1);
 	if (do_lock)
-		mutex_unlock(&binder_lock);
+		binder_unlock();
 	return 0;
 }
 
@@ -3529,16 +4137,26 @@ static int binder_stats_show(struct seq_file *m, void *unused)
 	int do_lock = !binder_debug_no_lock;
 
 	if (do_lock)
-		mutex_lock(&binder_lock);
+		binder_lock();
 
 	seq_puts(m, "binder stats:\n");
 
 	print_binder_stats(m, "", &binder_stats);
+	seq_printf(m, "binder_lock: acquired %lu contended %lu "
+		   "wait %llu ns max %llu ns\n",
+		   binder_lock_stats.acquired, binder_lock_stats.contended,
+		   (unsigned long long)binder_lock_stats.wait_ns,
+		   (unsigned long long)binder_lock_stats.max_wait_ns);
+	seq_printf(m, "page cache: cached %d hits %d misses %d reclaimed %d\n",
+		   atomic_read(&binder_page_cache_stats.cached),
+		   atomic_read(&binder_page_cache_stats.hits),
+		   atomic_read(&binder_page_cache_stats.misses),
+		   atomic_read(&binder_page_cache_stats.reclaimed));
 
 	hlist_for_each_entry(proc, pos, &binder_procs, proc_node)
 		print_binder_proc_stats(m, proc);
 	if (do_lock)
-		mutex_unlock(&binder_lock);
+		binder_unlock();
 	return 0;
 }
 
@@ -3549,13 +4167,47 @@ static int binder_transactions_show(struct seq_file *m, void *unused)
 	int do_lock = !binder_debug_no_lock;
 
 	if (do_lock)
-		mutex_lock(&binder_lock);
+		binder_lock();
 
 	seq_puts(m, "binder transactions:\n");
 	hlist_for_each_entry(proc, pos, &binder_procs, proc_node)
 		print_binder_proc(m, proc, 0);
 	if (do_lock)
-		mutex_unlock(&binder_lock);
+		binder_unlock();
+	return 0;
+}
+
+static void print_binder_latency_hist(struct seq_file *m, const char *name,
+				      u32 *hist)
+{
+	int i;
+
+	seq_printf(m, "  %s:", name);
+	for (i = 0; i < BINDER_LATENCY_BUCKETS - 1; i++)
+		if (hist[i])
+			seq_printf(m, " <%luus %u", 1UL << i, hist[i]);
+	if (hist[i])
+		seq_printf(m, " >=%luus %u", 1UL << (i - 1), hist[i]);
+	seq_puts(m, "\n");
+}
+
+static int binder_latency_show(struct seq_file *m, void *unused)
+{
+	struct binder_proc *proc;
+	struct hlist_node *pos;
+	int do_lock = !binder_debug_no_lock;
+
+	if (do_lock)
+		binder_lock();
+
+	seq_puts(m, "binder latency:\n");
+	hlist_for_each_entry(proc, pos, &binder_procs, proc_node) {
+		seq_printf(m, "proc %d\n", proc->pid);
+		print_binder_latency_hist(m, "queue", proc->latency.queue);
+		print_binder_latency_hist(m, "handle", proc->latency.handle);
+	}
+	if (do_lock)
+		binder_unlock();
 	return 0;
 }
 
@@ -3565,11 +4217,11 @@ static int binder_proc_show(struct seq_file *m, void *unused)
 	int do_lock = !binder_debug_no_lock;
 
 	if (do_lock)
-		mutex_lock(&binder_lock);
+		binder_lock();
 	seq_puts(m, "binder proc state:\n");
 	print_binder_proc(m, proc, 1);
 	if (do_lock)
-		mutex_unlock(&binder_lock);
+		binder_unlock();
 	return 0;
 }
 
@@ -3598,6 +4250,42 @@ static int binder_transaction_log_show(struct seq_file *m, void *unused)
 	return 0;
 }
 
+static int binder_shrink(struct shrinker *s, struct shrink_control *sc)
+{
+	struct binder_proc *proc;
+	struct hlist_node *pos;
+	int nr = sc->nr_to_scan;
+	int freed;
+
+	if (nr <= 0)
+		goto out;
+
+	/*
+	 * We may be called from an allocation made with binder_main_lock or
+	 * a proc's alloc_lock held, so never block on them here.
+	 */
+	if (!mutex_trylock(&binder_main_lock))
+		return -1;
+	hlist_for_each_entry(proc, pos, &binder_procs, proc_node) {
+		if (nr <= 0)
+			break;
+		if (!mutex_trylock(&proc->alloc_lock))
+			continue;
+		freed = binder_trim_page_cache(proc, nr, 1);
+		mutex_unlock(&proc->alloc_lock);
+		atomic_add(freed, &binder_page_cache_stats.reclaimed);
+		nr -= freed;
+	}
+	mutex_unlock(&binder_main_lock);
+out:
+	return atomic_read(&binder_page_cache_stats.cached);
+}
+
+static struct shrinker binder_shrinker = {
+	.shrink = binder_shrink,
+	.seeks = DEFAULT_SEEKS,
+};
+
 static const struct file_operations binder_fops = {
 	.owner = THIS_MODULE,
 	.poll = binder_poll,
@@ -3618,6 +4306,7 @@ BINDER_DEBUG_ENTRY(state);
 BINDER_DEBUG_ENTRY(stats);
 BINDER_DEBUG_ENTRY(transactions);
 BINDER_DEBUG_ENTRY(transaction_log);
+BINDER_DEBUG_ENTRY(latency);
 
 static int __init binder_init(void)
 {
@@ -3658,7 +4347,14 @@ static int __init binder_init(void)
 				    binder_debugfs_dir_entry_root,
 				    &binder_transaction_log_failed,
 				    &binder_transaction_log_fops);
+		debugfs_create_file("latency",
+				    S_IRUGO,
+				    binder_debugfs_dir_entry_root,
+				    NULL,
+				    &binder_latency_fops);
 	}
+	if (!ret)
+		register_shrinker(&binder_shrinker);
 	return ret;
 }
 
@@ -37,6 +37,17 @@ enum {
 enum {
 	FLAT_BINDER_FLAG_PRIORITY_MASK = 0xff,
 	FLAT_BINDER_FLAG_ACCEPTS_FDS = 0x100,
+	/*
+	 * Scheduling policy of the node's minimum priority. For SCHED_FIFO
+	 * and SCHED_RR the priority bits hold an RT priority, otherwise a
+	 * nice value. RT policies need an RT priority between 1 and
+	 * MAX_USER_RT_PRIO - 1 and, like FLAT_BINDER_FLAG_INHERIT_RT, an
+	 * owner with CAP_SYS_NICE.
+	 */
+	FLAT_BINDER_FLAG_SCHED_POLICY_MASK = 0x600,
+	FLAT_BINDER_FLAG_SCHED_POLICY_SHIFT = 9,
+	/* Let RT callers run their transactions on this node with RT policy */
+	FLAT_BINDER_FLAG_INHERIT_RT = 0x800,
 };
 
 /*
@@ -147,6 +158,32 @@ struct binder_transaction_data {
 	} data;
 };
 
+/*
+ * One user buffer of a scatter-gather transaction. The segments of a
+ * BC_TRANSACTION_SG or BC_REPLY_SG are gathered, in order, directly into
+ * the target's transaction buffer, so the sender does not have to flatten
+ * them into one contiguous buffer first.
+ */
+struct binder_sg_entry {
+	const void	*buffer;
+	size_t		size;
+};
+
+/* Upper bound on segment_count of a scatter-gather transaction */
+#define BINDER_SG_MAX_SEGMENTS	16
+
+struct binder_transaction_data_sg {
+	/*
+	 * data_size must equal the sum of the segment sizes; data.ptr.buffer
+	 * is ignored. Offsets are relative to the start of the gathered data.
+	 * segments must hold 1 to BINDER_SG_MAX_SEGMENTS entries; empty
+	 * entries are skipped.
+	 */
+	struct binder_transaction_data	transaction_data;
+	const struct binder_sg_entry	*segments;
+	size_t				segment_count;
+};
+
 struct binder_ptr_cookie {
 	void *ptr;
 	void *cookie;
@@ -324,6 +361,13 @@ enum BinderDriverCommandProtocol {
 	/*
 	 * void *: cookie
 	 */
+
+	BC_TRANSACTION_SG = _IOW('c', 17, struct binder_transaction_data_sg),
+	BC_REPLY_SG = _IOW('c', 18, struct binder_transaction_data_sg),
+	/*
+	 * binder_transaction_data_sg: the sent command, with the data
+	 * described by a list of user buffers.
+	 */
 };
 
 #endif /* _LINUX_BINDER_H */
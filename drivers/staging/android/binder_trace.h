@@ -0,0 +1,143 @@
+/* Copyright (c) 2012, Code Aurora Forum. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 and
+ * only version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM binder
+
+#if !defined(_BINDER_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _BINDER_TRACE_H
+
+#include <linux/tracepoint.h>
+
+struct binder_buffer;
+struct binder_node;
+struct binder_proc;
+struct binder_thread;
+struct binder_transaction;
+
+/*
+ * Tracepoint for a transaction or reply being queued to its target
+ */
+TRACE_EVENT(binder_transaction,
+	TP_PROTO(bool reply, struct binder_transaction *t,
+		 struct binder_node *target_node),
+	TP_ARGS(reply, t, target_node),
+	TP_STRUCT__entry(
+		__field(int, debug_id)
+		__field(int, target_node)
+		__field(int, to_proc)
+		__field(int, to_thread)
+		__field(int, reply)
+		__field(unsigned int, code)
+		__field(unsigned int, flags)
+		__field(size_t, data_size)
+	),
+	TP_fast_assign(
+		__entry->debug_id = t->debug_id;
+		__entry->target_node = target_node ? target_node->debug_id : 0;
+		__entry->to_proc = t->to_proc->pid;
+		__entry->to_thread = t->to_thread ? t->to_thread->pid : 0;
+		__entry->reply = reply;
+		__entry->code = t->code;
+		__entry->flags = t->flags;
+		__entry->data_size = t->buffer->data_size;
+	),
+	TP_printk("transaction=%d dest_node=%d dest_proc=%d dest_thread=%d "
+		  "reply=%d flags=0x%x code=0x%x size=%zd",
+		  __entry->debug_id, __entry->target_node,
+		  __entry->to_proc, __entry->to_thread,
+		  __entry->reply, __entry->flags, __entry->code,
+		  __entry->data_size)
+);
+
+/*
+ * Tracepoint for a thread picking up a queued transaction or reply
+ */
+TRACE_EVENT(binder_transaction_received,
+	TP_PROTO(struct binder_transaction *t, struct binder_thread *thread,
+		 s64 queue_us),
+	TP_ARGS(t, thread, queue_us),
+	TP_STRUCT__entry(
+		__field(int, debug_id)
+		__field(int, proc)
+		__field(int, thread)
+		__field(s64, queue_us)
+	),
+	TP_fast_assign(
+		__entry->debug_id = t->debug_id;
+		__entry->proc = thread->proc->pid;
+		__entry->thread = thread->pid;
+		__entry->queue_us = queue_us;
+	),
+	TP_printk("transaction=%d proc=%d thread=%d queued=%lldus",
+		  __entry->debug_id, __entry->proc, __entry->thread,
+		  __entry->queue_us)
+);
+
+/*
+ * Tracepoint for a binder thread changing scheduling policy or priority
+ */
+TRACE_EVENT(binder_set_priority,
+	TP_PROTO(int proc, int thread, int old_policy, int old_prio,
+		 int new_policy, int new_prio),
+	TP_ARGS(proc, thread, old_policy, old_prio, new_policy, new_prio),
+	TP_STRUCT__entry(
+		__field(int, proc)
+		__field(int, thread)
+		__field(int, old_policy)
+		__field(int, old_prio)
+		__field(int, new_policy)
+		__field(int, new_prio)
+	),
+	TP_fast_assign(
+		__entry->proc = proc;
+		__entry->thread = thread;
+		__entry->old_policy = old_policy;
+		__entry->old_prio = old_prio;
+		__entry->new_policy = new_policy;
+		__entry->new_prio = new_prio;
+	),
+	TP_printk("proc=%d thread=%d old=%d:%d => new=%d:%d",
+		  __entry->proc, __entry->thread,
+		  __entry->old_policy, __entry->old_prio,
+		  __entry->new_policy, __entry->new_prio)
+);
+
+/*
+ * Tracepoint for the objects of a transaction buffer being released
+ */
+TRACE_EVENT(binder_transaction_buffer_release,
+	TP_PROTO(struct binder_buffer *buf),
+	TP_ARGS(buf),
+	TP_STRUCT__entry(
+		__field(int, debug_id)
+		__field(size_t, data_size)
+		__field(size_t, offsets_size)
+	),
+	TP_fast_assign(
+		__entry->debug_id = buf->debug_id;
+		__entry->data_size = buf->data_size;
+		__entry->offsets_size = buf->offsets_size;
+	),
+	TP_printk("transaction=%d data_size=%zd offsets_size=%zd",
+		  __entry->debug_id, __entry->data_size,
+		  __entry->offsets_size)
+);
+
+#endif /* _BINDER_TRACE_H */
+
+#undef TRACE_INCLUDE_PATH
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_PATH .
+#define TRACE_INCLUDE_FILE binder_trace
+#include <trace/define_trace.h>
@@ -19,12 +19,16 @@
 
 #include <linux/sched.h>
 #include <linux/module.h>
+#include <linux/device.h>
 #include <linux/fs.h>
 #include <linux/miscdevice.h>
 #include <linux/uaccess.h>
 #include <linux/poll.h>
 #include <linux/slab.h>
 #include <linux/time.h>
+#include <linux/vmalloc.h>
+#include <linux/workqueue.h>
+#include <linux/lzo.h>
 #include "logger.h"
 
 #include <asm/ioctls.h>
@@ -34,34 +38,87 @@
  *
  * This structure lives from module insertion until module removal, so it does
  * not need additional reference counting. The structure is protected by the
- * mutex 'mutex'.
+ * spinlock 'lock'. Nothing that can fault or sleep is done under the lock:
+ * writers gather their payload before taking it and readers copy entries
+ * out to a private buffer, so a slow writer or reader never stalls others.
+ *
+ * The staging buffers of the compressed history are also protected by
+ * 'lock'. The chunk list and the LZO buffers are protected by 'hist_mutex',
+ * under which chunks are compressed and decompressed.
  */
 struct logger_log {
 	unsigned char 		*buffer;/* the ring buffer itself */
 	struct miscdevice	misc;	/* misc device representing the log */
 	wait_queue_head_t	wq;	/* wait queue for readers */
 	struct list_head	readers; /* this log's readers */
-	struct mutex		mutex;	/* mutex protecting buffer */
+	spinlock_t		lock;	/* lock protecting buffer */
 	size_t			w_off;	/* current write head offset */
 	size_t			head;	/* new readers start here */
 	size_t			size;	/* size of the log */
+	struct mutex		hist_mutex; /* protects the history chunks */
+	struct work_struct	hist_work; /* compresses hist_pending */
+	struct list_head	hist_chunks; /* compressed chunks, oldest first */
+	size_t			hist_size; /* limit on compressed bytes kept */
+	size_t			hist_used; /* compressed bytes kept */
+	unsigned long		hist_seq; /* sequence number of the next chunk */
+	unsigned char		*hist_active; /* entries being staged */
+	size_t			hist_active_len;
+	unsigned char		*hist_pending; /* full chunk to compress */
+	size_t			hist_pending_len;
+	unsigned char		*hist_cbuf; /* LZO output buffer */
+	void			*hist_wrkmem; /* LZO working memory */
 };
 
 /*
  * struct logger_reader - a logging device open for reading
  *
  * This object lives from open to release, so we don't need additional
- * reference counting. The structure is protected by log->mutex.
+ * reference counting. r_off, r_moved and list are protected by log->lock,
+ * buf by 'mutex', which serializes concurrent reads on the same file.
  */
 struct logger_reader {
 	struct logger_log	*log;	/* associated log */
 	struct list_head	list;	/* entry in logger_log's list */
 	size_t			r_off;	/* current read head offset */
+	int			r_moved; /* r_off moved by a writer, flush or resize */
+	struct mutex		mutex;	/* serializes reads of this reader */
+	unsigned char		*buf;	/* entry staged for copy to user */
+	unsigned char		*hist_buf; /* history being read, or NULL */
+	size_t			hist_off; /* next entry in hist_buf */
+	size_t			hist_len; /* bytes in hist_buf */
+	unsigned long		hist_seq; /* next history chunk to read */
+	int			hist_live; /* hist_buf holds the last history */
 };
 
+/*
+ * Payloads up to this size are gathered on the writer's stack, larger ones
+ * in a temporary allocation.
+ */
+#define LOGGER_STACK_PAYLOAD	256
+
 /* logger_offset - returns index 'n' into the log via (optimized) modulus */
 #define logger_offset(n)	((n) & (log->size - 1))
 
+/* bounds for LOGGER_SET_LOG_BUF_SIZE, the size must also be a power of two */
+#define LOGGER_MIN_LOG_SIZE	(16*1024)
+#define LOGGER_MAX_LOG_SIZE	(16*1024*1024)
+
+/* entries are compressed in chunks of this size */
+#define LOGGER_HIST_CHUNK	(16*1024)
+/* bound for the compressed history size */
+#define LOGGER_MAX_HIST_SIZE	(16*1024*1024)
+
+/*
+ * struct logger_history_chunk - a chunk of LZO-compressed entries that were
+ * pushed out of the log
+ */
+struct logger_history_chunk {
+	struct list_head	list;	/* entry in logger_log's hist_chunks */
+	unsigned long		seq;	/* chunks are numbered in log order */
+	size_t			size;	/* compressed size */
+	unsigned char		data[0];
+};
+
 /*
  * file_get_log - Given a file structure, return the associated log
  *
@@ -89,7 +146,7 @@ static inline struct logger_log *file_get_log(struct file *file)
  * get_entry_len - Grabs the length of the payload of the next entry starting
  * from 'off'.
  *
- * Caller needs to hold log->mutex.
+ * Caller needs to hold log->lock.
  */
 static __u32 get_entry_len(struct logger_log *log, size_t off)
 {
@@ -108,38 +165,137 @@ static __u32 get_entry_len(struct logger_log *log, size_t off)
 }
 
 /*
- * do_read_log_to_user - reads exactly 'count' bytes from 'log' into the
- * user-space buffer 'buf'. Returns 'count' on success.
+ * copy_from_log - copies 'count' bytes starting at 'off' out of 'log'
  *
- * Caller must hold log->mutex.
+ * Caller must hold log->lock.
  */
-static ssize_t do_read_log_to_user(struct logger_log *log,
-				   struct logger_reader *reader,
-				   char __user *buf,
-				   size_t count)
+static void copy_from_log(struct logger_log *log, unsigned char *dst,
+			  size_t off, size_t count)
 {
 	size_t len;
 
 	/*
 	 * We read from the log in two disjoint operations. First, we read from
-	 * the current read head offset up to 'count' bytes or to the end of
-	 * the log, whichever comes first.
+	 * 'off' up to 'count' bytes or to the end of the log, whichever comes
+	 * first.
 	 */
-	len = min(count, log->size - reader->r_off);
-	if (copy_to_user(buf, log->buffer + reader->r_off, len))
-		return -EFAULT;
+	len = min(count, log->size - off);
+	memcpy(dst, log->buffer + off, len);
 
 	/*
 	 * Second, we read any remaining bytes, starting back at the head of
 	 * the log.
 	 */
 	if (count != len)
-		if (copy_to_user(buf + len, log->buffer, count - len))
-			return -EFAULT;
+		memcpy(dst + len, log->buffer, count - len);
+}
 
-	reader->r_off = logger_offset(reader->r_off + count);
+/*
+ * do_read_log - reads exactly 'count' bytes from 'log' into the reader's
+ * private buffer. The read head is left alone until the entry has made it
+ * to userspace.
+ *
+ * Caller must hold log->lock.
+ */
+static void do_read_log(struct logger_log *log,
+			struct logger_reader *reader,
+			size_t count)
+{
+	copy_from_log(log, reader->buf, reader->r_off, count);
+	reader->r_moved = 0;
+}
 
-	return count;
+/*
+ * logger_history_fill - loads the reader's history buffer with the next
+ * compressed chunk. Once the chunks run out it loads the entries that are
+ * still staged instead and moves the reader to the head of the log, where
+ * the history ends.
+ *
+ * Caller must hold reader->mutex.
+ */
+static int logger_history_fill(struct logger_log *log,
+			       struct logger_reader *reader)
+{
+	struct logger_history_chunk *chunk;
+	size_t len;
+	int ret = 0;
+
+	mutex_lock(&log->hist_mutex);
+
+	/* chunks older than the one we want may have been dropped meanwhile */
+	list_for_each_entry(chunk, &log->hist_chunks, list)
+		if (chunk->seq >= reader->hist_seq)
+			break;
+
+	if (&chunk->list != &log->hist_chunks) {
+		len = LOGGER_HIST_CHUNK;
+		if (lzo1x_decompress_safe(chunk->data, chunk->size,
+					  reader->hist_buf, &len) != LZO_E_OK) {
+			len = 0;
+			ret = -EIO;
+		}
+		reader->hist_seq = chunk->seq + 1;
+	} else {
+		spin_lock(&log->lock);
+		len = log->hist_pending_len;
+		if (len)
+			memcpy(reader->hist_buf, log->hist_pending, len);
+		if (log->hist_active_len)
+			memcpy(reader->hist_buf + len, log->hist_active,
+			       log->hist_active_len);
+		len += log->hist_active_len;
+		reader->r_off = log->head;
+		reader->r_moved = 1;
+		spin_unlock(&log->lock);
+		reader->hist_live = 1;
+	}
+
+	reader->hist_off = 0;
+	reader->hist_len = len;
+
+	mutex_unlock(&log->hist_mutex);
+
+	return ret;
+}
+
+/*
+ * logger_read_history - read() for a reader that asked for the history with
+ * LOGGER_READ_HISTORY. Returns 0 once the history has been read, after
+ * which the reader carries on with the log itself.
+ *
+ * Caller must hold reader->mutex.
+ */
+static ssize_t logger_read_history(struct logger_log *log,
+				   struct logger_reader *reader,
+				   char __user *buf, size_t count)
+{
+	struct logger_entry entry;
+	size_t len;
+	int ret;
+
+	while (reader->hist_off == reader->hist_len) {
+		if (reader->hist_live) {
+			vfree(reader->hist_buf);
+			reader->hist_buf = NULL;
+			return 0;
+		}
+		ret = logger_history_fill(log, reader);
+		if (ret)
+			return ret;
+	}
+
+	/* entries are packed back to back, so the header may be unaligned */
+	memcpy(&entry, reader->hist_buf + reader->hist_off, sizeof(entry));
+	len = sizeof(struct logger_entry) + entry.len;
+	if (count < len)
+		return -EINVAL;
+
+	if (copy_to_user(buf, reader->hist_buf + reader->hist_off, len))
+		return -EFAULT;
+
+	reader->hist_off += len;
+
+	return len;
 }
 
 /*
@@ -162,13 +318,22 @@ static ssize_t logger_read(struct file *file, char __user *buf,
 	ssize_t ret;
 	DEFINE_WAIT(wait);
 
+	if (unlikely(reader->hist_buf)) {
+		mutex_lock(&reader->mutex);
+		ret = reader->hist_buf ?
+			logger_read_history(log, reader, buf, count) : 0;
+		mutex_unlock(&reader->mutex);
+		if (ret)
+			return ret;
+	}
+
 start:
 	while (1) {
 		prepare_to_wait(&log->wq, &wait, TASK_INTERRUPTIBLE);
 
-		mutex_lock(&log->mutex);
+		spin_lock(&log->lock);
 		ret = (log->w_off == reader->r_off);
-		mutex_unlock(&log->mutex);
+		spin_unlock(&log->lock);
 		if (!ret)
 			break;
 
@@ -189,26 +354,45 @@ start:
 	if (ret)
 		return ret;
 
-	mutex_lock(&log->mutex);
+	mutex_lock(&reader->mutex);
+	spin_lock(&log->lock);
 
 	/* is there still something to read or did we race? */
 	if (unlikely(log->w_off == reader->r_off)) {
-		mutex_unlock(&log->mutex);
+		spin_unlock(&log->lock);
+		mutex_unlock(&reader->mutex);
 		goto start;
 	}
 
 	/* get the size of the next entry */
 	ret = get_entry_len(log, reader->r_off);
 	if (count < ret) {
+		spin_unlock(&log->lock);
 		ret = -EINVAL;
 		goto out;
 	}
 
 	/* get exactly one entry from the log */
-	ret = do_read_log_to_user(log, reader, buf, ret);
+	do_read_log(log, reader, ret);
+	spin_unlock(&log->lock);
+
+	if (copy_to_user(buf, reader->buf, ret)) {
+		ret = -EFAULT;
+		goto out;
+	}
+
+	/*
+	 * Consume the entry only now that the user has it. If the read head
+	 * was moved meanwhile it already points past the entry, or the entry
+	 * is gone.
+	 */
+	spin_lock(&log->lock);
+	if (!reader->r_moved)
+		reader->r_off = logger_offset(reader->r_off + ret);
+	spin_unlock(&log->lock);
 
 out:
-	mutex_unlock(&log->mutex);
+	mutex_unlock(&reader->mutex);
 
 	return ret;
 }
@@ -217,7 +401,7 @@ out:
  * get_next_entry - return the offset of the first valid entry at least 'len'
  * bytes after 'off'.
  *
- * Caller must hold log->mutex.
+ * Caller must hold log->lock.
  */
 static size_t get_next_entry(struct logger_log *log, size_t off, size_t len)
 {
@@ -249,13 +433,180 @@ static inline int clock_interval(size_t a, size_t b, size_t c)
 	return 0;
 }
 
+/*
+ * logger_history_add - stages the entries from 'start' up to 'end', which
+ * are about to be overwritten, for the compressed history. Full chunks are
+ * handed to hist_work.
+ *
+ * Caller must hold log->lock.
+ */
+static void logger_history_add(struct logger_log *log, size_t start,
+			       size_t end)
+{
+	size_t len;
+
+	if (!log->hist_active)
+		return;
+
+	for (; start != end; start = logger_offset(start + len)) {
+		len = get_entry_len(log, start);
+
+		if (log->hist_active_len + len > LOGGER_HIST_CHUNK) {
+			/* the previous chunk is still being compressed */
+			if (log->hist_pending_len)
+				continue;
+
+			swap(log->hist_active, log->hist_pending);
+			log->hist_pending_len = log->hist_active_len;
+			log->hist_active_len = 0;
+			schedule_work(&log->hist_work);
+		}
+
+		copy_from_log(log, log->hist_active + log->hist_active_len,
+			      start, len);
+		log->hist_active_len += len;
+	}
+}
+
+/*
+ * logger_history_trim - drops the oldest chunks until the history takes at
+ * most 'size' compressed bytes.
+ *
+ * Caller must hold log->hist_mutex.
+ */
+static void logger_history_trim(struct logger_log *log, size_t size)
+{
+	struct logger_history_chunk *chunk;
+
+	while (log->hist_used > size) {
+		chunk = list_first_entry(&log->hist_chunks,
+					 struct logger_history_chunk, list);
+		list_del(&chunk->list);
+		log->hist_used -= chunk->size;
+		kfree(chunk);
+	}
+}
+
+/*
+ * logger_history_work - compresses the pending chunk onto the history
+ *
+ * Writers leave hist_pending alone until hist_pending_len is cleared, so it
+ * is compressed without log->lock.
+ */
+static void logger_history_work(struct work_struct *work)
+{
+	struct logger_log *log = container_of(work, struct logger_log,
+					      hist_work);
+	struct logger_history_chunk *chunk;
+	size_t len, clen;
+
+	mutex_lock(&log->hist_mutex);
+
+	spin_lock(&log->lock);
+	len = log->hist_pending_len;
+	spin_unlock(&log->lock);
+
+	if (!len)
+		goto out;
+
+	if (lzo1x_1_compress(log->hist_pending, len, log->hist_cbuf, &clen,
+			     log->hist_wrkmem) == LZO_E_OK) {
+		chunk = kmalloc(sizeof(*chunk) + clen, GFP_KERNEL);
+		if (chunk) {
+			chunk->seq = log->hist_seq++;
+			chunk->size = clen;
+			memcpy(chunk->data, log->hist_cbuf, clen);
+			list_add_tail(&chunk->list, &log->hist_chunks);
+			log->hist_used += clen;
+		}
+	}
+
+	spin_lock(&log->lock);
+	log->hist_pending_len = 0;
+	spin_unlock(&log->lock);
+
+	logger_history_trim(log, log->hist_size);
+
+out:
+	mutex_unlock(&log->hist_mutex);
+}
+
+/*
+ * logger_history_set - sets the limit on the compressed history to 'size'
+ * bytes, zero turns the history off and frees it.
+ */
+static int logger_history_set(struct logger_log *log, size_t size)
+{
+	unsigned char *active = NULL, *pending = NULL, *cbuf = NULL;
+	void *wrkmem = NULL;
+	int ret = -ENOMEM;
+
+	if (size > LOGGER_MAX_HIST_SIZE)
+		return -EINVAL;
+
+	if (size) {
+		active = vmalloc(LOGGER_HIST_CHUNK);
+		pending = vmalloc(LOGGER_HIST_CHUNK);
+		cbuf = vmalloc(lzo1x_worst_compress(LOGGER_HIST_CHUNK));
+		wrkmem = vmalloc(LZO1X_MEM_COMPRESS);
+		if (!active || !pending || !cbuf || !wrkmem)
+			goto out;
+	}
+
+	mutex_lock(&log->hist_mutex);
+
+	log->hist_size = size;
+	logger_history_trim(log, size);
+
+	/* turning it on or off swaps the buffers in or out */
+	if (!size != !log->hist_active) {
+		spin_lock(&log->lock);
+		swap(log->hist_active, active);
+		swap(log->hist_pending, pending);
+		log->hist_active_len = 0;
+		log->hist_pending_len = 0;
+		spin_unlock(&log->lock);
+
+		swap(log->hist_cbuf, cbuf);
+		swap(log->hist_wrkmem, wrkmem);
+	}
+
+	mutex_unlock(&log->hist_mutex);
+
+	ret = 0;
+out:
+	vfree(active);
+	vfree(pending);
+	vfree(cbuf);
+	vfree(wrkmem);
+
+	return ret;
+}
+
+/*
+ * logger_history_flush - drops the history along with the log
+ */
+static void logger_history_flush(struct logger_log *log)
+{
+	mutex_lock(&log->hist_mutex);
+
+	logger_history_trim(log, 0);
+
+	spin_lock(&log->lock);
+	log->hist_active_len = 0;
+	log->hist_pending_len = 0;
+	spin_unlock(&log->lock);
+
+	mutex_unlock(&log->hist_mutex);
+}
+
 /*
  * fix_up_readers - walk the list of all readers and "fix up" any who were
  * lapped by the writer; also do the same for the default "start head".
  * We do this by "pulling forward" the readers and start head to the first
  * entry after the new write head.
  *
- * The caller needs to hold log->mutex.
+ * The caller needs to hold log->lock.
  */
 static void fix_up_readers(struct logger_log *log, size_t len)
 {
@@ -263,18 +614,24 @@ static void fix_up_readers(struct logger_log *log, size_t len)
 	size_t new = logger_offset(old + len);
 	struct logger_reader *reader;
 
-	if (clock_interval(old, new, log->head))
-		log->head = get_next_entry(log, log->head, len);
+	if (clock_interval(old, new, log->head)) {
+		size_t head = get_next_entry(log, log->head, len);
+
+		logger_history_add(log, log->head, head);
+		log->head = head;
+	}
 
 	list_for_each_entry(reader, &log->readers, list)
-		if (clock_interval(old, new, reader->r_off))
+		if (clock_interval(old, new, reader->r_off)) {
 			reader->r_off = get_next_entry(log, reader->r_off, len);
+			reader->r_moved = 1;
+		}
 }
 
 /*
  * do_write_log - writes 'len' bytes from 'buf' to 'log'
  *
- * The caller needs to hold log->mutex.
+ * The caller needs to hold log->lock.
  */
 static void do_write_log(struct logger_log *log, const void *buf, size_t count)
 {
@@ -290,32 +647,6 @@ static void do_write_log(struct logger_log *log, const void *buf, size_t count)
 
 }
 
-/*
- * do_write_log_user - writes 'len' bytes from the user-space buffer 'buf' to
- * the log 'log'
- *
- * The caller needs to hold log->mutex.
- *
- * Returns 'count' on success, negative error code on failure.
- */
-static ssize_t do_write_log_from_user(struct logger_log *log,
-				      const void __user *buf, size_t count)
-{
-	size_t len;
-
-	len = min(count, log->size - log->w_off);
-	if (len && copy_from_user(log->buffer + log->w_off, buf, len))
-		return -EFAULT;
-
-	if (count != len)
-		if (copy_from_user(log->buffer, buf + len, count - len))
-			return -EFAULT;
-
-	log->w_off = logger_offset(log->w_off + count);
-
-	return count;
-}
-
 /*
  * logger_aio_write - our write method, implementing support for write(),
  * writev(), and aio_write(). Writes are our fast path, and we try to optimize
@@ -325,59 +656,70 @@ ssize_t logger_aio_write(struct kiocb *iocb, const struct iovec *iov,
 			 unsigned long nr_segs, loff_t ppos)
 {
 	struct logger_log *log = file_get_log(iocb->ki_filp);
-	size_t orig = log->w_off;
 	struct logger_entry header;
 	struct timespec now;
+	unsigned char stack_payload[LOGGER_STACK_PAYLOAD];
+	unsigned char *payload = stack_payload;
 	ssize_t ret = 0;
 
-	now = current_kernel_time();
-
 	header.pid = current->tgid;
 	header.tid = current->pid;
-	header.sec = now.tv_sec;
-	header.nsec = now.tv_nsec;
 	header.len = min_t(size_t, iocb->ki_left, LOGGER_ENTRY_MAX_PAYLOAD);
 
 	/* null writes succeed, return zero */
 	if (unlikely(!header.len))
 		return 0;
 
-	mutex_lock(&log->mutex);
+	if (header.len > sizeof(stack_payload)) {
+		payload = kmalloc(header.len, GFP_KERNEL);
+		if (!payload)
+			return -ENOMEM;
+	}
 
 	/*
-	 * Fix up any readers, pulling them forward to the first readable
-	 * entry after (what will be) the new write offset. We do this now
-	 * because if we partially fail, we can end up with clobbered log
-	 * entries that encroach on readable buffer.
+	 * Gather the payload before taking the log lock, so that faulting in
+	 * the user's buffer never holds up other writers or readers.
 	 */
-	fix_up_readers(log, sizeof(struct logger_entry) + header.len);
-
-	do_write_log(log, &header, sizeof(struct logger_entry));
-
-	while (nr_segs-- > 0) {
+	while (nr_segs-- > 0 && ret < header.len) {
 		size_t len;
-		ssize_t nr;
 
 		/* figure out how much of this vector we can keep */
 		len = min_t(size_t, iov->iov_len, header.len - ret);
 
-		/* write out this segment's payload */
-		nr = do_write_log_from_user(log, iov->iov_base, len);
-		if (unlikely(nr < 0)) {
-			log->w_off = orig;
-			mutex_unlock(&log->mutex);
-			return nr;
+		if (copy_from_user(payload + ret, iov->iov_base, len)) {
+			ret = -EFAULT;
+			goto out;
 		}
 
 		iov++;
-		ret += nr;
+		ret += len;
 	}
+	header.len = ret;
 
-	mutex_unlock(&log->mutex);
+	now = current_kernel_time();
+	header.sec = now.tv_sec;
+	header.nsec = now.tv_nsec;
+
+	spin_lock(&log->lock);
+
+	/*
+	 * Fix up any readers, pulling them forward to the first readable
+	 * entry after (what will be) the new write offset.
+	 */
+	fix_up_readers(log, sizeof(struct logger_entry) + header.len);
+
+	do_write_log(log, &header, sizeof(struct logger_entry));
+	do_write_log(log, payload, header.len);
+
+	spin_unlock(&log->lock);
 
 	/* wake up any blocked readers */
 	wake_up_interruptible(&log->wq);
 
+out:
+	if (payload != stack_payload)
+		kfree(payload);
+
 	return ret;
 }
 
@@ -408,13 +750,22 @@ static int logger_open(struct inode *inode, struct file *file)
 		if (!reader)
 			return -ENOMEM;
 
+		reader->buf = kmalloc(LOGGER_ENTRY_MAX_LEN, GFP_KERNEL);
+		if (!reader->buf) {
+			kfree(reader);
+			return -ENOMEM;
+		}
+
 		reader->log = log;
+		reader->r_moved = 0;
+		reader->hist_buf = NULL;
+		mutex_init(&reader->mutex);
 		INIT_LIST_HEAD(&reader->list);
 
-		mutex_lock(&log->mutex);
+		spin_lock(&log->lock);
 		reader->r_off = log->head;
 		list_add_tail(&reader->list, &log->readers);
-		mutex_unlock(&log->mutex);
+		spin_unlock(&log->lock);
 
 		file->private_data = reader;
 	} else
@@ -432,7 +783,13 @@ static int logger_release(struct inode *ignored, struct file *file)
 {
 	if (file->f_mode & FMODE_READ) {
 		struct logger_reader *reader = file->private_data;
+		struct logger_log *log = reader->log;
+
+		spin_lock(&log->lock);
 		list_del(&reader->list);
+		spin_unlock(&log->lock);
+		vfree(reader->hist_buf);
+		kfree(reader->buf);
 		kfree(reader);
 	}
 
@@ -462,21 +819,115 @@ static unsigned int logger_poll(struct file *file, poll_table *wait)
 
 	poll_wait(file, &log->wq, wait);
 
-	mutex_lock(&log->mutex);
-	if (log->w_off != reader->r_off)
+	spin_lock(&log->lock);
+	if (log->w_off != reader->r_off || reader->hist_buf)
 		ret |= POLLIN | POLLRDNORM;
-	mutex_unlock(&log->mutex);
+	spin_unlock(&log->lock);
 
 	return ret;
 }
 
+/*
+ * logger_resize - replace the log's buffer with a 'size' byte one
+ *
+ * The newest entries that fit are carried over to the new buffer and the
+ * readers are moved along with them; readers whose next entry was dropped
+ * continue from the oldest entry kept.
+ */
+static int logger_resize(struct logger_log *log, size_t size)
+{
+	struct logger_reader *reader;
+	unsigned char *buffer, *old_buffer;
+	size_t start, used, dropped, len;
+
+	if (!is_power_of_2(size) || size < LOGGER_MIN_LOG_SIZE ||
+	    size > LOGGER_MAX_LOG_SIZE)
+		return -EINVAL;
+
+	buffer = vmalloc(size);
+	if (!buffer)
+		return -ENOMEM;
+
+	spin_lock(&log->lock);
+
+	/* drop the oldest entries until the rest fits the new buffer */
+	start = log->head;
+	used = logger_offset(log->w_off - log->head);
+	while (used >= size) {
+		len = get_entry_len(log, start);
+		start = logger_offset(start + len);
+		used -= len;
+	}
+	dropped = logger_offset(start - log->head);
+
+	len = min(used, log->size - start);
+	memcpy(buffer, log->buffer + start, len);
+	if (used != len)
+		memcpy(buffer + len, log->buffer, used - len);
+
+	list_for_each_entry(reader, &log->readers, list) {
+		len = logger_offset(reader->r_off - log->head);
+		reader->r_off = len > dropped ? len - dropped : 0;
+		reader->r_moved = 1;
+	}
+
+	old_buffer = log->buffer;
+	log->buffer = buffer;
+	log->size = size;
+	log->head = 0;
+	log->w_off = used;
+
+	spin_unlock(&log->lock);
+
+	vfree(old_buffer);
+
+	printk(KERN_INFO "logger: resized log '%s' to %luK\n",
+	       log->misc.name, (unsigned long) size >> 10);
+
+	return 0;
+}
+
 static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 {
 	struct logger_log *log = file_get_log(file);
 	struct logger_reader *reader;
 	long ret = -ENOTTY;
 
-	mutex_lock(&log->mutex);
+	/* resizing allocates the new buffer, so it can't be done locked */
+	if (cmd == LOGGER_SET_LOG_BUF_SIZE) {
+		if (!capable(CAP_SYS_ADMIN))
+			return -EPERM;
+		return logger_resize(log, arg);
+	}
+
+	if (cmd == LOGGER_READ_HISTORY) {
+		unsigned char *hist_buf;
+
+		if (!(file->f_mode & FMODE_READ))
+			return -EBADF;
+
+		/* room for a decompressed chunk or for both staged ones */
+		hist_buf = vmalloc(2 * LOGGER_HIST_CHUNK);
+		if (!hist_buf)
+			return -ENOMEM;
+
+		reader = file->private_data;
+		mutex_lock(&reader->mutex);
+		vfree(reader->hist_buf);
+		reader->hist_buf = hist_buf;
+		reader->hist_off = 0;
+		reader->hist_len = 0;
+		reader->hist_seq = 0;
+		reader->hist_live = 0;
+		mutex_unlock(&reader->mutex);
+
+		return 0;
+	}
+
+	if (cmd == LOGGER_FLUSH_LOG && (file->f_mode & FMODE_WRITE))
+		logger_history_flush(log);
+
+	spin_lock(&log->lock);
 
 	switch (cmd) {
 	case LOGGER_GET_LOG_BUF_SIZE:
@@ -509,14 +960,16 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 			ret = -EBADF;
 			break;
 		}
-		list_for_each_entry(reader, &log->readers, list)
+		list_for_each_entry(reader, &log->readers, list) {
 			reader->r_off = log->w_off;
+			reader->r_moved = 1;
+		}
 		log->head = log->w_off;
 		ret = 0;
 		break;
 	}
 
-	mutex_unlock(&log->mutex);
+	spin_unlock(&log->lock);
 
 	return ret;
 }
@@ -533,14 +986,13 @@ static const struct file_operations logger_fops = {
 };
 
 /*
- * Defines a log structure with name 'NAME' and a size of 'SIZE' bytes, which
- * must be a power of two, greater than LOGGER_ENTRY_MAX_LEN, and less than
- * LONG_MAX minus LOGGER_ENTRY_MAX_LEN.
+ * Defines a log structure with name 'NAME' and an initial size of 'SIZE'
+ * bytes, which must be a power of two between LOGGER_MIN_LOG_SIZE and
+ * LOGGER_MAX_LOG_SIZE. The buffer itself is allocated by init_log().
  */
 #define DEFINE_LOGGER_DEVICE(VAR, NAME, SIZE) \
-static unsigned char _buf_ ## VAR[SIZE]; \
 static struct logger_log VAR = { \
-	.buffer = _buf_ ## VAR, \
+	.buffer = NULL, \
 	.misc = { \
 		.minor = MISC_DYNAMIC_MINOR, \
 		.name = NAME, \
@@ -549,10 +1001,13 @@ static struct logger_log VAR = { \
 	}, \
 	.wq = __WAIT_QUEUE_HEAD_INITIALIZER(VAR .wq), \
 	.readers = LIST_HEAD_INIT(VAR .readers), \
-	.mutex = __MUTEX_INITIALIZER(VAR .mutex), \
+	.lock = __SPIN_LOCK_UNLOCKED(VAR .lock), \
 	.w_off = 0, \
 	.head = 0, \
 	.size = SIZE, \
+	.hist_mutex = __MUTEX_INITIALIZER(VAR .hist_mutex), \
+	.hist_work = __WORK_INITIALIZER(VAR .hist_work, logger_history_work), \
+	.hist_chunks = LIST_HEAD_INIT(VAR .hist_chunks), \
 };
 
 DEFINE_LOGGER_DEVICE(log_main, LOGGER_LOG_MAIN, 256*1024)
@@ -573,17 +1028,118 @@ static struct logger_log *get_log_from_minor(int minor)
 	return NULL;
 }
 
+static ssize_t logger_show_buffer_size(struct device *dev,
+				       struct device_attribute *attr,
+				       char *buf)
+{
+	struct miscdevice *misc = dev_get_drvdata(dev);
+	struct logger_log *log = container_of(misc, struct logger_log, misc);
+
+	return sprintf(buf, "%lu\n", (unsigned long) log->size);
+}
+
+static ssize_t logger_store_buffer_size(struct device *dev,
+					struct device_attribute *attr,
+					const char *buf, size_t count)
+{
+	struct miscdevice *misc = dev_get_drvdata(dev);
+	struct logger_log *log = container_of(misc, struct logger_log, misc);
+	unsigned long size;
+	int ret;
+
+	ret = strict_strtoul(buf, 0, &size);
+	if (ret)
+		return ret;
+
+	ret = logger_resize(log, size);
+	if (ret)
+		return ret;
+
+	return count;
+}
+
+static DEVICE_ATTR(buffer_size, S_IRUGO | S_IWUSR, logger_show_buffer_size,
+		   logger_store_buffer_size);
+
+static ssize_t logger_show_history_size(struct device *dev,
+					struct device_attribute *attr,
+					char *buf)
+{
+	struct miscdevice *misc = dev_get_drvdata(dev);
+	struct logger_log *log = container_of(misc, struct logger_log, misc);
+
+	return sprintf(buf, "%lu\n", (unsigned long) log->hist_size);
+}
+
+static ssize_t logger_store_history_size(struct device *dev,
+					 struct device_attribute *attr,
+					 const char *buf, size_t count)
+{
+	struct miscdevice *misc = dev_get_drvdata(dev);
+	struct logger_log *log = container_of(misc, struct logger_log, misc);
+	unsigned long size;
+	int ret;
+
+	ret = strict_strtoul(buf, 0, &size);
+	if (ret)
+		return ret;
+
+	ret = logger_history_set(log, size);
+	if (ret)
+		return ret;
+
+	return count;
+}
+
+static DEVICE_ATTR(history_size, S_IRUGO | S_IWUSR, logger_show_history_size,
+		   logger_store_history_size);
+
+static ssize_t logger_show_history_used(struct device *dev,
+					struct device_attribute *attr,
+					char *buf)
+{
+	struct miscdevice *misc = dev_get_drvdata(dev);
+	struct logger_log *log = container_of(misc, struct logger_log, misc);
+
+	return sprintf(buf, "%lu\n", (unsigned long) log->hist_used);
+}
+
+static DEVICE_ATTR(history_used, S_IRUGO, logger_show_history_used, NULL);
+
 static int __init init_log(struct logger_log *log)
 {
 	int ret;
 
+	log->buffer = vmalloc(log->size);
+	if (!log->buffer) {
+		printk(KERN_ERR "logger: failed to allocate buffer "
+		       "for log '%s'!\n", log->misc.name);
+		return -ENOMEM;
+	}
+
 	ret = misc_register(&log->misc);
 	if (unlikely(ret)) {
 		printk(KERN_ERR "logger: failed to register misc "
 		       "device for log '%s'!\n", log->misc.name);
+		vfree(log->buffer);
+		log->buffer = NULL;
 		return ret;
 	}
 
+	ret = device_create_file(log->misc.this_device, &dev_attr_buffer_size);
+	if (ret)
+		printk(KERN_WARNING "logger: failed to create buffer_size "
+		       "attribute for log '%s'\n", log->misc.name);
+
+	ret = device_create_file(log->misc.this_device,
+				 &dev_attr_history_size);
+	if (!ret)
+		ret = device_create_file(log->misc.this_device,
+					 &dev_attr_history_used);
+	if (ret)
+		printk(KERN_WARNING "logger: failed to create history "
+		       "attributes for log '%s'\n", log->misc.name);
+
 	printk(KERN_INFO "logger: created %luK log '%s'\n",
 	       (unsigned long) log->size >> 10, log->misc.name);
 
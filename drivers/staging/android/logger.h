@@ -45,5 +45,7 @@ struct logger_entry {
 #define LOGGER_GET_LOG_LEN		_IO(__LOGGERIO, 2) /* used log len */
 #define LOGGER_GET_NEXT_ENTRY_LEN	_IO(__LOGGERIO, 3) /* next entry len */
 #define LOGGER_FLUSH_LOG		_IO(__LOGGERIO, 4) /* flush log */
+#define LOGGER_SET_LOG_BUF_SIZE		_IO(__LOGGERIO, 5) /* resize log */
+#define LOGGER_READ_HISTORY		_IO(__LOGGERIO, 6) /* history first */
 
 #endif /* _LINUX_LOGGER_H */
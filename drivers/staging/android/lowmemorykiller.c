@@ -29,17 +29,21 @@
  *
  */
 
+#include <linux/hash.h>
 #include <linux/kernel.h>
 #include <linux/kobject.h>
 #include <linux/memory.h>
 #include <linux/memory_hotplug.h>
 #include <linux/mm.h>
 #include <linux/module.h>
+#include <linux/mutex.h>
 #include <linux/notifier.h>
 #include <linux/oom.h>
 #include <linux/sched.h>
 #include <linux/slab.h>
+#include <linux/spinlock.h>
 #include <linux/sysfs.h>
+#include <linux/vmpressure.h>
 
 static uint32_t lowmem_debug_level = 2;
 static int lowmem_adj[6] = {
@@ -62,6 +66,7 @@ static size_t lowmem_minfree_notif_trigger;
 static unsigned int offlining;
 static struct task_struct *lowmem_deathpending;
 static unsigned long lowmem_deathpending_timeout;
+static ktime_t lowmem_deathpending_start;
 static struct kobject *lowmem_kobj;
 
 #define lowmem_print(level, x...)			\
@@ -70,6 +75,88 @@ static struct kobject *lowmem_kobj;
 			printk(x);			\
 	} while (0)
 
+/*
+ * Candidate index. Every thread group is kept in the bucket for its oom_adj,
+ * from fork and whenever the value is written through /proc, so victim
+ * selection only walks the highest non-empty buckets instead of the whole
+ * task list. The full scan is still used when the buckets yield no victim.
+ */
+#define LOWMEM_BUCKETS		(OOM_ADJUST_MAX - OOM_DISABLE + 1)
+#define LOWMEM_HASH_BITS	7
+#define LOWMEM_BUCKET_BATCH	16
+
+struct lowmem_candidate {
+	struct list_head	bucket_node;
+	struct hlist_node	hash_node;
+	struct task_struct	*task;	/* thread group leader */
+};
+
+static struct list_head lowmem_buckets[LOWMEM_BUCKETS];
+static struct hlist_head lowmem_hash[1 << LOWMEM_HASH_BITS];
+static struct kmem_cache *lowmem_candidate_cachep;
+static DEFINE_SPINLOCK(lowmem_lock);	/* protects the index and stats */
+static DEFINE_MUTEX(lowmem_scan_mutex);	/* serializes bucket scans */
+static int lowmem_use_buckets = 1;
+
+#ifdef CONFIG_VMPRESSURE
+static int lowmem_pressure_mode;
+#endif
+
+static struct lowmem_stats {
+	unsigned long	bucket_selects;
+	unsigned long	full_scans;
+	unsigned long	tasks_scanned;
+	u64		scan_ns;
+	u64		scan_ns_max;
+	unsigned long	kills;
+	u64		kill_latency_ns;
+	u64		kill_latency_ns_max;
+} lowmem_stats;
+
+static struct lowmem_candidate *lowmem_find_candidate(struct task_struct *task)
+{
+	struct lowmem_candidate *c;
+	struct hlist_node *pos;
+
+	hlist_for_each_entry(c, pos,
+			     &lowmem_hash[hash_ptr(task, LOWMEM_HASH_BITS)],
+			     hash_node)
+		if (c->task == task)
+			return c;
+	return NULL;
+}
+
+static int
+lowmem_oom_adj_notify(struct notifier_block *self, unsigned long val,
+		      void *data)
+{
+	struct task_struct *task = ((struct task_struct *)data)->group_leader;
+	int oom_adj = (int)val;
+	struct lowmem_candidate *c;
+	unsigned long flags;
+
+	spin_lock_irqsave(&lowmem_lock, flags);
+	c = lowmem_find_candidate(task);
+	if (c) {
+		list_del(&c->bucket_node);
+	} else {
+		c = kmem_cache_alloc(lowmem_candidate_cachep, GFP_ATOMIC);
+		if (!c)
+			goto out;
+		c->task = task;
+		hlist_add_head(&c->hash_node,
+			       &lowmem_hash[hash_ptr(task, LOWMEM_HASH_BITS)]);
+	}
+	list_add_tail(&c->bucket_node, &lowmem_buckets[oom_adj - OOM_DISABLE]);
+out:
+	spin_unlock_irqrestore(&lowmem_lock, flags);
+	return NOTIFY_OK;
+}
+
+static struct notifier_block oom_adj_nb = {
+	.notifier_call	= lowmem_oom_adj_notify,
+};
+
 static int
 task_notify_func(struct notifier_block *self, unsigned long val, void *data);
 
@@ -81,9 +168,26 @@ static int
 task_notify_func(struct notifier_block *self, unsigned long val, void *data)
 {
 	struct task_struct *task = data;
+	struct lowmem_candidate *c;
+	unsigned long flags;
+	u64 latency;
 
-	if (task == lowmem_deathpending)
+	spin_lock_irqsave(&lowmem_lock, flags);
+	if (task == lowmem_deathpending) {
 		lowmem_deathpending = NULL;
+		latency = ktime_to_ns(ktime_sub(ktime_get(),
+						lowmem_deathpending_start));
+		lowmem_stats.kill_latency_ns = latency;
+		if (latency > lowmem_stats.kill_latency_ns_max)
+			lowmem_stats.kill_latency_ns_max = latency;
+	}
+	c = lowmem_find_candidate(task);
+	if (c) {
+		list_del(&c->bucket_node);
+		hlist_del(&c->hash_node);
+		kmem_cache_free(lowmem_candidate_cachep, c);
+	}
+	spin_unlock_irqrestore(&lowmem_lock, flags);
 
 	return NOTIFY_OK;
 }
@@ -137,12 +241,159 @@ static inline void get_free_ram(int *other_free, int *other_file)
 	}
 }
 
-static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
+/*
+ * Pick the largest task of the highest non-empty bucket at or above min_adj.
+ * Returns the victim with a reference held.
+ *
+ * A bucket is moved to a private list and its entries are put back in
+ * batches, so the whole bucket is looked at without holding lowmem_lock
+ * while the tasks are examined. Entries keep no reference on their task;
+ * one that is already on its way to the free notifier is skipped.
+ */
+static struct task_struct *lowmem_select_from_buckets(int min_adj,
+						      int *oom_adj_out,
+						      int *tasksize_out)
+{
+	struct task_struct *batch[LOWMEM_BUCKET_BATCH];
+	struct task_struct *selected = NULL;
+	struct lowmem_candidate *c, *tmp;
+	struct list_head *bucket;
+	LIST_HEAD(pending);
+	unsigned long flags;
+	int selected_tasksize = 0;
+	int oom_adj, tasksize;
+	int i, n, done;
+
+	mutex_lock(&lowmem_scan_mutex);
+	for (oom_adj = OOM_ADJUST_MAX; oom_adj >= min_adj; oom_adj--) {
+		bucket = &lowmem_buckets[oom_adj - OOM_DISABLE];
+
+		spin_lock_irqsave(&lowmem_lock, flags);
+		list_splice_init(bucket, &pending);
+		spin_unlock_irqrestore(&lowmem_lock, flags);
+
+		do {
+			n = 0;
+			spin_lock_irqsave(&lowmem_lock, flags);
+			list_for_each_entry_safe(c, tmp, &pending, bucket_node) {
+				if (n == LOWMEM_BUCKET_BATCH)
+					break;
+				list_move_tail(&c->bucket_node, bucket);
+				if (atomic_inc_not_zero(&c->task->usage))
+					batch[n++] = c->task;
+			}
+			done = list_empty(&pending);
+			spin_unlock_irqrestore(&lowmem_lock, flags);
+
+			for (i = 0; i < n; i++) {
+				struct task_struct *p = batch[i];
+
+				task_lock(p);
+				if (!p->mm || p->signal->oom_adj != oom_adj) {
+					task_unlock(p);
+					put_task_struct(p);
+					continue;
+				}
+				tasksize = get_mm_rss(p->mm);
+				task_unlock(p);
+				if (tasksize <= selected_tasksize) {
+					put_task_struct(p);
+					continue;
+				}
+				if (selected)
+					put_task_struct(selected);
+				selected = p;
+				selected_tasksize = tasksize;
+			}
+		} while (!done);
+
+		if (selected) {
+			*oom_adj_out = oom_adj;
+			*tasksize_out = selected_tasksize;
+			break;
+		}
+	}
+	mutex_unlock(&lowmem_scan_mutex);
+
+	return selected;
+}
+
+/*
+ * Walk every process for the highest oom_adj, largest task at or above
+ * min_adj. Returns the victim with a reference held.
+ */
+static struct task_struct *lowmem_select_full_scan(int min_adj,
+						   int *oom_adj_out,
+						   int *tasksize_out)
 {
 	struct task_struct *p;
 	struct task_struct *selected = NULL;
-	int rem = 0;
+	int selected_tasksize = 0;
+	int selected_oom_adj = min_adj;
 	int tasksize;
+	unsigned long scanned = 0;
+	unsigned long flags;
+	ktime_t start = ktime_get();
+	u64 scan_ns;
+
+	read_lock(&tasklist_lock);
+	for_each_process(p) {
+		struct mm_struct *mm;
+		struct signal_struct *sig;
+		int oom_adj;
+
+		scanned++;
+		task_lock(p);
+		mm = p->mm;
+		sig = p->signal;
+		if (!mm || !sig) {
+			task_unlock(p);
+			continue;
+		}
+		oom_adj = sig->oom_adj;
+		if (oom_adj < min_adj) {
+			task_unlock(p);
+			continue;
+		}
+		tasksize = get_mm_rss(mm);
+		task_unlock(p);
+		if (tasksize <= 0)
+			continue;
+		if (selected) {
+			if (oom_adj < selected_oom_adj)
+				continue;
+			if (oom_adj == selected_oom_adj &&
+			    tasksize <= selected_tasksize)
+				continue;
+		}
+		selected = p;
+		selected_tasksize = tasksize;
+		selected_oom_adj = oom_adj;
+		lowmem_print(2, "select %d (%s), adj %d, size %d, to kill\n",
+			     p->pid, p->comm, oom_adj, tasksize);
+	}
+	if (selected)
+		get_task_struct(selected);
+	read_unlock(&tasklist_lock);
+
+	scan_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	spin_lock_irqsave(&lowmem_lock, flags);
+	lowmem_stats.full_scans++;
+	lowmem_stats.tasks_scanned += scanned;
+	lowmem_stats.scan_ns += scan_ns;
+	if (scan_ns > lowmem_stats.scan_ns_max)
+		lowmem_stats.scan_ns_max = scan_ns;
+	spin_unlock_irqrestore(&lowmem_lock, flags);
+
+	*oom_adj_out = selected_oom_adj;
+	*tasksize_out = selected_tasksize;
+	return selected;
+}
+
+static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
+{
+	struct task_struct *selected = NULL;
+	int rem = 0;
 	int i;
 	int min_adj = OOM_ADJUST_MAX + 1;
 	int selected_tasksize = 0;
@@ -150,6 +401,7 @@ static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 	int array_size = ARRAY_SIZE(lowmem_adj);
 	int other_free;
 	int other_file;
+	unsigned long flags;
 	/*
 	 * If we already have a death outstanding, then
 	 * bail out right away; indicating to vmscan
@@ -172,6 +424,25 @@ static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 		array_size = lowmem_adj_size;
 	if (lowmem_minfree_size < array_size)
 		array_size = lowmem_minfree_size;
+#ifdef CONFIG_VMPRESSURE
+	/*
+	 * In pressure mode the file cache only counts as free memory while
+	 * reclaim is actually getting pages back from it. Under critical
+	 * pressure it is ignored, so kills start even with a large page
+	 * cache that is thrashing; under low pressure only the most severe
+	 * threshold may trigger a kill, since reclaim is still cheap.
+	 */
+	if (lowmem_pressure_mode) {
+		enum vmpressure_levels level = vmpressure_level();
+
+		if (level == VMPRESSURE_CRITICAL)
+			other_file = 0;
+		else if (level == VMPRESSURE_LOW && array_size > 1)
+			array_size = 1;
+		lowmem_print(3, "lowmem_shrink pressure %u, level %d\n",
+			     vmpressure_value(), level);
+	}
+#endif
 	for (i = 0; i < array_size; i++) {
 		if (other_free < lowmem_minfree[i] &&
 		    other_file < lowmem_minfree[i]) {
@@ -192,55 +463,42 @@ static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 			     sc->nr_to_scan, sc->gfp_mask, rem);
 		return rem;
 	}
-	selected_oom_adj = min_adj;
-
-	read_lock(&tasklist_lock);
-	for_each_process(p) {
-		struct mm_struct *mm;
-		struct signal_struct *sig;
-		int oom_adj;
 
-		task_lock(p);
-		mm = p->mm;
-		sig = p->signal;
-		if (!mm || !sig) {
-			task_unlock(p);
-			continue;
-		}
-		oom_adj = sig->oom_adj;
-		if (oom_adj < min_adj) {
-			task_unlock(p);
-			continue;
-		}
-		tasksize = get_mm_rss(mm);
-		task_unlock(p);
-		if (tasksize <= 0)
-			continue;
+	if (lowmem_use_buckets) {
+		selected = lowmem_select_from_buckets(min_adj,
+						      &selected_oom_adj,
+						      &selected_tasksize);
 		if (selected) {
-			if (oom_adj < selected_oom_adj)
-				continue;
-			if (oom_adj == selected_oom_adj &&
-			    tasksize <= selected_tasksize)
-				continue;
+			spin_lock_irqsave(&lowmem_lock, flags);
+			lowmem_stats.bucket_selects++;
+			spin_unlock_irqrestore(&lowmem_lock, flags);
 		}
-		selected = p;
-		selected_tasksize = tasksize;
-		selected_oom_adj = oom_adj;
-		lowmem_print(2, "select %d (%s), adj %d, size %d, to kill\n",
-			     p->pid, p->comm, oom_adj, tasksize);
 	}
+	if (!selected)
+		selected = lowmem_select_full_scan(min_adj, &selected_oom_adj,
+						   &selected_tasksize);
+
 	if (selected) {
-		lowmem_print(1, "send sigkill to %d (%s), adj %d, size %d\n",
-			     selected->pid, selected->comm,
-			     selected_oom_adj, selected_tasksize);
-		lowmem_deathpending = selected;
-		lowmem_deathpending_timeout = jiffies + HZ;
-		force_sig(SIGKILL, selected);
-		rem -= selected_tasksize;
+		read_lock(&tasklist_lock);
+		if (pid_alive(selected)) {
+			lowmem_print(1, "send sigkill to %d (%s), adj %d, "
+				     "size %d\n", selected->pid,
+				     selected->comm, selected_oom_adj,
+				     selected_tasksize);
+			spin_lock_irqsave(&lowmem_lock, flags);
+			lowmem_deathpending = selected;
+			lowmem_deathpending_timeout = jiffies + HZ;
+			lowmem_deathpending_start = ktime_get();
+			lowmem_stats.kills++;
+			spin_unlock_irqrestore(&lowmem_lock, flags);
+			force_sig(SIGKILL, selected);
+			rem -= selected_tasksize;
+		}
+		read_unlock(&tasklist_lock);
+		put_task_struct(selected);
 	}
 	lowmem_print(4, "lowmem_shrink %lu, %x, return %d\n",
 		     sc->nr_to_scan, sc->gfp_mask, rem);
-	read_unlock(&tasklist_lock);
 	return rem;
 }
 
@@ -271,8 +529,40 @@ static struct kobj_attribute lowmem_notify_trigger_active_attr =
 	__ATTR(notify_trigger_active, S_IRUGO,
 			lowmem_notify_trigger_active_show, NULL);
 
+static ssize_t lowmem_stats_show(struct kobject *k,
+		struct kobj_attribute *attr, char *buf)
+{
+	struct lowmem_stats stats;
+	unsigned long flags;
+
+	spin_lock_irqsave(&lowmem_lock, flags);
+	stats = lowmem_stats;
+	spin_unlock_irqrestore(&lowmem_lock, flags);
+
+	return snprintf(buf, PAGE_SIZE,
+			"bucket_selects %lu\n"
+			"full_scans %lu\n"
+			"tasks_scanned %lu\n"
+			"scan_ns %llu\n"
+			"scan_ns_max %llu\n"
+			"kills %lu\n"
+			"kill_latency_ns %llu\n"
+			"kill_latency_ns_max %llu\n",
+			stats.bucket_selects, stats.full_scans,
+			stats.tasks_scanned,
+			(unsigned long long)stats.scan_ns,
+			(unsigned long long)stats.scan_ns_max,
+			stats.kills,
+			(unsigned long long)stats.kill_latency_ns,
+			(unsigned long long)stats.kill_latency_ns_max);
+}
+
+static struct kobj_attribute lowmem_stats_attr =
+	__ATTR(stats, S_IRUGO, lowmem_stats_show, NULL);
+
 static struct attribute *lowmem_default_attrs[] = {
 	&lowmem_notify_trigger_active_attr.attr,
+	&lowmem_stats_attr.attr,
 	NULL,
 };
 
@@ -301,7 +591,16 @@ static struct kobj_type lowmem_kobj_type = {
 static int __init lowmem_init(void)
 {
 	int rc;
+	int i;
+
+	lowmem_candidate_cachep = KMEM_CACHE(lowmem_candidate, 0);
+	if (!lowmem_candidate_cachep)
+		return -ENOMEM;
+	for (i = 0; i < LOWMEM_BUCKETS; i++)
+		INIT_LIST_HEAD(&lowmem_buckets[i]);
+
 	task_free_register(&task_nb);
+	register_oom_adj_notifier(&oom_adj_nb);
 	register_shrinker(&lowmem_shrinker);
 #ifdef CONFIG_MEMORY_HOTPLUG
 	hotplug_memory_notifier(lmk_hotplug_callback, 0);
@@ -325,7 +624,9 @@ err_kobj:
 
 err:
 	unregister_shrinker(&lowmem_shrinker);
+	unregister_oom_adj_notifier(&oom_adj_nb);
 	task_free_unregister(&task_nb);
+	kmem_cache_destroy(lowmem_candidate_cachep);
 
 	return rc;
 }
@@ -335,7 +636,9 @@ static void __exit lowmem_exit(void)
 	kobject_put(lowmem_kobj);
 	kfree(lowmem_kobj);
 	unregister_shrinker(&lowmem_shrinker);
+	unregister_oom_adj_notifier(&oom_adj_nb);
 	task_free_unregister(&task_nb);
+	kmem_cache_destroy(lowmem_candidate_cachep);
 }
 
 module_param_named(cost, lowmem_shrinker.seeks, int, S_IRUGO | S_IWUSR);
@@ -346,6 +649,11 @@ module_param_array_named(minfree, lowmem_minfree, uint, &lowmem_minfree_size,
 module_param_named(debug_level, lowmem_debug_level, uint, S_IRUGO | S_IWUSR);
 module_param_named(notify_trigger, lowmem_minfree_notif_trigger, uint,
 			 S_IRUGO | S_IWUSR);
+module_param_named(use_buckets, lowmem_use_buckets, bool, S_IRUGO | S_IWUSR);
+#ifdef CONFIG_VMPRESSURE
+module_param_named(pressure_mode, lowmem_pressure_mode, bool,
+			 S_IRUGO | S_IWUSR);
+#endif
 
 module_init(lowmem_init);
 module_exit(lowmem_exit);
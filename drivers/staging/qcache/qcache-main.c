@@ -5,7 +5,8 @@
  *
  * Qcache provides an in-kernel "host implementation" for transcendent memory
  * and, thus indirectly, for cleancache and frontswap.  Qcache includes a
- * page-accessible memory [1] interface, utilizing lzo1x compression:
+ * page-accessible memory [1] interface, utilizing crypto API compression
+ * (lzo1x by default):
  * 1) "compression buddies" ("zbud") is used for ephemeral pages
  * Zbud allows pairs (and potentially,
  * in the future, more than a pair of) compressed pages to be closely linked
@@ -18,9 +19,9 @@
 
 #include <linux/module.h>
 #include <linux/cpu.h>
+#include <linux/crypto.h>
 #include <linux/highmem.h>
 #include <linux/list.h>
-#include <linux/lzo.h>
 #include <linux/slab.h>
 #include <linux/spinlock.h>
 #include <linux/types.h>
@@ -38,6 +39,37 @@
 #define ZCACHE_GFP_MASK \
 	(__GFP_FS | __GFP_NORETRY | __GFP_NOWARN | __GFP_NOMEMALLOC)
 
+/*
+ * Compression goes through the crypto API so that any "compress" algorithm
+ * can be used. Each cpu has its own transform, as compressors keep state.
+ */
+/* Compressor for all pages, set with the qcache.compressor parameter */
+static char zcache_comp_name[CRYPTO_MAX_ALG_NAME] = "lzo";
+module_param_string(compressor, zcache_comp_name, sizeof(zcache_comp_name),
+		    0444);
+static DEFINE_PER_CPU(struct crypto_comp *, zcache_comp_tfm);
+
+enum zcache_comp_op {
+	ZCACHE_COMPOP_COMPRESS,
+	ZCACHE_COMPOP_DECOMPRESS
+};
+
+static int zcache_comp_op(enum zcache_comp_op op, const u8 *src,
+			  unsigned int slen, u8 *dst, unsigned int *dlen)
+{
+	struct crypto_comp *tfm;
+	int ret;
+
+	tfm = get_cpu_var(zcache_comp_tfm);
+	BUG_ON(tfm == NULL);
+	if (op == ZCACHE_COMPOP_COMPRESS)
+		ret = crypto_comp_compress(tfm, src, slen, dst, dlen);
+	else
+		ret = crypto_comp_decompress(tfm, src, slen, dst, dlen);
+	put_cpu_var(zcache_comp_tfm);
+	return ret;
+}
+
 #define MAX_POOLS_PER_CLIENT 16
 
 #define MAX_CLIENTS 16
@@ -95,6 +127,11 @@ static inline bool is_local_client(struct zcache_client *cli)
  * (3) one of PAGE_SIZE/64 "unbuddied" lists indexed by how many chunks
  * the one unbuddied zbud uses.  The data inside a zbpg cannot be
  * read or written unless the zbpg's lock is held.
+ *
+ * Every zbpg holding data is also on the LRU list, ordered by the time
+ * its most recent zbud was stored.  Eviction takes zbpgs from the head
+ * of that list, so the compressed pages that have gone unused longest
+ * are dropped first regardless of which pool they belong to.
  */
 
 #define ZBH_SENTINEL  0x43214321
@@ -113,6 +150,8 @@ struct zbud_hdr {
 
 struct zbud_page {
 	struct list_head bud_list;
+	struct list_head lru;
+	unsigned long stamp; /* jiffies when the last zbud was stored */
 	spinlock_t lock;
 	struct zbud_hdr buddy[ZBUD_MAX_BUDS];
 	DECL_SENTINEL
@@ -137,7 +176,10 @@ static unsigned long zbud_cumul_chunk_counts[NCHUNKS];
 struct list_head zbud_buddied_list;
 static unsigned long zcache_zbud_buddied_count;
 
-/* protects the buddied list and all unbuddied lists */
+/* least recently stored zbpgs first */
+static LIST_HEAD(zbud_lru_list);
+
+/* protects the buddied list, all unbuddied lists and the LRU list */
 static DEFINE_SPINLOCK(zbud_budlists_spinlock);
 
 static atomic_t zcache_zbud_curr_raw_pages;
@@ -254,6 +296,7 @@ static struct zbud_page *zbud_alloc_raw_page(void)
 	zbpg = zcache_get_free_page();
 	if (likely(zbpg != NULL)) {
 		INIT_LIST_HEAD(&zbpg->bud_list);
+		INIT_LIST_HEAD(&zbpg->lru);
 		zh0 = &zbpg->buddy[0]; zh1 = &zbpg->buddy[1];
 		spin_lock_init(&zbpg->lock);
 		atomic_inc(&zcache_zbud_curr_raw_pages);
@@ -272,6 +315,7 @@ static void zbud_free_raw_page(struct zbud_page *zbpg)
 
 	ASSERT_SENTINEL(zbpg, ZBPG);
 	BUG_ON(!list_empty(&zbpg->bud_list));
+	BUG_ON(!list_empty(&zbpg->lru));
 	BUG_ON(zh0->size != 0 || tmem_oid_valid(&zh0->oid));
 	BUG_ON(zh1->size != 0 || tmem_oid_valid(&zh1->oid));
 	INVERT_SENTINEL(zbpg, ZBPG);
@@ -319,6 +363,7 @@ static void zbud_free_and_delist(struct zbud_hdr *zh)
 		spin_lock(&zbud_budlists_spinlock);
 		BUG_ON(list_empty(&zbud_unbuddied[chunks].list));
 		list_del_init(&zbpg->bud_list);
+		list_del_init(&zbpg->lru);
 		zbud_unbuddied[chunks].count--;
 		spin_unlock(&zbud_budlists_spinlock);
 		zbud_free_raw_page(zbpg);
@@ -394,6 +439,8 @@ init_zh:
 	zh->oid = *oid;
 	zh->pool_id = pool_id;
 	zh->client_id = client_id;
+	zbpg->stamp = jiffies;
+	list_move_tail(&zbpg->lru, &zbud_lru_list);
 	/* can wait to copy the data until the list locks are dropped */
 	spin_unlock(&zbud_budlists_spinlock);
 
@@ -413,7 +460,7 @@ static int zbud_decompress(struct page *page, struct zbud_hdr *zh)
 {
 	struct zbud_page *zbpg;
 	unsigned budnum = zbud_budnum(zh);
-	size_t out_len = PAGE_SIZE;
+	unsigned int out_len = PAGE_SIZE;
 	char *to_va, *from_va;
 	unsigned size;
 	int ret = 0;
@@ -429,8 +476,9 @@ static int zbud_decompress(struct page *page, struct zbud_hdr *zh)
 	to_va = kmap_atomic(page, KM_USER0);
 	size = zh->size;
 	from_va = zbud_data(zh, size);
-	ret = lzo1x_decompress_safe(from_va, size, to_va, &out_len);
-	BUG_ON(ret != LZO_E_OK);
+	ret = zcache_comp_op(ZCACHE_COMPOP_DECOMPRESS, from_va, size,
+			     to_va, &out_len);
+	BUG_ON(ret);
 	BUG_ON(out_len != PAGE_SIZE);
 	kunmap_atomic(to_va, KM_USER0);
 out:
@@ -442,6 +490,113 @@ static struct tmem_pool *zcache_get_pool_by_id(uint16_t cli_id,
 						uint16_t poolid);
 static void zcache_put_pool(struct tmem_pool *pool);
 
+/*
+ * The following routines make room in the fmem region by evicting the
+ * least recently stored pages first.
+ */
+
+static unsigned long zcache_evicted_buddied_pages;
+static unsigned long zcache_evicted_unbuddied_pages;
+static unsigned long zcache_evicted_age_ms;
+
+/*
+ * Flush and free all zbuds in a zbpg, then free the pageframe
+ */
+static void zbud_evict_zbpg(struct zbud_page *zbpg)
+{
+	struct zbud_hdr *zh;
+	int i, j;
+	uint16_t client_id[ZBUD_MAX_BUDS], pool_id[ZBUD_MAX_BUDS];
+	uint32_t index[ZBUD_MAX_BUDS];
+	struct tmem_oid oid[ZBUD_MAX_BUDS];
+	struct tmem_pool *pool;
+
+	BUG_ON(!list_empty(&zbpg->bud_list));
+	for (i = 0, j = 0; i < ZBUD_MAX_BUDS; i++) {
+		zh = &zbpg->buddy[i];
+		if (zh->size) {
+			client_id[j] = zh->client_id;
+			pool_id[j] = zh->pool_id;
+			oid[j] = zh->oid;
+			index[j] = zh->index;
+			j++;
+			zbud_free(zh);
+		}
+	}
+	spin_unlock(&zbpg->lock);
+	for (i = 0; i < j; i++) {
+		pool = zcache_get_pool_by_id(client_id[i], pool_id[i]);
+		if (pool != NULL) {
+			tmem_flush_page(pool, &oid[i], index[i]);
+			zcache_put_pool(pool);
+		}
+	}
+	ASSERT_SENTINEL(zbpg, ZBPG);
+	spin_lock(&zbpg->lock);
+	zbud_free_raw_page(zbpg);
+}
+
+/*
+ * Don't look further than this down the LRU list for a zbpg of one
+ * particular pool, a pool at its quota then fails the put instead.
+ */
+#define ZBUD_LRU_SCAN_MAX 32
+
+static inline bool zbud_hdr_in_pool(struct zbud_hdr *zh, uint16_t client_id,
+					uint16_t pool_id)
+{
+	return zh->size != 0 && zh->client_id == client_id &&
+		zh->pool_id == pool_id;
+}
+
+/*
+ * Evict the least recently stored zbpg, or with pool_id >= 0 the least
+ * recently stored one holding a zbud of that pool of client_id.  The zbpg
+ * locks are only trylocked, they nest outside the budlists lock
+ * elsewhere.  Called with interrupts disabled; returns 1 if a zbpg was
+ * evicted.
+ */
+static int zbud_evict_lru(uint16_t client_id, int pool_id)
+{
+	struct zbud_page *zbpg;
+	struct zbud_hdr *zh0, *zh1;
+	unsigned chunks;
+	int scanned = 0;
+
+	spin_lock(&zbud_budlists_spinlock);
+	list_for_each_entry(zbpg, &zbud_lru_list, lru) {
+		if (pool_id >= 0 && ++scanned > ZBUD_LRU_SCAN_MAX)
+			break;
+		if (unlikely(!spin_trylock(&zbpg->lock)))
+			continue;
+		zh0 = &zbpg->buddy[0]; zh1 = &zbpg->buddy[1];
+		if (pool_id >= 0 &&
+		    !zbud_hdr_in_pool(zh0, client_id, pool_id) &&
+		    !zbud_hdr_in_pool(zh1, client_id, pool_id)) {
+			spin_unlock(&zbpg->lock);
+			continue;
+		}
+		if (zh0->size != 0 && zh1->size != 0) {
+			zcache_zbud_buddied_count--;
+			zcache_evicted_buddied_pages++;
+		} else {
+			chunks = zbud_size_to_chunks(zh0->size != 0 ?
+						     zh0->size : zh1->size);
+			zbud_unbuddied[chunks].count--;
+			zcache_evicted_unbuddied_pages++;
+		}
+		list_del_init(&zbpg->bud_list);
+		list_del_init(&zbpg->lru);
+		spin_unlock(&zbud_budlists_spinlock);
+		zcache_evicted_age_ms = jiffies_to_msecs(jiffies - zbpg->stamp);
+		/* want budlists unlocked when doing zbpg eviction */
+		zbud_evict_zbpg(zbpg);
+		return 1;
+	}
+	spin_unlock(&zbud_budlists_spinlock);
+	return 0;
+}
+
 static void zbud_init(void)
 {
 	int i;
@@ -470,6 +625,20 @@ static int zbud_show_unbuddied_list_counts(char *buf)
 	return p - buf;
 }
 
+static int zbud_show_lru_oldest_age_ms(char *buf)
+{
+	struct zbud_page *zbpg;
+	unsigned long age = 0;
+
+	spin_lock_irq(&zbud_budlists_spinlock);
+	if (!list_empty(&zbud_lru_list)) {
+		zbpg = list_first_entry(&zbud_lru_list, struct zbud_page, lru);
+		age = jiffies_to_msecs(jiffies - zbpg->stamp);
+	}
+	spin_unlock_irq(&zbud_budlists_spinlock);
+	return sprintf(buf, "%lu\n", age);
+}
+
 static int zbud_show_cumul_chunk_counts(char *buf)
 {
 	unsigned long i, chunks = 0, total_chunks = 0, sum_total_chunks = 0;
@@ -507,6 +676,16 @@ static unsigned long zcache_flobj_total;
 static unsigned long zcache_flobj_found;
 static unsigned long zcache_failed_eph_puts;
 
+/*
+ * Per-pool count of stored pages for the local client's pools and the
+ * quota on it, zero meaning no quota.  A pool at its quota evicts its
+ * own oldest zbpg to make room for a put.
+ */
+static atomic_t zcache_pool_zpages[MAX_POOLS_PER_CLIENT];
+static unsigned long zcache_pool_quota[MAX_POOLS_PER_CLIENT];
+static unsigned long zcache_quota_evictions;
+static unsigned long zcache_quota_rejects;
+
 /*
  * Tmem operations assume the poolid implies the invoking client.
  * Zcache only has one client (the kernel itself): LOCAL_CLIENT.
@@ -647,6 +826,12 @@ static int zcache_do_preload(struct tmem_pool *pool)
 		goto unlock_out;
 	}
 	page = qcache_alloc();
+	/*
+	 * The fmem region can't grow, so once it is full make room by
+	 * evicting the oldest zbpg rather than turning the put into a flush.
+	 */
+	if (unlikely(page == NULL) && zbud_evict_lru(LOCAL_CLIENT, -1))
+		page = qcache_alloc();
 	if (unlikely(page == NULL)) {
 		zcache_failed_get_free_pages++;
 		kmem_cache_free(zcache_obj_cache, obj);
@@ -813,11 +998,13 @@ static void *zcache_pampd_create(char *data, size_t size, bool raw, int eph,
 	}
 	pampd = (void *)zbud_create(client_id, pool->pool_id, oid,
 					index, page, cdata, clen);
-	if (pampd != NULL) {
-		count = atomic_inc_return(&zcache_curr_eph_pampd_count);
-		if (count > zcache_curr_eph_pampd_count_max)
-			zcache_curr_eph_pampd_count_max = count;
-	}
+	if (pampd == NULL)
+		goto out;
+	count = atomic_inc_return(&zcache_curr_eph_pampd_count);
+	if (count > zcache_curr_eph_pampd_count_max)
+		zcache_curr_eph_pampd_count_max = count;
+	if (is_local_client(cli))
+		atomic_inc(&zcache_pool_zpages[pool->pool_id]);
 out:
 	return pampd;
 }
@@ -842,11 +1029,14 @@ static int zcache_pampd_get_data_and_free(char *data, size_t *bufsize, bool raw,
 					void *pampd, struct tmem_pool *pool,
 					struct tmem_oid *oid, uint32_t index)
 {
-	int ret = 0;
+	int ret;
 
-	zbud_decompress((struct page *)(data), pampd);
+	/* fails if the zbpg is being evicted, see zbud_evict_lru() */
+	ret = zbud_decompress((struct page *)(data), pampd);
 	zbud_free_and_delist((struct zbud_hdr *)pampd);
 	atomic_dec(&zcache_curr_eph_pampd_count);
+	if (is_local_client(pool->client))
+		atomic_dec(&zcache_pool_zpages[pool->pool_id]);
 	return ret;
 }
 
@@ -860,6 +1050,8 @@ static void zcache_pampd_free(void *pampd, struct tmem_pool *pool,
 	zbud_free_and_delist((struct zbud_hdr *)pampd);
 	atomic_dec(&zcache_curr_eph_pampd_count);
 	BUG_ON(atomic_read(&zcache_curr_eph_pampd_count) < 0);
+	if (is_local_client(pool->client))
+		atomic_dec(&zcache_pool_zpages[pool->pool_id]);
 }
 
 static void zcache_pampd_free_obj(struct tmem_pool *pool, struct tmem_obj *obj)
@@ -895,25 +1087,25 @@ static struct tmem_pamops zcache_pamops = {
  * zcache compression/decompression and related per-cpu stuff
  */
 
-#define LZO_WORKMEM_BYTES LZO1X_1_MEM_COMPRESS
-#define LZO_DSTMEM_PAGE_ORDER 1
-static DEFINE_PER_CPU(unsigned char *, zcache_workmem);
+#define ZCACHE_DSTMEM_PAGE_ORDER 1
 static DEFINE_PER_CPU(unsigned char *, zcache_dstmem);
 
 static int zcache_compress(struct page *from, void **out_va, size_t *out_len)
 {
 	int ret = 0;
 	unsigned char *dmem = __get_cpu_var(zcache_dstmem);
-	unsigned char *wmem = __get_cpu_var(zcache_workmem);
+	unsigned int clen = PAGE_SIZE << ZCACHE_DSTMEM_PAGE_ORDER;
 	char *from_va;
 
 	BUG_ON(!irqs_disabled());
-	if (unlikely(dmem == NULL || wmem == NULL))
+	if (unlikely(dmem == NULL || __get_cpu_var(zcache_comp_tfm) == NULL))
 		goto out;  /* no buffer, so can't compress */
 	from_va = kmap_atomic(from, KM_USER0);
 	mb();
-	ret = lzo1x_1_compress(from_va, PAGE_SIZE, dmem, out_len, wmem);
-	BUG_ON(ret != LZO_E_OK);
+	ret = zcache_comp_op(ZCACHE_COMPOP_COMPRESS, from_va, PAGE_SIZE,
+			     dmem, &clen);
+	BUG_ON(ret);
+	*out_len = clen;
 	*out_va = dmem;
 	kunmap_atomic(from_va, KM_USER0);
 	ret = 1;
@@ -977,6 +1169,11 @@ ZCACHE_SYSFS_RO(qc_allocated);
 ZCACHE_SYSFS_RO(qc_freed);
 ZCACHE_SYSFS_RO(qc_used);
 ZCACHE_SYSFS_RO(qc_max_used);
+ZCACHE_SYSFS_RO(evicted_unbuddied_pages);
+ZCACHE_SYSFS_RO(evicted_buddied_pages);
+ZCACHE_SYSFS_RO(evicted_age_ms);
+ZCACHE_SYSFS_RO(quota_evictions);
+ZCACHE_SYSFS_RO(quota_rejects);
 ZCACHE_SYSFS_RO_ATOMIC(zbud_curr_raw_pages);
 ZCACHE_SYSFS_RO_ATOMIC(zbud_curr_zpages);
 ZCACHE_SYSFS_RO_ATOMIC(curr_obj_count);
@@ -985,6 +1182,56 @@ ZCACHE_SYSFS_RO_CUSTOM(zbud_unbuddied_list_counts,
 			zbud_show_unbuddied_list_counts);
 ZCACHE_SYSFS_RO_CUSTOM(zbud_cumul_chunk_counts,
 			zbud_show_cumul_chunk_counts);
+ZCACHE_SYSFS_RO_CUSTOM(zbud_lru_oldest_age_ms,
+			zbud_show_lru_oldest_age_ms);
+
+static int zcache_show_comp_algorithm(char *buf)
+{
+	return sprintf(buf, "%s\n", zcache_comp_name);
+}
+ZCACHE_SYSFS_RO_CUSTOM(comp_algorithm, zcache_show_comp_algorithm);
+
+/*
+ * One line per local pool: "id zpages quota".  Writing "id quota" sets
+ * the quota of that pool, a quota of 0 removes it.
+ */
+static ssize_t zcache_pool_quotas_show(struct kobject *kobj,
+				struct kobj_attribute *attr, char *buf)
+{
+	char *p = buf;
+	int i;
+
+	for (i = 0; i < MAX_POOLS_PER_CLIENT; i++) {
+		if (zcache_host.tmem_pools[i] == NULL)
+			continue;
+		p += sprintf(p, "%d %d %lu\n", i,
+			     atomic_read(&zcache_pool_zpages[i]),
+			     zcache_pool_quota[i]);
+	}
+	return p - buf;
+}
+
+static ssize_t zcache_pool_quotas_store(struct kobject *kobj,
+				struct kobj_attribute *attr,
+				const char *buf, size_t count)
+{
+	unsigned long quota;
+	int id;
+
+	if (sscanf(buf, "%d %lu", &id, &quota) != 2)
+		return -EINVAL;
+	if (id < 0 || id >= MAX_POOLS_PER_CLIENT ||
+	    zcache_host.tmem_pools[id] == NULL)
+		return -EINVAL;
+	zcache_pool_quota[id] = quota;
+	return count;
+}
+
+static struct kobj_attribute zcache_pool_quotas_attr = {
+	.attr = { .name = "pool_quotas", .mode = 0644 },
+	.show = zcache_pool_quotas_show,
+	.store = zcache_pool_quotas_store,
+};
 
 static struct attribute *qcache_attrs[] = {
 	&zcache_curr_obj_count_attr.attr,
@@ -1011,10 +1258,18 @@ static struct attribute *qcache_attrs[] = {
 	&zcache_aborted_shrink_attr.attr,
 	&zcache_zbud_unbuddied_list_counts_attr.attr,
 	&zcache_zbud_cumul_chunk_counts_attr.attr,
+	&zcache_comp_algorithm_attr.attr,
 	&zcache_qc_allocated_attr.attr,
 	&zcache_qc_freed_attr.attr,
 	&zcache_qc_used_attr.attr,
 	&zcache_qc_max_used_attr.attr,
+	&zcache_evicted_unbuddied_pages_attr.attr,
+	&zcache_evicted_buddied_pages_attr.attr,
+	&zcache_evicted_age_ms_attr.attr,
+	&zcache_zbud_lru_oldest_age_ms_attr.attr,
+	&zcache_quota_evictions_attr.attr,
+	&zcache_quota_rejects_attr.attr,
+	&zcache_pool_quotas_attr.attr,
 	NULL,
 };
 
@@ -1029,6 +1284,25 @@ static struct attribute_group qcache_attr_group = {
  * zcache shims between cleancache ops and tmem
  */
 
+/* check the quota of a local pool before a put */
+static bool zcache_pool_make_room(struct tmem_pool *pool)
+{
+	unsigned long quota;
+
+	if (!is_local_client(pool->client))
+		return true;
+	quota = zcache_pool_quota[pool->pool_id];
+	if (quota == 0 ||
+	    atomic_read(&zcache_pool_zpages[pool->pool_id]) < quota)
+		return true;
+	if (zbud_evict_lru(LOCAL_CLIENT, pool->pool_id)) {
+		zcache_quota_evictions++;
+		return true;
+	}
+	zcache_quota_rejects++;
+	return false;
+}
+
 static int zcache_put_page(int cli_id, int pool_id, struct tmem_oid *oidp,
 				uint32_t index, struct page *page)
 {
@@ -1039,7 +1313,8 @@ static int zcache_put_page(int cli_id, int pool_id, struct tmem_oid *oidp,
 	pool = zcache_get_pool_by_id(cli_id, pool_id);
 	if (unlikely(pool == NULL))
 		goto out;
-	if (!zcache_freeze && zcache_do_preload(pool) == 0) {
+	if (!zcache_freeze && zcache_pool_make_room(pool) &&
+	    zcache_do_preload(pool) == 0) {
 		/* preload does preempt_disable on success */
 		ret = tmem_put(pool, oidp, index, (char *)(page),
 				PAGE_SIZE, 0, is_ephemeral(pool));
@@ -1186,6 +1461,10 @@ static int zcache_new_pool(uint16_t cli_id, uint32_t flags)
 	pool->client = cli;
 	pool->pool_id = poolid;
 	tmem_new_pool(pool, flags);
+	if (is_local_client(cli)) {
+		atomic_set(&zcache_pool_zpages[poolid], 0);
+		zcache_pool_quota[poolid] = 0;
+	}
 	cli->tmem_pools[poolid] = pool;
 	pr_info("qcache: created %s tmem pool, id=%d, client=%d\n",
 		flags & TMEM_POOL_PERSIST ? "persistent" : "ephemeral",
@@ -1311,15 +1590,24 @@ static int __init qcache_init(void)
 	if (!qc->pages)
 		goto out;
 
+	if (!crypto_has_comp(zcache_comp_name, 0, 0)) {
+		pr_err("qcache: compressor %s not available\n",
+			zcache_comp_name);
+		ret = -ENODEV;
+		goto out;
+	}
+
 	tmem_register_hostops(&zcache_hostops);
 	tmem_register_pamops(&zcache_pamops);
 	for_each_online_cpu(cpu) {
+		struct crypto_comp *tfm;
+
+		tfm = crypto_alloc_comp(zcache_comp_name, 0, 0);
+		if (!IS_ERR(tfm))
+			per_cpu(zcache_comp_tfm, cpu) = tfm;
 		per_cpu(zcache_dstmem, cpu) = (void *)__get_free_pages(
 			GFP_KERNEL | __GFP_REPEAT,
-			LZO_DSTMEM_PAGE_ORDER),
-		per_cpu(zcache_workmem, cpu) =
-			kzalloc(LZO1X_MEM_COMPRESS,
-				GFP_KERNEL | __GFP_REPEAT);
+			ZCACHE_DSTMEM_PAGE_ORDER);
 	}
 	zcache_objnode_cache = kmem_cache_create("zcache_objnode",
 				sizeof(struct tmem_objnode), 0, 0, NULL);
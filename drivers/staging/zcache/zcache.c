@@ -6,7 +6,8 @@
  *
  * Zcache provides an in-kernel "host implementation" for transcendent memory
  * and, thus indirectly, for cleancache and frontswap.  Zcache includes two
- * page-accessible memory [1] interfaces, both utilizing lzo1x compression:
+ * page-accessible memory [1] interfaces, both utilizing crypto API compression
+ * (lzo1x by default):
  * 1) "compression buddies" ("zbud") is used for ephemeral pages
  * 2) xvmalloc is used for persistent pages.
  * Xvmalloc (based on the TLSF allocator) has very low fragmentation
@@ -20,9 +21,9 @@
  */
 
 #include <linux/cpu.h>
+#include <linux/crypto.h>
 #include <linux/highmem.h>
 #include <linux/list.h>
-#include <linux/lzo.h>
 #include <linux/slab.h>
 #include <linux/spinlock.h>
 #include <linux/types.h>
@@ -49,6 +50,35 @@
 	(__GFP_FS | __GFP_NORETRY | __GFP_NOWARN | __GFP_NOMEMALLOC)
 #endif
 
+/*
+ * Compression goes through the crypto API so that any "compress" algorithm
+ * can be used. Each cpu has its own transform, as compressors keep state.
+ */
+/* Compressor for all pages, set with the "zcache=<name>" boot parameter */
+static char zcache_comp_name[CRYPTO_MAX_ALG_NAME] = "lzo";
+static DEFINE_PER_CPU(struct crypto_comp *, zcache_comp_tfm);
+
+enum zcache_comp_op {
+	ZCACHE_COMPOP_COMPRESS,
+	ZCACHE_COMPOP_DECOMPRESS
+};
+
+static int zcache_comp_op(enum zcache_comp_op op, const u8 *src,
+			  unsigned int slen, u8 *dst, unsigned int *dlen)
+{
+	struct crypto_comp *tfm;
+	int ret;
+
+	tfm = get_cpu_var(zcache_comp_tfm);
+	BUG_ON(tfm == NULL);
+	if (op == ZCACHE_COMPOP_COMPRESS)
+		ret = crypto_comp_compress(tfm, src, slen, dst, dlen);
+	else
+		ret = crypto_comp_decompress(tfm, src, slen, dst, dlen);
+	put_cpu_var(zcache_comp_tfm);
+	return ret;
+}
+
 /**********
  * Compression buddies ("zbud") provides for packing two (or, possibly
  * in the future, more) compressed ephemeral pages into a single "raw"
@@ -64,6 +94,11 @@
  * (3) one of PAGE_SIZE/64 "unbuddied" lists indexed by how many chunks
  * the one unbuddied zbud uses.  The data inside a zbpg cannot be
  * read or written unless the zbpg's lock is held.
+ *
+ * Every zbpg holding data is also on the LRU list, ordered by the time
+ * its most recent zbud was stored.  Eviction takes zbpgs from the head
+ * of that list, so the compressed pages that have gone unused longest
+ * are dropped first regardless of which pool they belong to.
  */
 
 #define ZBH_SENTINEL  0x43214321
@@ -81,6 +116,8 @@ struct zbud_hdr {
 
 struct zbud_page {
 	struct list_head bud_list;
+	struct list_head lru;
+	unsigned long stamp; /* jiffies when the last zbud was stored */
 	spinlock_t lock;
 	struct zbud_hdr buddy[ZBUD_MAX_BUDS];
 	DECL_SENTINEL
@@ -105,7 +142,10 @@ static unsigned long zbud_cumul_chunk_counts[NCHUNKS];
 struct list_head zbud_buddied_list;
 static unsigned long zcache_zbud_buddied_count;
 
-/* protects the buddied list and all unbuddied lists */
+/* least recently stored zbpgs first */
+static LIST_HEAD(zbud_lru_list);
+
+/* protects the buddied list, all unbuddied lists and the LRU list */
 static DEFINE_SPINLOCK(zbud_budlists_spinlock);
 
 static LIST_HEAD(zbpg_unused_list);
@@ -201,6 +241,7 @@ static struct zbud_page *zbud_alloc_raw_page(void)
 		zbpg = zcache_get_free_page();
 	if (likely(zbpg != NULL)) {
 		INIT_LIST_HEAD(&zbpg->bud_list);
+		INIT_LIST_HEAD(&zbpg->lru);
 		zh0 = &zbpg->buddy[0]; zh1 = &zbpg->buddy[1];
 		spin_lock_init(&zbpg->lock);
 		if (recycled) {
@@ -226,6 +267,7 @@ static void zbud_free_raw_page(struct zbud_page *zbpg)
 
 	ASSERT_SENTINEL(zbpg, ZBPG);
 	BUG_ON(!list_empty(&zbpg->bud_list));
+	BUG_ON(!list_empty(&zbpg->lru));
 	ASSERT_SPINLOCK(&zbpg->lock);
 	BUG_ON(zh0->size != 0 || tmem_oid_valid(&zh0->oid));
 	BUG_ON(zh1->size != 0 || tmem_oid_valid(&zh1->oid));
@@ -267,7 +309,7 @@ static void zbud_free_and_delist(struct zbud_hdr *zh)
 
 	spin_lock(&zbpg->lock);
 	if (list_empty(&zbpg->bud_list)) {
-		/* ignore zombie page... see zbud_evict_pages() */
+		/* ignore zombie page... see zbud_evict_lru() */
 		spin_unlock(&zbpg->lock);
 		return;
 	}
@@ -279,6 +321,7 @@ static void zbud_free_and_delist(struct zbud_hdr *zh)
 		spin_lock(&zbud_budlists_spinlock);
 		BUG_ON(list_empty(&zbud_unbuddied[chunks].list));
 		list_del_init(&zbpg->bud_list);
+		list_del_init(&zbpg->lru);
 		zbud_unbuddied[chunks].count--;
 		spin_unlock(&zbud_budlists_spinlock);
 		zbud_free_raw_page(zbpg);
@@ -353,6 +396,8 @@ init_zh:
 	zh->index = index;
 	zh->oid = *oid;
 	zh->pool_id = pool_id;
+	zbpg->stamp = jiffies;
+	list_move_tail(&zbpg->lru, &zbud_lru_list);
 	/* can wait to copy the data until the list locks are dropped */
 	spin_unlock(&zbud_budlists_spinlock);
 
@@ -372,7 +417,7 @@ static int zbud_decompress(struct page *page, struct zbud_hdr *zh)
 {
 	struct zbud_page *zbpg;
 	unsigned budnum = zbud_budnum(zh);
-	size_t out_len = PAGE_SIZE;
+	unsigned int out_len = PAGE_SIZE;
 	char *to_va, *from_va;
 	unsigned size;
 	int ret = 0;
@@ -380,7 +425,7 @@ static int zbud_decompress(struct page *page, struct zbud_hdr *zh)
 	zbpg = container_of(zh, struct zbud_page, buddy[budnum]);
 	spin_lock(&zbpg->lock);
 	if (list_empty(&zbpg->bud_list)) {
-		/* ignore zombie page... see zbud_evict_pages() */
+		/* ignore zombie page... see zbud_evict_lru() */
 		ret = -EINVAL;
 		goto out;
 	}
@@ -389,8 +434,9 @@ static int zbud_decompress(struct page *page, struct zbud_hdr *zh)
 	to_va = kmap_atomic(page, KM_USER0);
 	size = zh->size;
 	from_va = zbud_data(zh, size);
-	ret = lzo1x_decompress_safe(from_va, size, to_va, &out_len);
-	BUG_ON(ret != LZO_E_OK);
+	ret = zcache_comp_op(ZCACHE_COMPOP_DECOMPRESS, from_va, size,
+			     to_va, &out_len);
+	BUG_ON(ret);
 	BUG_ON(out_len != PAGE_SIZE);
 	kunmap_atomic(to_va, KM_USER0);
 out:
@@ -400,12 +446,13 @@ out:
 
 /*
  * The following routines handle shrinking of ephemeral pages by evicting
- * pages "least valuable" first.
+ * the least recently stored pages first.
  */
 
 static unsigned long zcache_evicted_raw_pages;
 static unsigned long zcache_evicted_buddied_pages;
 static unsigned long zcache_evicted_unbuddied_pages;
+static unsigned long zcache_evicted_age_ms;
 
 static struct tmem_pool *zcache_get_pool_by_id(uint32_t poolid);
 static void zcache_put_pool(struct tmem_pool *pool);
@@ -447,17 +494,66 @@ static void zbud_evict_zbpg(struct zbud_page *zbpg)
 }
 
 /*
- * Free nr pages.  This code is funky because we want to hold the locks
- * protecting various lists for as short a time as possible, and in some
- * circumstances the list may change asynchronously when the list lock is
- * not held.  In some cases we also trylock not only to avoid waiting on a
- * page in use by another cpu, but also to avoid potential deadlock due to
- * lock inversion.
+ * Don't look further than this down the LRU list for a zbpg of one
+ * particular pool, a pool at its quota then fails the put instead.
+ */
+#define ZBUD_LRU_SCAN_MAX 32
+
+/*
+ * Evict the least recently stored zbpg, or with pool_id >= 0 the least
+ * recently stored one holding a zbud of that pool.  The zbpg locks are
+ * only trylocked, they nest outside the budlists lock elsewhere.  Called
+ * with bottom halves or interrupts disabled; returns 1 if a zbpg was
+ * evicted.
+ */
+static int zbud_evict_lru(int pool_id)
+{
+	struct zbud_page *zbpg;
+	struct zbud_hdr *zh0, *zh1;
+	unsigned chunks;
+	int scanned = 0;
+
+	spin_lock(&zbud_budlists_spinlock);
+	list_for_each_entry(zbpg, &zbud_lru_list, lru) {
+		if (pool_id >= 0 && ++scanned > ZBUD_LRU_SCAN_MAX)
+			break;
+		if (unlikely(!spin_trylock(&zbpg->lock)))
+			continue;
+		zh0 = &zbpg->buddy[0]; zh1 = &zbpg->buddy[1];
+		if (pool_id >= 0 &&
+		    !(zh0->size != 0 && zh0->pool_id == pool_id) &&
+		    !(zh1->size != 0 && zh1->pool_id == pool_id)) {
+			spin_unlock(&zbpg->lock);
+			continue;
+		}
+		if (zh0->size != 0 && zh1->size != 0) {
+			zcache_zbud_buddied_count--;
+			zcache_evicted_buddied_pages++;
+		} else {
+			chunks = zbud_size_to_chunks(zh0->size != 0 ?
+						     zh0->size : zh1->size);
+			zbud_unbuddied[chunks].count--;
+			zcache_evicted_unbuddied_pages++;
+		}
+		list_del_init(&zbpg->bud_list);
+		list_del_init(&zbpg->lru);
+		spin_unlock(&zbud_budlists_spinlock);
+		zcache_evicted_age_ms = jiffies_to_msecs(jiffies - zbpg->stamp);
+		/* want budlists unlocked when doing zbpg eviction */
+		zbud_evict_zbpg(zbpg);
+		return 1;
+	}
+	spin_unlock(&zbud_budlists_spinlock);
+	return 0;
+}
+
+/*
+ * Free nr pages: first any raw pages on the unused list, which hold no
+ * data, then the zbpgs that were stored least recently.
  */
 static void zbud_evict_pages(int nr)
 {
 	struct zbud_page *zbpg;
-	int i;
 
 	/* first try freeing any pages on unused list */
 retry_unused_list:
@@ -478,53 +574,11 @@ retry_unused_list:
 	}
 	spin_unlock_bh(&zbpg_unused_list_spinlock);
 
-	/* now try freeing unbuddied pages, starting with least space avail */
-	for (i = 0; i < MAX_CHUNK; i++) {
-retry_unbud_list_i:
-		spin_lock_bh(&zbud_budlists_spinlock);
-		if (list_empty(&zbud_unbuddied[i].list)) {
-			spin_unlock_bh(&zbud_budlists_spinlock);
-			continue;
-		}
-		list_for_each_entry(zbpg, &zbud_unbuddied[i].list, bud_list) {
-			if (unlikely(!spin_trylock(&zbpg->lock)))
-				continue;
-			list_del_init(&zbpg->bud_list);
-			zbud_unbuddied[i].count--;
-			spin_unlock(&zbud_budlists_spinlock);
-			zcache_evicted_unbuddied_pages++;
-			/* want budlists unlocked when doing zbpg eviction */
-			zbud_evict_zbpg(zbpg);
-			local_bh_enable();
-			if (--nr <= 0)
-				goto out;
-			goto retry_unbud_list_i;
-		}
-		spin_unlock_bh(&zbud_budlists_spinlock);
-	}
-
-	/* as a last resort, free buddied pages */
-retry_bud_list:
-	spin_lock_bh(&zbud_budlists_spinlock);
-	if (list_empty(&zbud_buddied_list)) {
-		spin_unlock_bh(&zbud_budlists_spinlock);
-		goto out;
-	}
-	list_for_each_entry(zbpg, &zbud_buddied_list, bud_list) {
-		if (unlikely(!spin_trylock(&zbpg->lock)))
-			continue;
-		list_del_init(&zbpg->bud_list);
-		zcache_zbud_buddied_count--;
-		spin_unlock(&zbud_budlists_spinlock);
-		zcache_evicted_buddied_pages++;
-		/* want budlists unlocked when doing zbpg eviction */
-		zbud_evict_zbpg(zbpg);
-		local_bh_enable();
-		if (--nr <= 0)
-			goto out;
-		goto retry_bud_list;
-	}
-	spin_unlock_bh(&zbud_budlists_spinlock);
+	/* then evict from the head of the LRU list */
+	local_bh_disable();
+	while (nr > 0 && zbud_evict_lru(-1))
+		nr--;
+	local_bh_enable();
 out:
 	return;
 }
@@ -558,6 +612,20 @@ static int zbud_show_unbuddied_list_counts(char *buf)
 	return p - buf;
 }
 
+static int zbud_show_lru_oldest_age_ms(char *buf)
+{
+	struct zbud_page *zbpg;
+	unsigned long age = 0;
+
+	spin_lock_bh(&zbud_budlists_spinlock);
+	if (!list_empty(&zbud_lru_list)) {
+		zbpg = list_first_entry(&zbud_lru_list, struct zbud_page, lru);
+		age = jiffies_to_msecs(jiffies - zbpg->stamp);
+	}
+	spin_unlock_bh(&zbud_budlists_spinlock);
+	return sprintf(buf, "%lu\n", age);
+}
+
 static int zbud_show_cumul_chunk_counts(char *buf)
 {
 	unsigned long i, chunks = 0, total_chunks = 0, sum_total_chunks = 0;
@@ -649,7 +717,7 @@ static void zv_free(struct xv_pool *xvpool, struct zv_hdr *zv)
 
 static void zv_decompress(struct page *page, struct zv_hdr *zv)
 {
-	size_t clen = PAGE_SIZE;
+	unsigned int clen = PAGE_SIZE;
 	char *to_va;
 	unsigned size;
 	int ret;
@@ -658,10 +726,10 @@ static void zv_decompress(struct page *page, struct zv_hdr *zv)
 	size = xv_get_object_size(zv) - sizeof(*zv);
 	BUG_ON(size == 0 || size > zv_max_page_size);
 	to_va = kmap_atomic(page, KM_USER0);
-	ret = lzo1x_decompress_safe((char *)zv + sizeof(*zv),
-					size, to_va, &clen);
+	ret = zcache_comp_op(ZCACHE_COMPOP_DECOMPRESS, (char *)zv + sizeof(*zv),
+			     size, to_va, &clen);
 	kunmap_atomic(to_va, KM_USER0);
-	BUG_ON(ret != LZO_E_OK);
+	BUG_ON(ret);
 	BUG_ON(clen != PAGE_SIZE);
 }
 
@@ -684,6 +752,16 @@ static struct {
 	struct xv_pool *xvpool;
 } zcache_client;
 
+/*
+ * Per-pool count of stored pages and the quota on it, zero meaning no
+ * quota.  An ephemeral pool at its quota evicts its own oldest zbpg to
+ * make room for a put, a persistent pool at its quota fails the put.
+ */
+static atomic_t zcache_pool_zpages[MAX_POOLS_PER_CLIENT];
+static unsigned long zcache_pool_quota[MAX_POOLS_PER_CLIENT];
+static unsigned long zcache_quota_evictions;
+static unsigned long zcache_quota_rejects;
+
 /*
  * Tmem operations assume the poolid implies the invoking client.
  * Zcache only has one client (the kernel itself), so translate
@@ -921,11 +999,11 @@ static void *zcache_pampd_create(struct tmem_pool *pool, struct tmem_oid *oid,
 		}
 		pampd = (void *)zbud_create(pool->pool_id, oid, index,
 						page, cdata, clen);
-		if (pampd != NULL) {
-			count = atomic_inc_return(&zcache_curr_eph_pampd_count);
-			if (count > zcache_curr_eph_pampd_count_max)
-				zcache_curr_eph_pampd_count_max = count;
-		}
+		if (pampd == NULL)
+			goto out;
+		count = atomic_inc_return(&zcache_curr_eph_pampd_count);
+		if (count > zcache_curr_eph_pampd_count_max)
+			zcache_curr_eph_pampd_count_max = count;
 	} else {
 		/*
 		 * FIXME: This is all the "policy" there is for now.
@@ -950,6 +1028,7 @@ static void *zcache_pampd_create(struct tmem_pool *pool, struct tmem_oid *oid,
 		if (count > zcache_curr_pers_pampd_count_max)
 			zcache_curr_pers_pampd_count_max = count;
 	}
+	atomic_inc(&zcache_pool_zpages[pool->pool_id]);
 out:
 	return pampd;
 }
@@ -985,6 +1064,7 @@ static void zcache_pampd_free(void *pampd, struct tmem_pool *pool)
 		atomic_dec(&zcache_curr_pers_pampd_count);
 		BUG_ON(atomic_read(&zcache_curr_pers_pampd_count) < 0);
 	}
+	atomic_dec(&zcache_pool_zpages[pool->pool_id]);
 }
 
 static struct tmem_pamops zcache_pamops = {
@@ -997,25 +1077,25 @@ static struct tmem_pamops zcache_pamops = {
  * zcache compression/decompression and related per-cpu stuff
  */
 
-#define LZO_WORKMEM_BYTES LZO1X_1_MEM_COMPRESS
-#define LZO_DSTMEM_PAGE_ORDER 1
-static DEFINE_PER_CPU(unsigned char *, zcache_workmem);
+#define ZCACHE_DSTMEM_PAGE_ORDER 1
 static DEFINE_PER_CPU(unsigned char *, zcache_dstmem);
 
 static int zcache_compress(struct page *from, void **out_va, size_t *out_len)
 {
 	int ret = 0;
 	unsigned char *dmem = __get_cpu_var(zcache_dstmem);
-	unsigned char *wmem = __get_cpu_var(zcache_workmem);
+	unsigned int clen = PAGE_SIZE << ZCACHE_DSTMEM_PAGE_ORDER;
 	char *from_va;
 
 	BUG_ON(!irqs_disabled());
-	if (unlikely(dmem == NULL || wmem == NULL))
+	if (unlikely(dmem == NULL || __get_cpu_var(zcache_comp_tfm) == NULL))
 		goto out;  /* no buffer, so can't compress */
 	from_va = kmap_atomic(from, KM_USER0);
 	mb();
-	ret = lzo1x_1_compress(from_va, PAGE_SIZE, dmem, out_len, wmem);
-	BUG_ON(ret != LZO_E_OK);
+	ret = zcache_comp_op(ZCACHE_COMPOP_COMPRESS, from_va, PAGE_SIZE,
+			     dmem, &clen);
+	BUG_ON(ret);
+	*out_len = clen;
 	*out_va = dmem;
 	kunmap_atomic(from_va, KM_USER0);
 	ret = 1;
@@ -1029,23 +1109,25 @@ static int zcache_cpu_notifier(struct notifier_block *nb,
 {
 	int cpu = (long)pcpu;
 	struct zcache_preload *kp;
+	struct crypto_comp *tfm;
 
 	switch (action) {
 	case CPU_UP_PREPARE:
+		tfm = crypto_alloc_comp(zcache_comp_name, 0, 0);
+		if (IS_ERR(tfm))
+			return NOTIFY_BAD;
+		per_cpu(zcache_comp_tfm, cpu) = tfm;
 		per_cpu(zcache_dstmem, cpu) = (void *)__get_free_pages(
 			GFP_KERNEL | __GFP_REPEAT,
-			LZO_DSTMEM_PAGE_ORDER),
-		per_cpu(zcache_workmem, cpu) =
-			kzalloc(LZO1X_MEM_COMPRESS,
-				GFP_KERNEL | __GFP_REPEAT);
+			ZCACHE_DSTMEM_PAGE_ORDER);
 		break;
 	case CPU_DEAD:
 	case CPU_UP_CANCELED:
+		crypto_free_comp(per_cpu(zcache_comp_tfm, cpu));
+		per_cpu(zcache_comp_tfm, cpu) = NULL;
 		free_pages((unsigned long)per_cpu(zcache_dstmem, cpu),
-				LZO_DSTMEM_PAGE_ORDER);
+				ZCACHE_DSTMEM_PAGE_ORDER);
 		per_cpu(zcache_dstmem, cpu) = NULL;
-		kfree(per_cpu(zcache_workmem, cpu));
-		per_cpu(zcache_workmem, cpu) = NULL;
 		kp = &per_cpu(zcache_preloads, cpu);
 		while (kp->nr) {
 			kmem_cache_free(zcache_objnode_cache,
@@ -1116,6 +1198,9 @@ ZCACHE_SYSFS_RO(zbpg_unused_list_count);
 ZCACHE_SYSFS_RO(evicted_raw_pages);
 ZCACHE_SYSFS_RO(evicted_unbuddied_pages);
 ZCACHE_SYSFS_RO(evicted_buddied_pages);
+ZCACHE_SYSFS_RO(evicted_age_ms);
+ZCACHE_SYSFS_RO(quota_evictions);
+ZCACHE_SYSFS_RO(quota_rejects);
 ZCACHE_SYSFS_RO(failed_get_free_pages);
 ZCACHE_SYSFS_RO(failed_alloc);
 ZCACHE_SYSFS_RO(put_to_flush);
@@ -1130,6 +1215,59 @@ ZCACHE_SYSFS_RO_CUSTOM(zbud_unbuddied_list_counts,
 			zbud_show_unbuddied_list_counts);
 ZCACHE_SYSFS_RO_CUSTOM(zbud_cumul_chunk_counts,
 			zbud_show_cumul_chunk_counts);
+ZCACHE_SYSFS_RO_CUSTOM(zbud_lru_oldest_age_ms,
+			zbud_show_lru_oldest_age_ms);
+
+static int zcache_show_comp_algorithm(char *buf)
+{
+	return sprintf(buf, "%s\n", zcache_comp_name);
+}
+ZCACHE_SYSFS_RO_CUSTOM(comp_algorithm, zcache_show_comp_algorithm);
+
+/*
+ * One line per pool: "id type zpages quota".  Writing "id quota" sets
+ * the quota of that pool, a quota of 0 removes it.
+ */
+static ssize_t zcache_pool_quotas_show(struct kobject *kobj,
+				struct kobj_attribute *attr, char *buf)
+{
+	struct tmem_pool *pool;
+	char *p = buf;
+	int i;
+
+	for (i = 0; i < MAX_POOLS_PER_CLIENT; i++) {
+		pool = zcache_client.tmem_pools[i];
+		if (pool == NULL)
+			continue;
+		p += sprintf(p, "%d %s %d %lu\n", i,
+			     is_ephemeral(pool) ? "ephemeral" : "persistent",
+			     atomic_read(&zcache_pool_zpages[i]),
+			     zcache_pool_quota[i]);
+	}
+	return p - buf;
+}
+
+static ssize_t zcache_pool_quotas_store(struct kobject *kobj,
+				struct kobj_attribute *attr,
+				const char *buf, size_t count)
+{
+	unsigned long quota;
+	int id;
+
+	if (sscanf(buf, "%d %lu", &id, &quota) != 2)
+		return -EINVAL;
+	if (id < 0 || id >= MAX_POOLS_PER_CLIENT ||
+	    zcache_client.tmem_pools[id] == NULL)
+		return -EINVAL;
+	zcache_pool_quota[id] = quota;
+	return count;
+}
+
+static struct kobj_attribute zcache_pool_quotas_attr = {
+	.attr = { .name = "pool_quotas", .mode = 0644 },
+	.show = zcache_pool_quotas_show,
+	.store = zcache_pool_quotas_store,
+};
 
 static struct attribute *zcache_attrs[] = {
 	&zcache_curr_obj_count_attr.attr,
@@ -1153,6 +1291,11 @@ static struct attribute *zcache_attrs[] = {
 	&zcache_evicted_raw_pages_attr.attr,
 	&zcache_evicted_unbuddied_pages_attr.attr,
 	&zcache_evicted_buddied_pages_attr.attr,
+	&zcache_evicted_age_ms_attr.attr,
+	&zcache_zbud_lru_oldest_age_ms_attr.attr,
+	&zcache_quota_evictions_attr.attr,
+	&zcache_quota_rejects_attr.attr,
+	&zcache_pool_quotas_attr.attr,
 	&zcache_failed_get_free_pages_attr.attr,
 	&zcache_failed_alloc_attr.attr,
 	&zcache_put_to_flush_attr.attr,
@@ -1160,6 +1303,7 @@ static struct attribute *zcache_attrs[] = {
 	&zcache_aborted_shrink_attr.attr,
 	&zcache_zbud_unbuddied_list_counts_attr.attr,
 	&zcache_zbud_cumul_chunk_counts_attr.attr,
+	&zcache_comp_algorithm_attr.attr,
 	NULL,
 };
 
@@ -1212,6 +1356,26 @@ static struct shrinker zcache_shrinker = {
  * zcache shims between cleancache/frontswap ops and tmem
  */
 
+/*
+ * Check the pool's quota before a put.  There is nothing a persistent
+ * pool may drop, so once it is full its puts fail and frontswap sends
+ * the pages to the swap device instead.
+ */
+static bool zcache_pool_make_room(struct tmem_pool *pool)
+{
+	unsigned long quota = zcache_pool_quota[pool->pool_id];
+
+	if (quota == 0 ||
+	    atomic_read(&zcache_pool_zpages[pool->pool_id]) < quota)
+		return true;
+	if (is_ephemeral(pool) && zbud_evict_lru(pool->pool_id)) {
+		zcache_quota_evictions++;
+		return true;
+	}
+	zcache_quota_rejects++;
+	return false;
+}
+
 static int zcache_put_page(int pool_id, struct tmem_oid *oidp,
 				uint32_t index, struct page *page)
 {
@@ -1222,7 +1386,8 @@ static int zcache_put_page(int pool_id, struct tmem_oid *oidp,
 	pool = zcache_get_pool_by_id(pool_id);
 	if (unlikely(pool == NULL))
 		goto out;
-	if (!zcache_freeze && zcache_do_preload(pool) == 0) {
+	if (!zcache_freeze && zcache_pool_make_room(pool) &&
+	    zcache_do_preload(pool) == 0) {
 		/* preload does preempt_disable on success */
 		ret = tmem_put(pool, oidp, index, page);
 		if (ret < 0) {
@@ -1349,6 +1514,8 @@ static int zcache_new_pool(uint32_t flags)
 	pool->client = &zcache_client;
 	pool->pool_id = poolid;
 	tmem_new_pool(pool, flags);
+	atomic_set(&zcache_pool_zpages[poolid], 0);
+	zcache_pool_quota[poolid] = 0;
 	zcache_client.tmem_pools[poolid] = pool;
 	pr_info("zcache: created %s tmem pool, id=%d\n",
 		flags & TMEM_POOL_PERSIST ? "persistent" : "ephemeral",
@@ -1565,6 +1732,9 @@ static int zcache_enabled;
 
 static int __init enable_zcache(char *s)
 {
+	/* "zcache=<compressor>" also selects the compressor */
+	if (*s == '=')
+		strlcpy(zcache_comp_name, s + 1, sizeof(zcache_comp_name));
 	zcache_enabled = 1;
 	return 1;
 }
@@ -1604,6 +1774,11 @@ static int __init zcache_init(void)
 	}
 #endif /* CONFIG_SYSFS */
 #if defined(CONFIG_CLEANCACHE) || defined(CONFIG_FRONTSWAP)
+	if (zcache_enabled && !crypto_has_comp(zcache_comp_name, 0, 0)) {
+		pr_err("zcache: compressor %s not available, disabling\n",
+			zcache_comp_name);
+		zcache_enabled = 0;
+	}
 	if (zcache_enabled) {
 		unsigned int cpu;
 
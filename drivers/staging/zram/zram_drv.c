@@ -25,13 +25,20 @@
 #include <linux/bitops.h>
 #include <linux/blkdev.h>
 #include <linux/buffer_head.h>
+#include <linux/completion.h>
+#include <linux/crypto.h>
 #include <linux/device.h>
+#include <linux/fs.h>
 #include <linux/genhd.h>
+#include <linux/hash.h>
 #include <linux/highmem.h>
+#include <linux/jhash.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
 #include <linux/slab.h>
-#include <linux/lzo.h>
 #include <linux/string.h>
 #include <linux/vmalloc.h>
+#include <linux/workqueue.h>
 
 #include "zram_drv.h"
 
@@ -89,21 +96,355 @@ static void zram_clear_flag(struct zram *zram, u32 index,
 	zram->table[index].flags &= ~BIT(flag);
 }
 
-static int page_zero_filled(void *ptr)
+static int page_same_filled(void *ptr, unsigned long *element)
 {
 	unsigned int pos;
 	unsigned long *page;
 
 	page = (unsigned long *)ptr;
 
-	for (pos = 0; pos != PAGE_SIZE / sizeof(*page); pos++) {
-		if (page[pos])
+	for (pos = 1; pos != PAGE_SIZE / sizeof(*page); pos++) {
+		if (page[pos] != page[0])
 			return 0;
 	}
 
+	*element = page[0];
 	return 1;
 }
 
+/*
+ * Compressed objects are named by the (struct page *, offset) pair with
+ * xvmalloc and by a handle with zsmalloc. Both are kept as an unsigned
+ * long and a u16 so the rest of the driver need not care which allocator
+ * the device was initialized with.
+ */
+static int zram_obj_alloc(struct zram *zram, size_t clen, unsigned long *obj,
+				u16 *offset)
+{
+	struct page *page;
+	u32 xv_offset;
+
+	if (zram->allocator == ZRAM_ZSMALLOC) {
+		*obj = zs_malloc(zram->zs_pool, clen);
+		*offset = 0;
+		return *obj ? 0 : -ENOMEM;
+	}
+
+	if (xv_malloc(zram->mem_pool, clen + sizeof(struct zobj_header),
+			&page, &xv_offset, GFP_NOIO | __GFP_HIGHMEM))
+		return -ENOMEM;
+
+	*obj = (unsigned long)page;
+	*offset = xv_offset;
+	return 0;
+}
+
+static void zram_obj_free(struct zram *zram, unsigned long obj, u16 offset)
+{
+	if (zram->allocator == ZRAM_ZSMALLOC)
+		zs_free(zram->zs_pool, obj);
+	else
+		xv_free(zram->mem_pool, (struct page *)obj, offset);
+}
+
+/* Only one object may be mapped at a time, and not across sleeping */
+static unsigned char *zram_obj_map(struct zram *zram, unsigned long obj,
+				u16 offset, enum zs_mapmode mm)
+{
+	if (zram->allocator == ZRAM_ZSMALLOC)
+		return zs_map_object(zram->zs_pool, obj, mm);
+	return kmap_atomic((struct page *)obj, KM_USER1) + offset;
+}
+
+static void zram_obj_unmap(struct zram *zram, unsigned long obj,
+				unsigned char *cmem)
+{
+	if (zram->allocator == ZRAM_ZSMALLOC)
+		zs_unmap_object(zram->zs_pool, obj);
+	else
+		kunmap_atomic(cmem, KM_USER1);
+}
+
+static u16 zram_obj_offset(struct zram *zram, u32 index)
+{
+	if (zram->allocator == ZRAM_ZSMALLOC)
+		return 0;
+	return zram->table[index].offset;
+}
+
+/* Compressed length of the object stored for @index, mapped at @cmem */
+static u32 zram_obj_size(struct zram *zram, u32 index, unsigned char *cmem)
+{
+	if (zram->allocator == ZRAM_ZSMALLOC)
+		return zram->table[index].size;
+	return xv_get_object_size(cmem) - sizeof(struct zobj_header);
+}
+
+static int zram_dedup_init(struct zram *zram, size_t num_pages)
+{
+	size_t nr;
+
+	/* About one bucket per 8 pages of disk, at least 256 */
+	nr = roundup_pow_of_two(max_t(size_t, num_pages >> 3, 256));
+	zram->dedup_bits = ilog2(nr);
+
+	zram->dedup_content = vzalloc(nr * sizeof(struct hlist_head));
+	zram->dedup_obj = vzalloc(nr * sizeof(struct hlist_head));
+	if (!zram->dedup_content || !zram->dedup_obj) {
+		vfree(zram->dedup_content);
+		vfree(zram->dedup_obj);
+		zram->dedup_content = NULL;
+		zram->dedup_obj = NULL;
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+static struct hlist_head *zram_dedup_obj_head(struct zram *zram,
+				unsigned long obj, u16 offset)
+{
+	return &zram->dedup_obj[hash_long(obj + offset, zram->dedup_bits)];
+}
+
+/*
+ * Find a stored object with the same compressed bytes and take a
+ * reference to it. Returns NULL if there is none.
+ */
+static struct zram_dedup *zram_dedup_get(struct zram *zram, u32 checksum,
+				unsigned char *src, size_t clen)
+{
+	struct zram_dedup *dedup;
+	struct hlist_node *pos;
+	unsigned char *cmem;
+	int match;
+
+	spin_lock(&zram->dedup_lock);
+	hlist_for_each_entry(dedup, pos, &zram->dedup_content[hash_32(checksum,
+				zram->dedup_bits)], content_node) {
+		if (dedup->checksum != checksum || dedup->size != clen)
+			continue;
+
+		cmem = zram_obj_map(zram, dedup->obj, dedup->offset,
+				ZS_MM_RO);
+		match = !memcmp(cmem + sizeof(struct zobj_header), src, clen);
+		zram_obj_unmap(zram, dedup->obj, cmem);
+
+		if (match) {
+			dedup->refcount++;
+			spin_unlock(&zram->dedup_lock);
+			return dedup;
+		}
+	}
+	spin_unlock(&zram->dedup_lock);
+
+	return NULL;
+}
+
+static void zram_dedup_add(struct zram *zram, struct zram_dedup *dedup,
+				u32 checksum, unsigned long obj, u16 offset,
+				size_t clen)
+{
+	dedup->checksum = checksum;
+	dedup->refcount = 1;
+	dedup->obj = obj;
+	dedup->offset = offset;
+	dedup->size = clen;
+
+	spin_lock(&zram->dedup_lock);
+	hlist_add_head(&dedup->content_node, &zram->dedup_content[
+			hash_32(checksum, zram->dedup_bits)]);
+	hlist_add_head(&dedup->obj_node,
+			zram_dedup_obj_head(zram, obj, offset));
+	spin_unlock(&zram->dedup_lock);
+}
+
+/*
+ * Drop a table entry's reference to its shared object and report the
+ * object's compressed length. Returns true if that was the last reference
+ * and the object itself must be freed.
+ */
+static bool zram_dedup_put(struct zram *zram, unsigned long obj, u16 offset,
+				u32 *size)
+{
+	struct zram_dedup *dedup;
+	struct hlist_node *pos;
+	bool last = false;
+
+	spin_lock(&zram->dedup_lock);
+	hlist_for_each_entry(dedup, pos,
+			zram_dedup_obj_head(zram, obj, offset), obj_node) {
+		if (dedup->obj != obj || dedup->offset != offset)
+			continue;
+
+		*size = dedup->size;
+		if (--dedup->refcount == 0) {
+			hlist_del(&dedup->content_node);
+			hlist_del(&dedup->obj_node);
+			kfree(dedup);
+			last = true;
+		}
+		break;
+	}
+	spin_unlock(&zram->dedup_lock);
+
+	return last;
+}
+
+static void zram_dedup_destroy(struct zram *zram)
+{
+	struct zram_dedup *dedup;
+	struct hlist_node *pos, *n;
+	size_t i;
+
+	if (!zram->dedup_obj)
+		return;
+
+	for (i = 0; i < (1 << zram->dedup_bits); i++) {
+		hlist_for_each_entry_safe(dedup, pos, n, &zram->dedup_obj[i],
+				obj_node) {
+			zram_obj_free(zram, dedup->obj, dedup->offset);
+			kfree(dedup);
+		}
+	}
+
+	vfree(zram->dedup_content);
+	vfree(zram->dedup_obj);
+	zram->dedup_content = NULL;
+	zram->dedup_obj = NULL;
+}
+
+static void zram_stream_free(struct zram_stream *zstrm)
+{
+	if (!IS_ERR_OR_NULL(zstrm->tfm))
+		crypto_free_comp(zstrm->tfm);
+	free_pages((unsigned long)zstrm->buffer, 1);
+	kfree(zstrm);
+}
+
+/*
+ * Streams are only allocated from process context, at init time or when
+ * max_comp_streams is raised, since allocating a crypto transform is not
+ * safe from the write path during reclaim.
+ */
+static struct zram_stream *zram_stream_alloc(const char *compressor)
+{
+	struct zram_stream *zstrm;
+
+	zstrm = kzalloc(sizeof(*zstrm), GFP_KERNEL);
+	if (!zstrm)
+		return NULL;
+
+	zstrm->tfm = crypto_alloc_comp(compressor, 0, 0);
+	/* Compressors may expand incompressible input, hence two pages */
+	zstrm->buffer = (void *)__get_free_pages(GFP_KERNEL | __GFP_ZERO, 1);
+	if (IS_ERR(zstrm->tfm) || !zstrm->buffer) {
+		zram_stream_free(zstrm);
+		return NULL;
+	}
+
+	return zstrm;
+}
+
+/* Get an idle stream, waiting for another I/O to release one if needed */
+static struct zram_stream *zram_stream_get(struct zram *zram)
+{
+	struct zram_stream *zstrm;
+
+	while (1) {
+		spin_lock(&zram->strm_lock);
+		if (!list_empty(&zram->idle_streams)) {
+			zstrm = list_first_entry(&zram->idle_streams,
+					struct zram_stream, list);
+			list_del(&zstrm->list);
+			spin_unlock(&zram->strm_lock);
+			return zstrm;
+		}
+		spin_unlock(&zram->strm_lock);
+
+		wait_event(zram->strm_wait, !list_empty(&zram->idle_streams));
+	}
+}
+
+static void zram_stream_put(struct zram *zram, struct zram_stream *zstrm)
+{
+	spin_lock(&zram->strm_lock);
+	if (zram->avail_streams > zram->max_streams) {
+		zram->avail_streams--;
+		spin_unlock(&zram->strm_lock);
+		zram_stream_free(zstrm);
+		return;
+	}
+	list_add(&zstrm->list, &zram->idle_streams);
+	spin_unlock(&zram->strm_lock);
+	wake_up(&zram->strm_wait);
+}
+
+/* Allocate streams until max_streams exist. Called with init_lock held. */
+static int zram_fill_streams(struct zram *zram)
+{
+	struct zram_stream *zstrm;
+
+	while (zram->avail_streams < zram->max_streams) {
+		zstrm = zram_stream_alloc(zram->compressor);
+		if (!zstrm)
+			return -ENOMEM;
+
+		spin_lock(&zram->strm_lock);
+		list_add(&zstrm->list, &zram->idle_streams);
+		zram->avail_streams++;
+		spin_unlock(&zram->strm_lock);
+		wake_up(&zram->strm_wait);
+	}
+
+	return 0;
+}
+
+/*
+ * Change the number of streams, i.e. how many I/Os can compress or
+ * decompress concurrently. Idle streams above the new limit are freed
+ * now, busy ones when they are released.
+ */
+int zram_set_max_streams(struct zram *zram, int max_streams)
+{
+	struct zram_stream *zstrm, *tmp;
+	LIST_HEAD(free_list);
+	int ret = 0;
+
+	mutex_lock(&zram->init_lock);
+
+	spin_lock(&zram->strm_lock);
+	zram->max_streams = max_streams;
+	list_for_each_entry_safe(zstrm, tmp, &zram->idle_streams, list) {
+		if (zram->avail_streams <= zram->max_streams)
+			break;
+		list_move(&zstrm->list, &free_list);
+		zram->avail_streams--;
+	}
+	spin_unlock(&zram->strm_lock);
+
+	list_for_each_entry_safe(zstrm, tmp, &free_list, list)
+		zram_stream_free(zstrm);
+
+	if (zram->init_done)
+		ret = zram_fill_streams(zram);
+
+	mutex_unlock(&zram->init_lock);
+
+	return ret;
+}
+
+static void zram_destroy_streams(struct zram *zram)
+{
+	struct zram_stream *zstrm, *tmp;
+
+	list_for_each_entry_safe(zstrm, tmp, &zram->idle_streams, list) {
+		list_del(&zstrm->list);
+		zram_stream_free(zstrm);
+	}
+	zram->avail_streams = 0;
+}
+
 static void zram_set_disksize(struct zram *zram, size_t totalram_bytes)
 {
 	if (!zram->disksize) {
@@ -133,15 +474,306 @@ static void zram_set_disksize(struct zram *zram, size_t totalram_bytes)
 	zram->disksize &= PAGE_MASK;
 }
 
+#ifdef CONFIG_ZRAM_WRITEBACK
+static unsigned long zram_alloc_block(struct zram *zram)
+{
+	unsigned long blk;
+
+	spin_lock(&zram->bitmap_lock);
+	blk = find_next_zero_bit(zram->bitmap, zram->nr_blocks, 1);
+	if (blk < zram->nr_blocks)
+		__set_bit(blk, zram->bitmap);
+	else
+		blk = 0;
+	spin_unlock(&zram->bitmap_lock);
+
+	return blk;
+}
+
+/*
+ * A read from the backing device is issued after table_lock is dropped, so
+ * the slot may be freed and its block written back to by another page in
+ * the meantime. Readers pin the block on bd_pins while the table entry is
+ * still locked, and a pinned block that is freed is only released when
+ * the last read of it ends. Only a few reads are in flight at a time, so
+ * the list stays short.
+ */
+struct zram_bd_pin {
+	struct list_head node;
+	unsigned long blk;
+};
+
+static bool zram_block_pinned(struct zram *zram, unsigned long blk)
+{
+	struct zram_bd_pin *pin;
+
+	list_for_each_entry(pin, &zram->bd_pins, node)
+		if (pin->blk == blk)
+			return true;
+
+	return false;
+}
+
+static void zram_free_block(struct zram *zram, unsigned long blk)
+{
+	spin_lock(&zram->bitmap_lock);
+	if (zram_block_pinned(zram, blk))
+		__set_bit(blk, zram->free_pending);
+	else
+		__clear_bit(blk, zram->bitmap);
+	spin_unlock(&zram->bitmap_lock);
+}
+
+static void zram_bd_read_begin(struct zram *zram, struct zram_bd_pin *pin,
+			unsigned long blk)
+{
+	pin->blk = blk;
+	spin_lock(&zram->bitmap_lock);
+	list_add(&pin->node, &zram->bd_pins);
+	spin_unlock(&zram->bitmap_lock);
+}
+
+static void zram_bd_read_end(struct zram *zram, struct zram_bd_pin *pin)
+{
+	unsigned long blk = pin->blk;
+
+	spin_lock(&zram->bitmap_lock);
+	list_del(&pin->node);
+	if (test_bit(blk, zram->free_pending) &&
+	    !zram_block_pinned(zram, blk)) {
+		__clear_bit(blk, zram->free_pending);
+		__clear_bit(blk, zram->bitmap);
+	}
+	spin_unlock(&zram->bitmap_lock);
+}
+
+static void zram_bdev_end_io(struct bio *bio, int err)
+{
+	complete(bio->bi_private);
+}
+
+/* Read or write the page at block @blk of the backing device and wait */
+static int zram_bdev_rw(struct zram *zram, int rw, unsigned long blk,
+			struct page *page)
+{
+	DECLARE_COMPLETION_ONSTACK(done);
+	struct bio *bio;
+	int ret = 0;
+
+	bio = bio_alloc(GFP_NOIO, 1);
+	if (!bio)
+		return -ENOMEM;
+
+	bio->bi_sector = blk << SECTORS_PER_PAGE_SHIFT;
+	bio->bi_bdev = zram->backing_dev;
+	bio->bi_end_io = zram_bdev_end_io;
+	bio->bi_private = &done;
+	if (!bio_add_page(bio, page, PAGE_SIZE, 0)) {
+		bio_put(bio);
+		return -EIO;
+	}
+
+	submit_bio(rw, bio);
+	wait_for_completion(&done);
+
+	if (!test_bit(BIO_UPTODATE, &bio->bi_flags))
+		ret = -EIO;
+	bio_put(bio);
+
+	return ret;
+}
+
+struct zram_read_work {
+	struct work_struct work;
+	struct zram *zram;
+	unsigned long blk;
+	struct page *page;
+	int ret;
+};
+
+static void zram_read_work_fn(struct work_struct *work)
+{
+	struct zram_read_work *rw =
+		container_of(work, struct zram_read_work, work);
+
+	rw->ret = zram_bdev_rw(rw->zram, READ_SYNC, rw->blk, rw->page);
+}
+
+/*
+ * Bios submitted from within zram's make_request are only dispatched
+ * after it returns, so waiting for one there would never finish. Reads
+ * from the backing device are issued and waited for by a worker instead.
+ */
+static int zram_read_from_bdev(struct zram *zram, unsigned long blk,
+			struct page *page)
+{
+	struct zram_read_work rw;
+
+	rw.zram = zram;
+	rw.blk = blk;
+	rw.page = page;
+
+	INIT_WORK_ONSTACK(&rw.work, zram_read_work_fn);
+	queue_work(system_unbound_wq, &rw.work);
+	flush_work(&rw.work);
+	destroy_work_on_stack(&rw.work);
+
+	if (!rw.ret)
+		zram_stat64_inc(zram, &zram->stats.bd_reads);
+
+	return rw.ret;
+}
+
+static void zram_close_backing_dev(struct zram *zram)
+{
+	if (!zram->backing_dev)
+		return;
+
+	blkdev_put(zram->backing_dev, FMODE_READ | FMODE_WRITE | FMODE_EXCL);
+	zram->backing_dev = NULL;
+	vfree(zram->bitmap);
+	zram->bitmap = NULL;
+	vfree(zram->free_pending);
+	zram->free_pending = NULL;
+	zram->nr_blocks = 0;
+	kfree(zram->backing_dev_path);
+	zram->backing_dev_path = NULL;
+}
+
+/*
+ * Use the block device at @path as backing device, or none if @path is
+ * empty. Its current contents are disregarded.
+ */
+int zram_set_backing_dev(struct zram *zram, const char *path)
+{
+	struct block_device *bdev;
+	unsigned long nr_blocks;
+	int ret = 0;
+
+	mutex_lock(&zram->init_lock);
+
+	if (zram->init_done) {
+		ret = -EBUSY;
+		goto out;
+	}
+
+	zram_close_backing_dev(zram);
+	if (!*path)
+		goto out;
+
+	bdev = blkdev_get_by_path(path, FMODE_READ | FMODE_WRITE | FMODE_EXCL,
+				zram);
+	if (IS_ERR(bdev)) {
+		ret = PTR_ERR(bdev);
+		goto out;
+	}
+
+	nr_blocks = i_size_read(bdev->bd_inode) >> PAGE_SHIFT;
+	if (bdev->bd_disk == zram->disk || nr_blocks < 2) {
+		ret = -EINVAL;
+		goto put;
+	}
+
+	ret = set_blocksize(bdev, PAGE_SIZE);
+	if (ret)
+		goto put;
+
+	zram->bitmap = vzalloc(BITS_TO_LONGS(nr_blocks) * sizeof(long));
+	zram->free_pending = vzalloc(BITS_TO_LONGS(nr_blocks) * sizeof(long));
+	zram->backing_dev_path = kstrdup(path, GFP_KERNEL);
+	if (!zram->bitmap || !zram->free_pending || !zram->backing_dev_path) {
+		vfree(zram->bitmap);
+		zram->bitmap = NULL;
+		vfree(zram->free_pending);
+		zram->free_pending = NULL;
+		kfree(zram->backing_dev_path);
+		zram->backing_dev_path = NULL;
+		ret = -ENOMEM;
+		goto put;
+	}
+
+	zram->backing_dev = bdev;
+	zram->nr_blocks = nr_blocks;
+	pr_info("Using %s as backing device, %lu pages\n", path, nr_blocks);
+	goto out;
+
+put:
+	blkdev_put(bdev, FMODE_READ | FMODE_WRITE | FMODE_EXCL);
+out:
+	mutex_unlock(&zram->init_lock);
+
+	return ret;
+}
+#else
+static inline void zram_free_block(struct zram *zram, unsigned long blk)
+{
+}
+
+struct zram_bd_pin {
+};
+
+static inline void zram_bd_read_begin(struct zram *zram,
+			struct zram_bd_pin *pin, unsigned long blk)
+{
+}
+
+static inline void zram_bd_read_end(struct zram *zram,
+			struct zram_bd_pin *pin)
+{
+}
+
+static inline int zram_read_from_bdev(struct zram *zram, unsigned long blk,
+			struct page *page)
+{
+	return -EIO;
+}
+
+static inline void zram_close_backing_dev(struct zram *zram)
+{
+}
+#endif
+
+/* Clear the idle mark of a page that is being read */
+static void zram_accessed(struct zram *zram, u32 index)
+{
+	if (likely(!zram_test_flag(zram, index, ZRAM_IDLE)))
+		return;
+
+	write_lock(&zram->table_lock);
+	zram_clear_flag(zram, index, ZRAM_IDLE);
+	write_unlock(&zram->table_lock);
+}
+
 static void zram_free_page(struct zram *zram, size_t index)
 {
 	u32 clen;
-	void *obj;
+	u16 offset;
+	unsigned char *cmem;
+
+	unsigned long obj = zram->table[index].handle;
+
+	/* Also tells a writeback in progress that the page went away */
+	zram_clear_flag(zram, index, ZRAM_IDLE);
+	zram_clear_flag(zram, index, ZRAM_UNDER_WB);
 
-	struct page *page = zram->table[index].page;
-	u32 offset = zram->table[index].offset;
+	if (zram_test_flag(zram, index, ZRAM_WB)) {
+		zram_free_block(zram, zram->table[index].element);
+		zram_clear_flag(zram, index, ZRAM_WB);
+		zram->table[index].element = 0;
+		zram_stat_dec(&zram->stats.pages_stored);
+		zram_stat64_sub(zram, &zram->stats.bd_count, 1);
+		return;
+	}
 
-	if (unlikely(!page)) {
+	/* Same filled pages keep only their pattern in the table entry */
+	if (zram_test_flag(zram, index, ZRAM_SAME)) {
+		zram_clear_flag(zram, index, ZRAM_SAME);
+		zram_stat_dec(&zram->stats.pages_same);
+		zram->table[index].element = 0;
+		return;
+	}
+
+	if (unlikely(!obj)) {
 		/*
 		 * No memory is allocated for zero filled pages.
 		 * Simply clear zero page flag.
@@ -155,25 +787,46 @@ static void zram_free_page(struct zram *zram, size_t index)
 
 	if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
 		clen = PAGE_SIZE;
-		__free_page(page);
+		__free_page(zram->table[index].page);
 		zram_clear_flag(zram, index, ZRAM_UNCOMPRESSED);
 		zram_stat_dec(&zram->stats.pages_expand);
 		goto out;
 	}
 
-	obj = kmap_atomic(page, KM_USER0) + offset;
-	clen = xv_get_object_size(obj) - sizeof(struct zobj_header);
-	kunmap_atomic(obj, KM_USER0);
+	offset = zram_obj_offset(zram, index);
+	if (zram->allocator == ZRAM_ZSMALLOC) {
+		clen = zram->table[index].size;
+	} else {
+		cmem = zram_obj_map(zram, obj, offset, ZS_MM_RO);
+		clen = zram_obj_size(zram, index, cmem);
+		zram_obj_unmap(zram, obj, cmem);
+	}
 
-	xv_free(zram->mem_pool, page, offset);
 	if (clen <= PAGE_SIZE / 2)
 		zram_stat_dec(&zram->stats.good_compress);
 
+	if (zram_test_flag(zram, index, ZRAM_DEDUP)) {
+		u32 size = 0;
+
+		zram_clear_flag(zram, index, ZRAM_DEDUP);
+		if (!zram_dedup_put(zram, obj, offset, &size)) {
+			/* Other entries still share the object */
+			zram_stat64_sub(zram, &zram->stats.dup_data_size,
+					size);
+			zram_stat_dec(&zram->stats.pages_dup);
+			zram_stat_dec(&zram->stats.pages_stored);
+			goto clear;
+		}
+	}
+
+	zram_obj_free(zram, obj, offset);
+
 out:
 	zram_stat64_sub(zram, &zram->stats.compr_size, clen);
 	zram_stat_dec(&zram->stats.pages_stored);
 
-	zram->table[index].page = NULL;
+clear:
+	zram->table[index].handle = 0;
 	zram->table[index].offset = 0;
 }
 
@@ -188,6 +841,19 @@ static void handle_zero_page(struct page *page)
 	flush_dcache_page(page);
 }
 
+static void handle_same_page(struct page *page, unsigned long element)
+{
+	unsigned int pos;
+	unsigned long *user_mem;
+
+	user_mem = kmap_atomic(page, KM_USER0);
+	for (pos = 0; pos != PAGE_SIZE / sizeof(*user_mem); pos++)
+		user_mem[pos] = element;
+	kunmap_atomic(user_mem, KM_USER0);
+
+	flush_dcache_page(page);
+}
+
 static void handle_uncompressed_page(struct zram *zram,
 				struct page *page, u32 index)
 {
@@ -204,33 +870,92 @@ static void handle_uncompressed_page(struct zram *zram,
 	flush_dcache_page(page);
 }
 
+/*
+ * Decompress the object stored for @index into @mem. Must be called with
+ * table_lock held for reading.
+ */
+static int zram_decompress_page(struct zram *zram, struct zram_stream *zstrm,
+				u32 index, unsigned char *mem)
+{
+	int ret;
+	unsigned int clen = PAGE_SIZE;
+	unsigned long obj = zram->table[index].handle;
+	unsigned char *cmem;
+
+	cmem = zram_obj_map(zram, obj, zram_obj_offset(zram, index),
+			ZS_MM_RO);
+
+	ret = crypto_comp_decompress(zstrm->tfm,
+			cmem + sizeof(struct zobj_header),
+			zram_obj_size(zram, index, cmem), mem, &clen);
+
+	zram_obj_unmap(zram, obj, cmem);
+
+	return ret;
+}
+
 static void zram_read(struct zram *zram, struct bio *bio)
 {
 
 	int i;
 	u32 index;
 	struct bio_vec *bvec;
+	struct zram_stream *zstrm;
 
 	zram_stat64_inc(zram, &zram->stats.num_reads);
 	index = bio->bi_sector >> SECTORS_PER_PAGE_SHIFT;
 
+	/* Not every compressor can decompress without a context */
+	zstrm = zram_stream_get(zram);
+
 	bio_for_each_segment(bvec, bio, i) {
 		int ret;
-		size_t clen;
 		struct page *page;
-		struct zobj_header *zheader;
-		unsigned char *user_mem, *cmem;
+		unsigned char *user_mem;
 
 		page = bvec->bv_page;
 
+		zram_accessed(zram, index);
+		read_lock(&zram->table_lock);
+
 		if (zram_test_flag(zram, index, ZRAM_ZERO)) {
+			read_unlock(&zram->table_lock);
 			handle_zero_page(page);
 			index++;
 			continue;
 		}
 
+		if (zram_test_flag(zram, index, ZRAM_SAME)) {
+			unsigned long element = zram->table[index].element;
+
+			read_unlock(&zram->table_lock);
+			handle_same_page(page, element);
+			index++;
+			continue;
+		}
+
+		if (unlikely(zram_test_flag(zram, index, ZRAM_WB))) {
+			unsigned long blk = zram->table[index].element;
+			struct zram_bd_pin pin;
+
+			zram_bd_read_begin(zram, &pin, blk);
+			read_unlock(&zram->table_lock);
+			ret = zram_read_from_bdev(zram, blk, page);
+			zram_bd_read_end(zram, &pin);
+			if (unlikely(ret)) {
+				pr_err("Backing device read failed! err=%d, "
+					"page=%u\n", ret, index);
+				zram_stat64_inc(zram, &zram->stats.failed_reads);
+				goto out;
+			}
+			flush_dcache_page(page);
+			index++;
+			continue;
+		}
+
 		/* Requested page is not present in compressed area */
 		if (unlikely(!zram->table[index].page)) {
+			read_unlock(&zram->table_lock);
 			pr_debug("Read before write: sector=%lu, size=%u",
 				(ulong)(bio->bi_sector), bio->bi_size);
 			handle_zero_page(page);
@@ -241,26 +966,18 @@ static void zram_read(struct zram *zram, struct bio *bio)
 		/* Page is stored uncompressed since it's incompressible */
 		if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
 			handle_uncompressed_page(zram, page, index);
+			read_unlock(&zram->table_lock);
 			index++;
 			continue;
 		}
 
 		user_mem = kmap_atomic(page, KM_USER0);
-		clen = PAGE_SIZE;
-
-		cmem = kmap_atomic(zram->table[index].page, KM_USER1) +
-				zram->table[index].offset;
-
-		ret = lzo1x_decompress_safe(
-			cmem + sizeof(*zheader),
-			xv_get_object_size(cmem) - sizeof(*zheader),
-			user_mem, &clen);
-
+		ret = zram_decompress_page(zram, zstrm, index, user_mem);
 		kunmap_atomic(user_mem, KM_USER0);
-		kunmap_atomic(cmem, KM_USER1);
+		read_unlock(&zram->table_lock);
 
 		/* Should NEVER happen. Return bio error if it does. */
-		if (unlikely(ret != LZO_E_OK)) {
+		if (unlikely(ret)) {
 			pr_err("Decompression failed! err=%d, page=%u\n",
 				ret, index);
 			zram_stat64_inc(zram, &zram->stats.failed_reads);
@@ -271,11 +988,13 @@ static void zram_read(struct zram *zram, struct bio *bio)
 		index++;
 	}
 
+	zram_stream_put(zram, zstrm);
 	set_bit(BIO_UPTODATE, &bio->bi_flags);
 	bio_endio(bio, 0);
 	return;
 
 out:
+	zram_stream_put(zram, zstrm);
 	bio_io_error(bio);
 }
 
@@ -290,42 +1009,60 @@ static void zram_write(struct zram *zram, struct bio *bio)
 
 	bio_for_each_segment(bvec, bio, i) {
 		int ret;
-		u32 offset;
-		size_t clen;
-		struct zobj_header *zheader;
+		u16 offset;
+		unsigned long obj;
+		unsigned int clen;
+		u32 checksum = 0;
+		unsigned long element;
+		bool uncompressed = false;
+		bool shared = false, dup = false;
+		struct zram_dedup *dedup = NULL;
+		struct zram_stream *zstrm;
 		struct page *page, *page_store;
 		unsigned char *user_mem, *cmem, *src;
 
 		page = bvec->bv_page;
-		src = zram->compress_buffer;
 
 		/*
-		 * System overwrites unused sectors. Free memory associated
-		 * with this sector now.
+		 * Compress and copy out on our own stream without holding
+		 * the table lock, so writers on other CPUs proceed in
+		 * parallel. The table entry is only switched over below.
 		 */
-		if (zram->table[index].page ||
-				zram_test_flag(zram, index, ZRAM_ZERO))
-			zram_free_page(zram, index);
-
-		mutex_lock(&zram->lock);
+		zstrm = zram_stream_get(zram);
+		src = zstrm->buffer;
 
 		user_mem = kmap_atomic(page, KM_USER0);
-		if (page_zero_filled(user_mem)) {
+		if (page_same_filled(user_mem, &element)) {
 			kunmap_atomic(user_mem, KM_USER0);
-			mutex_unlock(&zram->lock);
-			zram_stat_inc(&zram->stats.pages_zero);
-			zram_set_flag(zram, index, ZRAM_ZERO);
+			zram_stream_put(zram, zstrm);
+
+			/*
+			 * System overwrites unused sectors. Free memory
+			 * associated with this sector now.
+			 */
+			write_lock(&zram->table_lock);
+			zram_free_page(zram, index);
+			if (!element) {
+				zram_stat_inc(&zram->stats.pages_zero);
+				zram_set_flag(zram, index, ZRAM_ZERO);
+			} else {
+				zram->table[index].element = element;
+				zram_stat_inc(&zram->stats.pages_same);
+				zram_set_flag(zram, index, ZRAM_SAME);
+			}
+			write_unlock(&zram->table_lock);
 			index++;
 			continue;
 		}
 
-		ret = lzo1x_1_compress(user_mem, PAGE_SIZE, src, &clen,
-					zram->compress_workmem);
+		clen = 2 * PAGE_SIZE;
+		ret = crypto_comp_compress(zstrm->tfm, user_mem, PAGE_SIZE,
+					src, &clen);
 
 		kunmap_atomic(user_mem, KM_USER0);
 
-		if (unlikely(ret != LZO_E_OK)) {
-			mutex_unlock(&zram->lock);
+		if (unlikely(ret)) {
+			zram_stream_put(zram, zstrm);
 			pr_err("Compression failed! err=%d\n", ret);
 			zram_stat64_inc(zram, &zram->stats.failed_writes);
 			goto out;
@@ -340,7 +1077,7 @@ static void zram_write(struct zram *zram, struct bio *bio)
 			clen = PAGE_SIZE;
 			page_store = alloc_page(GFP_NOIO | __GFP_HIGHMEM);
 			if (unlikely(!page_store)) {
-				mutex_unlock(&zram->lock);
+				zram_stream_put(zram, zstrm);
 				pr_info("Error allocating memory for "
 					"incompressible page: %u\n", index);
 				zram_stat64_inc(zram,
@@ -348,33 +1085,45 @@ static void zram_write(struct zram *zram, struct bio *bio)
 				goto out;
 			}
 
+			obj = (unsigned long)page_store;
 			offset = 0;
-			zram_set_flag(zram, index, ZRAM_UNCOMPRESSED);
-			zram_stat_inc(&zram->stats.pages_expand);
-			zram->table[index].page = page_store;
+			uncompressed = true;
 			src = kmap_atomic(page, KM_USER0);
 			goto memstore;
 		}
 
-		if (xv_malloc(zram->mem_pool, clen + sizeof(*zheader),
-				&zram->table[index].page, &offset,
-				GFP_NOIO | __GFP_HIGHMEM)) {
-			mutex_unlock(&zram->lock);
+		if (zram->dedup_content) {
+			checksum = jhash(src, clen, 0);
+			dedup = zram_dedup_get(zram, checksum, src, clen);
+			if (dedup) {
+				zram_stream_put(zram, zstrm);
+				obj = dedup->obj;
+				offset = dedup->offset;
+				shared = dup = true;
+				goto install;
+			}
+			/* Without a record the object is simply not shared */
+			dedup = kmalloc(sizeof(*dedup), GFP_NOIO);
+		}
+
+		if (zram_obj_alloc(zram, clen, &obj, &offset)) {
+			zram_stream_put(zram, zstrm);
+			kfree(dedup);
 			pr_info("Error allocating memory for compressed "
-				"page: %u, size=%zu\n", index, clen);
+				"page: %u, size=%u\n", index, clen);
 			zram_stat64_inc(zram, &zram->stats.failed_writes);
 			goto out;
 		}
 
 memstore:
-		zram->table[index].offset = offset;
-
-		cmem = kmap_atomic(zram->table[index].page, KM_USER1) +
-				zram->table[index].offset;
+		if (unlikely(uncompressed))
+			cmem = kmap_atomic(page_store, KM_USER1);
+		else
+			cmem = zram_obj_map(zram, obj, offset, ZS_MM_WO);
 
 #if 0
 		/* Back-reference needed for memory defragmentation */
-		if (!zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)) {
+		if (!uncompressed) {
 			zheader = (struct zobj_header *)cmem;
 			zheader->table_idx = index;
 			cmem += sizeof(*zheader);
@@ -383,17 +1132,55 @@ memstore:
 
 		memcpy(cmem, src, clen);
 
-		kunmap_atomic(cmem, KM_USER1);
-		if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)))
+		if (unlikely(uncompressed)) {
+			kunmap_atomic(cmem, KM_USER1);
 			kunmap_atomic(src, KM_USER0);
+		} else {
+			zram_obj_unmap(zram, obj, cmem);
+		}
+
+		zram_stream_put(zram, zstrm);
+
+		if (dedup) {
+			zram_dedup_add(zram, dedup, checksum, obj, offset,
+					clen);
+			shared = true;
+		}
+
+install:
+		write_lock(&zram->table_lock);
+
+		/*
+		 * System overwrites unused sectors. Free memory associated
+		 * with this sector now.
+		 */
+		zram_free_page(zram, index);
+
+		zram->table[index].handle = obj;
+		if (zram->allocator == ZRAM_ZSMALLOC && !uncompressed)
+			zram->table[index].size = clen;
+		else
+			zram->table[index].offset = offset;
+		if (unlikely(uncompressed)) {
+			zram_set_flag(zram, index, ZRAM_UNCOMPRESSED);
+			zram_stat_inc(&zram->stats.pages_expand);
+		} else if (shared) {
+			zram_set_flag(zram, index, ZRAM_DEDUP);
+		}
 
 		/* Update stats */
-		zram_stat64_add(zram, &zram->stats.compr_size, clen);
+		if (dup) {
+			zram_stat64_add(zram, &zram->stats.dup_data_size,
+					clen);
+			zram_stat_inc(&zram->stats.pages_dup);
+		} else {
+			zram_stat64_add(zram, &zram->stats.compr_size, clen);
+		}
 		zram_stat_inc(&zram->stats.pages_stored);
 		if (clen <= PAGE_SIZE / 2)
 			zram_stat_inc(&zram->stats.good_compress);
 
-		mutex_unlock(&zram->lock);
+		write_unlock(&zram->table_lock);
 		index++;
 	}
 
@@ -461,34 +1248,38 @@ void zram_reset_device(struct zram *zram)
 	zram->init_done = 0;
 
 	/* Free various per-device buffers */
-	kfree(zram->compress_workmem);
-	free_pages((unsigned long)zram->compress_buffer, 1);
-
-	zram->compress_workmem = NULL;
-	zram->compress_buffer = NULL;
+	zram_destroy_streams(zram);
 
 	/* Free all pages that are still in this zram device */
 	for (index = 0; index < zram->disksize >> PAGE_SHIFT; index++) {
-		struct page *page;
-		u16 offset;
+		unsigned long obj = zram->table[index].handle;
 
-		page = zram->table[index].page;
-		offset = zram->table[index].offset;
+		if (!obj || zram_test_flag(zram, index, ZRAM_SAME) ||
+				zram_test_flag(zram, index, ZRAM_WB))
+			continue;
 
-		if (!page)
+		/* Shared objects are freed with the dedup index below */
+		if (zram_test_flag(zram, index, ZRAM_DEDUP))
 			continue;
 
 		if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)))
-			__free_page(page);
+			__free_page(zram->table[index].page);
 		else
-			xv_free(zram->mem_pool, page, offset);
+			zram_obj_free(zram, obj, zram_obj_offset(zram, index));
 	}
 
+	zram_dedup_destroy(zram);
+	zram_close_backing_dev(zram);
+
 	vfree(zram->table);
 	zram->table = NULL;
 
 	xv_destroy_pool(zram->mem_pool);
 	zram->mem_pool = NULL;
+	if (zram->zs_pool) {
+		zs_destroy_pool(zram->zs_pool);
+		zram->zs_pool = NULL;
+	}
 
 	/* Reset stats */
 	memset(&zram->stats, 0, sizeof(zram->stats));
@@ -511,16 +1302,9 @@ int zram_init_device(struct zram *zram)
 
 	zram_set_disksize(zram, totalram_pages << PAGE_SHIFT);
 
-	zram->compress_workmem = kzalloc(LZO1X_MEM_COMPRESS, GFP_KERNEL);
-	if (!zram->compress_workmem) {
-		pr_err("Error allocating compressor working memory!\n");
-		ret = -ENOMEM;
-		goto fail;
-	}
-
-	zram->compress_buffer = (void *)__get_free_pages(__GFP_ZERO, 1);
-	if (!zram->compress_buffer) {
-		pr_err("Error allocating compressor buffer space\n");
+	if (zram_fill_streams(zram) && !zram->avail_streams) {
+		pr_err("Error allocating %s compression stream\n",
+			zram->compressor);
 		ret = -ENOMEM;
 		goto fail;
 	}
@@ -540,13 +1324,22 @@ int zram_init_device(struct zram *zram)
 	/* zram devices sort of resembles non-rotational disks */
 	queue_flag_set_unlocked(QUEUE_FLAG_NONROT, zram->disk->queue);
 
-	zram->mem_pool = xv_create_pool();
-	if (!zram->mem_pool) {
+	if (zram->allocator == ZRAM_ZSMALLOC)
+		zram->zs_pool = zs_create_pool(GFP_NOIO | __GFP_HIGHMEM);
+	else
+		zram->mem_pool = xv_create_pool();
+	if (!zram->mem_pool && !zram->zs_pool) {
 		pr_err("Error creating memory pool\n");
 		ret = -ENOMEM;
 		goto fail;
 	}
 
+	if (zram->dedup_enable && zram_dedup_init(zram, num_pages)) {
+		pr_err("Error allocating deduplication index\n");
+		ret = -ENOMEM;
+		goto fail;
+	}
+
 	zram->init_done = 1;
 	mutex_unlock(&zram->init_lock);
 
@@ -561,12 +1354,328 @@ fail:
 	return ret;
 }
 
+/*
+ * Copy out up to zram_bench_pages of the data stored in the device. Filled
+ * pages are skipped since they never reach the compressor.
+ */
+static size_t zram_bench_samples(struct zram *zram, unsigned char *samples)
+{
+	size_t index, nr = 0;
+	struct zram_stream *zstrm;
+	unsigned char *cmem;
+
+	zstrm = zram_stream_get(zram);
+
+	for (index = 0; index < zram->disksize >> PAGE_SHIFT &&
+			nr < zram_bench_pages; index++) {
+		unsigned char *mem = samples + nr * PAGE_SIZE;
+
+		read_lock(&zram->table_lock);
+		if (zram_test_flag(zram, index, ZRAM_SAME) ||
+				zram_test_flag(zram, index, ZRAM_WB) ||
+				!zram->table[index].handle) {
+			read_unlock(&zram->table_lock);
+			continue;
+		}
+
+		if (zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)) {
+			cmem = kmap_atomic(zram->table[index].page, KM_USER1);
+			memcpy(mem, cmem, PAGE_SIZE);
+			kunmap_atomic(cmem, KM_USER1);
+			nr++;
+		} else if (!zram_decompress_page(zram, zstrm, index, mem)) {
+			nr++;
+		}
+		read_unlock(&zram->table_lock);
+	}
+
+	zram_stream_put(zram, zstrm);
+
+	return nr;
+}
+
+/*
+ * Compress and decompress a sample of the device's data with every
+ * available compressor, reporting throughput and compression ratio so the
+ * comp_algorithm for a workload can be chosen from real pages.
+ */
+ssize_t zram_comp_benchmark(struct zram *zram, char *buf)
+{
+	unsigned char *samples, *dst, *out;
+	ssize_t count = 0;
+	size_t nr, j;
+	int i;
+
+	mutex_lock(&zram->init_lock);
+
+	if (!zram->init_done) {
+		count = -ENODEV;
+		goto out_unlock;
+	}
+
+	samples = vmalloc(zram_bench_pages * PAGE_SIZE);
+	dst = (void *)__get_free_pages(GFP_KERNEL, 1);
+	out = (void *)__get_free_page(GFP_KERNEL);
+	if (!samples || !dst || !out) {
+		count = -ENOMEM;
+		goto out_free;
+	}
+
+	nr = zram_bench_samples(zram, samples);
+	if (!nr) {
+		count = -ENODATA;
+		goto out_free;
+	}
+
+	count += scnprintf(buf + count, PAGE_SIZE - count,
+			"sample pages %zu\n", nr);
+
+	for (i = 0; i < ARRAY_SIZE(zram_compressors); i++) {
+		const char *name = zram_compressors[i];
+		struct crypto_comp *tfm;
+		u64 comp_ns = 0, decomp_ns = 0, in, zsize = 0;
+		ktime_t start;
+		int ret = 0;
+
+		if (!crypto_has_comp(name, 0, 0))
+			continue;
+
+		tfm = crypto_alloc_comp(name, 0, 0);
+		if (IS_ERR(tfm))
+			continue;
+
+		for (j = 0; j < nr; j++) {
+			unsigned int clen = 2 * PAGE_SIZE;
+			unsigned int dlen = PAGE_SIZE;
+
+			start = ktime_get();
+			ret = crypto_comp_compress(tfm,
+					samples + j * PAGE_SIZE, PAGE_SIZE,
+					dst, &clen);
+			comp_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
+			if (ret)
+				break;
+
+			start = ktime_get();
+			ret = crypto_comp_decompress(tfm, dst, clen, out, &dlen);
+			decomp_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
+			if (ret)
+				break;
+
+			zsize += clen;
+		}
+		crypto_free_comp(tfm);
+
+		if (ret) {
+			count += scnprintf(buf + count, PAGE_SIZE - count,
+					"%-8s error %d\n", name, ret);
+			continue;
+		}
+
+		/* bytes per ns * 1000 = MB/s */
+		in = (u64)nr * PAGE_SIZE;
+		count += scnprintf(buf + count, PAGE_SIZE - count,
+				"%-8s compress %llu MB/s decompress %llu MB/s "
+				"ratio %llu.%02llu\n", name,
+				div64_u64(in * 1000, comp_ns ?: 1),
+				div64_u64(in * 1000, decomp_ns ?: 1),
+				div64_u64(in, zsize),
+				div64_u64(in * 100, zsize) % 100);
+	}
+
+out_free:
+	free_page((unsigned long)out);
+	free_pages((unsigned long)dst, 1);
+	vfree(samples);
+out_unlock:
+	mutex_unlock(&zram->init_lock);
+
+	return count;
+}
+
+/*
+ * Move zsmalloc objects out of sparsely used zspages so that their pages
+ * can be given back. Returns -EINVAL for devices using xvmalloc, which
+ * cannot move objects.
+ */
+int zram_compact(struct zram *zram)
+{
+	unsigned long freed;
+	int ret = 0;
+
+	mutex_lock(&zram->init_lock);
+
+	if (!zram->init_done) {
+		ret = -ENODEV;
+		goto out;
+	}
+
+	if (zram->allocator != ZRAM_ZSMALLOC) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	freed = zs_compact(zram->zs_pool);
+	zram_stat64_add(zram, &zram->stats.pages_compacted, freed);
+
+out:
+	mutex_unlock(&zram->init_lock);
+
+	return ret;
+}
+
+#ifdef CONFIG_ZRAM_WRITEBACK
+/*
+ * Mark every page held in memory idle. Pages read or written afterwards
+ * lose the mark, so the ones still marked at the next writeback have not
+ * been used in between.
+ */
+void zram_mark_idle(struct zram *zram)
+{
+	size_t index;
+
+	mutex_lock(&zram->init_lock);
+
+	for (index = 0; zram->init_done &&
+			index < zram->disksize >> PAGE_SHIFT; index++) {
+		write_lock(&zram->table_lock);
+		if (zram->table[index].handle &&
+				!zram_test_flag(zram, index, ZRAM_SAME) &&
+				!zram_test_flag(zram, index, ZRAM_WB))
+			zram_set_flag(zram, index, ZRAM_IDLE);
+		write_unlock(&zram->table_lock);
+	}
+
+	mutex_unlock(&zram->init_lock);
+}
+
+/* Whether @index holds a page in memory that writeback should move out */
+static bool zram_writeback_candidate(struct zram *zram, size_t index,
+				bool idle, bool huge)
+{
+	if (!zram->table[index].handle ||
+			zram_test_flag(zram, index, ZRAM_SAME) ||
+			zram_test_flag(zram, index, ZRAM_WB) ||
+			zram_test_flag(zram, index, ZRAM_UNDER_WB) ||
+			zram_test_flag(zram, index, ZRAM_DEDUP))
+		return false;
+
+	return (idle && zram_test_flag(zram, index, ZRAM_IDLE)) ||
+		(huge && zram_test_flag(zram, index, ZRAM_UNCOMPRESSED));
+}
+
+/*
+ * Write idle and/or incompressible pages to the backing device and free
+ * their memory. The table lock is not held across the I/O; a page freed
+ * or overwritten meanwhile loses ZRAM_UNDER_WB and is left alone.
+ */
+int zram_writeback(struct zram *zram, bool idle, bool huge)
+{
+	struct zram_stream *zstrm;
+	unsigned char *mem, *cmem;
+	struct page *page;
+	unsigned long blk;
+	size_t index;
+	bool uncompressed;
+	int ret = 0, err;
+
+	page = alloc_page(GFP_KERNEL);
+	if (!page)
+		return -ENOMEM;
+
+	mutex_lock(&zram->init_lock);
+
+	if (!zram->init_done || !zram->backing_dev) {
+		ret = -ENODEV;
+		goto out;
+	}
+
+	for (index = 0; index < zram->disksize >> PAGE_SHIFT; index++) {
+		write_lock(&zram->table_lock);
+		if (!zram_writeback_candidate(zram, index, idle, huge)) {
+			write_unlock(&zram->table_lock);
+			continue;
+		}
+		zram_set_flag(zram, index, ZRAM_UNDER_WB);
+		uncompressed = zram_test_flag(zram, index, ZRAM_UNCOMPRESSED);
+		write_unlock(&zram->table_lock);
+
+		blk = zram_alloc_block(zram);
+		if (!blk) {
+			ret = -ENOSPC;
+			goto abort;
+		}
+
+		zstrm = zram_stream_get(zram);
+		err = 0;
+
+		read_lock(&zram->table_lock);
+		if (!zram_test_flag(zram, index, ZRAM_UNDER_WB)) {
+			read_unlock(&zram->table_lock);
+			zram_stream_put(zram, zstrm);
+			zram_free_block(zram, blk);
+			continue;
+		}
+
+		mem = kmap_atomic(page, KM_USER0);
+		if (uncompressed) {
+			cmem = kmap_atomic(zram->table[index].page, KM_USER1);
+			memcpy(mem, cmem, PAGE_SIZE);
+			kunmap_atomic(cmem, KM_USER1);
+		} else {
+			err = zram_decompress_page(zram, zstrm, index, mem);
+		}
+		kunmap_atomic(mem, KM_USER0);
+		read_unlock(&zram->table_lock);
+
+		zram_stream_put(zram, zstrm);
+
+		if (!err)
+			err = zram_bdev_rw(zram, WRITE, blk, page);
+		if (err) {
+			zram_free_block(zram, blk);
+			ret = err;
+			goto abort;
+		}
+		zram_stat64_inc(zram, &zram->stats.bd_writes);
+
+		write_lock(&zram->table_lock);
+		if (!zram_test_flag(zram, index, ZRAM_UNDER_WB)) {
+			write_unlock(&zram->table_lock);
+			zram_free_block(zram, blk);
+			continue;
+		}
+		zram_free_page(zram, index);
+		zram->table[index].element = blk;
+		zram_set_flag(zram, index, ZRAM_WB);
+		zram_stat_inc(&zram->stats.pages_stored);
+		write_unlock(&zram->table_lock);
+
+		zram_stat64_inc(zram, &zram->stats.bd_count);
+		cond_resched();
+	}
+	goto out;
+
+abort:
+	write_lock(&zram->table_lock);
+	zram_clear_flag(zram, index, ZRAM_UNDER_WB);
+	write_unlock(&zram->table_lock);
+out:
+	mutex_unlock(&zram->init_lock);
+	__free_page(page);
+
+	return ret;
+}
+#endif
+
 void zram_slot_free_notify(struct block_device *bdev, unsigned long index)
 {
 	struct zram *zram;
 
 	zram = bdev->bd_disk->private_data;
+	write_lock(&zram->table_lock);
 	zram_free_page(zram, index);
+	write_unlock(&zram->table_lock);
 	zram_stat64_inc(zram, &zram->stats.notify_free);
 }
 
@@ -579,9 +1688,21 @@ static int create_device(struct zram *zram, int device_id)
 {
 	int ret = 0;
 
-	mutex_init(&zram->lock);
 	mutex_init(&zram->init_lock);
 	spin_lock_init(&zram->stat64_lock);
+	rwlock_init(&zram->table_lock);
+	spin_lock_init(&zram->dedup_lock);
+#ifdef CONFIG_ZRAM_WRITEBACK
+	spin_lock_init(&zram->bitmap_lock);
+	INIT_LIST_HEAD(&zram->bd_pins);
+#endif
+
+	INIT_LIST_HEAD(&zram->idle_streams);
+	spin_lock_init(&zram->strm_lock);
+	init_waitqueue_head(&zram->strm_wait);
+	zram->max_streams = num_online_cpus();
+	strlcpy(zram->compressor, default_compressor,
+		sizeof(zram->compressor));
 
 	zram->queue = blk_alloc_queue(GFP_KERNEL);
 	if (!zram->queue) {
@@ -15,10 +15,13 @@
 #ifndef _ZRAM_DRV_H_
 #define _ZRAM_DRV_H_
 
+#include <linux/crypto.h>
 #include <linux/spinlock.h>
 #include <linux/mutex.h>
+#include <linux/wait.h>
 
 #include "xvmalloc.h"
+#include "zsmalloc.h"
 
 /*
  * Some arbitrary value. This is just to catch
@@ -43,6 +46,18 @@ struct zobj_header {
 /* Default zram disk size: 25% of total RAM */
 static const unsigned default_disksize_perc_ram = 25;
 
+/* Default compressor, any crypto API "compress" algorithm can be used */
+static const char default_compressor[] = "lzo";
+
+/* Compressors listed in comp_algorithm and compared by comp_benchmark */
+static const char * const zram_compressors[] = {
+	"lzo",
+	"deflate",
+};
+
+/* Number of stored pages comp_benchmark uses as samples */
+static const unsigned zram_bench_pages = 64;
+
 /*
  * Pages that compress to size greater than this are stored
  * uncompressed in memory.
@@ -71,19 +86,68 @@ enum zram_pageflags {
 	/* Page consists entirely of zeros */
 	ZRAM_ZERO,
 
+	/* Page is one repeated non-zero word, kept in table.element */
+	ZRAM_SAME,
+
+	/* Compressed object is shared through a struct zram_dedup */
+	ZRAM_DEDUP,
+
+	/* Page lives on the backing device, table.element is its block */
+	ZRAM_WB,
+
+	/* Page is being written back; cleared if it is freed meanwhile */
+	ZRAM_UNDER_WB,
+
+	/* Page not accessed since it was last marked idle */
+	ZRAM_IDLE,
+
 	__NR_ZRAM_PAGEFLAGS,
 };
 
 /*-- Data structures */
 
+/* Allocators for compressed objects, chosen before device init */
+enum zram_allocator {
+	ZRAM_XVMALLOC,
+	ZRAM_ZSMALLOC,
+};
+
+static const char * const zram_allocators[] = {
+	[ZRAM_XVMALLOC] = "xvmalloc",
+	[ZRAM_ZSMALLOC] = "zsmalloc",
+};
+
 /* Allocated for each disk page */
 struct table {
-	struct page *page;
-	u16 offset;
+	union {
+		struct page *page;
+		unsigned long handle;	/* zsmalloc object */
+		unsigned long element;	/* ZRAM_SAME fill pattern or
+					 * ZRAM_WB block */
+	};
+	union {
+		u16 offset;	/* xvmalloc object offset in page */
+		u16 size;	/* zsmalloc object length */
+	};
 	u8 count;	/* object ref count (not yet used) */
 	u8 flags;
 } __attribute__((aligned(4)));
 
+/*
+ * A compressed object shared by all table entries whose data compressed
+ * to identical bytes. Hashed by content to find duplicates on write, and
+ * by location to find the object again when an entry is freed.
+ */
+struct zram_dedup {
+	struct hlist_node content_node;
+	struct hlist_node obj_node;
+	u32 checksum;
+	u32 refcount;
+	unsigned long obj;	/* struct page * or zsmalloc handle */
+	u16 offset;		/* xvmalloc only */
+	u16 size;		/* compressed length */
+};
+
 struct zram_stats {
 	u64 compr_size;		/* compressed size of pages stored */
 	u64 num_reads;		/* failed + successful */
@@ -92,20 +156,71 @@ struct zram_stats {
 	u64 failed_writes;	/* can happen when memory is too low */
 	u64 invalid_io;		/* non-page-aligned I/O requests */
 	u64 notify_free;	/* no. of swap slot free notifications */
+	u64 dup_data_size;	/* compressed bytes not stored thanks to
+				 * deduplication */
+	u64 pages_compacted;	/* pages freed by zsmalloc compaction */
+	u64 bd_count;		/* no. of pages on the backing device */
+	u64 bd_reads;		/* no. of reads from the backing device */
+	u64 bd_writes;		/* no. of pages written back */
 	u32 pages_zero;		/* no. of zero filled pages */
+	u32 pages_same;		/* no. of same word filled pages */
+	u32 pages_dup;		/* no. of pages sharing another page's
+				 * compressed object */
 	u32 pages_stored;	/* no. of pages currently stored */
 	u32 good_compress;	/* % of pages with compression ratio<=50% */
 	u32 pages_expand;	/* % of incompressible pages */
 };
 
+/* Compressor instance and output buffer used by one I/O at a time */
+struct zram_stream {
+	struct crypto_comp *tfm;
+	void *buffer;
+	struct list_head list;
+};
+
 struct zram {
+	enum zram_allocator allocator;
 	struct xv_pool *mem_pool;
-	void *compress_workmem;
-	void *compress_buffer;
+	struct zs_pool *zs_pool;
 	struct table *table;
 	spinlock_t stat64_lock;	/* protect 64-bit stats */
-	struct mutex lock;	/* protect compression buffers against
-				 * concurrent writes */
+	rwlock_t table_lock;	/* protect table entries and the
+				 * 32-bit stats */
+	/*
+	 * Compression streams. I/Os compress and decompress concurrently,
+	 * each on its own stream, up to max_streams at a time.
+	 */
+	char compressor[CRYPTO_MAX_ALG_NAME];
+	struct list_head idle_streams;
+	spinlock_t strm_lock;	/* protect idle_streams and counts */
+	wait_queue_head_t strm_wait;
+	int avail_streams;	/* streams allocated */
+	int max_streams;
+	/*
+	 * Content hash index of compressed objects, only set up when
+	 * dedup_enable was set before the device was initialized.
+	 */
+	int dedup_enable;
+	spinlock_t dedup_lock;	/* protect the hash tables and refcounts */
+	struct hlist_head *dedup_content;
+	struct hlist_head *dedup_obj;
+	unsigned int dedup_bits;
+#ifdef CONFIG_ZRAM_WRITEBACK
+	/*
+	 * Optional block device idle and incompressible pages are written
+	 * back to. Block usage is tracked in bitmap, block 0 is never used.
+	 * Reads from the backing device pin their block on bd_pins; a pinned
+	 * block that is freed stays allocated, marked in free_pending, until
+	 * the last read of it ends.
+	 */
+	struct block_device *backing_dev;
+	char *backing_dev_path;
+	unsigned long *bitmap;
+	unsigned long *free_pending;
+	unsigned long nr_blocks;
+	struct list_head bd_pins;
+	spinlock_t bitmap_lock;
+#endif
 	struct request_queue *queue;
 	struct gendisk *disk;
 	int init_done;
@@ -128,5 +243,13 @@ extern struct attribute_group zram_disk_attr_group;
 
 extern int zram_init_device(struct zram *zram);
 extern void zram_reset_device(struct zram *zram);
+extern int zram_set_max_streams(struct zram *zram, int max_streams);
+extern ssize_t zram_comp_benchmark(struct zram *zram, char *buf);
+extern int zram_compact(struct zram *zram);
+#ifdef CONFIG_ZRAM_WRITEBACK
+extern int zram_set_backing_dev(struct zram *zram, const char *path);
+extern void zram_mark_idle(struct zram *zram);
+extern int zram_writeback(struct zram *zram, bool idle, bool huge);
+#endif
 
 #endif
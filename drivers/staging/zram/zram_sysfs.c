@@ -12,9 +12,11 @@
  * Project home: http://compcache.googlecode.com/
  */
 
+#include <linux/crypto.h>
 #include <linux/device.h>
 #include <linux/genhd.h>
 #include <linux/mm.h>
+#include <linux/string.h>
 
 #include "zram_drv.h"
 
@@ -112,6 +114,258 @@ static ssize_t reset_store(struct device *dev,
 	return len;
 }
 
+static ssize_t max_comp_streams_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	return sprintf(buf, "%d\n", zram->max_streams);
+}
+
+static ssize_t max_comp_streams_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	int ret;
+	unsigned long num;
+	struct zram *zram = dev_to_zram(dev);
+
+	ret = strict_strtoul(buf, 10, &num);
+	if (ret)
+		return ret;
+
+	if (num < 1 || num > INT_MAX)
+		return -EINVAL;
+
+	ret = zram_set_max_streams(zram, num);
+	if (ret)
+		return ret;
+
+	return len;
+}
+
+static ssize_t comp_algorithm_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	int i;
+	ssize_t count = 0;
+	bool listed = false;
+	struct zram *zram = dev_to_zram(dev);
+
+	for (i = 0; i < ARRAY_SIZE(zram_compressors); i++) {
+		const char *name = zram_compressors[i];
+
+		if (!strcmp(zram->compressor, name)) {
+			count += sprintf(buf + count, "[%s] ", name);
+			listed = true;
+		} else if (crypto_has_comp(name, 0, 0)) {
+			count += sprintf(buf + count, "%s ", name);
+		}
+	}
+	if (!listed)
+		count += sprintf(buf + count, "[%s] ", zram->compressor);
+
+	buf[count - 1] = '\n';
+
+	return count;
+}
+
+static ssize_t comp_algorithm_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	char name[CRYPTO_MAX_ALG_NAME];
+	struct zram *zram = dev_to_zram(dev);
+
+	if (zram->init_done) {
+		pr_info("Cannot change compressor for initialized device\n");
+		return -EBUSY;
+	}
+
+	strlcpy(name, buf, sizeof(name));
+	strim(name);
+
+	if (!crypto_has_comp(name, 0, 0))
+		return -EINVAL;
+
+	strlcpy(zram->compressor, name, sizeof(zram->compressor));
+
+	return len;
+}
+
+static ssize_t comp_benchmark_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	return zram_comp_benchmark(zram, buf);
+}
+
+static ssize_t allocator_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	int i;
+	ssize_t count = 0;
+	struct zram *zram = dev_to_zram(dev);
+
+	for (i = 0; i < ARRAY_SIZE(zram_allocators); i++) {
+		if (i == zram->allocator)
+			count += sprintf(buf + count, "[%s] ",
+					zram_allocators[i]);
+		else
+			count += sprintf(buf + count, "%s ",
+					zram_allocators[i]);
+	}
+	buf[count - 1] = '\n';
+
+	return count;
+}
+
+static ssize_t allocator_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	int i;
+	struct zram *zram = dev_to_zram(dev);
+
+	if (zram->init_done) {
+		pr_info("Cannot change allocator for initialized device\n");
+		return -EBUSY;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(zram_allocators); i++) {
+		if (sysfs_streq(buf, zram_allocators[i])) {
+			zram->allocator = i;
+			return len;
+		}
+	}
+
+	return -EINVAL;
+}
+
+static ssize_t compact_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	int ret;
+	struct zram *zram = dev_to_zram(dev);
+
+	ret = zram_compact(zram);
+	if (ret)
+		return ret;
+
+	return len;
+}
+
+#ifdef CONFIG_ZRAM_WRITEBACK
+static ssize_t backing_dev_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	ssize_t ret;
+	struct zram *zram = dev_to_zram(dev);
+
+	mutex_lock(&zram->init_lock);
+	ret = sprintf(buf, "%s\n", zram->backing_dev_path ?: "none");
+	mutex_unlock(&zram->init_lock);
+
+	return ret;
+}
+
+static ssize_t backing_dev_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	int ret;
+	char path[64];
+	struct zram *zram = dev_to_zram(dev);
+
+	if (len >= sizeof(path))
+		return -EINVAL;
+
+	strlcpy(path, buf, sizeof(path));
+	strim(path);
+	if (!strcmp(path, "none"))
+		path[0] = '\0';
+
+	ret = zram_set_backing_dev(zram, path);
+	if (ret)
+		return ret;
+
+	return len;
+}
+
+static ssize_t idle_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	if (!sysfs_streq(buf, "all"))
+		return -EINVAL;
+
+	zram_mark_idle(zram);
+
+	return len;
+}
+
+static ssize_t writeback_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	int ret;
+	bool idle = false, huge = false;
+	struct zram *zram = dev_to_zram(dev);
+
+	if (sysfs_streq(buf, "idle"))
+		idle = true;
+	else if (sysfs_streq(buf, "huge"))
+		huge = true;
+	else if (sysfs_streq(buf, "all"))
+		idle = huge = true;
+	else
+		return -EINVAL;
+
+	ret = zram_writeback(zram, idle, huge);
+	if (ret)
+		return ret;
+
+	return len;
+}
+
+static ssize_t bd_stat_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	return sprintf(buf, "%8llu %8llu %8llu\n",
+		zram_stat64_read(zram, &zram->stats.bd_count),
+		zram_stat64_read(zram, &zram->stats.bd_reads),
+		zram_stat64_read(zram, &zram->stats.bd_writes));
+}
+#endif
+
+static ssize_t dedup_enable_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	return sprintf(buf, "%d\n", zram->dedup_enable);
+}
+
+static ssize_t dedup_enable_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	int ret;
+	unsigned long val;
+	struct zram *zram = dev_to_zram(dev);
+
+	if (zram->init_done) {
+		pr_info("Cannot change dedup_enable for initialized device\n");
+		return -EBUSY;
+	}
+
+	ret = strict_strtoul(buf, 10, &val);
+	if (ret)
+		return ret;
+
+	zram->dedup_enable = !!val;
+
+	return len;
+}
+
 static ssize_t num_reads_show(struct device *dev,
 		struct device_attribute *attr, char *buf)
 {
@@ -156,6 +410,45 @@ static ssize_t zero_pages_show(struct device *dev,
 	return sprintf(buf, "%u\n", zram->stats.pages_zero);
 }
 
+static ssize_t same_pages_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	return sprintf(buf, "%u\n", zram->stats.pages_same);
+}
+
+static ssize_t dup_pages_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	return sprintf(buf, "%u\n", zram->stats.pages_dup);
+}
+
+static ssize_t dup_data_size_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	return sprintf(buf, "%llu\n",
+		zram_stat64_read(zram, &zram->stats.dup_data_size));
+}
+
+static ssize_t saved_size_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+	u64 val;
+
+	/* Filled pages need no storage, duplicates none of their own */
+	val = (u64)(zram->stats.pages_zero + zram->stats.pages_same) <<
+		PAGE_SHIFT;
+	val += zram_stat64_read(zram, &zram->stats.dup_data_size);
+
+	return sprintf(buf, "%llu\n", val);
+}
+
 static ssize_t orig_data_size_show(struct device *dev,
 		struct device_attribute *attr, char *buf)
 {
@@ -181,38 +474,129 @@ static ssize_t mem_used_total_show(struct device *dev,
 	struct zram *zram = dev_to_zram(dev);
 
 	if (zram->init_done) {
-		val = xv_get_total_size_bytes(zram->mem_pool) +
-			((u64)(zram->stats.pages_expand) << PAGE_SHIFT);
+		if (zram->allocator == ZRAM_ZSMALLOC)
+			val = zs_get_total_size_bytes(zram->zs_pool);
+		else
+			val = xv_get_total_size_bytes(zram->mem_pool);
+		val += (u64)(zram->stats.pages_expand) << PAGE_SHIFT;
 	}
 
 	return sprintf(buf, "%llu\n", val);
 }
 
+/*
+ * Per size class usage of the zsmalloc pool. Slots allocated but not
+ * used are lost to fragmentation until compact is triggered.
+ */
+static ssize_t mem_fragmentation_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	int i;
+	ssize_t count = 0;
+	struct zs_class_stats stats;
+	unsigned long zspages = 0, objs_allocated = 0, objs_used = 0;
+	struct zram *zram = dev_to_zram(dev);
+
+	mutex_lock(&zram->init_lock);
+
+	if (!zram->init_done || zram->allocator != ZRAM_ZSMALLOC) {
+		mutex_unlock(&zram->init_lock);
+		return -EINVAL;
+	}
+
+	count += scnprintf(buf + count, PAGE_SIZE - count,
+			"%5s %5s %5s %8s %10s %10s\n", "class", "size",
+			"pages", "zspages", "allocated", "used");
+
+	for (i = 0; !zs_get_class_stats(zram->zs_pool, i, &stats); i++) {
+		zspages += stats.zspages;
+		objs_allocated += stats.objs_allocated;
+		objs_used += stats.objs_used;
+		if (!stats.zspages)
+			continue;
+
+		count += scnprintf(buf + count, PAGE_SIZE - count,
+				"%5d %5zu %5u %8lu %10lu %10lu\n", i,
+				stats.size, stats.pages_per_zspage,
+				stats.zspages, stats.objs_allocated,
+				stats.objs_used);
+	}
+
+	count += scnprintf(buf + count, PAGE_SIZE - count,
+			"%5s %5s %5s %8lu %10lu %10lu\n"
+			"pages compacted %llu\n", "total", "", "",
+			zspages, objs_allocated, objs_used,
+			zram_stat64_read(zram, &zram->stats.pages_compacted));
+
+	mutex_unlock(&zram->init_lock);
+
+	return count;
+}
+
 static DEVICE_ATTR(disksize, S_IRUGO | S_IWUSR,
 		disksize_show, disksize_store);
 static DEVICE_ATTR(initstate, S_IRUGO, initstate_show, NULL);
 static DEVICE_ATTR(reset, S_IWUSR, NULL, reset_store);
+static DEVICE_ATTR(max_comp_streams, S_IRUGO | S_IWUSR,
+		max_comp_streams_show, max_comp_streams_store);
+static DEVICE_ATTR(dedup_enable, S_IRUGO | S_IWUSR,
+		dedup_enable_show, dedup_enable_store);
+static DEVICE_ATTR(comp_algorithm, S_IRUGO | S_IWUSR,
+		comp_algorithm_show, comp_algorithm_store);
+static DEVICE_ATTR(comp_benchmark, S_IRUSR, comp_benchmark_show, NULL);
+static DEVICE_ATTR(allocator, S_IRUGO | S_IWUSR,
+		allocator_show, allocator_store);
+static DEVICE_ATTR(compact, S_IWUSR, NULL, compact_store);
+#ifdef CONFIG_ZRAM_WRITEBACK
+static DEVICE_ATTR(backing_dev, S_IRUGO | S_IWUSR,
+		backing_dev_show, backing_dev_store);
+static DEVICE_ATTR(idle, S_IWUSR, NULL, idle_store);
+static DEVICE_ATTR(writeback, S_IWUSR, NULL, writeback_store);
+static DEVICE_ATTR(bd_stat, S_IRUGO, bd_stat_show, NULL);
+#endif
 static DEVICE_ATTR(num_reads, S_IRUGO, num_reads_show, NULL);
 static DEVICE_ATTR(num_writes, S_IRUGO, num_writes_show, NULL);
 static DEVICE_ATTR(invalid_io, S_IRUGO, invalid_io_show, NULL);
 static DEVICE_ATTR(notify_free, S_IRUGO, notify_free_show, NULL);
 static DEVICE_ATTR(zero_pages, S_IRUGO, zero_pages_show, NULL);
+static DEVICE_ATTR(same_pages, S_IRUGO, same_pages_show, NULL);
+static DEVICE_ATTR(dup_pages, S_IRUGO, dup_pages_show, NULL);
+static DEVICE_ATTR(dup_data_size, S_IRUGO, dup_data_size_show, NULL);
+static DEVICE_ATTR(saved_size, S_IRUGO, saved_size_show, NULL);
 static DEVICE_ATTR(orig_data_size, S_IRUGO, orig_data_size_show, NULL);
 static DEVICE_ATTR(compr_data_size, S_IRUGO, compr_data_size_show, NULL);
 static DEVICE_ATTR(mem_used_total, S_IRUGO, mem_used_total_show, NULL);
+static DEVICE_ATTR(mem_fragmentation, S_IRUSR, mem_fragmentation_show, NULL);
 
 static struct attribute *zram_disk_attrs[] = {
 	&dev_attr_disksize.attr,
 	&dev_attr_initstate.attr,
 	&dev_attr_reset.attr,
+	&dev_attr_max_comp_streams.attr,
+	&dev_attr_dedup_enable.attr,
+	&dev_attr_comp_algorithm.attr,
+	&dev_attr_comp_benchmark.attr,
+	&dev_attr_allocator.attr,
+	&dev_attr_compact.attr,
+#ifdef CONFIG_ZRAM_WRITEBACK
+	&dev_attr_backing_dev.attr,
+	&dev_attr_idle.attr,
+	&dev_attr_writeback.attr,
+	&dev_attr_bd_stat.attr,
+#endif
 	&dev_attr_num_reads.attr,
 	&dev_attr_num_writes.attr,
 	&dev_attr_invalid_io.attr,
 	&dev_attr_notify_free.attr,
 	&dev_attr_zero_pages.attr,
+	&dev_attr_same_pages.attr,
+	&dev_attr_dup_pages.attr,
+	&dev_attr_dup_data_size.attr,
+	&dev_attr_saved_size.attr,
 	&dev_attr_orig_data_size.attr,
 	&dev_attr_compr_data_size.attr,
 	&dev_attr_mem_used_total.attr,
+	&dev_attr_mem_fragmentation.attr,
 	NULL,
 };
 
@@ -0,0 +1,739 @@
+/*
+ * zsmalloc memory allocator
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+/*
+ * Objects are grouped in size classes, 16 bytes apart. Each class carves
+ * its objects out of "zspages": groups of 1 to ZS_MAX_PAGES_PER_ZSPAGE
+ * (possibly highmem) pages treated as one contiguous area, sized so that
+ * little space is lost at the end. Objects may therefore span a page
+ * boundary; such objects are copied through a per-cpu buffer on map.
+ *
+ * Callers refer to objects through handles rather than addresses. This
+ * lets zs_compact() move objects out of sparsely used zspages into fuller
+ * ones of the same class and give the emptied pages back, which keeps
+ * long running pools from fragmenting.
+ */
+
+#ifdef CONFIG_ZRAM_DEBUG
+#define DEBUG
+#endif
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/bitops.h>
+#include <linux/errno.h>
+#include <linux/highmem.h>
+#include <linux/init.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/percpu.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/string.h>
+#include <linux/vmalloc.h>
+
+#include "zsmalloc.h"
+
+#define ZS_MIN_ALLOC_SIZE	32
+#define ZS_MAX_ALLOC_SIZE	PAGE_SIZE
+#define ZS_SIZE_CLASS_DELTA	16
+#define ZS_SIZE_CLASSES		((ZS_MAX_ALLOC_SIZE - ZS_MIN_ALLOC_SIZE) / \
+					ZS_SIZE_CLASS_DELTA + 1)
+#define ZS_MAX_PAGES_PER_ZSPAGE	4
+
+/* Objects moved by zs_compact() before it drops the class locks */
+#define ZS_COMPACT_BATCH	32
+
+enum fullness_group {
+	ZS_ALMOST_FULL,		/* more than 3/4 of the objects in use */
+	ZS_ALMOST_EMPTY,
+	ZS_FULL,
+	_ZS_NR_FULLNESS_GROUPS,
+};
+
+struct zspage;
+
+/* What a handle points to: the current location of an object */
+struct zs_handle {
+	struct zspage *zspage;
+	u16 idx;		/* object index within the zspage */
+	u16 class;		/* size class, never changes */
+};
+
+struct zspage {
+	struct list_head list;
+	enum fullness_group fullness;
+	unsigned int inuse;
+	unsigned int first_free;	/* all slots below are in use */
+	struct page *pages[ZS_MAX_PAGES_PER_ZSPAGE];
+	struct zs_handle *handles[];	/* per slot, NULL if free */
+};
+
+struct size_class {
+	/* Protects the zspage lists, their slots and the counts below */
+	spinlock_t lock;
+	/*
+	 * Object locations. Held for reading while an object is mapped
+	 * and for writing while zs_compact() moves objects.
+	 */
+	rwlock_t migrate_lock;
+	size_t size;
+	unsigned int index;
+	unsigned int pages_per_zspage;
+	unsigned int objs_per_zspage;
+	struct list_head fullness_list[_ZS_NR_FULLNESS_GROUPS];
+	unsigned long zspages;
+	unsigned long objs_used;
+};
+
+struct zs_pool {
+	struct size_class classes[ZS_SIZE_CLASSES];
+	gfp_t flags;
+	atomic_long_t pages_allocated;
+};
+
+/* Per-cpu state of the object currently mapped on that cpu */
+struct mapping_area {
+	char *buf;		/* copy of an object spanning two pages */
+	void *addr;		/* what zs_map_object() returned */
+	enum zs_mapmode mm;
+	bool spanning;
+};
+
+static DEFINE_PER_CPU(struct mapping_area, zs_map_area);
+
+/* Shared by all pools, set up when the first one is created */
+static DEFINE_MUTEX(zs_init_lock);
+static int zs_nr_pools;
+static struct kmem_cache *zs_handle_cachep;
+
+static int get_size_class_index(size_t size)
+{
+	if (size < ZS_MIN_ALLOC_SIZE)
+		size = ZS_MIN_ALLOC_SIZE;
+	return DIV_ROUND_UP(size - ZS_MIN_ALLOC_SIZE, ZS_SIZE_CLASS_DELTA);
+}
+
+/* Number of pages per zspage that wastes the least space for @size */
+static unsigned int get_pages_per_zspage(size_t size)
+{
+	unsigned int i, best = 1, best_usedpc = 0;
+
+	for (i = 1; i <= ZS_MAX_PAGES_PER_ZSPAGE; i++) {
+		size_t zspage_size = i * PAGE_SIZE;
+		unsigned int usedpc;
+
+		usedpc = (zspage_size - zspage_size % size) * 100 / zspage_size;
+		if (usedpc > best_usedpc) {
+			best_usedpc = usedpc;
+			best = i;
+		}
+	}
+
+	return best;
+}
+
+static enum fullness_group get_fullness_group(struct size_class *class,
+					struct zspage *zspage)
+{
+	if (zspage->inuse == class->objs_per_zspage)
+		return ZS_FULL;
+	if (zspage->inuse * 4 > class->objs_per_zspage * 3)
+		return ZS_ALMOST_FULL;
+	return ZS_ALMOST_EMPTY;
+}
+
+static void fix_fullness_group(struct size_class *class, struct zspage *zspage)
+{
+	enum fullness_group fg = get_fullness_group(class, zspage);
+
+	if (fg == zspage->fullness)
+		return;
+	list_move(&zspage->list, &class->fullness_list[fg]);
+	zspage->fullness = fg;
+}
+
+static struct zspage *alloc_zspage(struct zs_pool *pool,
+				struct size_class *class)
+{
+	struct zspage *zspage;
+	unsigned int i;
+
+	zspage = kzalloc(sizeof(*zspage) + class->objs_per_zspage *
+			sizeof(struct zs_handle *),
+			pool->flags & ~__GFP_HIGHMEM);
+	if (!zspage)
+		return NULL;
+
+	for (i = 0; i < class->pages_per_zspage; i++) {
+		zspage->pages[i] = alloc_page(pool->flags);
+		if (!zspage->pages[i])
+			goto fail;
+	}
+	zspage->fullness = ZS_ALMOST_EMPTY;
+
+	return zspage;
+
+fail:
+	while (i--)
+		__free_page(zspage->pages[i]);
+	kfree(zspage);
+	return NULL;
+}
+
+static void free_zspage(struct zs_pool *pool, struct size_class *class,
+			struct zspage *zspage)
+{
+	unsigned int i;
+
+	for (i = 0; i < class->pages_per_zspage; i++)
+		__free_page(zspage->pages[i]);
+	kfree(zspage);
+	atomic_long_sub(class->pages_per_zspage, &pool->pages_allocated);
+}
+
+static void obj_location(struct size_class *class, unsigned int idx,
+			unsigned int *page_idx, unsigned int *offset)
+{
+	unsigned long off = (unsigned long)idx * class->size;
+
+	*page_idx = off >> PAGE_SHIFT;
+	*offset = off & ~PAGE_MASK;
+}
+
+/* Put @handle in the first free slot of @zspage, which must not be full */
+static void obj_attach(struct size_class *class, struct zspage *zspage,
+			struct zs_handle *handle)
+{
+	unsigned int idx = zspage->first_free;
+
+	while (zspage->handles[idx])
+		idx++;
+
+	zspage->handles[idx] = handle;
+	zspage->first_free = idx + 1;
+	zspage->inuse++;
+	class->objs_used++;
+
+	handle->zspage = zspage;
+	handle->idx = idx;
+	handle->class = class->index;
+
+	fix_fullness_group(class, zspage);
+}
+
+static void obj_detach(struct size_class *class, struct zspage *zspage,
+			unsigned int idx)
+{
+	zspage->handles[idx] = NULL;
+	if (idx < zspage->first_free)
+		zspage->first_free = idx;
+	zspage->inuse--;
+	class->objs_used--;
+}
+
+/* A partially used zspage to allocate from, preferring fuller ones */
+static struct zspage *find_zspage(struct size_class *class)
+{
+	int fg;
+
+	for (fg = ZS_ALMOST_FULL; fg <= ZS_ALMOST_EMPTY; fg++) {
+		if (!list_empty(&class->fullness_list[fg]))
+			return list_first_entry(&class->fullness_list[fg],
+					struct zspage, list);
+	}
+
+	return NULL;
+}
+
+static int zs_global_init(void)
+{
+	int cpu, ret = 0;
+
+	mutex_lock(&zs_init_lock);
+	if (zs_nr_pools++)
+		goto out;
+
+	zs_handle_cachep = KMEM_CACHE(zs_handle, 0);
+	if (!zs_handle_cachep)
+		goto fail;
+
+	for_each_possible_cpu(cpu) {
+		struct mapping_area *area = &per_cpu(zs_map_area, cpu);
+
+		area->buf = kmalloc(ZS_MAX_ALLOC_SIZE, GFP_KERNEL);
+		if (!area->buf)
+			goto fail;
+	}
+
+out:
+	mutex_unlock(&zs_init_lock);
+	return ret;
+
+fail:
+	for_each_possible_cpu(cpu) {
+		kfree(per_cpu(zs_map_area, cpu).buf);
+		per_cpu(zs_map_area, cpu).buf = NULL;
+	}
+	if (zs_handle_cachep)
+		kmem_cache_destroy(zs_handle_cachep);
+	zs_handle_cachep = NULL;
+	zs_nr_pools--;
+	ret = -ENOMEM;
+	goto out;
+}
+
+static void zs_global_exit(void)
+{
+	int cpu;
+
+	mutex_lock(&zs_init_lock);
+	if (--zs_nr_pools)
+		goto out;
+
+	for_each_possible_cpu(cpu) {
+		kfree(per_cpu(zs_map_area, cpu).buf);
+		per_cpu(zs_map_area, cpu).buf = NULL;
+	}
+	kmem_cache_destroy(zs_handle_cachep);
+	zs_handle_cachep = NULL;
+
+out:
+	mutex_unlock(&zs_init_lock);
+}
+
+/**
+ * zs_create_pool - Creates an allocation pool to work from.
+ * @flags: allocation flags used for object pages
+ *
+ * Returns NULL on error.
+ */
+struct zs_pool *zs_create_pool(gfp_t flags)
+{
+	struct zs_pool *pool;
+	int i, fg;
+
+	if (zs_global_init())
+		return NULL;
+
+	pool = vzalloc(sizeof(*pool));
+	if (!pool) {
+		zs_global_exit();
+		return NULL;
+	}
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		struct size_class *class = &pool->classes[i];
+
+		spin_lock_init(&class->lock);
+		rwlock_init(&class->migrate_lock);
+		class->index = i;
+		class->size = ZS_MIN_ALLOC_SIZE + i * ZS_SIZE_CLASS_DELTA;
+		if (class->size > ZS_MAX_ALLOC_SIZE)
+			class->size = ZS_MAX_ALLOC_SIZE;
+		class->pages_per_zspage = get_pages_per_zspage(class->size);
+		class->objs_per_zspage = class->pages_per_zspage *
+						PAGE_SIZE / class->size;
+		for (fg = 0; fg < _ZS_NR_FULLNESS_GROUPS; fg++)
+			INIT_LIST_HEAD(&class->fullness_list[fg]);
+	}
+
+	pool->flags = flags;
+	atomic_long_set(&pool->pages_allocated, 0);
+
+	return pool;
+}
+EXPORT_SYMBOL_GPL(zs_create_pool);
+
+/*
+ * Frees the pool along with any objects still allocated from it, so a
+ * caller tearing everything down need not free objects one by one.
+ */
+void zs_destroy_pool(struct zs_pool *pool)
+{
+	struct zspage *zspage, *tmp;
+	unsigned int idx;
+	int i, fg;
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		struct size_class *class = &pool->classes[i];
+
+		for (fg = 0; fg < _ZS_NR_FULLNESS_GROUPS; fg++) {
+			list_for_each_entry_safe(zspage, tmp,
+					&class->fullness_list[fg], list) {
+				for (idx = 0; idx < class->objs_per_zspage;
+						idx++) {
+					if (zspage->handles[idx])
+						kmem_cache_free(
+							zs_handle_cachep,
+							zspage->handles[idx]);
+				}
+				list_del(&zspage->list);
+				free_zspage(pool, class, zspage);
+			}
+		}
+	}
+
+	vfree(pool);
+	zs_global_exit();
+}
+EXPORT_SYMBOL_GPL(zs_destroy_pool);
+
+/**
+ * zs_malloc - Allocate block of given size from pool.
+ * @pool: pool to allocate from
+ * @size: size of block to allocate
+ *
+ * Returns a handle to the object, or 0 on failure. The object can only
+ * be accessed between zs_map_object() and zs_unmap_object().
+ */
+unsigned long zs_malloc(struct zs_pool *pool, size_t size)
+{
+	struct zs_handle *handle;
+	struct size_class *class;
+	struct zspage *zspage;
+
+	if (unlikely(!size || size > ZS_MAX_ALLOC_SIZE))
+		return 0;
+
+	handle = kmem_cache_alloc(zs_handle_cachep,
+				pool->flags & ~__GFP_HIGHMEM);
+	if (!handle)
+		return 0;
+
+	class = &pool->classes[get_size_class_index(size)];
+
+	spin_lock(&class->lock);
+	zspage = find_zspage(class);
+	if (!zspage) {
+		spin_unlock(&class->lock);
+
+		zspage = alloc_zspage(pool, class);
+		if (!zspage) {
+			kmem_cache_free(zs_handle_cachep, handle);
+			return 0;
+		}
+		atomic_long_add(class->pages_per_zspage,
+				&pool->pages_allocated);
+
+		spin_lock(&class->lock);
+		list_add(&zspage->list,
+			&class->fullness_list[ZS_ALMOST_EMPTY]);
+		class->zspages++;
+	}
+	obj_attach(class, zspage, handle);
+	spin_unlock(&class->lock);
+
+	return (unsigned long)handle;
+}
+EXPORT_SYMBOL_GPL(zs_malloc);
+
+void zs_free(struct zs_pool *pool, unsigned long obj)
+{
+	struct zs_handle *handle = (struct zs_handle *)obj;
+	struct size_class *class = &pool->classes[handle->class];
+	struct zspage *zspage;
+
+	spin_lock(&class->lock);
+	zspage = handle->zspage;
+	obj_detach(class, zspage, handle->idx);
+	if (!zspage->inuse) {
+		list_del(&zspage->list);
+		class->zspages--;
+		spin_unlock(&class->lock);
+		free_zspage(pool, class, zspage);
+	} else {
+		fix_fullness_group(class, zspage);
+		spin_unlock(&class->lock);
+	}
+
+	kmem_cache_free(zs_handle_cachep, handle);
+}
+EXPORT_SYMBOL_GPL(zs_free);
+
+/**
+ * zs_map_object - get address of allocated object from handle.
+ * @pool: pool from which the object was allocated
+ * @handle: handle returned from zs_malloc
+ * @mm: whether the object is read, written or both
+ *
+ * Only one object can be mapped per cpu at a time, and the caller must
+ * not sleep until zs_unmap_object(). The object will not be moved by
+ * compaction while it is mapped.
+ */
+void *zs_map_object(struct zs_pool *pool, unsigned long obj,
+			enum zs_mapmode mm)
+{
+	struct zs_handle *handle = (struct zs_handle *)obj;
+	struct size_class *class = &pool->classes[handle->class];
+	struct mapping_area *area;
+	unsigned int page_idx, offset;
+	struct page **pages;
+	char *addr;
+
+	read_lock(&class->migrate_lock);
+
+	pages = handle->zspage->pages;
+	obj_location(class, handle->idx, &page_idx, &offset);
+
+	area = &get_cpu_var(zs_map_area);
+	area->mm = mm;
+	area->spanning = offset + class->size > PAGE_SIZE;
+
+	if (!area->spanning) {
+		area->addr = kmap_atomic(pages[page_idx], KM_USER1) + offset;
+		return area->addr;
+	}
+
+	if (mm != ZS_MM_WO) {
+		size_t first = PAGE_SIZE - offset;
+
+		addr = kmap_atomic(pages[page_idx], KM_USER1);
+		memcpy(area->buf, addr + offset, first);
+		kunmap_atomic(addr, KM_USER1);
+		addr = kmap_atomic(pages[page_idx + 1], KM_USER1);
+		memcpy(area->buf + first, addr, class->size - first);
+		kunmap_atomic(addr, KM_USER1);
+	}
+	area->addr = area->buf;
+
+	return area->addr;
+}
+EXPORT_SYMBOL_GPL(zs_map_object);
+
+void zs_unmap_object(struct zs_pool *pool, unsigned long obj)
+{
+	struct zs_handle *handle = (struct zs_handle *)obj;
+	struct size_class *class = &pool->classes[handle->class];
+	struct mapping_area *area = &__get_cpu_var(zs_map_area);
+	unsigned int page_idx, offset;
+	struct page **pages;
+	char *addr;
+
+	if (!area->spanning) {
+		kunmap_atomic(area->addr, KM_USER1);
+		goto out;
+	}
+
+	if (area->mm != ZS_MM_RO) {
+		size_t first;
+
+		pages = handle->zspage->pages;
+		obj_location(class, handle->idx, &page_idx, &offset);
+		first = PAGE_SIZE - offset;
+
+		addr = kmap_atomic(pages[page_idx], KM_USER1);
+		memcpy(addr + offset, area->buf, first);
+		kunmap_atomic(addr, KM_USER1);
+		addr = kmap_atomic(pages[page_idx + 1], KM_USER1);
+		memcpy(addr, area->buf + first, class->size - first);
+		kunmap_atomic(addr, KM_USER1);
+	}
+
+out:
+	put_cpu_var(zs_map_area);
+	read_unlock(&class->migrate_lock);
+}
+EXPORT_SYMBOL_GPL(zs_unmap_object);
+
+/*
+ * Memory held by the pool: the zspage pages plus the metadata allocated
+ * next to them, a struct zspage with its slot array per zspage and a
+ * struct zs_handle per object.
+ */
+u64 zs_get_total_size_bytes(struct zs_pool *pool)
+{
+	u64 size = (u64)atomic_long_read(&pool->pages_allocated) << PAGE_SHIFT;
+	int i;
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		struct size_class *class = &pool->classes[i];
+
+		spin_lock(&class->lock);
+		size += (u64)class->zspages * (sizeof(struct zspage) +
+			class->objs_per_zspage * sizeof(struct zs_handle *));
+		size += (u64)class->objs_used * sizeof(struct zs_handle);
+		spin_unlock(&class->lock);
+	}
+
+	return size;
+}
+EXPORT_SYMBOL_GPL(zs_get_total_size_bytes);
+
+/* Copy one object's bytes between slots, either of which may span pages */
+static void copy_object(struct size_class *class, struct zspage *src,
+			unsigned int src_idx, struct zspage *dst,
+			unsigned int dst_idx)
+{
+	unsigned int s_page, s_off, d_page, d_off;
+	size_t left = class->size;
+
+	obj_location(class, src_idx, &s_page, &s_off);
+	obj_location(class, dst_idx, &d_page, &d_off);
+
+	while (left) {
+		size_t len = min3(left, (size_t)(PAGE_SIZE - s_off),
+				(size_t)(PAGE_SIZE - d_off));
+		char *s_addr, *d_addr;
+
+		s_addr = kmap_atomic(src->pages[s_page], KM_USER0);
+		d_addr = kmap_atomic(dst->pages[d_page], KM_USER1);
+		memcpy(d_addr + d_off, s_addr + s_off, len);
+		kunmap_atomic(d_addr, KM_USER1);
+		kunmap_atomic(s_addr, KM_USER0);
+
+		left -= len;
+		s_off += len;
+		d_off += len;
+		if (s_off == PAGE_SIZE) {
+			s_page++;
+			s_off = 0;
+		}
+		if (d_off == PAGE_SIZE) {
+			d_page++;
+			d_off = 0;
+		}
+	}
+}
+
+/*
+ * Pick the zspage to empty (the last almost empty one) and the zspage to
+ * fill (the fullest partial one other than that).
+ */
+static bool pick_compact_pair(struct size_class *class, struct zspage **src,
+				struct zspage **dst)
+{
+	struct list_head *almost_empty =
+		&class->fullness_list[ZS_ALMOST_EMPTY];
+	struct list_head *almost_full =
+		&class->fullness_list[ZS_ALMOST_FULL];
+
+	if (list_empty(almost_empty))
+		return false;
+	*src = list_entry(almost_empty->prev, struct zspage, list);
+
+	if (!list_empty(almost_full))
+		*dst = list_first_entry(almost_full, struct zspage, list);
+	else if (almost_empty->next != almost_empty->prev)
+		*dst = list_first_entry(almost_empty, struct zspage, list);
+	else
+		return false;
+
+	return true;
+}
+
+static unsigned long compact_class(struct zs_pool *pool,
+				struct size_class *class)
+{
+	unsigned long freed = 0;
+	struct zspage *src, *dst;
+	unsigned int idx, moved;
+
+	while (1) {
+		moved = 0;
+		write_lock(&class->migrate_lock);
+		spin_lock(&class->lock);
+
+		/* Stop once no whole zspage could be freed any more */
+		if (class->zspages * class->objs_per_zspage -
+				class->objs_used < class->objs_per_zspage)
+			goto unlock_out;
+
+		while (moved < ZS_COMPACT_BATCH) {
+			if (!pick_compact_pair(class, &src, &dst))
+				goto unlock_out;
+
+			for (idx = 0; idx < class->objs_per_zspage &&
+				      src->inuse && moved < ZS_COMPACT_BATCH;
+				      idx++) {
+				struct zs_handle *handle = src->handles[idx];
+
+				if (!handle)
+					continue;
+				if (dst->inuse == class->objs_per_zspage)
+					break;
+
+				obj_detach(class, src, idx);
+				obj_attach(class, dst, handle);
+				copy_object(class, src, idx, dst, handle->idx);
+				moved++;
+			}
+
+			if (!src->inuse) {
+				list_del(&src->list);
+				class->zspages--;
+				free_zspage(pool, class, src);
+				freed += class->pages_per_zspage;
+			} else {
+				fix_fullness_group(class, src);
+			}
+		}
+
+		spin_unlock(&class->lock);
+		write_unlock(&class->migrate_lock);
+		cond_resched();
+	}
+
+unlock_out:
+	spin_unlock(&class->lock);
+	write_unlock(&class->migrate_lock);
+
+	return freed;
+}
+
+/**
+ * zs_compact - move objects to free sparsely used zspages
+ * @pool: pool to compact
+ *
+ * Returns the number of pages given back. Must be called from process
+ * context.
+ */
+unsigned long zs_compact(struct zs_pool *pool)
+{
+	unsigned long freed = 0;
+	int i;
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++)
+		freed += compact_class(pool, &pool->classes[i]);
+
+	return freed;
+}
+EXPORT_SYMBOL_GPL(zs_compact);
+
+/**
+ * zs_get_class_stats - fragmentation statistics of one size class
+ * @pool: pool to report on
+ * @class_idx: index of the class, starting at 0
+ * @stats: filled in on success
+ *
+ * Returns -ENOENT once @class_idx is past the last class.
+ */
+int zs_get_class_stats(struct zs_pool *pool, int class_idx,
+			struct zs_class_stats *stats)
+{
+	struct size_class *class;
+
+	if (class_idx < 0 || class_idx >= ZS_SIZE_CLASSES)
+		return -ENOENT;
+
+	class = &pool->classes[class_idx];
+
+	spin_lock(&class->lock);
+	stats->size = class->size;
+	stats->pages_per_zspage = class->pages_per_zspage;
+	stats->zspages = class->zspages;
+	stats->objs_allocated = class->zspages * class->objs_per_zspage;
+	stats->objs_used = class->objs_used;
+	spin_unlock(&class->lock);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(zs_get_class_stats);
@@ -0,0 +1,51 @@
+/*
+ * zsmalloc memory allocator
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+#ifndef _ZS_MALLOC_H_
+#define _ZS_MALLOC_H_
+
+#include <linux/types.h>
+
+/*
+ * How a mapped object is accessed. Objects spanning two pages are copied
+ * to a per-cpu buffer on map for reading and back on unmap for writing.
+ */
+enum zs_mapmode {
+	ZS_MM_RW,
+	ZS_MM_RO,
+	ZS_MM_WO,
+};
+
+struct zs_pool;
+
+struct zs_class_stats {
+	size_t size;			/* object size of the class */
+	unsigned int pages_per_zspage;
+	unsigned long zspages;		/* zspages allocated */
+	unsigned long objs_allocated;	/* object slots in those zspages */
+	unsigned long objs_used;	/* slots holding an object */
+};
+
+struct zs_pool *zs_create_pool(gfp_t flags);
+void zs_destroy_pool(struct zs_pool *pool);
+
+unsigned long zs_malloc(struct zs_pool *pool, size_t size);
+void zs_free(struct zs_pool *pool, unsigned long handle);
+
+void *zs_map_object(struct zs_pool *pool, unsigned long handle,
+			enum zs_mapmode mm);
+void zs_unmap_object(struct zs_pool *pool, unsigned long handle);
+
+u64 zs_get_total_size_bytes(struct zs_pool *pool);
+unsigned long zs_compact(struct zs_pool *pool);
+int zs_get_class_stats(struct zs_pool *pool, int class_idx,
+			struct zs_class_stats *stats);
+
+#endif
@@ -13,8 +13,51 @@
 
 struct gen_pool;
 
+/*
+ * An allocation algorithm: finds @nr free bits in the @size bits of a
+ * chunk's @map, starting at bit @start and aligned to @align_mask as if
+ * the map began at bit @align_offset. Returns the first bit of the area,
+ * or @size or more if there is none.
+ */
+typedef unsigned long (*genpool_algo_t)(unsigned long *map,
+					unsigned long size,
+					unsigned long start,
+					unsigned int nr,
+					unsigned long align_mask,
+					unsigned long align_offset,
+					void *data);
+
+#define GEN_POOL_FRAG_BUCKETS	16
+
+/*
+ * Free space layout of a pool, in bytes. Free extents are counted by
+ * their order in allocation units, the last bucket taking all larger.
+ */
+struct gen_pool_frag_stats {
+	unsigned long size;
+	unsigned long avail;
+	unsigned long largest_free;
+	unsigned long nr_extents;
+	unsigned long extents[GEN_POOL_FRAG_BUCKETS];
+};
+
 struct gen_pool *__must_check gen_pool_create(unsigned order, int nid);
 
+void gen_pool_set_algo(struct gen_pool *pool, genpool_algo_t algo, void *data);
+
+unsigned long gen_pool_first_fit(unsigned long *map, unsigned long size,
+				 unsigned long start, unsigned int nr,
+				 unsigned long align_mask,
+				 unsigned long align_offset, void *data);
+unsigned long gen_pool_best_fit(unsigned long *map, unsigned long size,
+				unsigned long start, unsigned int nr,
+				unsigned long align_mask,
+				unsigned long align_offset, void *data);
+unsigned long gen_pool_buddy_fit(unsigned long *map, unsigned long size,
+				 unsigned long start, unsigned int nr,
+				 unsigned long align_mask,
+				 unsigned long align_offset, void *data);
+
 void gen_pool_destroy(struct gen_pool *pool);
 
 unsigned long __must_check
@@ -27,7 +70,7 @@ gen_pool_alloc_aligned(struct gen_pool *pool, size_t size,
  * @size:	Number of bytes to allocate from the pool.
  *
  * Allocate the requested number of bytes from the specified pool.
- * Uses a first-fit algorithm.
+ * Uses the pool's algorithm, first-fit unless set otherwise.
  */
 static inline unsigned long __must_check
 gen_pool_alloc(struct gen_pool *pool, size_t size)
@@ -37,6 +80,10 @@ gen_pool_alloc(struct gen_pool *pool, size_t size)
 
 void gen_pool_free(struct gen_pool *pool, unsigned long addr, size_t size);
 
+void gen_pool_get_frag_stats(struct gen_pool *pool,
+			     struct gen_pool_frag_stats *stats);
+void gen_pool_debugfs_create(struct gen_pool *pool, const char *name);
+
 extern phys_addr_t gen_pool_virt_to_phys(struct gen_pool *pool, unsigned long);
 extern int gen_pool_add_virt(struct gen_pool *, unsigned long, phys_addr_t,
 			     size_t, int);
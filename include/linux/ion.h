@@ -25,7 +25,7 @@
 struct ion_handle;
 /**
  * enum ion_heap_types - list of all possible types of heaps
- * @ION_HEAP_TYPE_SYSTEM:	 memory allocated via vmalloc
+ * @ION_HEAP_TYPE_SYSTEM:	 memory allocated from pooled high-order pages
  * @ION_HEAP_TYPE_SYSTEM_CONTIG: memory allocated via kmalloc
  * @ION_HEAP_TYPE_CARVEOUT:	 memory allocated from a prereserved
  * 				 carveout heap, allocations are physically
@@ -149,6 +149,7 @@ struct ion_buffer;
  * @size:	size of the heap in bytes if applicable
  * @memory_type:Memory type used for the heap
  * @has_outer_cache:    set to 1 if outer cache is used, 0 otherwise.
+ * @flags:	ION_HEAP_FLAG_* options for the heap
  * @extra_data:	Extra data specific to each heap type
  */
 struct ion_platform_heap {
@@ -159,9 +160,16 @@ struct ion_platform_heap {
 	size_t size;
 	enum ion_memory_types memory_type;
 	unsigned int has_outer_cache;
+	unsigned long flags;
 	void *extra_data;
 };
 
+/*
+ * Free the heap's buffers from a kernel thread once their last reference
+ * is dropped, instead of in the context dropping it.
+ */
+#define ION_HEAP_FLAG_DEFER_FREE	(1 << 0)
+
 /**
  * struct ion_cp_heap_pdata - defines a content protection heap in the given
  * platform
@@ -462,6 +470,21 @@ int ion_map_iommu(struct ion_client *client, struct ion_handle *handle,
 int ion_handle_get_size(struct ion_client *client, struct ion_handle *handle,
 			unsigned long *size);
 
+/**
+ * ion_handle_get_heap_type - get the type of the heap backing a handle
+ *
+ * @client - client who allocated the handle
+ * @handle - handle to get the heap type of
+ * @type - pointer to store the heap type
+ *
+ * Lets a client tell memory it may hold on to cheaply, such as system
+ * pages, from carveouts shared with other users. Returns 0 on success,
+ * negative value on error.
+ */
+int ion_handle_get_heap_type(struct ion_client *client,
+			     struct ion_handle *handle,
+			     enum ion_heap_type *type);
+
 /**
  * ion_unmap_iommu - unmap the handle from an iommu
  *
@@ -609,6 +632,12 @@ static inline int ion_handle_get_flags(struct ion_client *client,
 	return -ENODEV;
 }
 
+static inline int ion_handle_get_heap_type(struct ion_client *client,
+	struct ion_handle *handle, enum ion_heap_type *type)
+{
+	return -ENODEV;
+}
+
 static inline int ion_map_iommu(struct ion_client *client,
 			struct ion_handle *handle, int domain_num,
 			int partition_num, unsigned long align,
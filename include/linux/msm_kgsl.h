@@ -59,7 +59,8 @@ enum kgsl_deviceid {
 	KGSL_DEVICE_3D0		= 0x00000000,
 	KGSL_DEVICE_2D0		= 0x00000001,
 	KGSL_DEVICE_2D1		= 0x00000002,
-	KGSL_DEVICE_MAX		= 0x00000003
+	KGSL_DEVICE_NULL	= 0x00000003,
+	KGSL_DEVICE_MAX		= 0x00000004
 };
 
 enum kgsl_user_mem_type {
@@ -51,6 +51,9 @@ extern void out_of_memory(struct zonelist *zonelist, gfp_t gfp_mask,
 		int order, nodemask_t *mask);
 extern int register_oom_notifier(struct notifier_block *nb);
 extern int unregister_oom_notifier(struct notifier_block *nb);
+extern int register_oom_adj_notifier(struct notifier_block *nb);
+extern int unregister_oom_adj_notifier(struct notifier_block *nb);
+extern void oom_adj_changed(struct task_struct *task);
 
 extern bool oom_killer_disabled;
 
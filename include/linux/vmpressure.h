@@ -0,0 +1,53 @@
+#ifndef _LINUX_VMPRESSURE_H
+#define _LINUX_VMPRESSURE_H
+
+#include <linux/gfp.h>
+#include <linux/mmzone.h>
+#include <linux/notifier.h>
+
+/*
+ * Memory pressure derived from reclaim efficiency: the share of scanned
+ * pages that reclaim failed to free over a window of scanning.
+ */
+enum vmpressure_levels {
+	VMPRESSURE_LOW = 0,
+	VMPRESSURE_MEDIUM,
+	VMPRESSURE_CRITICAL,
+	VMPRESSURE_NUM_LEVELS,
+};
+
+#ifdef CONFIG_VMPRESSURE
+extern void vmpressure(gfp_t gfp, struct zone *zone,
+		       unsigned long scanned, unsigned long reclaimed);
+extern enum vmpressure_levels vmpressure_level(void);
+extern unsigned int vmpressure_value(void);
+extern int vmpressure_register_notifier(struct notifier_block *nb);
+extern int vmpressure_unregister_notifier(struct notifier_block *nb);
+#else
+static inline void vmpressure(gfp_t gfp, struct zone *zone,
+			      unsigned long scanned, unsigned long reclaimed)
+{
+}
+
+static inline enum vmpressure_levels vmpressure_level(void)
+{
+	return VMPRESSURE_LOW;
+}
+
+static inline unsigned int vmpressure_value(void)
+{
+	return 0;
+}
+
+static inline int vmpressure_register_notifier(struct notifier_block *nb)
+{
+	return 0;
+}
+
+static inline int vmpressure_unregister_notifier(struct notifier_block *nb)
+{
+	return 0;
+}
+#endif /* CONFIG_VMPRESSURE */
+
+#endif /* _LINUX_VMPRESSURE_H */
@@ -1382,6 +1382,8 @@ static struct task_struct *copy_process(unsigned long clone_flags,
 	if (clone_flags & CLONE_THREAD)
 		threadgroup_fork_read_unlock(current);
 	perf_event_fork(p);
+	if (likely(p->pid) && thread_group_leader(p))
+		oom_adj_changed(p);
 	return p;
 
 bad_fork_free_pid:
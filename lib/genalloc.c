@@ -13,7 +13,11 @@
 #include <linux/slab.h>
 #include <linux/module.h>
 #include <linux/bitmap.h>
+#include <linux/debugfs.h>
 #include <linux/genalloc.h>
+#include <linux/log2.h>
+#include <linux/mutex.h>
+#include <linux/seq_file.h>
 
 
 /* General purpose special memory pool descriptor. */
@@ -21,6 +25,9 @@ struct gen_pool {
 	rwlock_t lock;			/* protects chunks list */
 	struct list_head chunks;	/* list of chunks in this pool */
 	unsigned order;			/* minimum allocation order */
+	genpool_algo_t algo;		/* allocation function */
+	void *data;			/* passed to algo */
+	struct dentry *debugfs;		/* fragmentation report */
 };
 
 /* General purpose special memory pool chunk descriptor. */
@@ -55,11 +62,123 @@ struct gen_pool *__must_check gen_pool_create(unsigned order, int nid)
 		rwlock_init(&pool->lock);
 		INIT_LIST_HEAD(&pool->chunks);
 		pool->order = order;
+		pool->algo = gen_pool_first_fit;
+		pool->data = NULL;
+		pool->debugfs = NULL;
 	}
 	return pool;
 }
 EXPORT_SYMBOL(gen_pool_create);
 
+/**
+ * gen_pool_set_algo() - set the allocation algorithm of a pool
+ * @pool:	Pool to change.
+ * @algo:	Allocation function, NULL for gen_pool_first_fit.
+ * @data:	Additional data passed to @algo.
+ *
+ * Must not be called while allocations from the pool are in progress.
+ */
+void gen_pool_set_algo(struct gen_pool *pool, genpool_algo_t algo, void *data)
+{
+	write_lock(&pool->lock);
+	pool->algo = algo ? algo : gen_pool_first_fit;
+	pool->data = data;
+	write_unlock(&pool->lock);
+}
+EXPORT_SYMBOL(gen_pool_set_algo);
+
+/**
+ * gen_pool_first_fit() - find the first free area large enough
+ * @map:	The bitmap of the chunk.
+ * @size:	Number of bits in the bitmap.
+ * @start:	Bit to start searching at.
+ * @nr:		Number of bits to allocate.
+ * @align_mask:	Alignment mask, in bits, of the area.
+ * @align_offset: Offset, in bits, of bit 0 for alignment purposes.
+ * @data:	Unused.
+ *
+ * Returns the first bit of the area, or @size or more if none fits.
+ */
+unsigned long gen_pool_first_fit(unsigned long *map, unsigned long size,
+				 unsigned long start, unsigned int nr,
+				 unsigned long align_mask,
+				 unsigned long align_offset, void *data)
+{
+	return bitmap_find_next_zero_area_off(map, size, start, nr,
+					      align_mask, align_offset);
+}
+EXPORT_SYMBOL(gen_pool_first_fit);
+
+/**
+ * gen_pool_best_fit() - find the smallest free extent large enough
+ * @map:	The bitmap of the chunk.
+ * @size:	Number of bits in the bitmap.
+ * @start:	Bit to start searching at.
+ * @nr:		Number of bits to allocate.
+ * @align_mask:	Alignment mask, in bits, of the area.
+ * @align_offset: Offset, in bits, of bit 0 for alignment purposes.
+ * @data:	Unused.
+ *
+ * Free extents are walked a word at a time, and an extent of exactly the
+ * requested size ends the search. Leaving large extents alone keeps them
+ * available for later large requests.
+ *
+ * Returns the first bit of the area, or @size if none fits.
+ */
+unsigned long gen_pool_best_fit(unsigned long *map, unsigned long size,
+				unsigned long start, unsigned int nr,
+				unsigned long align_mask,
+				unsigned long align_offset, void *data)
+{
+	unsigned long best = size, best_len = ~0UL;
+	unsigned long index, end, aligned;
+
+	index = find_next_zero_bit(map, size, start);
+	while (index < size) {
+		end = find_next_bit(map, size, index);
+		aligned = __ALIGN_MASK(index + align_offset, align_mask) -
+			  align_offset;
+		if (aligned + nr <= end && end - index < best_len) {
+			best = aligned;
+			best_len = end - index;
+			if (best_len == nr)
+				break;
+		}
+		index = find_next_zero_bit(map, size, end);
+	}
+
+	return best;
+}
+EXPORT_SYMBOL(gen_pool_best_fit);
+
+/**
+ * gen_pool_buddy_fit() - best fit at the natural alignment of the size
+ * @map:	The bitmap of the chunk.
+ * @size:	Number of bits in the bitmap.
+ * @start:	Bit to start searching at.
+ * @nr:		Number of bits to allocate.
+ * @align_mask:	Alignment mask, in bits, of the area.
+ * @align_offset: Offset, in bits, of bit 0 for alignment purposes.
+ * @data:	Unused.
+ *
+ * Aligns each area to the power of two it rounds up to, as a buddy
+ * allocator would, so that freed areas merge back into aligned extents
+ * that later requests of the same or larger sizes can use.
+ *
+ * Returns the first bit of the area, or @size if none fits.
+ */
+unsigned long gen_pool_buddy_fit(unsigned long *map, unsigned long size,
+				 unsigned long start, unsigned int nr,
+				 unsigned long align_mask,
+				 unsigned long align_offset, void *data)
+{
+	align_mask |= roundup_pow_of_two(nr) - 1;
+
+	return gen_pool_best_fit(map, size, start, nr, align_mask,
+				 align_offset, data);
+}
+EXPORT_SYMBOL(gen_pool_buddy_fit);
+
 /**
  * gen_pool_add_virt - add a new chunk of special memory to the pool
  * @pool: pool to add new memory chunk to
@@ -143,6 +262,8 @@ void gen_pool_destroy(struct gen_pool *pool)
 	struct gen_pool_chunk *chunk;
 	int bit;
 
+	debugfs_remove(pool->debugfs);
+
 	while (!list_empty(&pool->chunks)) {
 		chunk = list_entry(pool->chunks.next, struct gen_pool_chunk,
 				   next_chunk);
@@ -166,7 +287,7 @@ EXPORT_SYMBOL(gen_pool_destroy);
  *			must be aligned to 1MiB).
  *
  * Allocate the requested number of bytes from the specified pool.
- * Uses a first-fit algorithm.
+ * Uses the pool's algorithm, first-fit unless set otherwise.
  */
 unsigned long __must_check
 gen_pool_alloc_aligned(struct gen_pool *pool, size_t size,
@@ -189,9 +310,8 @@ gen_pool_alloc_aligned(struct gen_pool *pool, size_t size,
 			continue;
 
 		spin_lock_irqsave(&chunk->lock, flags);
-		start = bitmap_find_next_zero_area_off(chunk->bits, chunk->size,
-						       0, size, align_mask,
-						       chunk->start);
+		start = pool->algo(chunk->bits, chunk->size, 0, size,
+				   align_mask, chunk->start, pool->data);
 		if (start >= chunk->size) {
 			spin_unlock_irqrestore(&chunk->lock, flags);
 			continue;
@@ -245,3 +365,111 @@ done:
 	read_unlock(&pool->lock);
 }
 EXPORT_SYMBOL(gen_pool_free);
+
+/**
+ * gen_pool_get_frag_stats() - report the free space layout of a pool
+ * @pool:	Pool to report on.
+ * @stats:	Filled in with the pool's sizes and free extents.
+ *
+ * Sizes are in bytes. A free extent of 2^n to 2^(n+1) - 1 allocation
+ * units is counted in @stats->extents[n], the last bucket taking all
+ * larger ones.
+ */
+void gen_pool_get_frag_stats(struct gen_pool *pool,
+			     struct gen_pool_frag_stats *stats)
+{
+	struct gen_pool_chunk *chunk;
+	unsigned long index, end, flags;
+
+	memset(stats, 0, sizeof(*stats));
+
+	read_lock(&pool->lock);
+	list_for_each_entry(chunk, &pool->chunks, next_chunk) {
+		stats->size += chunk->size << pool->order;
+
+		spin_lock_irqsave(&chunk->lock, flags);
+		index = find_next_zero_bit(chunk->bits, chunk->size, 0);
+		while (index < chunk->size) {
+			unsigned long len;
+
+			end = find_next_bit(chunk->bits, chunk->size, index);
+			len = end - index;
+
+			stats->avail += len << pool->order;
+			stats->largest_free = max(stats->largest_free,
+						  len << pool->order);
+			stats->nr_extents++;
+			stats->extents[min_t(unsigned long, ilog2(len),
+					     GEN_POOL_FRAG_BUCKETS - 1)]++;
+
+			index = find_next_zero_bit(chunk->bits, chunk->size,
+						   end);
+		}
+		spin_unlock_irqrestore(&chunk->lock, flags);
+	}
+	read_unlock(&pool->lock);
+}
+EXPORT_SYMBOL(gen_pool_get_frag_stats);
+
+static struct dentry *gen_pool_debugfs_root;
+static DEFINE_MUTEX(gen_pool_debugfs_lock);
+
+static int gen_pool_frag_show(struct seq_file *s, void *unused)
+{
+	struct gen_pool *pool = s->private;
+	struct gen_pool_frag_stats stats;
+	int i;
+
+	gen_pool_get_frag_stats(pool, &stats);
+
+	seq_printf(s, "size: %lu\n", stats.size);
+	seq_printf(s, "free: %lu\n", stats.avail);
+	seq_printf(s, "largest free extent: %lu\n", stats.largest_free);
+	seq_printf(s, "free extents: %lu\n", stats.nr_extents);
+	for (i = 0; i < GEN_POOL_FRAG_BUCKETS; i++) {
+		if (!stats.extents[i])
+			continue;
+		seq_printf(s, "  %s%lu: %lu\n",
+			   i == GEN_POOL_FRAG_BUCKETS - 1 ? ">= " : "",
+			   (1UL << i) << pool->order, stats.extents[i]);
+	}
+
+	return 0;
+}
+
+static int gen_pool_frag_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, gen_pool_frag_show, inode->i_private);
+}
+
+static const struct file_operations gen_pool_frag_fops = {
+	.open = gen_pool_frag_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+/**
+ * gen_pool_debugfs_create() - report a pool's fragmentation in debugfs
+ * @pool:	Pool to report on.
+ * @name:	Name of the file, created in the genalloc debugfs directory.
+ *
+ * The file goes away with the pool.
+ */
+void gen_pool_debugfs_create(struct gen_pool *pool, const char *name)
+{
+	mutex_lock(&gen_pool_debugfs_lock);
+	if (!gen_pool_debugfs_root)
+		gen_pool_debugfs_root = debugfs_create_dir("genalloc", NULL);
+	mutex_unlock(&gen_pool_debugfs_lock);
+
+	if (IS_ERR_OR_NULL(gen_pool_debugfs_root))
+		return;
+
+	pool->debugfs = debugfs_create_file(name, S_IRUGO,
+					    gen_pool_debugfs_root, pool,
+					    &gen_pool_frag_fops);
+	if (IS_ERR(pool->debugfs))
+		pool->debugfs = NULL;
+}
+EXPORT_SYMBOL(gen_pool_debugfs_create);
@@ -150,9 +150,10 @@ static int remove_alloc(struct alloc *victim_node)
 }
 
 static struct gen_pool *initialize_gpool(unsigned long start,
-	unsigned long size)
+	unsigned long size, unsigned int id)
 {
 	struct gen_pool *gpool;
+	char name[16];
 
 	gpool = gen_pool_create(PAGE_SHIFT, -1);
 
@@ -162,6 +163,10 @@ static struct gen_pool *initialize_gpool(unsigned long start,
 		gen_pool_destroy(gpool);
 		return NULL;
 	}
+	gen_pool_set_algo(gpool, gen_pool_best_fit, NULL);
+
+	snprintf(name, sizeof(name), "mempool%u", id);
+	gen_pool_debugfs_create(gpool, name);
 
 	return gpool;
 }
@@ -240,7 +245,8 @@ static struct mem_pool *mem_type_to_memory_pool(int mem_type)
 
 	mutex_lock(&mpool->pool_mutex);
 	if (!mpool->gpool)
-		mpool->gpool = initialize_gpool(mpool->paddr, mpool->size);
+		mpool->gpool = initialize_gpool(mpool->paddr, mpool->size,
+						mpool->id);
 	mutex_unlock(&mpool->pool_mutex);
 	if (!mpool->gpool)
 		return NULL;
@@ -27,8 +27,13 @@
 #include <linux/personality.h>
 #include <linux/bitops.h>
 #include <linux/mutex.h>
+#include <linux/spinlock.h>
 #include <linux/shmem_fs.h>
 #include <linux/ashmem.h>
+#include <linux/debugfs.h>
+#include <linux/kthread.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
 #include <asm/cacheflush.h>
 
 #define ASHMEM_NAME_PREFIX "dev/ashmem/"
@@ -38,10 +43,11 @@
 /*
  * ashmem_area - anonymous shared memory area
  * Lifecycle: From our parent file's open() until its release()
- * Locking: Protected by `ashmem_mutex'
+ * Locking: Protected by its own `mutex'
  * Big Note: Mappings do NOT pin this structure; it dies on close()
  */
 struct ashmem_area {
+	struct mutex mutex;		/* protects the area and its ranges */
 	char name[ASHMEM_FULL_NAME_LEN];/* optional name for /proc/pid/maps */
 	struct list_head unpinned_list;	/* list of all ashmem areas */
 	struct file *file;		/* the shmem-based backing file */
@@ -54,7 +60,8 @@ struct ashmem_area {
 /*
  * ashmem_range - represents an interval of unpinned (evictable) pages
  * Lifecycle: From unpin to pin
- * Locking: Protected by `ashmem_mutex'
+ * Locking: Protected by its area's `mutex', the lru entry and moving it
+ *          on or off the LRU also by `ashmem_lru_lock'
  */
 struct ashmem_range {
 	struct list_head lru;		/* entry in LRU list */
@@ -65,18 +72,24 @@ struct ashmem_range {
 	unsigned int purged;		/* ASHMEM_NOT or ASHMEM_WAS_PURGED */
 };
 
-/* LRU list of unpinned pages, protected by ashmem_mutex */
-static LIST_HEAD(ashmem_lru_list);
-
-/* Count of pages on our LRU list, protected by ashmem_mutex */
-static unsigned long lru_count;
-
 /*
- * ashmem_mutex - protects the list of and each individual ashmem_area
+ * ashmem_lru_lock - protects the LRU list of unpinned ranges and its counts
+ *
+ * Pin and unpin only take the mutex of the area concerned, so apps
+ * working on different areas never wait for each other, nor for the
+ * shrinker, which only trylocks areas and skips the busy ones.
  *
- * Lock Ordering: ashmex_mutex -> i_mutex -> i_alloc_sem
+ * Lock Ordering: asma->mutex -> ashmem_lru_lock
+ *                asma->mutex -> i_mutex -> i_alloc_sem
  */
-static DEFINE_MUTEX(ashmem_mutex);
+static DEFINE_SPINLOCK(ashmem_lru_lock);
+
+/* LRU list of unpinned pages, protected by ashmem_lru_lock */
+static LIST_HEAD(ashmem_lru_list);
+
+/* Count of pages and ranges on our LRU list, protected by ashmem_lru_lock */
+static unsigned long lru_count;
+static unsigned long lru_nr_ranges;
 
 static struct kmem_cache *ashmem_area_cachep __read_mostly;
 static struct kmem_cache *ashmem_range_cachep __read_mostly;
@@ -107,14 +120,26 @@ static struct kmem_cache *ashmem_range_cachep __read_mostly;
 
 static inline void lru_add(struct ashmem_range *range)
 {
+	spin_lock(&ashmem_lru_lock);
 	list_add_tail(&range->lru, &ashmem_lru_list);
 	lru_count += range_size(range);
+	lru_nr_ranges++;
+	spin_unlock(&ashmem_lru_lock);
 }
 
-static inline void lru_del(struct ashmem_range *range)
+/* Caller must hold ashmem_lru_lock. */
+static inline void __lru_del(struct ashmem_range *range)
 {
 	list_del(&range->lru);
 	lru_count -= range_size(range);
+	lru_nr_ranges--;
+}
+
+static inline void lru_del(struct ashmem_range *range)
+{
+	spin_lock(&ashmem_lru_lock);
+	__lru_del(range);
+	spin_unlock(&ashmem_lru_lock);
 }
 
 /*
@@ -126,7 +151,7 @@ static inline void lru_del(struct ashmem_range *range)
  * 'start' - starting page, inclusive
  * 'end' - ending page, inclusive
  *
- * Caller must hold ashmem_mutex.
+ * Caller must hold asma->mutex.
  */
 static int range_alloc(struct ashmem_area *asma,
 		       struct ashmem_range *prev_range, unsigned int purged,
@@ -162,18 +187,23 @@ static void range_del(struct ashmem_range *range)
 /*
  * range_shrink - shrinks a range
  *
- * Caller must hold ashmem_mutex.
+ * Caller must hold asma->mutex.
  */
 static inline void range_shrink(struct ashmem_range *range,
 				size_t start, size_t end)
 {
 	size_t pre = range_size(range);
 
-	range->pgstart = start;
-	range->pgend = end;
-
-	if (range_on_lru(range))
+	if (range_on_lru(range)) {
+		spin_lock(&ashmem_lru_lock);
+		range->pgstart = start;
+		range->pgend = end;
 		lru_count -= pre - range_size(range);
+		spin_unlock(&ashmem_lru_lock);
+	} else {
+		range->pgstart = start;
+		range->pgend = end;
+	}
 }
 
 static int ashmem_open(struct inode *inode, struct file *file)
@@ -189,6 +219,7 @@ static int ashmem_open(struct inode *inode, struct file *file)
 	if (unlikely(!asma))
 		return -ENOMEM;
 
+	mutex_init(&asma->mutex);
 	INIT_LIST_HEAD(&asma->unpinned_list);
 	memcpy(asma->name, ASHMEM_NAME_PREFIX, ASHMEM_NAME_PREFIX_LEN);
 	asma->prot_mask = PROT_MASK;
@@ -197,19 +228,24 @@ static int ashmem_open(struct inode *inode, struct file *file)
 	return 0;
 }
 
-static int ashmem_release(struct inode *ignored, struct file *file)
+static void ashmem_area_free(struct ashmem_area *asma)
 {
-	struct ashmem_area *asma = file->private_data;
 	struct ashmem_range *range, *next;
 
-	mutex_lock(&ashmem_mutex);
+	/* Once its ranges are off the LRU the shrinker cannot find us */
+	mutex_lock(&asma->mutex);
 	list_for_each_entry_safe(range, next, &asma->unpinned_list, unpinned)
 		range_del(range);
-	mutex_unlock(&ashmem_mutex);
+	mutex_unlock(&asma->mutex);
 
 	if (asma->file)
 		fput(asma->file);
 	kmem_cache_free(ashmem_area_cachep, asma);
+}
+
+static int ashmem_release(struct inode *ignored, struct file *file)
+{
+	ashmem_area_free(file->private_data);
 
 	return 0;
 }
@@ -220,7 +256,7 @@ static ssize_t ashmem_read(struct file *file, char __user *buf,
 	struct ashmem_area *asma = file->private_data;
 	int ret = 0;
 
-	mutex_lock(&ashmem_mutex);
+	mutex_lock(&asma->mutex);
 
 	/* If size is not set, or set to 0, always return EOF. */
 	if (asma->size == 0) {
@@ -241,7 +277,7 @@ static ssize_t ashmem_read(struct file *file, char __user *buf,
 	asma->file->f_pos = *pos;
 
 out:
-	mutex_unlock(&ashmem_mutex);
+	mutex_unlock(&asma->mutex);
 	return ret;
 }
 
@@ -250,7 +286,7 @@ static loff_t ashmem_llseek(struct file *file, loff_t offset, int origin)
 	struct ashmem_area *asma = file->private_data;
 	int ret;
 
-	mutex_lock(&ashmem_mutex);
+	mutex_lock(&asma->mutex);
 
 	if (asma->size == 0) {
 		ret = -EINVAL;
@@ -271,7 +307,7 @@ static loff_t ashmem_llseek(struct file *file, loff_t offset, int origin)
 	file->f_pos = asma->file->f_pos;
 
 out:
-	mutex_unlock(&ashmem_mutex);
+	mutex_unlock(&asma->mutex);
 	return ret;
 }
 
@@ -288,7 +324,7 @@ static int ashmem_mmap(struct file *file, struct vm_area_struct *vma)
 	struct ashmem_area *asma = file->private_data;
 	int ret = 0;
 
-	mutex_lock(&ashmem_mutex);
+	mutex_lock(&asma->mutex);
 
 	/* user needs to SET_SIZE before mapping */
 	if (unlikely(!asma->size)) {
@@ -332,10 +368,31 @@ static int ashmem_mmap(struct file *file, struct vm_area_struct *vma)
 	asma->vm_start = vma->vm_start;
 
 out:
-	mutex_unlock(&ashmem_mutex);
+	mutex_unlock(&asma->mutex);
 	return ret;
 }
 
+/*
+ * range_purge - drop the pages of an unpinned range and take it off the LRU
+ *
+ * Called with the mutex of the range's area and ashmem_lru_lock held. Drops
+ * ashmem_lru_lock and returns the number of pages purged.
+ */
+static size_t range_purge(struct ashmem_range *range)
+{
+	struct inode *inode = range->asma->file->f_dentry->d_inode;
+	loff_t start = range->pgstart * PAGE_SIZE;
+	loff_t end = (range->pgend + 1) * PAGE_SIZE - 1;
+
+	range->purged = ASHMEM_WAS_PURGED;
+	__lru_del(range);
+	spin_unlock(&ashmem_lru_lock);
+
+	vmtruncate_range(inode, start, end);
+
+	return range_size(range);
+}
+
 /*
  * ashmem_shrink - our cache shrinker, called from mm/vmscan.c :: shrink_slab
  *
@@ -350,10 +407,19 @@ out:
  * We approximate LRU via least-recently-unpinned, jettisoning unpinned partial
  * chunks of ashmem regions LRU-wise one-at-a-time until we hit 'nr_to_scan'
  * pages freed.
+ *
+ * Areas are only trylocked: a range whose area is being pinned or unpinned
+ * right now is in use, so it is rotated to the tail of the LRU instead of
+ * making reclaim wait for that app. The range cannot go away while it is
+ * on the LRU and we hold ashmem_lru_lock, and neither can its area while
+ * we hold the area's mutex.
  */
 static int ashmem_shrink(struct shrinker *s, struct shrink_control *sc)
 {
-	struct ashmem_range *range, *next;
+	struct ashmem_range *range;
+	struct ashmem_area *asma;
+	unsigned long busy = 0;
+	unsigned long ret;
 
 	/* We might recurse into filesystem code, so bail out if necessary */
 	if (sc->nr_to_scan && !(sc->gfp_mask & __GFP_FS))
@@ -361,23 +427,27 @@ static int ashmem_shrink(struct shrinker *s, struct shrink_control *sc)
 	if (!sc->nr_to_scan)
 		return lru_count;
 
-	mutex_lock(&ashmem_mutex);
-	list_for_each_entry_safe(range, next, &ashmem_lru_list, lru) {
-		struct inode *inode = range->asma->file->f_dentry->d_inode;
-		loff_t start = range->pgstart * PAGE_SIZE;
-		loff_t end = (range->pgend + 1) * PAGE_SIZE - 1;
+	spin_lock(&ashmem_lru_lock);
+	while (sc->nr_to_scan > 0 && !list_empty(&ashmem_lru_list) &&
+			busy < lru_nr_ranges) {
+		range = list_first_entry(&ashmem_lru_list,
+					struct ashmem_range, lru);
+		asma = range->asma;
+		if (!mutex_trylock(&asma->mutex)) {
+			list_move_tail(&range->lru, &ashmem_lru_list);
+			busy++;
+			continue;
+		}
 
-		vmtruncate_range(inode, start, end);
-		range->purged = ASHMEM_WAS_PURGED;
-		lru_del(range);
+		sc->nr_to_scan -= range_purge(range);
 
-		sc->nr_to_scan -= range_size(range);
-		if (sc->nr_to_scan <= 0)
-			break;
+		mutex_unlock(&asma->mutex);
+		spin_lock(&ashmem_lru_lock);
 	}
-	mutex_unlock(&ashmem_mutex);
+	ret = lru_count;
+	spin_unlock(&ashmem_lru_lock);
 
-	return lru_count;
+	return ret;
 }
 
 static struct shrinker ashmem_shrinker = {
@@ -389,7 +459,7 @@ static int set_prot_mask(struct ashmem_area *asma, unsigned long prot)
 {
 	int ret = 0;
 
-	mutex_lock(&ashmem_mutex);
+	mutex_lock(&asma->mutex);
 
 	/* the user can only remove, not add, protection bits */
 	if (unlikely((asma->prot_mask & prot) != prot)) {
@@ -404,7 +474,7 @@ static int set_prot_mask(struct ashmem_area *asma, unsigned long prot)
 	asma->prot_mask = prot;
 
 out:
-	mutex_unlock(&ashmem_mutex);
+	mutex_unlock(&asma->mutex);
 	return ret;
 }
 
@@ -412,7 +482,7 @@ static int set_name(struct ashmem_area *asma, void __user *name)
 {
 	int ret = 0;
 
-	mutex_lock(&ashmem_mutex);
+	mutex_lock(&asma->mutex);
 
 	/* cannot change an existing mapping's name */
 	if (unlikely(asma->file)) {
@@ -426,7 +496,7 @@ static int set_name(struct ashmem_area *asma, void __user *name)
 	asma->name[ASHMEM_FULL_NAME_LEN-1] = '\0';
 
 out:
-	mutex_unlock(&ashmem_mutex);
+	mutex_unlock(&asma->mutex);
 
 	return ret;
 }
@@ -435,7 +505,7 @@ static int get_name(struct ashmem_area *asma, void __user *name)
 {
 	int ret = 0;
 
-	mutex_lock(&ashmem_mutex);
+	mutex_lock(&asma->mutex);
 	if (asma->name[ASHMEM_NAME_PREFIX_LEN] != '\0') {
 		size_t len;
 
@@ -452,7 +522,7 @@ static int get_name(struct ashmem_area *asma, void __user *name)
 					  sizeof(ASHMEM_NAME_DEF))))
 			ret = -EFAULT;
 	}
-	mutex_unlock(&ashmem_mutex);
+	mutex_unlock(&asma->mutex);
 
 	return ret;
 }
@@ -461,7 +531,7 @@ static int get_name(struct ashmem_area *asma, void __user *name)
  * ashmem_pin - pin the given ashmem region, returning whether it was
  * previously purged (ASHMEM_WAS_PURGED) or not (ASHMEM_NOT_PURGED).
  *
- * Caller must hold ashmem_mutex.
+ * Caller must hold asma->mutex.
  */
 static int ashmem_pin(struct ashmem_area *asma, size_t pgstart, size_t pgend)
 {
@@ -527,7 +597,7 @@ static int ashmem_pin(struct ashmem_area *asma, size_t pgstart, size_t pgend)
 /*
  * ashmem_unpin - unpin the given range of pages. Returns zero on success.
  *
- * Caller must hold ashmem_mutex.
+ * Caller must hold asma->mutex.
  */
 static int ashmem_unpin(struct ashmem_area *asma, size_t pgstart, size_t pgend)
 {
@@ -562,7 +632,7 @@ restart:
  * ashmem_get_pin_status - Returns ASHMEM_IS_UNPINNED if _any_ pages in the
  * given interval are unpinned and ASHMEM_IS_PINNED otherwise.
  *
- * Caller must hold ashmem_mutex.
+ * Caller must hold asma->mutex.
  */
 static int ashmem_get_pin_status(struct ashmem_area *asma, size_t pgstart,
 				 size_t pgend)
@@ -611,7 +681,7 @@ static int ashmem_pin_unpin(struct ashmem_area *asma, unsigned long cmd,
 	pgstart = pin.offset / PAGE_SIZE;
 	pgend = pgstart + (pin.len / PAGE_SIZE) - 1;
 
-	mutex_lock(&ashmem_mutex);
+	mutex_lock(&asma->mutex);
 
 	switch (cmd) {
 	case ASHMEM_PIN:
@@ -625,7 +695,7 @@ static int ashmem_pin_unpin(struct ashmem_area *asma, unsigned long cmd,
 		break;
 	}
 
-	mutex_unlock(&ashmem_mutex);
+	mutex_unlock(&asma->mutex);
 
 	return ret;
 }
@@ -728,10 +798,12 @@ static long ashmem_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 		break;
 	case ASHMEM_SET_SIZE:
 		ret = -EINVAL;
+		mutex_lock(&asma->mutex);
 		if (!asma->file) {
 			ret = 0;
 			asma->size = (size_t) arg;
 		}
+		mutex_unlock(&asma->mutex);
 		break;
 	case ASHMEM_GET_SIZE:
 		ret = asma->size;
@@ -826,6 +898,258 @@ void put_ashmem_file(struct file *file)
 }
 EXPORT_SYMBOL(put_ashmem_file);
 
+#ifdef CONFIG_ASHMEM_BENCHMARK
+/*
+ * Pin/unpin microbenchmark. Writing "<threads> <iterations>" to
+ * /sys/kernel/debug/ashmem/pin_bench runs that many threads, each
+ * unpinning and re-pinning the pages of its own area in a loop while
+ * another thread keeps purging the unpinned ranges of those areas the way
+ * the shrinker does, trylocking each area. Areas of other users are left
+ * alone. Reading the file shows the cost of a pin+unpin pair seen by the
+ * slowest thread.
+ */
+#define ASHMEM_BENCH_PAGES	16
+#define ASHMEM_BENCH_MAX_THREADS	64
+
+struct ashmem_bench {
+	struct ashmem_area *asma;
+	unsigned long iterations;
+	struct completion done;
+	u64 ns;
+	int *stop;
+};
+
+struct ashmem_bench_shrink {
+	struct ashmem_bench *bench;
+	int nr_threads;
+	unsigned long passes;
+	unsigned long skips;
+};
+
+static DEFINE_MUTEX(ashmem_bench_mutex);
+static char ashmem_bench_result[128];
+
+static int ashmem_bench_thread(void *data)
+{
+	struct ashmem_bench *b = data;
+	struct ashmem_area *asma = b->asma;
+	ktime_t start = ktime_get();
+	unsigned long i;
+
+	for (i = 0; i < b->iterations && !ACCESS_ONCE(*b->stop); i++) {
+		mutex_lock(&asma->mutex);
+		ashmem_unpin(asma, 0, ASHMEM_BENCH_PAGES - 1);
+		mutex_unlock(&asma->mutex);
+
+		mutex_lock(&asma->mutex);
+		ashmem_pin(asma, 0, ASHMEM_BENCH_PAGES - 1);
+		mutex_unlock(&asma->mutex);
+	}
+
+	b->ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	complete(&b->done);
+
+	return 0;
+}
+
+static int ashmem_bench_shrink_thread(void *data)
+{
+	struct ashmem_bench_shrink *s = data;
+	struct ashmem_range *range;
+	struct ashmem_area *asma;
+	int i;
+
+	while (!kthread_should_stop()) {
+		for (i = 0; i < s->nr_threads; i++) {
+			asma = s->bench[i].asma;
+			if (!mutex_trylock(&asma->mutex)) {
+				s->skips++;
+				continue;
+			}
+
+			spin_lock(&ashmem_lru_lock);
+			list_for_each_entry(range, &asma->unpinned_list,
+					    unpinned) {
+				if (!range_on_lru(range))
+					continue;
+				range_purge(range);
+				spin_lock(&ashmem_lru_lock);
+			}
+			spin_unlock(&ashmem_lru_lock);
+
+			mutex_unlock(&asma->mutex);
+		}
+		s->passes++;
+		cond_resched();
+	}
+
+	return 0;
+}
+
+static struct ashmem_area *ashmem_bench_area(void)
+{
+	struct ashmem_area *asma;
+	struct file *vmfile;
+
+	asma = kmem_cache_zalloc(ashmem_area_cachep, GFP_KERNEL);
+	if (!asma)
+		return NULL;
+
+	mutex_init(&asma->mutex);
+	INIT_LIST_HEAD(&asma->unpinned_list);
+	asma->size = ASHMEM_BENCH_PAGES * PAGE_SIZE;
+
+	vmfile = shmem_file_setup("ashmem_bench", asma->size, 0);
+	if (IS_ERR(vmfile)) {
+		kmem_cache_free(ashmem_area_cachep, asma);
+		return NULL;
+	}
+	asma->file = vmfile;
+
+	return asma;
+}
+
+static int ashmem_bench_run(int nr_threads, unsigned long iterations)
+{
+	struct ashmem_bench *bench;
+	struct ashmem_bench_shrink shrink;
+	struct task_struct *shrinker, *task;
+	u64 max_ns = 0;
+	int stop = 0;
+	int i, started, ret = 0;
+
+	bench = kcalloc(nr_threads, sizeof(*bench), GFP_KERNEL);
+	if (!bench)
+		return -ENOMEM;
+
+	for (i = 0; i < nr_threads; i++) {
+		bench[i].asma = ashmem_bench_area();
+		if (!bench[i].asma) {
+			ret = -ENOMEM;
+			goto out;
+		}
+		bench[i].iterations = iterations;
+		bench[i].stop = &stop;
+		init_completion(&bench[i].done);
+	}
+
+	shrink.bench = bench;
+	shrink.nr_threads = nr_threads;
+	shrink.passes = 0;
+	shrink.skips = 0;
+
+	shrinker = kthread_run(ashmem_bench_shrink_thread, &shrink,
+				"ashmem_bench_shrink");
+	if (IS_ERR(shrinker)) {
+		ret = PTR_ERR(shrinker);
+		goto out;
+	}
+
+	for (started = 0; started < nr_threads; started++) {
+		task = kthread_run(ashmem_bench_thread, &bench[started],
+				   "ashmem_bench/%d", started);
+		if (IS_ERR(task)) {
+			/* Let the threads already running finish early */
+			ret = PTR_ERR(task);
+			stop = 1;
+			break;
+		}
+	}
+	for (i = 0; i < started; i++) {
+		wait_for_completion(&bench[i].done);
+		max_ns = max(max_ns, bench[i].ns);
+	}
+
+	kthread_stop(shrinker);
+
+	if (ret)
+		goto out;
+
+	snprintf(ashmem_bench_result, sizeof(ashmem_bench_result),
+		 "threads %d iterations %lu: %llu ns per pin+unpin, "
+		 "%lu shrinker passes, %lu busy areas skipped\n",
+		 nr_threads, iterations, div64_u64(max_ns, iterations),
+		 shrink.passes, shrink.skips);
+
+out:
+	for (i = 0; i < nr_threads && bench[i].asma; i++)
+		ashmem_area_free(bench[i].asma);
+	kfree(bench);
+
+	return ret;
+}
+
+static ssize_t ashmem_bench_read(struct file *file, char __user *buf,
+				 size_t len, loff_t *pos)
+{
+	ssize_t ret;
+
+	mutex_lock(&ashmem_bench_mutex);
+	ret = simple_read_from_buffer(buf, len, pos, ashmem_bench_result,
+				      strlen(ashmem_bench_result));
+	mutex_unlock(&ashmem_bench_mutex);
+
+	return ret;
+}
+
+static ssize_t ashmem_bench_write(struct file *file, const char __user *buf,
+				  size_t len, loff_t *pos)
+{
+	char cmd[32];
+	int nr_threads;
+	unsigned long iterations;
+	int ret;
+
+	if (len >= sizeof(cmd))
+		return -EINVAL;
+	if (copy_from_user(cmd, buf, len))
+		return -EFAULT;
+	cmd[len] = '\0';
+
+	if (sscanf(cmd, "%d %lu", &nr_threads, &iterations) != 2 ||
+	    nr_threads < 1 || nr_threads > ASHMEM_BENCH_MAX_THREADS ||
+	    !iterations)
+		return -EINVAL;
+
+	mutex_lock(&ashmem_bench_mutex);
+	ret = ashmem_bench_run(nr_threads, iterations);
+	mutex_unlock(&ashmem_bench_mutex);
+
+	return ret ? ret : len;
+}
+
+static const struct file_operations ashmem_bench_fops = {
+	.read = ashmem_bench_read,
+	.write = ashmem_bench_write,
+	.llseek = default_llseek,
+};
+
+static struct dentry *ashmem_debugfs_dir;
+
+static void ashmem_bench_init(void)
+{
+	ashmem_debugfs_dir = debugfs_create_dir("ashmem", NULL);
+	if (IS_ERR_OR_NULL(ashmem_debugfs_dir))
+		return;
+
+	debugfs_create_file("pin_bench", 0600, ashmem_debugfs_dir, NULL,
+			    &ashmem_bench_fops);
+}
+
+static void ashmem_bench_exit(void)
+{
+	debugfs_remove_recursive(ashmem_debugfs_dir);
+}
+#else
+static inline void ashmem_bench_init(void)
+{
+}
+
+static inline void ashmem_bench_exit(void)
+{
+}
+#endif
+
 static struct file_operations ashmem_fops = {
 	.owner = THIS_MODULE,
 	.open = ashmem_open,
@@ -871,6 +1195,8 @@ static int __init ashmem_init(void)
 
 	register_shrinker(&ashmem_shrinker);
 
+	ashmem_bench_init();
+
 	printk(KERN_INFO "ashmem: initialized\n");
 
 	return 0;
@@ -880,6 +1206,8 @@ static void __exit ashmem_exit(void)
 {
 	int ret;
 
+	ashmem_bench_exit();
+
 	unregister_shrinker(&ashmem_shrinker);
 
 	ret = misc_deregister(&ashmem_misc);
@@ -586,6 +586,32 @@ int unregister_oom_notifier(struct notifier_block *nb)
 }
 EXPORT_SYMBOL_GPL(unregister_oom_notifier);
 
+static ATOMIC_NOTIFIER_HEAD(oom_adj_notify_list);
+
+int register_oom_adj_notifier(struct notifier_block *nb)
+{
+	return atomic_notifier_chain_register(&oom_adj_notify_list, nb);
+}
+EXPORT_SYMBOL_GPL(register_oom_adj_notifier);
+
+int unregister_oom_adj_notifier(struct notifier_block *nb)
+{
+	return atomic_notifier_chain_unregister(&oom_adj_notify_list, nb);
+}
+EXPORT_SYMBOL_GPL(unregister_oom_adj_notifier);
+
+/*
+ * Tell interested parties that the oom_adj of task's thread group changed,
+ * or that a new thread group inherited it at fork. Called with
+ * task->sighand->siglock held or before the new task first runs, so
+ * notifiers must not sleep.
+ */
+void oom_adj_changed(struct task_struct *task)
+{
+	atomic_notifier_call_chain(&oom_adj_notify_list,
+				   task->signal->oom_adj, task);
+}
+
 /*
  * Try to acquire the OOM killer lock for the zones in zonelist.  Returns zero
  * if a parallel OOM killing is already taking place that includes a zone in
@@ -0,0 +1,246 @@
+/*
+ * Reclaim efficiency based memory pressure
+ *
+ * Every zone accumulates the pages scanned and reclaimed by kswapd and
+ * direct reclaim. Once a window of scanning completes, the share of scanned
+ * pages that could not be reclaimed becomes the zone's pressure. The highest
+ * pressure among recently reclaimed zones is the system level, reported
+ * through /sys/kernel/mm/vmpressure/level (which can be poll()ed) and to
+ * in-kernel users through a notifier chain.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.
+ */
+
+#include <linux/init.h>
+#include <linux/jiffies.h>
+#include <linux/kobject.h>
+#include <linux/module.h>
+#include <linux/mm.h>
+#include <linux/spinlock.h>
+#include <linux/swap.h>
+#include <linux/sysfs.h>
+#include <linux/vmpressure.h>
+#include <linux/workqueue.h>
+
+/* Pages that must be scanned in a zone before its pressure is updated */
+#define VMPRESSURE_WIN		(SWAP_CLUSTER_MAX * 16)
+
+/* Pressure, in percent, at which each level starts */
+#define VMPRESSURE_LEVEL_MED	60
+#define VMPRESSURE_LEVEL_CRIT	95
+
+/* A zone that has not been reclaimed from for this long has no pressure */
+#define VMPRESSURE_EXPIRE	HZ
+
+struct vmpressure_zone {
+	spinlock_t	lock;
+	unsigned long	scanned;
+	unsigned long	reclaimed;
+	unsigned int	pressure;
+	unsigned long	stamp;
+};
+
+static struct vmpressure_zone vmpressure_zones[MAX_NUMNODES][MAX_NR_ZONES];
+static enum vmpressure_levels vmpressure_last_level;
+static BLOCKING_NOTIFIER_HEAD(vmpressure_notify_list);
+
+static const char * const vmpressure_str_levels[] = {
+	[VMPRESSURE_LOW] = "low",
+	[VMPRESSURE_MEDIUM] = "medium",
+	[VMPRESSURE_CRITICAL] = "critical",
+};
+
+static struct vmpressure_zone *zone_vmpressure(struct zone *zone)
+{
+	return &vmpressure_zones[zone_to_nid(zone)][zone_idx(zone)];
+}
+
+static unsigned int vmpressure_calc(unsigned long scanned,
+				    unsigned long reclaimed)
+{
+	/* Reclaimed can exceed scanned when pages are freed by other means */
+	if (reclaimed >= scanned)
+		return 0;
+	return 100 - reclaimed * 100 / scanned;
+}
+
+static enum vmpressure_levels vmpressure_to_level(unsigned int pressure)
+{
+	if (pressure >= VMPRESSURE_LEVEL_CRIT)
+		return VMPRESSURE_CRITICAL;
+	else if (pressure >= VMPRESSURE_LEVEL_MED)
+		return VMPRESSURE_MEDIUM;
+	return VMPRESSURE_LOW;
+}
+
+static unsigned int vmpressure_zone_value(struct vmpressure_zone *vz)
+{
+	if (time_after(jiffies, vz->stamp + VMPRESSURE_EXPIRE))
+		return 0;
+	return vz->pressure;
+}
+
+/**
+ * vmpressure_value() - current system memory pressure
+ *
+ * Returns the highest pressure, in percent, among zones that completed a
+ * reclaim window recently.
+ */
+unsigned int vmpressure_value(void)
+{
+	struct zone *zone;
+	unsigned int pressure = 0;
+
+	for_each_populated_zone(zone)
+		pressure = max(pressure,
+			       vmpressure_zone_value(zone_vmpressure(zone)));
+	return pressure;
+}
+EXPORT_SYMBOL_GPL(vmpressure_value);
+
+enum vmpressure_levels vmpressure_level(void)
+{
+	return vmpressure_to_level(vmpressure_value());
+}
+EXPORT_SYMBOL_GPL(vmpressure_level);
+
+int vmpressure_register_notifier(struct notifier_block *nb)
+{
+	return blocking_notifier_chain_register(&vmpressure_notify_list, nb);
+}
+EXPORT_SYMBOL_GPL(vmpressure_register_notifier);
+
+int vmpressure_unregister_notifier(struct notifier_block *nb)
+{
+	return blocking_notifier_chain_unregister(&vmpressure_notify_list, nb);
+}
+EXPORT_SYMBOL_GPL(vmpressure_unregister_notifier);
+
+static void vmpressure_work_fn(struct work_struct *work)
+{
+	enum vmpressure_levels level = vmpressure_level();
+
+	/*
+	 * Listeners hear about every level change, and keep hearing about
+	 * elevated pressure for as long as reclaim keeps failing.
+	 */
+	if (level == VMPRESSURE_LOW && vmpressure_last_level == VMPRESSURE_LOW)
+		return;
+	vmpressure_last_level = level;
+
+	sysfs_notify(mm_kobj, "vmpressure", "level");
+	blocking_notifier_call_chain(&vmpressure_notify_list, level, NULL);
+}
+static DECLARE_WORK(vmpressure_work, vmpressure_work_fn);
+
+/**
+ * vmpressure() - account reclaim efficiency for a zone
+ * @gfp:	gfp mask of the allocation that triggered reclaim
+ * @zone:	zone that was reclaimed from
+ * @scanned:	number of pages scanned
+ * @reclaimed:	number of pages reclaimed
+ *
+ * Called from shrink_zone() by both kswapd and direct reclaim. Must not be
+ * called with interrupts disabled; notification is deferred to a work item.
+ */
+void vmpressure(gfp_t gfp, struct zone *zone,
+		unsigned long scanned, unsigned long reclaimed)
+{
+	struct vmpressure_zone *vz = zone_vmpressure(zone);
+
+	/*
+	 * Only reclaim on behalf of allocations that user pages could satisfy
+	 * says anything about how hard user memory is to get back. GFP_NOFS
+	 * and GFP_NOIO reclaim can't write back dirty pages, so its
+	 * efficiency would overstate the pressure.
+	 */
+	if (!(gfp & (__GFP_HIGHMEM | __GFP_MOVABLE | __GFP_FS)))
+		return;
+	if (!scanned)
+		return;
+
+	spin_lock(&vz->lock);
+	vz->scanned += scanned;
+	vz->reclaimed += reclaimed;
+	if (vz->scanned < VMPRESSURE_WIN) {
+		spin_unlock(&vz->lock);
+		return;
+	}
+	vz->pressure = vmpressure_calc(vz->scanned, vz->reclaimed);
+	vz->stamp = jiffies;
+	vz->scanned = 0;
+	vz->reclaimed = 0;
+	spin_unlock(&vz->lock);
+
+	schedule_work(&vmpressure_work);
+}
+
+#ifdef CONFIG_SYSFS
+
+static ssize_t level_show(struct kobject *kobj,
+			  struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%s\n", vmpressure_str_levels[vmpressure_level()]);
+}
+
+static struct kobj_attribute level_attr = __ATTR_RO(level);
+
+static ssize_t pressure_show(struct kobject *kobj,
+			     struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", vmpressure_value());
+}
+
+static struct kobj_attribute pressure_attr = __ATTR_RO(pressure);
+
+static ssize_t zones_show(struct kobject *kobj,
+			  struct kobj_attribute *attr, char *buf)
+{
+	struct zone *zone;
+	ssize_t count = 0;
+
+	for_each_populated_zone(zone) {
+		struct vmpressure_zone *vz = zone_vmpressure(zone);
+
+		count += snprintf(buf + count, PAGE_SIZE - count,
+				  "Node %d, zone %8s pressure %3u scanned %lu "
+				  "reclaimed %lu\n",
+				  zone_to_nid(zone), zone->name,
+				  vmpressure_zone_value(vz), vz->scanned,
+				  vz->reclaimed);
+	}
+	return count;
+}
+
+static struct kobj_attribute zones_attr = __ATTR_RO(zones);
+
+static struct attribute *vmpressure_attrs[] = {
+	&level_attr.attr,
+	&pressure_attr.attr,
+	&zones_attr.attr,
+	NULL,
+};
+
+static struct attribute_group vmpressure_attr_group = {
+	.attrs = vmpressure_attrs,
+	.name = "vmpressure",
+};
+
+static int __init vmpressure_sysfs_init(void)
+{
+	return sysfs_create_group(mm_kobj, &vmpressure_attr_group);
+}
+module_init(vmpressure_sysfs_init);
+
+#endif /* CONFIG_SYSFS */
+
+static int __init vmpressure_init(void)
+{
+	int nid, i;
+
+	for (nid = 0; nid < MAX_NUMNODES; nid++)
+		for (i = 0; i < MAX_NR_ZONES; i++)
+			spin_lock_init(&vmpressure_zones[nid][i].lock);
+	return 0;
+}
+core_initcall(vmpressure_init);
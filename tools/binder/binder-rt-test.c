@@ -0,0 +1,350 @@
+/*
+ * binder-rt-test -- check the RT scheduling flags of binder nodes
+ *
+ * Copyright (c) 2012, Code Aurora Forum. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 and
+ * only version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Must run as root, with no other context manager registered (stop
+ * servicemanager first): the test becomes the context manager so it has
+ * somewhere to send its nodes. An unprivileged child checks that nodes
+ * asking for RT scheduling are refused without CAP_SYS_NICE.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <binder.h>
+
+#define MAP_SIZE	(128 * 1024)
+#define NOBODY		9999
+
+/* Transaction codes understood by the looper */
+#define CODE_PUBLISH	1
+#define CODE_PROBE	2
+
+struct probe_reply {
+	int policy;
+	int priority;
+};
+
+struct cmd_buf {
+	uint8_t data[256];
+	size_t size;
+};
+
+static const char *device_path = "/dev/binder";
+static int failures;
+
+static void die(const char *what)
+{
+	fprintf(stderr, "binder-rt-test: %s: %s\n", what, strerror(errno));
+	exit(1);
+}
+
+static void expect(const char *name, int ok)
+{
+	printf("%-44s %s\n", name, ok ? "PASS" : "FAIL");
+	if (!ok)
+		failures++;
+}
+
+static int open_binder(void)
+{
+	int fd = open(device_path, O_RDWR);
+
+	if (fd < 0)
+		die(device_path);
+	if (mmap(NULL, MAP_SIZE, PROT_READ, MAP_PRIVATE, fd, 0) == MAP_FAILED)
+		die("mmap");
+
+	return fd;
+}
+
+static size_t write_read(int fd, void *wbuf, size_t wsize,
+			 void *rbuf, size_t rsize)
+{
+	struct binder_write_read bwr = {
+		.write_size = wsize,
+		.write_buffer = (unsigned long)wbuf,
+		.read_size = rsize,
+		.read_buffer = (unsigned long)rbuf,
+	};
+
+	/* The driver picks up where it stopped when the call is repeated */
+	while (ioctl(fd, BINDER_WRITE_READ, &bwr) < 0) {
+		if (errno != EINTR)
+			die("BINDER_WRITE_READ");
+	}
+
+	return bwr.read_consumed;
+}
+
+static void put_cmd(struct cmd_buf *buf, uint32_t cmd,
+		    const void *arg, size_t size)
+{
+	memcpy(buf->data + buf->size, &cmd, sizeof(cmd));
+	memcpy(buf->data + buf->size + sizeof(cmd), arg, size);
+	buf->size += sizeof(cmd) + size;
+}
+
+static unsigned long node_flags(int policy, int priority)
+{
+	return (policy << FLAT_BINDER_FLAG_SCHED_POLICY_SHIFT) |
+		(priority & FLAT_BINDER_FLAG_PRIORITY_MASK);
+}
+
+/*
+ * Send a transaction and wait for it to end. Returns the BR_ command that
+ * ended it; the data of a BR_REPLY is copied to reply.
+ */
+static uint32_t call(int fd, uint32_t handle, uint32_t code,
+		     const void *data, size_t size,
+		     const size_t *offsets, size_t offsets_size,
+		     void *reply, size_t reply_size)
+{
+	struct binder_transaction_data tr = {
+		.target.handle = handle,
+		.code = code,
+		.data_size = size,
+		.offsets_size = offsets_size,
+		.data.ptr.buffer = data,
+		.data.ptr.offsets = offsets,
+	};
+	struct cmd_buf out = { .size = 0 };
+	uint32_t in[64];
+
+	put_cmd(&out, BC_TRANSACTION, &tr, sizeof(tr));
+
+	while (1) {
+		size_t consumed = write_read(fd, out.data, out.size,
+					     in, sizeof(in));
+		uint8_t *ptr = (uint8_t *)in;
+		uint8_t *end = ptr + consumed;
+
+		out.size = 0;
+
+		while (ptr < end) {
+			struct binder_transaction_data txn;
+			uint32_t cmd;
+
+			memcpy(&cmd, ptr, sizeof(cmd));
+			ptr += sizeof(cmd);
+
+			switch (cmd) {
+			case BR_REPLY:
+				memcpy(&txn, ptr, sizeof(txn));
+				if (reply != NULL)
+					memcpy(reply, txn.data.ptr.buffer,
+					       txn.data_size < reply_size ?
+					       txn.data_size : reply_size);
+				put_cmd(&out, BC_FREE_BUFFER,
+					&txn.data.ptr.buffer, sizeof(void *));
+				write_read(fd, out.data, out.size, NULL, 0);
+				return cmd;
+			case BR_FAILED_REPLY:
+			case BR_DEAD_REPLY:
+				return cmd;
+			}
+
+			ptr += _IOC_SIZE(cmd);
+		}
+	}
+}
+
+/* Send a new node with the given flags to the context manager */
+static uint32_t publish(int fd, unsigned long flags, uint32_t *handle)
+{
+	static unsigned long nodes;
+	struct flat_binder_object obj = {
+		.type = BINDER_TYPE_BINDER,
+		.flags = flags,
+	};
+	size_t offset = 0;
+
+	/* Any unique value will do for the node's address */
+	obj.binder = (void *)++nodes;
+	obj.cookie = obj.binder;
+
+	return call(fd, 0, CODE_PUBLISH, &obj, sizeof(obj),
+		    &offset, sizeof(offset), handle, sizeof(*handle));
+}
+
+static void handle_transaction(int fd, struct binder_transaction_data *txn)
+{
+	struct binder_transaction_data reply;
+	struct cmd_buf out = { .size = 0 };
+	struct probe_reply probe;
+	struct sched_param param;
+	uint32_t handle;
+
+	memset(&reply, 0, sizeof(reply));
+
+	if (txn->code == CODE_PUBLISH &&
+	    txn->data_size >= sizeof(struct flat_binder_object)) {
+		const struct flat_binder_object *obj = txn->data.ptr.buffer;
+
+		/* Keep the node alive once the buffer holding it is freed */
+		handle = obj->handle;
+		put_cmd(&out, BC_ACQUIRE, &handle, sizeof(handle));
+		reply.data.ptr.buffer = &handle;
+		reply.data_size = sizeof(handle);
+	} else if (txn->code == CODE_PROBE) {
+		probe.policy = sched_getscheduler(0);
+		sched_getparam(0, &param);
+		probe.priority = param.sched_priority;
+		reply.data.ptr.buffer = &probe;
+		reply.data_size = sizeof(probe);
+	}
+
+	put_cmd(&out, BC_FREE_BUFFER, &txn->data.ptr.buffer, sizeof(void *));
+	put_cmd(&out, BC_REPLY, &reply, sizeof(reply));
+	write_read(fd, out.data, out.size, NULL, 0);
+}
+
+static void *looper(void *arg)
+{
+	int fd = (long)arg;
+	uint32_t cmd = BC_ENTER_LOOPER;
+	uint32_t in[64];
+
+	write_read(fd, &cmd, sizeof(cmd), NULL, 0);
+
+	while (1) {
+		size_t consumed = write_read(fd, NULL, 0, in, sizeof(in));
+		uint8_t *ptr = (uint8_t *)in;
+		uint8_t *end = ptr + consumed;
+
+		while (ptr < end) {
+			memcpy(&cmd, ptr, sizeof(cmd));
+			ptr += sizeof(cmd);
+
+			if (cmd == BR_TRANSACTION) {
+				struct binder_transaction_data txn;
+
+				memcpy(&txn, ptr, sizeof(txn));
+				handle_transaction(fd, &txn);
+			}
+
+			ptr += _IOC_SIZE(cmd);
+		}
+	}
+
+	return NULL;
+}
+
+/* Publish a node from a child without CAP_SYS_NICE, returns the BR_ code */
+static uint32_t unprivileged_publish(int fd, unsigned long flags)
+{
+	uint32_t handle;
+	int status;
+	pid_t pid;
+
+	pid = fork();
+	if (pid < 0)
+		die("fork");
+
+	if (pid == 0) {
+		close(fd);
+		if (setgid(NOBODY) || setuid(NOBODY))
+			die("setuid");
+		fd = open_binder();
+		switch (publish(fd, flags, &handle)) {
+		case BR_REPLY:
+			_exit(0);
+		case BR_FAILED_REPLY:
+			_exit(2);
+		default:
+			_exit(3);
+		}
+	}
+
+	if (waitpid(pid, &status, 0) < 0)
+		die("waitpid");
+	if (!WIFEXITED(status))
+		return 0;
+
+	switch (WEXITSTATUS(status)) {
+	case 0:
+		return BR_REPLY;
+	case 2:
+		return BR_FAILED_REPLY;
+	default:
+		return 0;
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	struct probe_reply probe;
+	pthread_t thread;
+	uint32_t handle;
+	int fd, ok;
+
+	if (argc > 1)
+		device_path = argv[1];
+
+	if (geteuid() != 0) {
+		fprintf(stderr, "binder-rt-test: must run as root\n");
+		return 1;
+	}
+
+	fd = open_binder();
+	if (ioctl(fd, BINDER_SET_CONTEXT_MGR, 0))
+		die("BINDER_SET_CONTEXT_MGR (is servicemanager running?)");
+
+	if (pthread_create(&thread, NULL, looper, (void *)(long)fd))
+		die("pthread_create");
+
+	expect("SCHED_FIFO priority 0 refused",
+	       publish(fd, node_flags(SCHED_FIFO, 0), &handle) ==
+	       BR_FAILED_REPLY);
+	expect("SCHED_FIFO priority 100 refused",
+	       publish(fd, node_flags(SCHED_FIFO, 100), &handle) ==
+	       BR_FAILED_REPLY);
+	expect("SCHED_RR priority 255 refused",
+	       publish(fd, node_flags(SCHED_RR, 255), &handle) ==
+	       BR_FAILED_REPLY);
+
+	ok = publish(fd, node_flags(SCHED_FIFO, 10), &handle) == BR_REPLY;
+	expect("SCHED_FIFO priority 10 accepted", ok);
+	if (ok) {
+		ok = call(fd, handle, CODE_PROBE, NULL, 0, NULL, 0,
+			  &probe, sizeof(probe)) == BR_REPLY;
+		expect("handler runs at SCHED_FIFO priority 10",
+		       ok && probe.policy == SCHED_FIFO &&
+		       probe.priority == 10);
+	}
+
+	expect("unprivileged SCHED_FIFO node refused",
+	       unprivileged_publish(fd, node_flags(SCHED_FIFO, 10)) ==
+	       BR_FAILED_REPLY);
+	expect("unprivileged INHERIT_RT node refused",
+	       unprivileged_publish(fd, FLAT_BINDER_FLAG_INHERIT_RT) ==
+	       BR_FAILED_REPLY);
+	expect("unprivileged SCHED_NORMAL node accepted",
+	       unprivileged_publish(fd, node_flags(SCHED_OTHER, 0)) ==
+	       BR_REPLY);
+
+	printf("%d failures\n", failures);
+
+	return failures ? 1 : 0;
+}
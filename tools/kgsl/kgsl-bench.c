@@ -0,0 +1,208 @@
+/*
+ * kgsl-bench -- measure the cost of the KGSL submission path
+ *
+ * Copyright (c) 2012, Code Aurora Forum. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 and
+ * only version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Meant to be run against /dev/kgsl-null (CONFIG_MSM_KGSL_NULL), where
+ * commands are retired in software and the numbers reflect the driver
+ * alone, but works against any KGSL device.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <linux/msm_kgsl.h>
+
+#define IB_SIZE		4096
+
+static const char *device_path = "/dev/kgsl-null";
+static unsigned int iterations = 10000;
+static unsigned int map_size = 64 * 1024;
+static int fd;
+
+static double now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void report(const char *name, unsigned int count, double start)
+{
+	double elapsed = now_us() - start;
+
+	printf("%-16s %8u ops %10.0f us %8.2f us/op %10.0f ops/s\n",
+	       name, count, elapsed, elapsed / count,
+	       count * 1e6 / elapsed);
+}
+
+static void die(const char *what)
+{
+	fprintf(stderr, "kgsl-bench: %s: %s\n", what, strerror(errno));
+	exit(1);
+}
+
+static unsigned int issue(unsigned int ctxt, struct kgsl_ibdesc *ib)
+{
+	struct kgsl_ringbuffer_issueibcmds cmds = {
+		.drawctxt_id = ctxt,
+		.ibdesc_addr = (unsigned int)(uintptr_t)ib,
+		.numibs = 1,
+		.flags = KGSL_CONTEXT_SUBMIT_IB_LIST,
+	};
+
+	if (ioctl(fd, IOCTL_KGSL_RINGBUFFER_ISSUEIBCMDS, &cmds))
+		die("IOCTL_KGSL_RINGBUFFER_ISSUEIBCMDS");
+
+	return cmds.timestamp;
+}
+
+static void wait_ts(unsigned int ctxt, unsigned int timestamp)
+{
+	struct kgsl_device_waittimestamp_ctxtid wait = {
+		.context_id = ctxt,
+		.timestamp = timestamp,
+		.timeout = 10000,
+	};
+
+	if (ioctl(fd, IOCTL_KGSL_DEVICE_WAITTIMESTAMP_CTXTID, &wait))
+		die("IOCTL_KGSL_DEVICE_WAITTIMESTAMP_CTXTID");
+}
+
+/* Back to back submissions, one wait at the end */
+static void bench_issue(unsigned int ctxt, struct kgsl_ibdesc *ib)
+{
+	unsigned int i, timestamp = 0;
+	double start = now_us();
+
+	for (i = 0; i < iterations; i++)
+		timestamp = issue(ctxt, ib);
+	wait_ts(ctxt, timestamp);
+
+	report("issueibcmds", iterations, start);
+}
+
+/* Submit and wait for each command, i.e. the retire round trip */
+static void bench_wait(unsigned int ctxt, struct kgsl_ibdesc *ib)
+{
+	unsigned int i;
+	double start = now_us();
+
+	for (i = 0; i < iterations; i++)
+		wait_ts(ctxt, issue(ctxt, ib));
+
+	report("waittimestamp", iterations, start);
+}
+
+/* Map and unmap the same user buffer, page table updates included */
+static void bench_map(void)
+{
+	struct kgsl_map_user_mem map;
+	struct kgsl_sharedmem_free req;
+	unsigned int i;
+	double start;
+	void *buf;
+
+	buf = mmap(NULL, map_size, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+	if (buf == MAP_FAILED)
+		die("mmap");
+
+	start = now_us();
+	for (i = 0; i < iterations; i++) {
+		memset(&map, 0, sizeof(map));
+		map.hostptr = (unsigned int)(uintptr_t)buf;
+		map.len = map_size;
+		map.memtype = KGSL_USER_MEM_TYPE_ADDR;
+		if (ioctl(fd, IOCTL_KGSL_MAP_USER_MEM, &map))
+			die("IOCTL_KGSL_MAP_USER_MEM");
+
+		req.gpuaddr = map.gpuaddr;
+		if (ioctl(fd, IOCTL_KGSL_SHAREDMEM_FREE, &req))
+			die("IOCTL_KGSL_SHAREDMEM_FREE");
+	}
+	report("map_user_mem", iterations, start);
+
+	munmap(buf, map_size);
+}
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: kgsl-bench [-d device] [-n iterations] [-s map size]\n");
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	struct kgsl_drawctxt_create create = { .flags = 0 };
+	struct kgsl_drawctxt_destroy destroy;
+	struct kgsl_gpumem_alloc alloc = { .size = IB_SIZE };
+	struct kgsl_sharedmem_free req;
+	struct kgsl_ibdesc ib;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "d:n:s:")) != -1) {
+		switch (opt) {
+		case 'd':
+			device_path = optarg;
+			break;
+		case 'n':
+			iterations = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			map_size = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (iterations == 0 || map_size == 0 || map_size % 4096)
+		usage();
+
+	fd = open(device_path, O_RDWR);
+	if (fd < 0)
+		die(device_path);
+
+	if (ioctl(fd, IOCTL_KGSL_DRAWCTXT_CREATE, &create))
+		die("IOCTL_KGSL_DRAWCTXT_CREATE");
+
+	/* The contents are never looked at, only the address is checked */
+	if (ioctl(fd, IOCTL_KGSL_GPUMEM_ALLOC, &alloc))
+		die("IOCTL_KGSL_GPUMEM_ALLOC");
+
+	memset(&ib, 0, sizeof(ib));
+	ib.gpuaddr = alloc.gpuaddr;
+	ib.sizedwords = IB_SIZE / sizeof(unsigned int);
+
+	bench_issue(create.drawctxt_id, &ib);
+	bench_wait(create.drawctxt_id, &ib);
+	bench_map();
+
+	req.gpuaddr = alloc.gpuaddr;
+	ioctl(fd, IOCTL_KGSL_SHAREDMEM_FREE, &req);
+
+	destroy.drawctxt_id = create.drawctxt_id;
+	ioctl(fd, IOCTL_KGSL_DRAWCTXT_DESTROY, &destroy);
+
+	close(fd);
+	return 0;
+}
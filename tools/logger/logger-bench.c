@@ -0,0 +1,215 @@
+/*
+ * logger-bench -- measure the write and read throughput of an Android log
+ *
+ * Copyright (c) 2012, Code Aurora Forum. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 and
+ * only version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Writer threads log entries the way liblog does (priority, tag and
+ * message in one writev) while reader threads drain the log, so the
+ * numbers include the contention between the two sides.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <logger.h>
+
+#define MAX_THREADS	64
+
+struct reader_stats {
+	unsigned long entries;
+	unsigned long bytes;
+};
+
+static const char *device_path = "/dev/log/main";
+static unsigned int writers = 4;
+static unsigned int readers = 1;
+static unsigned int entries = 100000;
+static unsigned int payload_size = 64;
+
+static pthread_barrier_t start_barrier;
+static volatile int writers_done;
+
+static double now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void die(const char *what)
+{
+	fprintf(stderr, "logger-bench: %s: %s\n", what, strerror(errno));
+	exit(1);
+}
+
+static void *writer(void *arg)
+{
+	static const char tag[] = "logger-bench";
+	unsigned char prio = 4;	/* ANDROID_LOG_INFO */
+	struct iovec iov[3];
+	char *msg;
+	unsigned int i;
+	int fd;
+
+	fd = open(device_path, O_WRONLY);
+	if (fd < 0)
+		die(device_path);
+
+	msg = malloc(payload_size);
+	if (msg == NULL)
+		die("malloc");
+	memset(msg, 'x', payload_size - 1);
+	msg[payload_size - 1] = '\0';
+
+	iov[0].iov_base = &prio;
+	iov[0].iov_len = 1;
+	iov[1].iov_base = (void *)tag;
+	iov[1].iov_len = sizeof(tag);
+	iov[2].iov_base = msg;
+	iov[2].iov_len = payload_size;
+
+	pthread_barrier_wait(&start_barrier);
+
+	for (i = 0; i < entries; i++) {
+		if (writev(fd, iov, 3) < 0)
+			die("writev");
+	}
+
+	free(msg);
+	close(fd);
+
+	return NULL;
+}
+
+static void *reader(void *arg)
+{
+	struct reader_stats *stats = arg;
+	char buf[LOGGER_ENTRY_MAX_LEN];
+	ssize_t ret;
+	int fd;
+
+	fd = open(device_path, O_RDONLY | O_NONBLOCK);
+	if (fd < 0)
+		die(device_path);
+
+	/* Only count what is written during the run */
+	while (read(fd, buf, sizeof(buf)) > 0)
+		;
+
+	pthread_barrier_wait(&start_barrier);
+
+	while (1) {
+		ret = read(fd, buf, sizeof(buf));
+		if (ret > 0) {
+			stats->entries++;
+			stats->bytes += ret;
+			continue;
+		}
+		if (ret < 0 && errno != EAGAIN)
+			die("read");
+		if (writers_done)
+			break;
+		sched_yield();
+	}
+
+	close(fd);
+
+	return NULL;
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: logger-bench [-d device] [-w writers] "
+		"[-r readers] [-n entries per writer] [-s payload size]\n");
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	pthread_t writer_threads[MAX_THREADS], reader_threads[MAX_THREADS];
+	struct reader_stats stats[MAX_THREADS];
+	unsigned long total = 0, bytes = 0;
+	double start, write_us, read_us;
+	unsigned int i;
+	int c;
+
+	while ((c = getopt(argc, argv, "d:w:r:n:s:")) != -1) {
+		switch (c) {
+		case 'd':
+			device_path = optarg;
+			break;
+		case 'w':
+			writers = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			readers = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			entries = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			payload_size = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage();
+		}
+	}
+
+	if (writers == 0 || writers > MAX_THREADS || readers > MAX_THREADS ||
+	    payload_size == 0 || payload_size > LOGGER_ENTRY_MAX_PAYLOAD - 32)
+		usage();
+
+	memset(stats, 0, sizeof(stats));
+	pthread_barrier_init(&start_barrier, NULL, writers + readers + 1);
+
+	for (i = 0; i < readers; i++)
+		if (pthread_create(&reader_threads[i], NULL, reader, &stats[i]))
+			die("pthread_create");
+	for (i = 0; i < writers; i++)
+		if (pthread_create(&writer_threads[i], NULL, writer, NULL))
+			die("pthread_create");
+
+	pthread_barrier_wait(&start_barrier);
+	start = now_us();
+
+	for (i = 0; i < writers; i++)
+		pthread_join(writer_threads[i], NULL);
+	write_us = now_us() - start;
+	writers_done = 1;
+
+	for (i = 0; i < readers; i++) {
+		pthread_join(reader_threads[i], NULL);
+		total += stats[i].entries;
+		bytes += stats[i].bytes;
+	}
+	read_us = now_us() - start;
+
+	printf("%u writers, %u readers, %u byte payloads\n",
+	       writers, readers, payload_size);
+	printf("write %10u entries %10.0f us %10.0f entries/s %8.2f MB/s\n",
+	       writers * entries, write_us, writers * entries * 1e6 / write_us,
+	       (double)writers * entries * payload_size / write_us);
+	if (readers)
+		printf("read  %10lu entries %10.0f us %10.0f entries/s "
+		       "%8.2f MB/s\n", total / readers, read_us,
+		       total * 1e6 / read_us, bytes / read_us);
+
+	return 0;
+}
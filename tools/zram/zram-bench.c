@@ -0,0 +1,296 @@
+/*
+ * zram-bench -- measure how zram write bandwidth scales with max_comp_streams
+ *
+ * Copyright (c) 2012, Code Aurora Forum. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 and
+ * only version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * For every stream count given, one writer per thread (pinned round robin
+ * to the online CPUs) fills its own region of the device with O_DIRECT
+ * page writes, the way swap-out hits it. The device must already have a
+ * disksize set and must not be in use.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+
+#define PAGE_SZ		4096
+#define MAX_THREADS	64
+#define MAX_RUNS	16
+
+struct writer_arg {
+	unsigned int id;
+	double us;
+};
+
+static const char *device_path = "/dev/zram0";
+static unsigned int threads;
+static unsigned int pages = 16384;
+static const char *sample_path;
+
+static char *sample;
+static size_t sample_pages;
+static int ncpus;
+
+static pthread_barrier_t start_barrier;
+
+static double now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void die(const char *what)
+{
+	fprintf(stderr, "zram-bench: %s: %s\n", what, strerror(errno));
+	exit(1);
+}
+
+/*
+ * Without a sample file, build pages of text-like data that compress about
+ * as well as typical anonymous memory. Every page is different, so
+ * deduplication does not skew the numbers.
+ */
+static void make_sample(void)
+{
+	static const char *words[] = {
+		"zram", "page", "swap", "kswapd", "compress", "stream",
+		"memory", "reclaim", "0x00000000", "0xffffffff", "\n",
+	};
+	uint32_t seed = 1;
+	size_t i, off;
+
+	sample_pages = 256;
+	if (posix_memalign((void **)&sample, PAGE_SZ, sample_pages * PAGE_SZ))
+		die("posix_memalign");
+
+	for (i = 0; i < sample_pages; i++) {
+		char *page = sample + i * PAGE_SZ;
+
+		off = snprintf(page, PAGE_SZ, "%zu ", i);
+		while (off < PAGE_SZ) {
+			const char *w;
+			size_t len;
+
+			seed = seed * 1103515245 + 12345;
+			w = words[(seed >> 16) % (sizeof(words) / sizeof(words[0]))];
+			len = strlen(w);
+			if (len > PAGE_SZ - off)
+				len = PAGE_SZ - off;
+			memcpy(page + off, w, len);
+			off += len;
+		}
+	}
+}
+
+static void load_sample(void)
+{
+	ssize_t ret;
+	int fd;
+
+	fd = open(sample_path, O_RDONLY);
+	if (fd < 0)
+		die(sample_path);
+
+	sample_pages = 1024;
+	if (posix_memalign((void **)&sample, PAGE_SZ, sample_pages * PAGE_SZ))
+		die("posix_memalign");
+
+	ret = read(fd, sample, sample_pages * PAGE_SZ);
+	if (ret < 0)
+		die(sample_path);
+	if (ret < PAGE_SZ) {
+		fprintf(stderr, "zram-bench: %s: need at least one page\n",
+			sample_path);
+		exit(1);
+	}
+	sample_pages = ret / PAGE_SZ;
+
+	close(fd);
+}
+
+static void *writer(void *arg)
+{
+	struct writer_arg *wa = arg;
+	off_t base = (off_t)wa->id * pages * PAGE_SZ;
+	cpu_set_t cpus;
+	double start;
+	unsigned int i;
+	int fd;
+
+	CPU_ZERO(&cpus);
+	CPU_SET(wa->id % ncpus, &cpus);
+	sched_setaffinity(0, sizeof(cpus), &cpus);
+
+	fd = open(device_path, O_WRONLY | O_DIRECT);
+	if (fd < 0)
+		die(device_path);
+
+	pthread_barrier_wait(&start_barrier);
+	start = now_us();
+
+	for (i = 0; i < pages; i++) {
+		char *page = sample + ((wa->id + i) % sample_pages) * PAGE_SZ;
+
+		if (pwrite(fd, page, PAGE_SZ, base + (off_t)i * PAGE_SZ) !=
+		    PAGE_SZ)
+			die("pwrite");
+	}
+
+	wa->us = now_us() - start;
+	close(fd);
+
+	return NULL;
+}
+
+static void set_streams(const char *name, unsigned int streams)
+{
+	char path[128];
+	FILE *f;
+
+	snprintf(path, sizeof(path), "/sys/block/%s/max_comp_streams", name);
+	f = fopen(path, "w");
+	if (f == NULL)
+		die(path);
+	fprintf(f, "%u\n", streams);
+	if (fclose(f))
+		die(path);
+}
+
+static void run(const char *name, unsigned int streams)
+{
+	pthread_t writer_threads[MAX_THREADS];
+	struct writer_arg args[MAX_THREADS];
+	double start, total_us, slowest = 0;
+	double mb = (double)threads * pages * PAGE_SZ / (1024 * 1024);
+	unsigned int i;
+
+	set_streams(name, streams);
+	pthread_barrier_init(&start_barrier, NULL, threads + 1);
+
+	for (i = 0; i < threads; i++) {
+		args[i].id = i;
+		if (pthread_create(&writer_threads[i], NULL, writer, &args[i]))
+			die("pthread_create");
+	}
+
+	pthread_barrier_wait(&start_barrier);
+	start = now_us();
+
+	for (i = 0; i < threads; i++) {
+		pthread_join(writer_threads[i], NULL);
+		if (args[i].us > slowest)
+			slowest = args[i].us;
+	}
+	total_us = now_us() - start;
+
+	pthread_barrier_destroy(&start_barrier);
+
+	printf("%7u %10.0f %10.2f %12.0f %12.0f\n", streams, total_us,
+	       mb * 1e6 / total_us, threads * pages * 1e6 / total_us,
+	       slowest);
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: zram-bench [-d device] [-t threads] "
+		"[-n pages per thread] [-f sample file] [streams ...]\n");
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int streams[MAX_RUNS];
+	unsigned int nruns = 0;
+	unsigned long long size;
+	const char *name;
+	int fd, c;
+
+	ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (ncpus < 1)
+		ncpus = 1;
+	threads = ncpus;
+
+	while ((c = getopt(argc, argv, "d:t:n:f:")) != -1) {
+		switch (c) {
+		case 'd':
+			device_path = optarg;
+			break;
+		case 't':
+			threads = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			pages = strtoul(optarg, NULL, 0);
+			break;
+		case 'f':
+			sample_path = optarg;
+			break;
+		default:
+			usage();
+		}
+	}
+
+	for (; optind < argc && nruns < MAX_RUNS; optind++)
+		streams[nruns++] = strtoul(argv[optind], NULL, 0);
+	if (nruns == 0) {
+		/* 1, 2, 4, ... up to the thread count */
+		for (c = 1; c < threads && nruns < MAX_RUNS - 1; c *= 2)
+			streams[nruns++] = c;
+		streams[nruns++] = threads;
+	}
+
+	if (threads == 0 || threads > MAX_THREADS || pages == 0)
+		usage();
+
+	name = strrchr(device_path, '/');
+	name = name ? name + 1 : device_path;
+
+	fd = open(device_path, O_RDONLY);
+	if (fd < 0)
+		die(device_path);
+	if (ioctl(fd, BLKGETSIZE64, &size))
+		die("BLKGETSIZE64");
+	close(fd);
+
+	if ((unsigned long long)threads * pages * PAGE_SZ > size) {
+		fprintf(stderr, "zram-bench: %u threads x %u pages do not fit "
+			"in %s (%llu bytes)\n", threads, pages, device_path,
+			size);
+		return 1;
+	}
+
+	if (sample_path)
+		load_sample();
+	else
+		make_sample();
+
+	printf("%s: %u writers on %d cpus, %u pages each\n", device_path,
+	       threads, ncpus, pages);
+	printf("%7s %10s %10s %12s %12s\n", "streams", "us", "MB/s",
+	       "pages/s", "slowest_us");
+
+	for (c = 0; c < nruns; c++)
+		run(name, streams[c]);
+
+	return 0;
+}